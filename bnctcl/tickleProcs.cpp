@@ -1296,6 +1296,12 @@ int floodcontrol(const char* Function) {
 		Result = 0; /* not supported anymore */
 	else if (strcasecmp(Function, "items") == 0)
 		Result = FloodControl->GetQueueSize();
+	else if (strcasecmp(Function, "bytelevel") == 0)
+		Result = FloodControl->GetByteLevel();
+	else if (strcasecmp(Function, "linelevel") == 0)
+		Result = FloodControl->GetLineLevel();
+	else if (strcasecmp(Function, "delay") == 0)
+		Result = FloodControl->GetDelay();
 	else if (strcasecmp(Function, "on") == 0) {
 		FloodControl->Enable();
 		Result = 1;
@@ -1303,7 +1309,7 @@ int floodcontrol(const char* Function) {
 		FloodControl->Disable();
 		Result = 1;
 	} else
-		throw "Function should be one of: bytes items on off";
+		throw "Function should be one of: bytes items bytelevel linelevel delay on off";
 
 	return Result;
 }
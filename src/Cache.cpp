@@ -19,89 +19,239 @@
 
 #include "StdAfx.h"
 
-int CacheGetIntegerReal(CConfig *Config, int *CacheValue, const char *Option, const char *Prefix) {
-	char *OptionName;
+/**
+ * CSettingsCache
+ *
+ * Constructs a new, uninitialized settings cache.
+ */
+CSettingsCache::CSettingsCache(void) {
+	m_Config = NULL;
+	m_Schema = NULL;
+	m_Base = NULL;
+	m_IsSet = NULL;
+}
+
+/**
+ * ~CSettingsCache
+ *
+ * Destructs the settings cache.
+ */
+CSettingsCache::~CSettingsCache(void) {
+	Detach();
+}
 
-	if (Prefix != NULL) {
-		int rc = asprintf(&OptionName, "%s%s", Prefix, Option);
+/**
+ * Initialize
+ *
+ * Attaches the cache to a configuration object and reads all settings.
+ * This is usually called by the CacheInitialize macro.
+ *
+ * @param Config the configuration object
+ * @param Schema the cache's schema
+ * @param Base the address of the struct which holds the values
+ * @param Values the addresses of the values
+ * @param IsSet an array which is used for tracking which settings exist
+ */
+void CSettingsCache::Initialize(CConfig *Config, cacheschema_t *Schema, void *Base, void **Values, bool *IsSet) {
+	Detach();
 
-		if (RcFailed(rc)) {
-			return 0;
+	if (Schema->FullNames == NULL) {
+		Schema->FullNames = (char **)malloc(sizeof(char *) * Schema->Count);
+		Schema->Offsets = (size_t *)malloc(sizeof(size_t) * Schema->Count);
+		Schema->Ids = new CHashtable<char **, false>();
+
+		if (AllocFailed(Schema->FullNames) || AllocFailed(Schema->Offsets) || AllocFailed(Schema->Ids)) {
+			g_Bouncer->Fatal();
 		}
-	} else {
-		OptionName = const_cast<char *>(Option);
-	}
 
-	*CacheValue = Config->ReadInteger(OptionName);
+		for (int i = 0; i < Schema->Count; i++) {
+			int rc = asprintf(&Schema->FullNames[i], "%s%s", Schema->Prefix, Schema->Names[i]);
+
+			if (RcFailed(rc)) {
+				g_Bouncer->Fatal();
+			}
 
-	if (Prefix != NULL) {
-		free(OptionName);
+			Schema->Offsets[i] = (char *)Values[i] - (char *)Base;
+
+			if (IsError(Schema->Ids->Add(Schema->FullNames[i], &Schema->FullNames[i]))) {
+				g_Bouncer->Fatal();
+			}
+		}
 	}
 
-	return *CacheValue;
+	m_Config = Config;
+	m_Schema = Schema;
+	m_Base = (char *)Base;
+	m_IsSet = IsSet;
+
+	m_Config->RegisterCache(this);
+
+	Reload();
 }
 
-const char *CacheGetStringReal(CConfig *Config, const char **CacheValue, const char *Option, const char *Prefix) {
-	char *OptionName;
+/**
+ * Detach
+ *
+ * Detaches the cache from its configuration object.
+ */
+void CSettingsCache::Detach(void) {
+	if (m_Config != NULL) {
+		m_Config->UnregisterCache(this);
+		m_Config = NULL;
+	}
+}
 
-	if (Prefix != NULL) {
-		int rc = asprintf(&OptionName, "%s%s", Prefix, Option);
+/**
+ * Update
+ *
+ * Reads a setting from the configuration object.
+ *
+ * @param Option the ID of the setting
+ * @param Notify whether to call the change notification callbacks if
+ *               the setting's value has changed
+ */
+void CSettingsCache::Update(int Option, bool Notify) {
+	const char *Value = m_Config->ReadString(m_Schema->FullNames[Option]);
+	void *Address = m_Base + m_Schema->Offsets[Option];
+	bool Changed;
 
-		if (RcFailed(rc)) {
-			return NULL;
-		}
+	m_IsSet[Option] = (Value != NULL);
+
+	if (m_Schema->Types[Option] == Cache_Integer) {
+		int IntValue = (Value != NULL) ? atoi(Value) : 0;
+
+		Changed = (*(int *)Address != IntValue);
+		*(int *)Address = IntValue;
 	} else {
-		OptionName = const_cast<char *>(Option);
-	}
+		const char *OldValue = *(const char **)Address;
 
-	*CacheValue = Config->ReadString(OptionName);
+		/* the old value has already been freed, only compare the pointers */
+		Changed = (OldValue != Value);
+		*(const char **)Address = Value;
+	}
 
-	if (Prefix != NULL) {
-		free(OptionName);
+	if (!Notify || !Changed) {
+		return;
 	}
 
-	return *CacheValue;
+	for (int i = 0; i < m_Callbacks.GetLength(); i++) {
+		m_Callbacks[i].Proc(Option, m_Callbacks[i].Cookie);
+	}
 }
 
-void CacheSetIntegerReal(CConfig *Config, int *CacheValue, const char *Option, int Value, const char *Prefix) {
-	char *OptionName;
+/**
+ * SettingChanged
+ *
+ * Called by the configuration object when a setting has been changed.
+ *
+ * @param Setting the name of the setting
+ */
+void CSettingsCache::SettingChanged(const char *Setting) {
+	char **Name = m_Schema->Ids->Get(Setting);
 
-	if (Prefix != NULL) {
-		int rc = asprintf(&OptionName, "%s%s", Prefix, Option);
+	if (Name != NULL) {
+		Update(Name - m_Schema->FullNames, true);
+	}
+}
 
-		if (RcFailed(rc)) {
-			return;
-		}
-	} else {
-		OptionName = const_cast<char *>(Option);
+/**
+ * Reload
+ *
+ * Reads all settings from the configuration object.
+ */
+void CSettingsCache::Reload(void) {
+	for (int i = 0; i < m_Schema->Count; i++) {
+		Update(i, false);
 	}
+}
 
-	*CacheValue = Value;
+/**
+ * GetInteger
+ *
+ * Returns the value of an integer setting.
+ *
+ * @param Option the ID of the setting
+ */
+int CSettingsCache::GetInteger(int Option) const {
+	return *(int *)(m_Base + m_Schema->Offsets[Option]);
+}
 
-	Config->WriteInteger(OptionName, Value);
+/**
+ * GetString
+ *
+ * Returns the value of a string setting.
+ *
+ * @param Option the ID of the setting
+ */
+const char *CSettingsCache::GetString(int Option) const {
+	return *(const char **)(m_Base + m_Schema->Offsets[Option]);
+}
 
-	if (Prefix != NULL) {
-		free(OptionName);
-	}
+/**
+ * IsSet
+ *
+ * Returns whether a setting exists in the configuration object.
+ *
+ * @param Option the ID of the setting
+ */
+bool CSettingsCache::IsSet(int Option) const {
+	return m_IsSet[Option];
 }
 
-void CacheSetStringReal(CConfig *Config, const char **CacheValue, const char *Option, const char *Value, const char *Prefix) {
-	char *OptionName;
+/**
+ * SetInteger
+ *
+ * Sets the value of a setting.
+ *
+ * @param Option the ID of the setting
+ * @param Value the new value
+ */
+void CSettingsCache::SetInteger(int Option, int Value) {
+	m_Config->WriteInteger(m_Schema->FullNames[Option], Value);
+}
 
-	if (Prefix != NULL) {
-		int rc = asprintf(&OptionName, "%s%s", Prefix, Option);
+/**
+ * SetString
+ *
+ * Sets the value of a setting.
+ *
+ * @param Option the ID of the setting
+ * @param Value the new value, or NULL to remove the setting
+ */
+void CSettingsCache::SetString(int Option, const char *Value) {
+	m_Config->WriteString(m_Schema->FullNames[Option], Value);
+}
 
-		if (RcFailed(rc)) {
-			return;
-		}
-	} else {
-		OptionName = const_cast<char *>(Option);
-	}
+/**
+ * RegisterCallback
+ *
+ * Registers a function which is called whenever one of the cached
+ * settings is changed.
+ *
+ * @param Proc the function
+ * @param Cookie a user-specific pointer which is passed to the function
+ */
+void CSettingsCache::RegisterCallback(CacheChangedProc Proc, void *Cookie) {
+	cachecallback_t Callback;
+
+	Callback.Proc = Proc;
+	Callback.Cookie = Cookie;
 
-	Config->WriteString(OptionName, Value);
-	*CacheValue = Config->ReadString(OptionName);
+	m_Callbacks.Insert(Callback);
+}
 
-	if (Prefix != NULL) {
-		free(OptionName);
+/**
+ * UnregisterCallback
+ *
+ * Removes a change notification function.
+ *
+ * @param Proc the function
+ * @param Cookie the cookie which was used for RegisterCallback
+ */
+void CSettingsCache::UnregisterCallback(CacheChangedProc Proc, void *Cookie) {
+	for (int i = m_Callbacks.GetLength() - 1; i >= 0; i--) {
+		if (m_Callbacks[i].Proc == Proc && m_Callbacks[i].Cookie == Cookie) {
+			m_Callbacks.Remove(i);
+		}
 	}
 }
@@ -20,34 +20,139 @@
 #ifndef CACHE_H
 #define CACHE_H
 
-#define CACHE(Name) struct configcache##Name
+/**
+ * cachetype_t
+ *
+ * The type of a cached setting.
+ */
+typedef enum cachetype_e {
+	Cache_Integer,
+	Cache_String
+} cachetype_t;
+
+/**
+ * cacheschema_t
+ *
+ * Describes the settings of a cache type. There is exactly one schema for
+ * each cache type (see DEFINE_CACHE), it is shared by all caches of that type.
+ */
+typedef struct cacheschema_s {
+	const char *Prefix; /**< the prefix of the settings' names */
+	int Count; /**< the number of settings */
+	const char *const *Names; /**< the names of the settings (without the prefix) */
+	const cachetype_t *Types; /**< the types of the settings */
+	char **FullNames; /**< the names of the settings (including the prefix) */
+	size_t *Offsets; /**< where the settings' values are stored in a cache */
+	CHashtable<char **, false> *Ids; /**< maps the settings' names to their entries in FullNames */
+} cacheschema_t;
 
-#define DEFINE_CACHE(Name) CACHE(Name) { \
-	CConfig *BgConfig; \
-	const char *BgPrefix;
-#define END_DEFINE_CACHE };
+typedef void (*CacheChangedProc)(int Option, void *Cookie);
 
-#define DEFINE_OPTION_INT(Name) int Name
-#define DEFINE_OPTION_STRING(Name) const char *Name
+/**
+ * cachecallback_t
+ *
+ * A function which is called when a cached setting is changed.
+ */
+typedef struct cachecallback_s {
+	CacheChangedProc Proc; /**< the function */
+	void *Cookie; /**< a user-specific pointer which is passed to the function */
+} cachecallback_t;
 
-#define CacheInitialize(Cache, Config, Prefix) { \
-	memset(&(Cache), 0xFF, sizeof((Cache))); \
-	(Cache).BgConfig = Config; \
-	(Cache).BgPrefix = Prefix; \
-	}
+/**
+ * CSettingsCache
+ *
+ * Keeps parsed copies of frequently used settings. The cache is notified by
+ * its configuration object whenever a setting is changed, so reading a
+ * cached setting is a plain memory access.
+ */
+class SBNCAPI CSettingsCache {
+private:
+	CConfig *m_Config; /**< the configuration object */
+	cacheschema_t *m_Schema; /**< the cache's schema */
+	char *m_Base; /**< the address of the struct which holds the values */
+	bool *m_IsSet; /**< whether the settings exist in the configuration object */
+	CVector<cachecallback_t> m_Callbacks; /**< change notification callbacks */
 
+	void Update(int Option, bool Notify);
+
+public:
 #ifndef SWIG
-int CacheGetIntegerReal(CConfig *Config, int *CacheValue, const char *Option, const char *Prefix);
-const char *CacheGetStringReal(CConfig *Config, const char **CacheValue, const char *Option, const char *Prefix);
+	CSettingsCache(void);
+	virtual ~CSettingsCache(void);
+#endif /* SWIG */
 
-void CacheSetIntegerReal(CConfig *Config, int *CacheValue, const char *Option, int Value, const char *Prefix);
-void CacheSetStringReal(CConfig *Config, const char **CacheValue, const char *Option, const char *Value, const char *Prefix);
+	void Initialize(CConfig *Config, cacheschema_t *Schema, void *Base, void **Values, bool *IsSet);
+	void Detach(void);
 
-#define CacheGetInteger(Cache, Option) (((Cache).Option == -1 || !(Cache).BgConfig->CanUseCache()) ? CacheGetIntegerReal((Cache).BgConfig, &((Cache).Option), #Option, (Cache).BgPrefix) : (Cache).Option)
-#define CacheGetString(Cache, Option) (((Cache).Option == (char *)-1 || !(Cache).BgConfig->CanUseCache())? CacheGetStringReal((Cache).BgConfig, &((Cache).Option), #Option, (Cache).BgPrefix) : (Cache).Option)
+	void SettingChanged(const char *Setting);
+	void Reload(void);
 
-#define CacheSetInteger(Cache, Option, Value) CacheSetIntegerReal((Cache).BgConfig, &((Cache).Option), #Option, Value, (Cache).BgPrefix)
-#define CacheSetString(Cache, Option, Value) CacheSetStringReal((Cache).BgConfig, &((Cache).Option), #Option, Value, (Cache).BgPrefix)
-#endif /* SWIG */
+	int GetInteger(int Option) const;
+	const char *GetString(int Option) const;
+	bool IsSet(int Option) const;
+
+	void SetInteger(int Option, int Value);
+	void SetString(int Option, const char *Value);
+
+	void RegisterCallback(CacheChangedProc Proc, void *Cookie);
+	void UnregisterCallback(CacheChangedProc Proc, void *Cookie);
+};
+
+#define CACHE(Name) struct configcache##Name
+#define CacheId(Name, Option) configcache##Name::Id_##Option
+
+#define CACHE_OPTION_ID(Option) Id_##Option,
+#define CACHE_OPTION_INT(Option) int Option;
+#define CACHE_OPTION_STRING(Option) const char *Option;
+#define CACHE_OPTION_NAME(Option) #Option,
+#define CACHE_OPTION_TYPE_INT(Option) Cache_Integer,
+#define CACHE_OPTION_TYPE_STRING(Option) Cache_String,
+#define CACHE_OPTION_ADDRESS(Option) (void *)&Option,
+
+/**
+ * DEFINE_CACHE
+ *
+ * Defines a cache type. The options are specified as a macro which takes
+ * two arguments (one for integer and one for string settings), e.g.:
+ *
+ * #define FOO_OPTIONS(INT, STRING) INT(port) STRING(name)
+ * DEFINE_CACHE(Foo, "foo.", FOO_OPTIONS)
+ *
+ * Each setting gets an ID (Id_<name>) and a member which holds its value.
+ *
+ * @param Name the name of the cache type
+ * @param Prefix the prefix of the settings' names
+ * @param Options the settings
+ */
+#define DEFINE_CACHE(Name, Prefix, Options) CACHE(Name) { \
+	enum { Options(CACHE_OPTION_ID, CACHE_OPTION_ID) OptionCount }; \
+	\
+	Options(CACHE_OPTION_INT, CACHE_OPTION_STRING) \
+	bool IsSet[OptionCount]; \
+	CSettingsCache Bg; \
+	\
+	static cacheschema_t *GetSchema(void) { \
+		static const char *const Names[] = { Options(CACHE_OPTION_NAME, CACHE_OPTION_NAME) }; \
+		static const cachetype_t Types[] = { Options(CACHE_OPTION_TYPE_INT, CACHE_OPTION_TYPE_STRING) }; \
+		static cacheschema_t Schema = { Prefix, OptionCount, Names, Types, NULL, NULL, NULL }; \
+		\
+		return &Schema; \
+	} \
+	\
+	void Initialize(CConfig *Config) { \
+		void *Values[] = { Options(CACHE_OPTION_ADDRESS, CACHE_OPTION_ADDRESS) }; \
+		\
+		Bg.Initialize(Config, GetSchema(), this, Values, IsSet); \
+	} \
+};
+
+#define CacheInitialize(Cache, Config) (Cache).Initialize(Config)
+
+#define CacheGetInteger(Cache, Option) ((Cache).Option)
+#define CacheGetString(Cache, Option) ((Cache).Option)
+#define CacheIsSet(Cache, Option) ((Cache).IsSet[(Cache).Id_##Option])
+
+#define CacheSetInteger(Cache, Option, Value) (Cache).Bg.SetInteger((Cache).Id_##Option, Value)
+#define CacheSetString(Cache, Option, Value) (Cache).Bg.SetString((Cache).Id_##Option, Value)
 
 #endif /* CACHE_H */
@@ -744,15 +744,62 @@ void CChannel::AddBacklogLine(const char *Source, const char *Message) {
  * Plays back the backlog.
  */
 void CChannel::PlayBacklog(CClientConnection *Client) {
+	char **Lines;
+	int Count;
+
+	Lines = RenderBacklog(Client->HasCapability("znc.in/server-time-iso"), &Count);
+
+	if (Lines == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < Count; i++) {
+		Client->WriteUnformattedLine(Lines[i]);
+
+		free(Lines[i]);
+	}
+
+	free(Lines);
+}
+
+/**
+ * RenderBacklog
+ *
+ * Renders the lines which are sent to a client when the backlog is played
+ * back. The caller is responsible for freeing the lines and the array.
+ *
+ * @param ServerTime whether the client supports server-time
+ * @param Count receives the number of lines
+ */
+char **CChannel::RenderBacklog(bool ServerTime, int *Count) {
 	char strMessageTime[100];
 	tm MessageTm;
-	bool tscap = Client->HasCapability("znc.in/server-time-iso");
+	char **Lines;
+	int Length = 0, rc;
+
+	*Count = 0;
 
-	if (!tscap)
-		Client->WriteLine(":-sBNC!bouncer@shroudbnc.info PRIVMSG %s :** Start of channel log.", m_Name);
+	for (CListCursor<backlog_t> BacklogCursor(&m_Backlog); BacklogCursor.IsValid(); BacklogCursor.Proceed()) {
+		Length++;
+	}
+
+	// the start and end markers
+	Lines = (char **)malloc(sizeof(char *) * (Length + 2));
+
+	if (AllocFailed(Lines)) {
+		return NULL;
+	}
+
+	if (!ServerTime) {
+		rc = asprintf(&Lines[*Count], ":-sBNC!bouncer@shroudbnc.info PRIVMSG %s :** Start of channel log.", m_Name);
+
+		if (!RcFailed(rc)) {
+			(*Count)++;
+		}
+	}
 
 	for (CListCursor<backlog_t> BacklogCursor(&m_Backlog); BacklogCursor.IsValid(); BacklogCursor.Proceed()) {
-		if (!tscap) {
+		if (!ServerTime) {
 			MessageTm = *localtime(&(BacklogCursor->Time));
 
 #ifdef _WIN32
@@ -761,16 +808,27 @@ void CChannel::PlayBacklog(CClientConnection *Client) {
 			strftime(strMessageTime, sizeof(strMessageTime), "%a %B %d %Y %H:%M:%S" , &MessageTm);
 #endif
 
-			Client->WriteLine(":%s PRIVMSG %s :(%s) %s", BacklogCursor->Source, m_Name, strMessageTime, BacklogCursor->Message);
+			rc = asprintf(&Lines[*Count], ":%s PRIVMSG %s :(%s) %s", BacklogCursor->Source, m_Name, strMessageTime, BacklogCursor->Message);
 		} else {
 			MessageTm = *gmtime(&(BacklogCursor->Time));
 			strftime(strMessageTime, sizeof(strMessageTime), "%Y-%m-%dT%H:%M:%S", &MessageTm);
-			Client->WriteLine("@time=%s.0Z :%s PRIVMSG %s :%s", strMessageTime, BacklogCursor->Source, m_Name, BacklogCursor->Message);
+			rc = asprintf(&Lines[*Count], "@time=%s.0Z :%s PRIVMSG %s :%s", strMessageTime, BacklogCursor->Source, m_Name, BacklogCursor->Message);
+		}
+
+		if (!RcFailed(rc)) {
+			(*Count)++;
+		}
+	}
+
+	if (!ServerTime) {
+		rc = asprintf(&Lines[*Count], ":-sBNC!bouncer@shroudbnc.info PRIVMSG %s :** End of channel log.", m_Name);
+
+		if (!RcFailed(rc)) {
+			(*Count)++;
 		}
 	}
 
-	if (!tscap)
-		Client->WriteLine(":-sBNC!bouncer@shroudbnc.info PRIVMSG %s :** End of channel log.", m_Name);
+	return Lines;
 }
 
 /**
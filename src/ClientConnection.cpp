@@ -28,8 +28,10 @@ IMPL_DNSEVENTPROXY(CClientConnection, AsyncDnsFinishedClient)
  *
  * @param Client the client socket
  * @param SSL whether to use SSL
+ * @param PreAuthAddress the address which was counted as an unauthenticated
+ *                       connection by the reputation table, or NULL
  */
-CClientConnection::CClientConnection(SOCKET Client, bool SSL) : CConnection(Client, SSL, Role_Server) {
+CClientConnection::CClientConnection(SOCKET Client, bool SSL, const sockaddr *PreAuthAddress) : CConnection(Client, SSL, Role_Server) {
 	m_Nick = NULL;
 	m_Password = NULL;
 	m_Username = NULL;
@@ -43,33 +45,43 @@ CClientConnection::CClientConnection(SOCKET Client, bool SSL) : CConnection(Clie
 	m_PingTimer = NULL;
 	m_DestroyClientTimer = NULL;
 	m_CapabilitiesEnd = false;
-	m_Capabilities = new CHashtable<const char *, false>();
+	m_Capabilities = NULL;
+	m_PasswordCheck = NULL;
+	m_PreAuthAddress = NULL;
+	m_LoginPending = false;
+	m_DeferredQ = NULL;
+	m_Producing = false;
+	m_AttachStarted = 0;
+	m_AttachChannels = 0;
+
+	if (PreAuthAddress != NULL) {
+		m_PreAuthAddress = (sockaddr *)malloc(SOCKADDR_LEN(PreAuthAddress->sa_family));
+
+		if (AllocFailed(m_PreAuthAddress)) {
+			g_Bouncer->GetReputationTable()->RemovePreAuth(PreAuthAddress);
+		} else {
+			memcpy(m_PreAuthAddress, PreAuthAddress, SOCKADDR_LEN(PreAuthAddress->sa_family));
+		}
+	}
 
 	if (Client != INVALID_SOCKET) {
 		WriteLine(":shroudbnc.info NOTICE AUTH :*** shroudBNC %s - "
 			"Copyright (C) 2005-2014 Gunnar Beutner", g_Bouncer->GetBouncerVersion());
 
-		m_ClientLookup = new CDnsQuery(this, USE_DNSEVENTPROXY(CClientConnection, AsyncDnsFinishedClient));
-
 		sockaddr *Remote = GetRemoteAddress();
 
 		if (Remote == NULL) {
-			Kill("Internal error: GetRemoteAddress() failed. Could not look up your hostname.");
+			Kill("Internal error: GetRemoteAddress() failed.");
 
 			return;
 		}
 
-		WriteLine(":shroudbnc.info NOTICE AUTH :*** Doing reverse DNS lookup on %s...", IpToString(Remote));
+		// the hostname is looked up once the client has logged in
+		m_PeerName = strdup(IpToString(Remote));
 
-		m_ClientLookup->GetHostByAddr(Remote);
-	}
-
-	if (m_Nick == NULL) {
 		m_AuthTimer = new CTimer(30, false, ClientAuthTimer, this);
 	}
 
-	m_PingTimer = new CTimer(45, true, ClientPingTimer, this);
-
 	m_LastResponse = g_CurrentTime;
 }
 
@@ -90,25 +102,18 @@ CClientConnection::~CClientConnection() {
 	delete m_PingTimer;
 	delete m_DestroyClientTimer;
 	delete m_Capabilities;
-}
 
-/**
- * ProcessBncCommand
- *
- * Processes a bouncer command (i.e. /sbnc <command> or /msg -sBNC <command>).
- *
- * @param Subcommand the command's name
- * @param argc number of parameters for the command
- * @param argv arguments for the command
- * @param NoticeUser whether to send replies as notices
- */
-bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, const char **argv, bool NoticeUser) {
-	char *Out;
-	const CVector<CModule *> *Modules;
-	bool latchedRetVal = true;
-	int rc;
+	ClearProducers();
 
-	Modules = g_Bouncer->GetModules();
+	delete m_DeferredQ;
+
+	// the worker thread's result is discarded
+	if (m_PasswordCheck != NULL) {
+		m_PasswordCheck->Client = NULL;
+	}
+
+	ReleasePreAuth();
+}
 
 /**
  * SENDUSER
@@ -126,6 +131,164 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		} \
 	} while (0)
 
+/**
+ * RegisterCommands
+ *
+ * Registers the bouncer's built-in commands.
+ *
+ * @param Commands the list of commands
+ */
+void CClientConnection::RegisterCommands(commandlist_t *Commands) {
+	RegisterCommand(Commands, "adduser", "Admin", "creates a new user",
+		"Syntax: adduser <username> [password]\nCreates a new user.",
+		BuiltinCommand<&CClientConnection::AddUserCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "deluser", "Admin", "removes a user",
+		"Syntax: deluser <username>\nDeletes a user.",
+		BuiltinCommand<&CClientConnection::DelUserCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "resetpass", "Admin", "sets a user's password",
+		"Syntax: resetpass <user> <password>\nResets another user's password.",
+		BuiltinCommand<&CClientConnection::ResetPassCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "who", "Admin", "shows users",
+		"Syntax: who\nShows a list of all users.\nFlags (which are displayed in front of the username):\n"
+		"@ user is an admin\n* user is currently logged in\n! user is suspended",
+		BuiltinCommand<&CClientConnection::WhoCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "reconnects", "Admin", "shows the reconnect queue",
+		"Syntax: reconnects\nShows the users which are waiting for a reconnect, the rate limits for each server and bind ip "
+		"and when all of these users will have been reconnected.",
+		BuiltinCommand<&CClientConnection::ReconnectsCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "admin", "Admin", "gives someone admin privileges",
+		"Syntax: admin <username>\nGives admin privileges to a user.",
+		BuiltinCommand<&CClientConnection::AdminCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "unadmin", "Admin", "removes someone's admin privileges",
+		"Syntax: unadmin <username>\nRemoves someone's admin privileges.",
+		BuiltinCommand<&CClientConnection::UnadminCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "suspend", "Admin", "suspends a user",
+		"Syntax: suspend <username> [reason]\nSuspends an account. An optional reason can be specified.",
+		BuiltinCommand<&CClientConnection::SuspendCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "unsuspend", "Admin", "unsuspends a user",
+		"Syntax: unsuspend <username>\nRemoves a suspension from the specified account.",
+		BuiltinCommand<&CClientConnection::UnsuspendCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "lsmod", "Admin", "lists loaded modules",
+		"Syntax: lsmod\nLists all currently loaded modules.",
+		BuiltinCommand<&CClientConnection::LsmodCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "insmod", "Admin", "loads a module",
+		"Syntax: insmod <filename>\nLoads a module.",
+		BuiltinCommand<&CClientConnection::InsmodCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "rmmod", "Admin", "unloads a module",
+		"Syntax: rmmod <index>\nUnloads a module. Use the \"lsmod\" command to view a list of loaded modules.",
+		BuiltinCommand<&CClientConnection::RmmodCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "simul", "Admin", "simulates a command on another user's connection",
+		"Syntax: simul <username> <command>\nExecutes a command in another user's context.",
+		BuiltinCommand<&CClientConnection::SimulCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "broadcast", "Admin", "sends a global notice to all bouncer users",
+		"Syntax: broadcast <text>\nSends a notice to all currently connected users.",
+		BuiltinCommand<&CClientConnection::BroadcastCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "kill", "Admin", "disconnects a user from the bouncer",
+		"Syntax: kill <username>\nDisconnects a user from the bouncer.",
+		BuiltinCommand<&CClientConnection::KillCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "playmainlog", "Admin", "plays the bouncer's log",
+		"Syntax: playmainlog [offset] [count]\nDisplays the bouncer's log. A negative offset counts from the end of the log.",
+		BuiltinCommand<&CClientConnection::PlayMainLogCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "erasemainlog", "Admin", "erases the bouncer's log",
+		"Syntax: erasemainlog\nErases the bouncer's log.",
+		BuiltinCommand<&CClientConnection::EraseMainLogCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "globalset", "Admin", "sets global options",
+		"Syntax: globalset [option] [value]\nDisplays or changed global options.",
+		BuiltinCommand<&CClientConnection::GlobalSetCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "globalunset", "Admin", "restores the default value of a global option",
+		"Syntax: globalunset <option>\nRestores the default value of a global option.",
+		BuiltinCommand<&CClientConnection::GlobalUnsetCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "die", "Admin", "terminates the bouncer",
+		"Syntax: die\nTerminates the bouncer.",
+		BuiltinCommand<&CClientConnection::DieCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "addlistener", "Admin", "creates an additional listener",
+#ifdef USESSL
+		"Syntax: addlistener <port> [address] [ssl]\nCreates an additional listener which can be used by clients.",
+#else
+		"Syntax: addlistener <port> [address]\nCreates an additional listener which can be used by clients.",
+#endif
+		BuiltinCommand<&CClientConnection::AddListenerCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "dellistener", "Admin", "removes a listener",
+		"Syntax: dellistener <port>\nRemoves a listener.",
+		BuiltinCommand<&CClientConnection::DelListenerCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "listeners", "Admin", "lists all listeners",
+		"Syntax: listeners\nLists all listeners.",
+		BuiltinCommand<&CClientConnection::ListenersCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "exportconfig", "Admin", "writes the users' settings to their configuration files",
+		"Syntax: exportconfig\nWrites the settings of all users to their configuration files (users/<username>.conf)."
+		" This can be used to back up the config store or to stop using it.",
+		BuiltinCommand<&CClientConnection::ExportConfigCommand>, COMMAND_ADMIN);
+	RegisterCommand(Commands, "impulse", "Admin", "triggers a debug impulse", NULL,
+		BuiltinCommand<&CClientConnection::ImpulseCommand>, COMMAND_ADMIN | COMMAND_HIDDEN);
+
+	RegisterCommand(Commands, "read", "User", "plays your message log",
+		"Syntax: read [offset] [count]\nDisplays your private log. A negative offset counts from the end of the log.",
+		BuiltinCommand<&CClientConnection::ReadCommand>, 0);
+	RegisterCommand(Commands, "erase", "User", "erases your message log",
+		"Syntax: erase\nErases your private log.",
+		BuiltinCommand<&CClientConnection::EraseCommand>, 0);
+	RegisterCommand(Commands, "set", "User", "sets configurable options for your user",
+		"Syntax: set [option] [value]\nDisplays or changes configurable options for your user.",
+		BuiltinCommand<&CClientConnection::SetCommand>, 0);
+	RegisterCommand(Commands, "unset", "User", "restores the default value of an option",
+		"Syntax: unset <option>\nRestores the default value of an option.",
+		BuiltinCommand<&CClientConnection::UnsetCommand>, 0);
+	RegisterCommand(Commands, "jump", "User", "reconnects to the irc server",
+		"Syntax: jump\nReconnects to the irc server.",
+		BuiltinCommand<&CClientConnection::JumpCommand>, 0);
+	RegisterCommand(Commands, "partall", "User", "parts all channels and tells shroudBNC not to rejoin them when you reconnect to a server",
+		"Syntax: partall\nParts all channels and tells shroudBNC not to rejoin any channels when you reconnect to a"
+		" server.\nThis might be useful if you get disconnected due to a \"Max sendq exceeded\" error.",
+		BuiltinCommand<&CClientConnection::PartAllCommand>, 0);
+	RegisterCommand(Commands, "backlog", "User", "replays the channel log for the specified channel",
+		"Syntax: backlog <#channel>\nPlays the channel log for the specified channel.",
+		BuiltinCommand<&CClientConnection::BacklogCommand>, 0);
+	RegisterCommand(Commands, "erasebacklog", "User", "erases the backlog for the specified channel or all channels",
+		"Syntax: erasebacklog [#channel]\nErases the specified channel's backlog. Or all channels' backlogs if no channel is given.",
+		BuiltinCommand<&CClientConnection::EraseBacklogCommand>, 0);
+	RegisterCommand(Commands, "disconnect", "User", "disconnects a user from the irc server",
+		"Syntax: disconnect [username]\nDisconnects you from the irc server. Admins can specify another user whose"
+		" IRC connection should be closed.",
+		BuiltinCommand<&CClientConnection::DisconnectCommand>, 0);
+#ifdef HAVE_LIBSSL
+	RegisterCommand(Commands, "savecert", "User", "saves your current client certificate for use with public key authentication",
+		"Syntax: savecert\nSaves your current client certificate for use with public key authentication.\n"
+		"Once you have saved your certificate you can use it for logging in without a password.",
+		BuiltinCommand<&CClientConnection::SaveCertCommand>, 0);
+	RegisterCommand(Commands, "delcert", "User", "removes a certificate",
+		"Syntax: delcert <id>\nRemoves the specified certificate.",
+		BuiltinCommand<&CClientConnection::DelCertCommand>, 0);
+	RegisterCommand(Commands, "showcert", "User", "shows information about your certificates",
+		"Syntax: showcert\nShows a list of certificates which can be used for logging in.",
+		BuiltinCommand<&CClientConnection::ShowCertCommand>, 0);
+#endif /* HAVE_LIBSSL */
+	RegisterCommand(Commands, "status", "User", "tells you the current status",
+		"Syntax: status\nDisplays information about your user. This command is used for debugging.",
+		BuiltinCommand<&CClientConnection::StatusCommand>, 0);
+	RegisterCommand(Commands, "direct", "User", "sends a raw line to the irc server", NULL,
+		BuiltinCommand<&CClientConnection::DirectCommand>, COMMAND_HIDDEN);
+	RegisterCommand(Commands, "help", "User", "displays a list of commands or information about individual commands",
+		"Syntax: help [command]\nDisplays a list of commands or information about individual commands.",
+		BuiltinCommand<&CClientConnection::HelpCommand>, 0);
+}
+
+/**
+ * ProcessBncCommand
+ *
+ * Processes a bouncer command (i.e. /sbnc <command> or /msg -sBNC <command>).
+ *
+ * @param Subcommand the command's name
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, const char **argv, bool NoticeUser) {
+	const CVector<CModule *> *Modules;
+	command_t *Command;
+	bool latchedRetVal = true;
+
+	Modules = g_Bouncer->GetModules();
+
 	if (argc < 1) {
 		if (NoticeUser) {
 			SENDUSER("You need to specify a command. Try /sbnc help");
@@ -136,166 +299,140 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		return false;
 	}
 
+	// modules add their commands to the client's list when they see the "help" command
 	if (strcasecmp(Subcommand, "help") == 0) {
-		if (argc <= 1) {
-			SENDUSER("--The following commands are available to you--");
-			SENDUSER("--Used as '/sbnc <command>', or '/msg -sbnc <command>'");
+		FlushCommands(&m_CommandList);
+	}
+
+	for (int i = 0; i < Modules->GetLength(); i++) {
+		if ((*Modules)[i]->InterceptClientCommand(this, Subcommand, argc, argv, NoticeUser)) {
+			latchedRetVal = false;
 		}
+	}
 
-		FlushCommands(&m_CommandList);
+	// "help" is answered even if a module has handled it because it also lists the modules' commands
+	if (!latchedRetVal && strcasecmp(Subcommand, "help") != 0) {
+		return false;
+	}
 
-		if (GetOwner()->IsAdmin()) {
-			AddCommand(&m_CommandList, "adduser", "Admin", "creates a new user",
-				"Syntax: adduser <username> [password]\nCreates a new user.");
-			AddCommand(&m_CommandList, "deluser", "Admin", "removes a user",
-				"Syntax: deluser <username>\nDeletes a user.");
-			AddCommand(&m_CommandList, "resetpass", "Admin", "sets a user's password",
-				"Syntax: resetpass <user> <password>\nResets another user's password.");
-			AddCommand(&m_CommandList, "who", "Admin", "shows users",
-				"Syntax: who\nShows a list of all users.\nFlags (which are displayed in front of the username):\n"
-				"@ user is an admin\n* user is currently logged in\n! user is suspended");
-			AddCommand(&m_CommandList, "admin", "Admin", "gives someone admin privileges",
-				"Syntax: admin <username>\nGives admin privileges to a user.");
-			AddCommand(&m_CommandList, "unadmin", "Admin", "removes someone's admin privileges",
-				"Syntax: unadmin <username>\nRemoves someone's admin privileges.");
-			AddCommand(&m_CommandList, "suspend", "Admin", "suspends a user",
-				"Syntax: suspend <username> [reason]\nSuspends an account. An optional reason can be specified.");
-			AddCommand(&m_CommandList, "unsuspend", "Admin", "unsuspends a user",
-				"Syntax: unsuspend <username>\nRemoves a suspension from the specified account.");
-			AddCommand(&m_CommandList, "lsmod", "Admin", "lists loaded modules",
-				"Syntax: lsmod\nLists all currently loaded modules.");
-			AddCommand(&m_CommandList, "insmod", "Admin", "loads a module",
-				"Syntax: insmod <filename>\nLoads a module.");
-			AddCommand(&m_CommandList, "rmmod", "Admin", "unloads a module",
-				"Syntax: rmmod <index>\nUnloads a module. Use the \"lsmod\" command to view a list of loaded modules.");
-			AddCommand(&m_CommandList, "simul", "Admin", "simulates a command on another user's connection",
-				"Syntax: simul <username> <command>\nExecutes a command in another user's context.");
-			AddCommand(&m_CommandList, "broadcast", "Admin", "sends a global notice to all bouncer users",
-				"Syntax: broadcast <text>\nSends a notice to all currently connected users.");
-			AddCommand(&m_CommandList, "kill", "Admin", "disconnects a user from the bouncer",
-				"Syntax: kill <username>\nDisconnects a user from the bouncer.");
-			AddCommand(&m_CommandList, "disconnect", "Admin", "disconnects a user from the irc server",
-				"Syntax: disconnect [username]\nDisconnects a user from the IRC server which he is currently connected to."
-				" If you don't specify a username, your own IRC connection will be closed.");
-			AddCommand(&m_CommandList, "playmainlog", "Admin", "plays the bouncer's log",
-				"Syntax: playmainlog\nDisplays the bouncer's log.");
-			AddCommand(&m_CommandList, "erasemainlog", "Admin", "erases the bouncer's log",
-				"Syntax: erasemainlog\nErases the bouncer's log.");
-			AddCommand(&m_CommandList, "globalset", "Admin", "sets global options",
-				"Syntax: globalset [option] [value]\nDisplays or changed global options.");
-			AddCommand(&m_CommandList, "globalunset", "Admin", "restores the default value of a global option",
-				"Syntax: globalunset <option>\nRestores the default value of a global option.");
-			AddCommand(&m_CommandList, "die", "Admin", "terminates the bouncer",
-				"Syntax: die\nTerminates the bouncer.");
-			AddCommand(&m_CommandList, "addlistener", "Admin", "creates an additional listener",
-#ifdef USESSL
-				"Syntax: addlistener <port> [address] [ssl]\nCreates an additional listener which can be used by clients.");
-#else
-				"Syntax: addlistener <port> [address]\nCreates an additional listener which can be used by clients.");
-#endif
+	Command = GetCommand(Subcommand);
 
-			AddCommand(&m_CommandList, "dellistener", "Admin", "removes a listener",
-				"Syntax: dellistener <port>\nRemoves a listener.");
-			AddCommand(&m_CommandList, "listeners", "Admin", "lists all listeners",
-				"Syntax: listeners\nLists all listeners.");
-		}
-
-		AddCommand(&m_CommandList, "read", "User", "plays your message log",
-			"Syntax: read\nDisplays your private log.");
-		AddCommand(&m_CommandList, "erase", "User", "erases your message log",
-			"Syntax: erase\nErases your private log.");
-		AddCommand(&m_CommandList, "set", "User", "sets configurable options for your user",
-			"Syntax: set [option] [value]\nDisplays or changes configurable options for your user.");
-		AddCommand(&m_CommandList, "unset", "User", "restores the default value of an option",
-			"Syntax: unset <option>\nRestores the default value of an option.");
-		AddCommand(&m_CommandList, "jump", "User", "reconnects to the irc server",
-			"Syntax: jump\nReconnects to the irc server.");
-		AddCommand(&m_CommandList, "partall", "User", "parts all channels and tells shroudBNC not to rejoin them when you reconnect to a server",
-			"Syntax: partall\nParts all channels and tells shroudBNC not to rejoin any channels when you reconnect to a"
-			" server.\nThis might be useful if you get disconnected due to a \"Max sendq exceeded\" error.");
-		AddCommand(&m_CommandList, "backlog", "User", "replays the channel log for the specified channel",
-			"Syntax: backlog <#channel>\nPlays the channel log for the specified channel.");
-		AddCommand(&m_CommandList, "erasebacklog", "User", "erases the backlog for the specified channel or all channels",
-			"Syntax: erasebacklog [#channel]\nErases the specified channel's backlog. Or all channels' backlogs if no channel is given.");
-		if (!GetOwner()->IsAdmin()) {
-			AddCommand(&m_CommandList, "disconnect", "User", "disconnects a user from the irc server",
-				"Syntax: disconnect\nDisconnects you from the irc server.");
-		}
-#ifdef HAVE_LIBSSL
-		AddCommand(&m_CommandList, "savecert", "User", "saves your current client certificate for use with public key authentication",
-			"Syntax: savecert\nSaves your current client certificate for use with public key authentication.\n"
-			"Once you have saved your certificate you can use it for logging in without a password.");
-		AddCommand(&m_CommandList, "delcert", "User", "removes a certificate",
-			"Syntax: delcert <id>\nRemoves the specified certificate.");
-		AddCommand(&m_CommandList, "showcert", "User", "shows information about your certificates",
-			"Syntax: showcert\nShows a list of certificates which can be used for logging in.");
-#endif /* HAVE_LIBSSL */
+	if (Command != NULL && Command->Handler != NULL) {
+		return Command->Handler(this, argc, argv, NoticeUser);
+	}
 
-		if (GetOwner()->IsAdmin()) {
-			AddCommand(&m_CommandList, "status", "User", "tells you the current status",
-				"Syntax: status\nDisplays information about your user. This command is used for debugging.");
-		}
+	if (NoticeUser) {
+		RealNotice("Unknown command. Try /sbnc help");
+	} else {
+		Privmsg("Unknown command. Try /msg -sBNC help");
+	}
+
+	return false;
+}
+
+/**
+ * GetCommand
+ *
+ * Returns the specified command if the user is allowed to use it.
+ *
+ * @param Name the name of the command
+ */
+command_t *CClientConnection::GetCommand(const char *Name) {
+	commandlist_t Commands = *g_Bouncer->GetCommands();
+	command_t *Command;
 
-		AddCommand(&m_CommandList, "help", "User", "displays a list of commands or information about individual commands",
-			"Syntax: help [command]\nDisplays a list of commands or information about individual commands.");
+	if (Commands == NULL) {
+		return NULL;
 	}
 
-	for (int i = 0; i < Modules->GetLength(); i++) {
-		if ((*Modules)[i]->InterceptClientCommand(this, Subcommand, argc, argv, NoticeUser)) {
-			latchedRetVal = false;
-		}
+	Command = Commands->Get(Name);
+
+	if (Command == NULL || ((Command->Flags & COMMAND_ADMIN) && !GetOwner()->IsAdmin())) {
+		return NULL;
 	}
 
-	if (strcasecmp(Subcommand, "help") == 0) {
-		if (argc <= 1) {
-			// show help
-			hash_t<command_t *> *Hash;
-			hash_t<command_t *> *CommandList;
-			int i = 0;
-			size_t Align = 0, Len;
+	return Command;
+}
 
-			CommandList = (hash_t<command_t *> *)malloc(sizeof(hash_t<command_t *>) * m_CommandList->GetLength());
+/**
+ * HelpCommand
+ *
+ * Implements the "help" command. The list of commands consists of the
+ * built-in commands and the commands which modules have added to the
+ * client's command list.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::HelpCommand(int argc, const char **argv, bool NoticeUser) {
+	commandlist_t Commands = *g_Bouncer->GetCommands();
+	char *Out;
+	int rc;
 
-			while ((Hash = m_CommandList->Iterate(i++)) != NULL) {
-				CommandList[i - 1] = *Hash;
+	if (argc <= 1) {
+		hash_t<command_t *> *Hash;
+		hash_t<command_t *> *CommandList;
+		int i = 0, Count = 0;
+		size_t Align = 0, Len;
 
-				Len = strlen(Hash->Name);
+		SENDUSER("--The following commands are available to you--");
+		SENDUSER("--Used as '/sbnc <command>', or '/msg -sbnc <command>'");
 
-				if (Len > Align) {
-					Align = Len;
-				}
+		CommandList = (hash_t<command_t *> *)malloc(sizeof(hash_t<command_t *>) *
+			(Commands->GetLength() + (m_CommandList ? m_CommandList->GetLength() : 0)));
+
+		if (AllocFailed(CommandList)) {
+			return false;
+		}
+
+		while ((Hash = Commands->Iterate(i++)) != NULL) {
+			if ((Hash->Value->Flags & COMMAND_HIDDEN) || GetCommand(Hash->Name) == NULL) {
+				continue;
+			}
+
+			// modules can replace the help for built-in commands
+			if (m_CommandList != NULL && m_CommandList->Get(Hash->Name) != NULL) {
+				continue;
 			}
 
-			qsort(CommandList, m_CommandList->GetLength(), sizeof(hash_t<command_t *>), CmpCommandT);
+			CommandList[Count++] = *Hash;
+		}
+
+		i = 0;
 
-			char *Category = NULL;
-			char *Format;
+		while (m_CommandList != NULL && (Hash = m_CommandList->Iterate(i++)) != NULL) {
+			CommandList[Count++] = *Hash;
+		}
 
-			rc = asprintf(&Format, "%%-%ds - %%s", (int)Align);
+		for (i = 0; i < Count; i++) {
+			Len = strlen(CommandList[i].Name);
 
-			if (RcFailed(rc)) {
-				g_Bouncer->Fatal();
+			if (Len > Align) {
+				Align = Len;
 			}
+		}
 
-			for (int i = 0; i < m_CommandList->GetLength(); i++) {
-				if (Category == NULL || strcasecmp(CommandList[i].Value->Category, Category) != 0) {
-					if (Category) {
-						SENDUSER("--");
-					}
+		qsort(CommandList, Count, sizeof(hash_t<command_t *>), CmpCommandT);
 
-					Category = CommandList[i].Value->Category;
+		char *Category = NULL;
+		char *Format;
 
-					rc = asprintf(&Out, "%s commands", Category);
+		rc = asprintf(&Format, "%%-%ds - %%s", (int)Align);
 
-					if (RcFailed(rc)) {
-						g_Bouncer->Fatal();
-					}
+		if (RcFailed(rc)) {
+			g_Bouncer->Fatal();
+		}
 
-					SENDUSER(Out);
-					free(Out);
+		for (i = 0; i < Count; i++) {
+			if (Category == NULL || strcasecmp(CommandList[i].Value->Category, Category) != 0) {
+				if (Category) {
+					SENDUSER("--");
 				}
 
-				rc = asprintf(&Out, Format, CommandList[i].Name, CommandList[i].Value->Description);
+				Category = CommandList[i].Value->Category;
+
+				rc = asprintf(&Out, "%s commands", Category);
 
 				if (RcFailed(rc)) {
 					g_Bouncer->Fatal();
@@ -305,1192 +442,2029 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 				free(Out);
 			}
 
-			free(Format);
-			free(CommandList);
+			rc = asprintf(&Out, Format, CommandList[i].Name, CommandList[i].Value->Description);
 
-			SENDUSER("End of HELP.");
-		} else {
-			command_t *Command = m_CommandList->Get(argv[1]);
+			if (RcFailed(rc)) {
+				g_Bouncer->Fatal();
+			}
 
-			if (Command == NULL) {
-				SENDUSER("There is no such command.");
-			} else if (Command->HelpText == NULL) {
-				SENDUSER("No help is available for this command.");
-			} else {
-				char *Help = strdup(Command->HelpText);
-				char *HelpBase = Help;
+			SENDUSER(Out);
+			free(Out);
+		}
 
-				while (true) {
-					char *NextLine = strchr(Help, '\n');
+		free(Format);
+		free(CommandList);
 
-					if (NextLine) {
-						NextLine[0] = '\0';
-						NextLine++;
-					}
+		SENDUSER("End of HELP.");
+	} else {
+		command_t *Command = NULL;
 
-					SENDUSER(Help);
+		if (m_CommandList != NULL) {
+			Command = m_CommandList->Get(argv[1]);
+		}
 
-					if (NextLine == NULL) {
-						break;
-					} else {
-						Help = NextLine;
-					}
-				}
+		if (Command == NULL) {
+			Command = GetCommand(argv[1]);
 
-				free(HelpBase);
+			if (Command != NULL && (Command->Flags & COMMAND_HIDDEN)) {
+				Command = NULL;
 			}
 		}
 
-		FlushCommands(&m_CommandList);
+		if (Command == NULL) {
+			SENDUSER("There is no such command.");
+		} else if (Command->HelpText == NULL) {
+			SENDUSER("No help is available for this command.");
+		} else {
+			char *Help = strdup(Command->HelpText);
+			char *HelpBase = Help;
 
-		return false;
-	}
+			while (true) {
+				char *NextLine = strchr(Help, '\n');
 
-	if (!latchedRetVal) {
-		return false;
-	}
+				if (NextLine) {
+					NextLine[0] = '\0';
+					NextLine++;
+				}
 
-	if (strcasecmp(Subcommand, "lsmod") == 0 && GetOwner()->IsAdmin()) {
-		for (int i = 0; i < Modules->GetLength(); i++) {
-			rc = asprintf(&Out, "%d: %s", i + 1, (*Modules)[i]->GetFilename());
+				SENDUSER(Help);
 
-			if (RcFailed(rc)) {
-				return false;
+				if (NextLine == NULL) {
+					break;
+				} else {
+					Help = NextLine;
+				}
 			}
 
-			SENDUSER(Out);
-			free(Out);
+			free(HelpBase);
 		}
+	}
 
-		SENDUSER("End of MODULES.");
+	FlushCommands(&m_CommandList);
 
-		return false;
-	} else if (strcasecmp(Subcommand, "insmod") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: INSMOD module-path");
+	return false;
+}
+
+/**
+ * LsmodCommand
+ *
+ * Implements the "lsmod" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::LsmodCommand(int argc, const char **argv, bool NoticeUser) {
+	const CVector<CModule *> *Modules = g_Bouncer->GetModules();
+	char *Out;
+	int rc;
+
+	for (int i = 0; i < Modules->GetLength(); i++) {
+		rc = asprintf(&Out, "%d: %s", i + 1, (*Modules)[i]->GetFilename());
+
+		if (RcFailed(rc)) {
 			return false;
 		}
 
-		RESULT<CModule *> ModuleResult = g_Bouncer->LoadModule(argv[1]);
+		SENDUSER(Out);
+		free(Out);
+	}
 
-		if (!IsError(ModuleResult)) {
-			SENDUSER("Module was successfully loaded.");
-		} else {
-			rc = asprintf(&Out, "Module could not be loaded: %s", GETDESCRIPTION(ModuleResult));
+	SENDUSER("End of MODULES.");
 
-			if (RcFailed(rc)) {
-				SENDUSER("Module could not be loaded.");
+	return false;
+}
 
-				return false;
-			}
+/**
+ * InsmodCommand
+ *
+ * Implements the "insmod" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::InsmodCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
 
-			SENDUSER(Out);
+	if (argc < 2) {
+		SENDUSER("Syntax: INSMOD module-path");
+		return false;
+	}
 
-			free(Out);
-		}
+	RESULT<CModule *> ModuleResult = g_Bouncer->LoadModule(argv[1]);
+
+	if (!IsError(ModuleResult)) {
+		SENDUSER("Module was successfully loaded.");
+	} else {
+		rc = asprintf(&Out, "Module could not be loaded: %s", GETDESCRIPTION(ModuleResult));
+
+		if (RcFailed(rc)) {
+			SENDUSER("Module could not be loaded.");
 
-		return false;
-	} else if (strcasecmp(Subcommand, "rmmod") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: RMMOD module-id");
 			return false;
 		}
 
-		int Index = atoi(argv[1]);
-
-		if (Index == 0 || Index > Modules->GetLength()) {
-			SENDUSER("There is no such module.");
-		} else {
-			CModule *Module = (*Modules)[Index - 1];
+		SENDUSER(Out);
 
-			if (g_Bouncer->UnloadModule(Module)) {
-				SENDUSER("Done.");
-			} else {
-				SENDUSER("Failed to unload this module.");
-			}
-		}
+		free(Out);
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "globalunset") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: globalunset option");
-		} else {
-			if (NoticeUser) {
-				rc = asprintf(&Out, "SBNC GLOBALSET %s :", argv[1]);
-			} else {
-				rc = asprintf(&Out, "PRIVMSG -sBNC :GLOBALSET %s :", argv[1]);
-			}
+	return false;
+}
 
-			if (!RcFailed(rc)) {
-				ParseLine(Out);
-				free(Out);
-			}
-		}
+/**
+ * RmmodCommand
+ *
+ * Implements the "rmmod" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::RmmodCommand(int argc, const char **argv, bool NoticeUser) {
+	const CVector<CModule *> *Modules = g_Bouncer->GetModules();
 
+	if (argc < 2) {
+		SENDUSER("Syntax: RMMOD module-id");
 		return false;
-	} else if (strcasecmp(Subcommand, "globalset") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 3) {
-			SENDUSER("Configurable settings:");
-			SENDUSER("--");
+	}
 
-			rc = asprintf(&Out, "defaultvhost - %s", g_Bouncer->GetDefaultVHost() ? g_Bouncer->GetDefaultVHost() : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	int Index = atoi(argv[1]);
 
-			rc = asprintf(&Out, "motd - %s", g_Bouncer->GetMotd() ? g_Bouncer->GetMotd() : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
-		} else {
-			if (strcasecmp(argv[1], "defaultvhost") == 0) {
-				g_Bouncer->SetDefaultVHost(argv[2]);
-			} else if (strcasecmp(argv[1], "motd") == 0) {
-				ArgRejoinArray(argv, 2);
-				g_Bouncer->SetMotd(argv[2]);
-			} else {
-				SENDUSER("Unknown setting.");
-				return false;
-			}
+	if (Index == 0 || Index > Modules->GetLength()) {
+		SENDUSER("There is no such module.");
+	} else {
+		CModule *Module = (*Modules)[Index - 1];
 
+		if (g_Bouncer->UnloadModule(Module)) {
 			SENDUSER("Done.");
-		}
-
-		return false;
-	} else if (strcasecmp(Subcommand, "unset") == 0) {
-		if (argc < 2) {
-			SENDUSER("Syntax: unset option");
 		} else {
-			if (NoticeUser) {
-				rc = asprintf(&Out, "SBNC SET %s :", argv[1]);
-			} else {
-				rc = asprintf(&Out, "PRIVMSG -sBNC :SET %s :", argv[1]);
-			}
-
-			if (!RcFailed(rc)) {
-				ParseLine(Out);
-				free(Out);
-			}
+			SENDUSER("Failed to unload this module.");
 		}
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "set") == 0) {
-		if (argc < 3) {
-			SENDUSER("Configurable settings:");
-			SENDUSER("--");
-
-			SENDUSER("password - Set");
+	return false;
+}
 
-			rc = asprintf(&Out, "vhost - %s", GetOwner()->GetVHost() ? GetOwner()->GetVHost() : "Default");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
+/**
+ * GlobalUnsetCommand
+ *
+ * Implements the "globalunset" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::GlobalUnsetCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	if (argc < 2) {
+		SENDUSER("Syntax: globalunset option");
+	} else {
+		if (NoticeUser) {
+			rc = asprintf(&Out, "SBNC GLOBALSET %s :", argv[1]);
+		} else {
+			rc = asprintf(&Out, "PRIVMSG -sBNC :GLOBALSET %s :", argv[1]);
+		}
+
+		if (!RcFailed(rc)) {
+			ParseLine(Out);
+			free(Out);
+		}
+	}
+
+	return false;
+}
+
+/**
+ * GlobalSetCommand
+ *
+ * Implements the "globalset" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::GlobalSetCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	if (argc < 3) {
+		SENDUSER("Configurable settings:");
+		SENDUSER("--");
+
+		rc = asprintf(&Out, "defaultvhost - %s", g_Bouncer->GetDefaultVHost() ? g_Bouncer->GetDefaultVHost() : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "motd - %s", g_Bouncer->GetMotd() ? g_Bouncer->GetMotd() : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+	} else {
+		if (strcasecmp(argv[1], "defaultvhost") == 0) {
+			g_Bouncer->SetDefaultVHost(argv[2]);
+		} else if (strcasecmp(argv[1], "motd") == 0) {
+			ArgRejoinArray(argv, 2);
+			g_Bouncer->SetMotd(argv[2]);
+		} else {
+			SENDUSER("Unknown setting.");
+			return false;
+		}
+
+		SENDUSER("Done.");
+	}
+
+	return false;
+}
+
+/**
+ * UnsetCommand
+ *
+ * Implements the "unset" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::UnsetCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	if (argc < 2) {
+		SENDUSER("Syntax: unset option");
+	} else {
+		if (NoticeUser) {
+			rc = asprintf(&Out, "SBNC SET %s :", argv[1]);
+		} else {
+			rc = asprintf(&Out, "PRIVMSG -sBNC :SET %s :", argv[1]);
+		}
+
+		if (!RcFailed(rc)) {
+			ParseLine(Out);
+			free(Out);
+		}
+	}
+
+	return false;
+}
+
+/**
+ * SetCommand
+ *
+ * Implements the "set" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::SetCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	if (argc < 3) {
+		SENDUSER("Configurable settings:");
+		SENDUSER("--");
+
+		SENDUSER("password - Set");
+
+		rc = asprintf(&Out, "vhost - %s", GetOwner()->GetVHost() ? GetOwner()->GetVHost() : "Default");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		if (GetOwner()->GetServer() != NULL) {
+			rc = asprintf(&Out, "server - [%s]:%d", GetOwner()->GetServer(), GetOwner()->GetPort());
+		} else {
+			Out = strdup("server - Not set");
+
+			rc = (Out == NULL) ? -1 : 0;
+		}
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "serverpass - %s", GetOwner()->GetServerPassword() ? "Set" : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "realname - %s", GetOwner()->GetRealname());
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "awaynick - %s", GetOwner()->GetAwayNick() ? GetOwner()->GetAwayNick() : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "away - %s", GetOwner()->GetAwayText() ? GetOwner()->GetAwayText() : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "awaymessage - %s", GetOwner()->GetAwayMessage() ? GetOwner()->GetAwayMessage() : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "usequitasaway - %s", GetOwner()->GetUseQuitReason() ? "On" : "Off");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+#ifdef HAVE_LIBSSL
+		rc = asprintf(&Out, "ssl - %s", GetOwner()->GetSSL() ? "On" : "Off");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+#endif /* HAVE_LIBSSL */
+
+		const char *AutoModes = GetOwner()->GetAutoModes();
+		bool ValidAutoModes = AutoModes && *AutoModes;
+		const char *DropModes = GetOwner()->GetDropModes();
+		bool ValidDropModes = DropModes && *DropModes;
+
+		const char *AutoModesPrefix = "+", *DropModesPrefix = "-";
+
+		if (!ValidAutoModes || (AutoModes && (*AutoModes == '+' || *AutoModes == '-'))) {
+			AutoModesPrefix = "";
+		}
+
+		if (!ValidDropModes || (DropModes && (*DropModes == '-' || *DropModes == '+'))) {
+			DropModesPrefix = "";
+		}
+
+		rc = asprintf(&Out, "automodes - %s%s", AutoModesPrefix, ValidAutoModes ? AutoModes : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		rc = asprintf(&Out, "dropmodes - %s%s", DropModesPrefix, ValidDropModes ? DropModes : "Not set");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		if (GetOwner()->IsAdmin()) {
+			rc = asprintf(&Out, "sysnotices - %s", GetOwner()->GetSystemNotices() ? "On" : "Off");
+			if (!RcFailed(rc)) {
+				SENDUSER(Out);
 				free(Out);
 			}
+		}
+
+		rc = asprintf(&Out, "autobacklog - %s", GetOwner()->GetAutoBacklog() ? GetOwner()->GetAutoBacklog() : "Off");
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+	} else {
+		if (strcasecmp(argv[1], "server") == 0) {
+			if (argc > 3) {
+				GetOwner()->UnmarkQuitted();
+
+				GetOwner()->SetPort(atoi(argv[3]));
+				GetOwner()->SetServer(argv[2]);
+			} else if (argc > 2) {
+				GetOwner()->UnmarkQuitted();
+
+				// the order of the SetServer/SetPort had some importance
+				// i wonder what it was... hm
+				if (strlen(argv[2]) == 0) {
+					GetOwner()->SetServer(NULL);
+					GetOwner()->SetPort(6667);
+				} else {
+					char *ServerStr = NULL;
+					const char *PortStr = strchr(argv[2], ':');
+					unsigned int Port = 6667;
+
+					// Check whether there's a second colon and ignore 'port' if there
+					// isn't because it's most likely an IPv6 address instead.
+					if (PortStr != NULL && strrchr(argv[2], ':') == PortStr) {
+						PortStr++;
+
+						Port = atoi(PortStr);
+
+						if (Port == 0) {
+							Port = 6667;
+						}
+
+						ServerStr = strdup(argv[2]);
+
+						if (ServerStr != NULL) {
+							ServerStr[PortStr - argv[2] - 1] = '\0';
+						}
+					}
+
+					GetOwner()->SetPort(Port);
+					GetOwner()->SetServer((ServerStr != NULL) ? ServerStr : argv[2]);
+					
+					free(ServerStr);
+				}
+			} else {
+				SENDUSER("Syntax: /sbnc set server host port");
+
+				return false;
+			}
+		} else if (strcasecmp(argv[1], "realname") == 0) {
+			ArgRejoinArray(argv, 2);
+			GetOwner()->SetRealname(argv[2]);
+		} else if (strcasecmp(argv[1], "awaynick") == 0) {
+			GetOwner()->SetAwayNick(argv[2]);
+		} else if (strcasecmp(argv[1], "away") == 0) {
+			ArgRejoinArray(argv, 2);
+			GetOwner()->SetAwayText(argv[2]);
+		} else if (strcasecmp(argv[1], "awaymessage") == 0) {
+			ArgRejoinArray(argv, 2);
+			GetOwner()->SetAwayMessage(argv[2]);
+		} else if (strcasecmp(argv[1], "vhost") == 0) {
+			GetOwner()->SetVHost(argv[2]);
+		} else if (strcasecmp(argv[1], "serverpass") == 0) {
+			GetOwner()->SetServerPassword(argv[2]);
+		} else if (strcasecmp(argv[1], "password") == 0) {
+			if (strlen(argv[2]) < 6 || argc > 3 || strchr(argv[2], ':') != NULL) {
+				SENDUSER("Your password is too short or contains invalid characters.");
+				return false;
+			} else {
+				GetOwner()->SetPassword(argv[2]);
+			}
+		} else if (strcasecmp(argv[1], "usequitasaway") == 0) {
+			if (strcasecmp(argv[2], "on") == 0) {
+				GetOwner()->SetUseQuitReason(true);
+			} else if (strcasecmp(argv[2], "off") == 0) {
+				GetOwner()->SetUseQuitReason(false);
+			} else {
+				SENDUSER("Value must be either 'on' or 'off'.");
+
+				return false;
+			}
+		} else if (strcasecmp(argv[1], "automodes") == 0) {
+			ArgRejoinArray(argv, 2);
+			GetOwner()->SetAutoModes(argv[2]);
+		} else if (strcasecmp(argv[1], "dropmodes") == 0) {
+			ArgRejoinArray(argv, 2);
+			GetOwner()->SetDropModes(argv[2]);
+		} else if (strcasecmp(argv[1], "ssl") == 0) {
+			if (strcasecmp(argv[2], "on") == 0) {
+				GetOwner()->SetSSL(true);
+			} else if (strcasecmp(argv[2], "off") == 0) {
+				GetOwner()->SetSSL(false);
+			} else {
+				SENDUSER("Value must be either 'on' or 'off'.");
+
+				return false;
+			}
+		} else if (strcasecmp(argv[1], "sysnotices") == 0) {
+			if (strcasecmp(argv[2], "on") == 0) {
+				GetOwner()->SetSystemNotices(true);
+			} else if (strcasecmp(argv[2], "off") == 0) {
+				GetOwner()->SetSystemNotices(false);
+			} else {
+				SENDUSER("Value must be either 'on' or 'off'.");
+
+				return false;
+			}
+		} else if (strcasecmp(argv[1], "autobacklog") == 0) {
+			if (strcasecmp(argv[2], "on") == 0 || strcasecmp(argv[2], "off") == 0) {
+				GetOwner()->SetAutoBacklog(argv[2]);
+			} else {
+				SENDUSER("Value must be either 'on' or 'off'.");
+
+				return false;
+			}
+		} else {
+			SENDUSER("Unknown setting.");
+			return false;
+		}
+
+		SENDUSER("Done.");
+	}
+
+	return false;
+}
+
+#ifdef HAVE_LIBSSL
+/**
+ * SaveCertCommand
+ *
+ * Implements the "savecert" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::SaveCertCommand(int argc, const char **argv, bool NoticeUser) {
+	if (!IsSSL()) {
+		SENDUSER("Error: You are not using an SSL-encrypted connection.");
+	} else if (GetPeerCertificate() == NULL) {
+		SENDUSER("Error: You are not using a client certificate.");
+	} else {
+		GetOwner()->AddClientCertificate(GetPeerCertificate());
+
+		SENDUSER("Your certificate was stored and will be used for public key authentication.");
+	}
+
+	return false;
+}
+
+/**
+ * ShowCertCommand
+ *
+ * Implements the "showcert" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ShowCertCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	char Buffer[300];
+	const CVector<X509 *> *Certificates;
+	X509_NAME *name;
+	bool First = true;
+
+	Certificates = GetOwner()->GetClientCertificates();
+
+	for (int i = 0; i < Certificates->GetLength(); i++) {
+		X509 *Certificate = (*Certificates)[i];
+
+		if (First == false) {
+			SENDUSER("---");
+		} else {
+			First = false;
+		}
+
+		rc = asprintf(&Out, "Client Certificate #%d", i + 1);
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		name = X509_get_issuer_name(Certificate);
+		X509_NAME_oneline(name, Buffer, sizeof(Buffer));
+
+		rc = asprintf(&Out, "issuer: %s", Buffer);
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		name = X509_get_subject_name(Certificate);
+		X509_NAME_oneline(name, Buffer, sizeof(Buffer));
+
+		rc = asprintf(&Out, "subject: %s", Buffer);
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+	}
+
+	SENDUSER("End of CERTIFICATES.");
+
+	return false;
+}
+
+/**
+ * DelCertCommand
+ *
+ * Implements the "delcert" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::DelCertCommand(int argc, const char **argv, bool NoticeUser) {
+	int id;
+
+	if (argc < 2) {
+		SENDUSER("Syntax: delcert ID");
+		
+		return false;
+	}
+
+	id = atoi(argv[1]);
+
+	X509 *Certificate;
+	const CVector<X509 *> *Certificates = GetOwner()->GetClientCertificates();
+
+	if (id <= 0 || id > Certificates->GetLength()) {
+		Certificate = NULL;
+	} else {
+		Certificate = (*Certificates)[id - 1];
+	}
+
+	if (Certificate != NULL) {
+		if (GetOwner()->RemoveClientCertificate(Certificate)) {
+			SENDUSER("Done.");
+		} else {
+			SENDUSER("An error occured while removing the certificate.");
+		}
+	} else {
+		SENDUSER("The ID you specified is not valid. Use the SHOWCERT command to get a list of valid IDs.");
+	}
+
+	return false;
+}
+#endif /* HAVE_LIBSSL */
+
+/**
+ * DieCommand
+ *
+ * Implements the "die" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::DieCommand(int argc, const char **argv, bool NoticeUser) {
+	g_Bouncer->Log("Shutdown requested by %s", GetOwner()->GetUsername());
+	g_Bouncer->Shutdown();
+
+	return false;
+}
+
+/**
+ * AddUserCommand
+ *
+ * Implements the "adduser" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::AddUserCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	const char *Password;
+	char RandomPassword[10];
+
+	if (argc < 2) {
+		SENDUSER("Syntax: ADDUSER username [password]");
+		return false;
+	} else if (argc < 3) {
+		const char RandomPasswordChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+		RandomPassword[9] = '\0';
+
+		for (unsigned int i = 0; i < 9; i++) {
+			RandomPassword[i] = RandomPasswordChars[rand() % (sizeof(RandomPasswordChars) - 1)];
+		}
+
+		Password = RandomPassword;
+	} else {
+		Password = argv[2];
+	}
+
+	if (g_Bouncer->GetUser(argv[1]) != NULL) {
+		SENDUSER("The specified username is already in use.");
+
+		return false;
+	}
+
+	if (!g_Bouncer->IsValidUsername(argv[1])) {
+		SENDUSER("Could not create user: The username must be alpha-numeric.");
+
+		return false;
+	}
+
+	g_Bouncer->CreateUser(argv[1], Password);
+
+	if (argc < 3) {
+		rc = asprintf(&Out, "The new user's password is \"%s\".", Password);
+
+		if (RcFailed(rc)) {
+			return false;
+		}
+
+		SENDUSER(Out);
+
+		free(Out);
+	}
+
+	SENDUSER("Done.");
+
+	return false;
+}
+
+/**
+ * DelUserCommand
+ *
+ * Implements the "deluser" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::DelUserCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: DELUSER username");
+		return false;
+	}
+
+	if (strcasecmp(argv[1], GetOwner()->GetUsername()) == 0) {
+		SENDUSER("You cannot remove yourself.");
+
+		return false;
+	}
+
+	RESULT<bool> Result = g_Bouncer->RemoveUser(argv[1]);
+
+	if (IsError(Result)) {
+		SENDUSER(GETDESCRIPTION(Result));
+	} else {
+		SENDUSER("Done.");
+	}
+
+	return false;
+}
+
+/**
+ * SimulCommand
+ *
+ * Implements the "simul" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::SimulCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	if (argc < 3) {
+		SENDUSER("Syntax: SIMUL username :command");
+		return false;
+	}
+
+	CUser *User = g_Bouncer->GetUser(argv[1]);
+
+	if (User) {
+		ArgRejoinArray(argv, 2);
+		User->Simulate(argv[2], this);
+
+		SENDUSER("Done.");
+	} else {
+		rc = asprintf(&Out, "No such user: %s", argv[1]);
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+	}
+
+	return false;
+}
+
+/**
+ * DirectCommand
+ *
+ * Implements the "direct" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::DirectCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: DIRECT :command");
+		return false;
+	}
+
+	CIRCConnection *IRC = GetOwner()->GetIRCConnection();
+
+	ArgRejoinArray(argv, 1);
+	IRC->WriteLine("%s", argv[1]);
+
+	return false;
+}
+
+/**
+ * BroadcastCommand
+ *
+ * Implements the "broadcast" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::BroadcastCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: BROADCAST :text");
+		return false;
+	}
+
+	ArgRejoinArray(argv, 1);
+	g_Bouncer->GlobalNotice(argv[1]);
+	return false;
+}
+
+/**
+ * KillCommand
+ *
+ * Implements the "kill" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::KillCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
 
-			if (GetOwner()->GetServer() != NULL) {
-				rc = asprintf(&Out, "server - [%s]:%d", GetOwner()->GetServer(), GetOwner()->GetPort());
-			} else {
-				Out = strdup("server - Not set");
+	if (argc < 2) {
+		SENDUSER("Syntax: KILL username [reason]");
+		return false;
+	}
 
-				rc = (Out == NULL) ? -1 : 0;
-			}
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	CUser *User = g_Bouncer->GetUser(argv[1]);
 
-			rc = asprintf(&Out, "serverpass - %s", GetOwner()->GetServerPassword() ? "Set" : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	const char *Reason = "No reason specified.";
 
-			rc = asprintf(&Out, "realname - %s", GetOwner()->GetRealname());
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	if (argc >= 3) {
+		ArgRejoinArray(argv, 2);
+		Reason = argv[2];
+	}
 
-			rc = asprintf(&Out, "awaynick - %s", GetOwner()->GetAwayNick() ? GetOwner()->GetAwayNick() : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	rc = asprintf(&Out, "You were disconnected from the bouncer. (Requested by %s: %s)", GetOwner()->GetUsername(), Reason);
 
-			rc = asprintf(&Out, "away - %s", GetOwner()->GetAwayText() ? GetOwner()->GetAwayText() : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	if (RcFailed(rc)) {
+		return false;
+	}
 
-			rc = asprintf(&Out, "awaymessage - %s", GetOwner()->GetAwayMessage() ? GetOwner()->GetAwayMessage() : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	if (User != NULL && User->GetClientConnectionMultiplexer() != NULL) {
+		User->GetClientConnectionMultiplexer()->Kill(Out);
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There is no such user or that user is not currently logged in.");
+	}
 
-			rc = asprintf(&Out, "usequitasaway - %s", GetOwner()->GetUseQuitReason() ? "On" : "Off");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	free(Out);
 
-#ifdef HAVE_LIBSSL
-			rc = asprintf(&Out, "ssl - %s", GetOwner()->GetSSL() ? "On" : "Off");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
-#endif /* HAVE_LIBSSL */
+	return false;
+}
 
-			const char *AutoModes = GetOwner()->GetAutoModes();
-			bool ValidAutoModes = AutoModes && *AutoModes;
-			const char *DropModes = GetOwner()->GetDropModes();
-			bool ValidDropModes = DropModes && *DropModes;
+/**
+ * DisconnectCommand
+ *
+ * Implements the "disconnect" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::DisconnectCommand(int argc, const char **argv, bool NoticeUser) {
+	CUser *User;
 
-			const char *AutoModesPrefix = "+", *DropModesPrefix = "-";
+	if (GetOwner()->IsAdmin() && argc >= 2) {
+		User = g_Bouncer->GetUser(argv[1]);
+	} else {
+		User = GetOwner();
+	}
 
-			if (!ValidAutoModes || (AutoModes && (*AutoModes == '+' || *AutoModes == '-'))) {
-				AutoModesPrefix = "";
-			}
+	if (User == NULL) {
+		SENDUSER("There is no such user.");
+		return false;
+	}
 
-			if (!ValidDropModes || (DropModes && (*DropModes == '-' || *DropModes == '+'))) {
-				DropModesPrefix = "";
-			}
+	CIRCConnection *IRC = User->GetIRCConnection();
 
-			rc = asprintf(&Out, "automodes - %s%s", AutoModesPrefix, ValidAutoModes ? AutoModes : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	User->MarkQuitted(true);
 
-			rc = asprintf(&Out, "dropmodes - %s%s", DropModesPrefix, ValidDropModes ? DropModes : "Not set");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+	if (IRC == NULL) {
+		if (User == GetOwner()) {
+			SENDUSER("You are not connected to a server.");
+		} else {
+			SENDUSER("The user is not connected to a server.");
+		}
 
-			if (GetOwner()->IsAdmin()) {
-				rc = asprintf(&Out, "sysnotices - %s", GetOwner()->GetSystemNotices() ? "On" : "Off");
-				if (!RcFailed(rc)) {
-					SENDUSER(Out);
-					free(Out);
-				}
-			}
+		return false;
+	}
 
-			rc = asprintf(&Out, "autobacklog - %s", GetOwner()->GetAutoBacklog() ? GetOwner()->GetAutoBacklog() : "Off");
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
-		} else {
-			if (strcasecmp(argv[1], "server") == 0) {
-				if (argc > 3) {
-					GetOwner()->UnmarkQuitted();
-
-					GetOwner()->SetPort(atoi(argv[3]));
-					GetOwner()->SetServer(argv[2]);
-				} else if (argc > 2) {
-					GetOwner()->UnmarkQuitted();
-
-					// the order of the SetServer/SetPort had some importance
-					// i wonder what it was... hm
-					if (strlen(argv[2]) == 0) {
-						GetOwner()->SetServer(NULL);
-						GetOwner()->SetPort(6667);
-					} else {
-						char *ServerStr = NULL;
-						const char *PortStr = strchr(argv[2], ':');
-						unsigned int Port = 6667;
+	IRC->Kill("Requested.");
 
-						// Check whether there's a second colon and ignore 'port' if there
-						// isn't because it's most likely an IPv6 address instead.
-						if (PortStr != NULL && strrchr(argv[2], ':') == PortStr) {
-							PortStr++;
+	SENDUSER("Done.");
 
-							Port = atoi(PortStr);
+	return false;
+}
 
-							if (Port == 0) {
-								Port = 6667;
-							}
+/**
+ * JumpCommand
+ *
+ * Implements the "jump" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::JumpCommand(int argc, const char **argv, bool NoticeUser) {
+	if (GetOwner()->GetIRCConnection()) {
+		GetOwner()->GetIRCConnection()->Kill("Reconnecting");
 
-							ServerStr = strdup(argv[2]);
+		GetOwner()->SetIRCConnection(NULL);
+	}
 
-							if (ServerStr != NULL) {
-								ServerStr[PortStr - argv[2] - 1] = '\0';
-							}
-						}
+	if (GetOwner()->GetServer() == NULL) {
+		SENDUSER("Cannot reconnect: You haven't set a server yet.");
+	} else {
+		GetOwner()->ScheduleReconnect(5);
+	}
 
-						GetOwner()->SetPort(Port);
-						GetOwner()->SetServer((ServerStr != NULL) ? ServerStr : argv[2]);
-						
-						free(ServerStr);
-					}
-				} else {
-					SENDUSER("Syntax: /sbnc set server host port");
+	return false;
+}
 
-					return false;
-				}
-			} else if (strcasecmp(argv[1], "realname") == 0) {
-				ArgRejoinArray(argv, 2);
-				GetOwner()->SetRealname(argv[2]);
-			} else if (strcasecmp(argv[1], "awaynick") == 0) {
-				GetOwner()->SetAwayNick(argv[2]);
-			} else if (strcasecmp(argv[1], "away") == 0) {
-				ArgRejoinArray(argv, 2);
-				GetOwner()->SetAwayText(argv[2]);
-			} else if (strcasecmp(argv[1], "awaymessage") == 0) {
-				ArgRejoinArray(argv, 2);
-				GetOwner()->SetAwayMessage(argv[2]);
-			} else if (strcasecmp(argv[1], "vhost") == 0) {
-				GetOwner()->SetVHost(argv[2]);
-			} else if (strcasecmp(argv[1], "serverpass") == 0) {
-				GetOwner()->SetServerPassword(argv[2]);
-			} else if (strcasecmp(argv[1], "password") == 0) {
-				if (strlen(argv[2]) < 6 || argc > 3 || strchr(argv[2], ':') != NULL) {
-					SENDUSER("Your password is too short or contains invalid characters.");
-					return false;
-				} else {
-					GetOwner()->SetPassword(argv[2]);
-				}
-			} else if (strcasecmp(argv[1], "usequitasaway") == 0) {
-				if (strcasecmp(argv[2], "on") == 0) {
-					GetOwner()->SetUseQuitReason(true);
-				} else if (strcasecmp(argv[2], "off") == 0) {
-					GetOwner()->SetUseQuitReason(false);
-				} else {
-					SENDUSER("Value must be either 'on' or 'off'.");
+/**
+ * StatusCommand
+ *
+ * Implements the "status" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::StatusCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
 
-					return false;
-				}
-			} else if (strcasecmp(argv[1], "automodes") == 0) {
-				ArgRejoinArray(argv, 2);
-				GetOwner()->SetAutoModes(argv[2]);
-			} else if (strcasecmp(argv[1], "dropmodes") == 0) {
-				ArgRejoinArray(argv, 2);
-				GetOwner()->SetDropModes(argv[2]);
-			} else if (strcasecmp(argv[1], "ssl") == 0) {
-				if (strcasecmp(argv[2], "on") == 0) {
-					GetOwner()->SetSSL(true);
-				} else if (strcasecmp(argv[2], "off") == 0) {
-					GetOwner()->SetSSL(false);
-				} else {
-					SENDUSER("Value must be either 'on' or 'off'.");
+	rc = asprintf(&Out, "Username: %s", GetOwner()->GetUsername());
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-					return false;
-				}
-			} else if (strcasecmp(argv[1], "sysnotices") == 0) {
-				if (strcasecmp(argv[2], "on") == 0) {
-					GetOwner()->SetSystemNotices(true);
-				} else if (strcasecmp(argv[2], "off") == 0) {
-					GetOwner()->SetSystemNotices(false);
-				} else {
-					SENDUSER("Value must be either 'on' or 'off'.");
+	rc = asprintf(&Out, "This is shroudBNC %s", g_Bouncer->GetBouncerVersion());
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-					return false;
-				}
-			} else if (strcasecmp(argv[1], "autobacklog") == 0) {
-				if (strcasecmp(argv[2], "on") == 0 || strcasecmp(argv[2], "off") == 0) {
-					GetOwner()->SetAutoBacklog(argv[2]);
-				} else {
-					SENDUSER("Value must be either 'on' or 'off'.");
+	rc = asprintf(&Out, "You are %san admin.", GetOwner()->IsAdmin() ? "" : "not ");
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-					return false;
-				}
-			} else {
-				SENDUSER("Unknown setting.");
-				return false;
-			}
+	rc = asprintf(&Out, "Client: sendq: %d, recvq: %d", (int)GetSendqSize(), (int)GetRecvqSize());
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-			SENDUSER("Done.");
-		}
+	CConfig *Config = GetOwner()->GetConfig();
 
-		return false;
-#ifdef HAVE_LIBSSL
-	} else if (strcasecmp(Subcommand, "savecert") == 0) {
-		if (!IsSSL()) {
-			SENDUSER("Error: You are not using an SSL-encrypted connection.");
-		} else if (GetPeerCertificate() == NULL) {
-			SENDUSER("Error: You are not using a client certificate.");
-		} else {
-			GetOwner()->AddClientCertificate(GetPeerCertificate());
+	rc = asprintf(&Out, "Config: %u writes, last write: %u msecs, slowest write: %u msecs%s",
+		Config->GetFlushCount(), Config->GetLastFlushTime(), Config->GetMaxFlushTime(),
+		Config->IsDirty() ? " (changes pending)" : "");
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-			SENDUSER("Your certificate was stored and will be used for public key authentication.");
-		}
+	if (GetOwner()->IsAdmin()) {
+		const dnscachestats_t *DnsStats = CDnsQuery::GetCacheStats();
 
-		return false;
-	} else if (strcasecmp(Subcommand, "showcert") == 0) {
-		char Buffer[300];
-		const CVector<X509 *> *Certificates;
-		X509_NAME *name;
-		bool First = true;
+		rc = asprintf(&Out, "DNS cache: %d entries, %u hits, %u negative hits, %u misses, %u coalesced",
+			CDnsQuery::GetCacheSize(), DnsStats->Hits, DnsStats->NegativeHits,
+			DnsStats->Misses, DnsStats->Coalesced);
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
 
-		Certificates = GetOwner()->GetClientCertificates();
+		CReputationTable *Reputation = g_Bouncer->GetReputationTable();
 
-		for (int i = 0; i < Certificates->GetLength(); i++) {
-			X509 *Certificate = (*Certificates)[i];
+		rc = asprintf(&Out, "Pre-auth connections: %u (%u addresses tracked), %u rejected by connection limits, %u from blocked addresses",
+			Reputation->GetPreAuthConnections(), Reputation->GetAddressCount(),
+			Reputation->GetRejectedConnections(), Reputation->GetBlockedConnections());
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
 
-			if (First == false) {
-				SENDUSER("---");
-			} else {
-				First = false;
-			}
+#ifdef HAVE_LIBSSL
+		CSSLSessionCache *Sessions = g_Bouncer->GetSSLSessionCache();
 
-			rc = asprintf(&Out, "Client Certificate #%d", i + 1);
+		if (Sessions != NULL) {
+			rc = asprintf(&Out, "SSL sessions: %u of %u client handshakes and %u of %u IRC server handshakes were resumed",
+				Sessions->GetServerResumptions(), Sessions->GetServerHandshakes(),
+				Sessions->GetClientResumptions(), Sessions->GetClientHandshakes());
 			if (!RcFailed(rc)) {
 				SENDUSER(Out);
 				free(Out);
 			}
+		}
+#endif /* HAVE_LIBSSL */
+	}
+
+	CIRCConnection *IRC = GetOwner()->GetIRCConnection();
+
+	if (IRC) {
+		rc = asprintf(&Out, "IRC: sendq: %d, recvq: %d", (int)IRC->GetSendqSize(), (int)IRC->GetRecvqSize());
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
+
+		CFloodControl *FloodControl = IRC->GetFloodControl();
+
+		rc = asprintf(&Out, "Flood control: %u bytes, %u lines available, next line in %u msecs",
+			FloodControl->GetByteLevel(), FloodControl->GetLineLevel(), FloodControl->GetDelay());
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
+		}
 
-			name = X509_get_issuer_name(Certificate);
-			X509_NAME_oneline(name, Buffer, sizeof(Buffer));
+		CQueue *Queues[] = { IRC->GetQueueHigh(), IRC->GetQueueMiddle(), IRC->GetQueueLow() };
+		const char *QueueNames[] = { "mode", "server", "help" };
 
-			rc = asprintf(&Out, "issuer: %s", Buffer);
+		for (unsigned int i = 0; i < sizeof(Queues) / sizeof(Queues[0]); i++) {
+			rc = asprintf(&Out, "Queue %s: %d lines for %d targets", QueueNames[i],
+				Queues[i]->GetLength(), Queues[i]->GetTargetCount());
 			if (!RcFailed(rc)) {
 				SENDUSER(Out);
 				free(Out);
 			}
 
-			name = X509_get_subject_name(Certificate);
-			X509_NAME_oneline(name, Buffer, sizeof(Buffer));
+			int a = 0;
 
-			rc = asprintf(&Out, "subject: %s", Buffer);
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
+			while (const queue_target_t *Target = Queues[i]->GetTargetAt(a++)) {
+				rc = asprintf(&Out, "  %s: %d lines, waiting for %u msecs",
+					Target->Name[0] != '\0' ? Target->Name : "(no target)",
+					Target->Count, Queues[i]->GetTargetWait(Target));
+				if (!RcFailed(rc)) {
+					SENDUSER(Out);
+					free(Out);
+				}
 			}
 		}
 
-		SENDUSER("End of CERTIFICATES.");
+		SENDUSER("Channels:");
 
-		return false;
-	} else if (strcasecmp(Subcommand, "delcert") == 0) {
-		int id;
+		int a = 0;
 
-		if (argc < 2) {
-			SENDUSER("Syntax: delcert ID");
-			
-			return false;
+		while (hash_t<CChannel *> *Chan = IRC->GetChannels()->Iterate(a++)) {
+			SENDUSER(Chan->Name);
 		}
 
-		id = atoi(argv[1]);
+		SENDUSER("End of CHANNELS.");
+	}
 
-		X509 *Certificate;
-		const CVector<X509 *> *Certificates = GetOwner()->GetClientCertificates();
+	rc = asprintf(&Out, "IRC Uptime: %d seconds", GetOwner()->GetIRCUptime());
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-		if (id <= 0 || id > Certificates->GetLength()) {
-			Certificate = NULL;
-		} else {
-			Certificate = (*Certificates)[id - 1];
-		}
+	return false;
+}
 
-		if (Certificate != NULL) {
-			if (GetOwner()->RemoveClientCertificate(Certificate)) {
-				SENDUSER("Done.");
-			} else {
-				SENDUSER("An error occured while removing the certificate.");
-			}
-		} else {
-			SENDUSER("The ID you specified is not valid. Use the SHOWCERT command to get a list of valid IDs.");
-		}
+/**
+ * ImpulseCommand
+ *
+ * Implements the "impulse" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ImpulseCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: impulse command");
 
 		return false;
-#endif /* HAVE_LIBSSL */
-	} else if (strcasecmp(Subcommand, "die") == 0 && GetOwner()->IsAdmin()) {
-		g_Bouncer->Log("Shutdown requested by %s", GetOwner()->GetUsername());
-		g_Bouncer->Shutdown();
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "adduser") == 0 && GetOwner()->IsAdmin()) {
-		const char *Password;
-		char RandomPassword[10];
+	const char *Reply = g_Bouncer->DebugImpulse(atoi(argv[1]));
 
-		if (argc < 2) {
-			SENDUSER("Syntax: ADDUSER username [password]");
-			return false;
-		} else if (argc < 3) {
-			const char RandomPasswordChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	if (Reply != NULL) {
+		SENDUSER(Reply);
+	} else {
+		SENDUSER("No return value.");
+	}
 
-			RandomPassword[9] = '\0';
+	return false;
+}
 
-			for (unsigned int i = 0; i < 9; i++) {
-				RandomPassword[i] = RandomPasswordChars[rand() % (sizeof(RandomPasswordChars) - 1)];
-			}
+/**
+ * WhoCommand
+ *
+ * Implements the "who" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::WhoCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	char **Keys = g_Bouncer->GetUsers()->GetSortedKeys();
+	int Count = g_Bouncer->GetUsers()->GetLength();
 
-			Password = RandomPassword;
+	for (int i = 0; i < Count; i++) {
+		const char *Server, *ClientAddr;
+		CUser *User = g_Bouncer->GetUser(Keys[i]);
+
+		if (User == NULL) {
+			continue;
+		}
+
+		if (User->GetIRCConnection()) {
+			Server = User->GetIRCConnection()->GetServer();
 		} else {
-			Password = argv[2];
+			Server = NULL;
 		}
 
-		if (g_Bouncer->GetUser(argv[1]) != NULL) {
-			SENDUSER("The specified username is already in use.");
+		if (User->GetPrimaryClientConnection() != NULL) {
+			ClientAddr = User->GetPrimaryClientConnection()->GetPeerName();
+		} else {
+			ClientAddr = NULL;
+		}
 
-			return false;
+		const char *LastSeen;
+		tm SeenTm;
+		time_t SeenTime;
+		char strSeenTime[100];
+
+		if (User->GetLastSeen() == 0) {
+			LastSeen = "Never";
+		} else if (User->GetPrimaryClientConnection() != NULL) {
+			LastSeen = "Now";
+		} else {
+			SeenTime = User->GetLastSeen();
+			SeenTm = *localtime(&SeenTime);
+
+#ifdef _WIN32
+			strftime(strSeenTime, sizeof(strSeenTime), "%#c" , &SeenTm);
+#else
+			strftime(strSeenTime, sizeof(strSeenTime), "%a %B %d %Y %H:%M:%S" , &SeenTm);
+#endif
+
+			LastSeen = strSeenTime;
 		}
 
-		if (!g_Bouncer->IsValidUsername(argv[1])) {
-			SENDUSER("Could not create user: The username must be alpha-numeric.");
+		CIRCConnection *IRC = User->GetIRCConnection();
 
-			return false;
+		rc = asprintf(&Out, "%s%s%s%s(%s)@%s [%s] [Last seen: %s] :%s",
+			User->IsLocked() ? "!" : "",
+			User->IsAdmin() ? "@" : "",
+			ClientAddr ? "*" : "",
+			User->GetUsername(),
+			IRC ? (IRC->GetCurrentNick() ? IRC->GetCurrentNick() : "<none>") : User->GetNick(),
+			ClientAddr ? ClientAddr : "",
+			Server ? Server : "",
+			LastSeen,
+			User->GetRealname());
+
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
 		}
+	}
 
-		g_Bouncer->CreateUser(argv[1], Password);
+	free(Keys);
 
-		if (argc < 3) {
-			rc = asprintf(&Out, "The new user's password is \"%s\".", Password);
+	SENDUSER("End of USERS.");
 
-			if (RcFailed(rc)) {
-				return false;
-			}
+	return false;
+}
+
+/**
+ * ReconnectsCommand
+ *
+ * Implements the "reconnects" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ReconnectsCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
 
-			SENDUSER(Out);
+	CReconnectPlanner *Planner = g_Bouncer->GetReconnectPlanner();
+	int Queued = Planner->GetQueueLength();
 
-			free(Out);
-		}
+	if (Queued > 0) {
+		rc = asprintf(&Out, "%d users are waiting for a reconnect (%d with a reserved slot), full recovery in %d seconds.",
+			Queued, Planner->GetReservedCount(), (int)(max(Planner->GetRecoveryTime(), g_CurrentTime) - g_CurrentTime));
+	} else {
+		rc = asprintf(&Out, "No users are waiting for a reconnect.");
+	}
 
-		SENDUSER("Done.");
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "deluser") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: DELUSER username");
-			return false;
-		}
+	rc = asprintf(&Out, "Interval: %d seconds, burst: %d connects, dns prefetches: %u",
+		Planner->GetInterval(), Planner->GetBurst(), Planner->GetPrefetchCount());
 
-		if (strcasecmp(argv[1], GetOwner()->GetUsername()) == 0) {
-			SENDUSER("You cannot remove yourself.");
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-			return false;
-		}
+	for (int Type = 0; Type < 2; Type++) {
+		const CHashtable<reconnect_bucket_t *, false> *Buckets;
+		int a = 0;
 
-		RESULT<bool> Result = g_Bouncer->RemoveUser(argv[1]);
+		Buckets = (Type == 0) ? Planner->GetServerBuckets() : Planner->GetBindIpBuckets();
 
-		if (IsError(Result)) {
-			SENDUSER(GETDESCRIPTION(Result));
-		} else {
-			SENDUSER("Done.");
-		}
+		while (hash_t<reconnect_bucket_t *> *Bucket = Buckets->Iterate(a++)) {
+			int Waiting = 0;
 
-		return false;
-	} else if (strcasecmp(Subcommand, "simul") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 3) {
-			SENDUSER("Syntax: SIMUL username :command");
-			return false;
-		}
+			for (int i = 0; i < Queued; i++) {
+				CUser *User = Planner->GetQueuedUser(i);
+				const char *Name = (Type == 0) ? User->GetServer() : User->GetBindIp();
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
+				if (strcasecmp(Name ? Name : "", Bucket->Name) == 0) {
+					Waiting++;
+				}
+			}
 
-		if (User) {
-			ArgRejoinArray(argv, 2);
-			User->Simulate(argv[2], this);
+			rc = asprintf(&Out, "%s %s: %d waiting, %u connects, next free slot in %d seconds",
+				(Type == 0) ? "Server" : "Bind IP",
+				Bucket->Name[0] != '\0' ? Bucket->Name : "(default)", Waiting, Bucket->Value->Connects,
+				(int)(Planner->GetAvailableTime(Bucket->Value) - g_CurrentTime));
 
-			SENDUSER("Done.");
-		} else {
-			rc = asprintf(&Out, "No such user: %s", argv[1]);
 			if (!RcFailed(rc)) {
 				SENDUSER(Out);
 				free(Out);
 			}
 		}
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "direct") == 0) {
-		if (argc < 2) {
-			SENDUSER("Syntax: DIRECT :command");
-			return false;
-		}
+	rc = asprintf(&Out, "Registrations: %d concurrent per server and bind ip, join bursts: %d every %d seconds",
+		Planner->GetMaxRegistrations(), Planner->GetJoinBurst(), Planner->GetJoinInterval());
 
-		CIRCConnection *IRC = GetOwner()->GetIRCConnection();
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-		ArgRejoinArray(argv, 1);
-		IRC->WriteLine("%s", argv[1]);
+	int i = 0;
+	while (hash_t<admission_t *> *Admission = Planner->GetAdmissions()->Iterate(i++)) {
+		rc = asprintf(&Out, "Admission %s: %d registering, %d waiting to join, %u joins, %u deferred, next join slot in %d seconds",
+			Admission->Name, Admission->Value->Registering, Admission->Value->JoinsWaiting,
+			Admission->Value->Joins, Admission->Value->Deferred,
+			(int)(Planner->GetNextJoinTime(Admission->Value) - g_CurrentTime));
 
-		return false;
-	} else if (strcasecmp(Subcommand, "broadcast") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: BROADCAST :text");
-			return false;
+		if (!RcFailed(rc)) {
+			SENDUSER(Out);
+			free(Out);
 		}
+	}
 
-		ArgRejoinArray(argv, 1);
-		g_Bouncer->GlobalNotice(argv[1]);
-		return false;
-	} else if (strcasecmp(Subcommand, "kill") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: KILL username [reason]");
-			return false;
-		}
+	SENDUSER("End of RECONNECTS.");
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
+	return false;
+}
 
-		const char *Reason = "No reason specified.";
+/**
+ * AddListenerCommand
+ *
+ * Implements the "addlistener" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::AddListenerCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+#ifdef USESSL
+		SENDUSER("Syntax: addlistener <port> [address] [ssl]");
+#else
+		SENDUSER("Syntax: addlistener <port> [address]");
+#endif
 
-		if (argc >= 3) {
-			ArgRejoinArray(argv, 2);
-			Reason = argv[2];
-		}
+		return false;
+	}
 
-		rc = asprintf(&Out, "You were disconnected from the bouncer. (Requested by %s: %s)", GetOwner()->GetUsername(), Reason);
+	unsigned int Port = atoi(argv[1]);
 
-		if (RcFailed(rc)) {
-			return false;
-		}
+	if (Port <= 1024 || Port >= 65534) {
+		SENDUSER("You did not specify a valid port.");
 
-		if (User != NULL && User->GetClientConnectionMultiplexer() != NULL) {
-			User->GetClientConnectionMultiplexer()->Kill(Out);
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There is no such user or that user is not currently logged in.");
-		}
+		return false;
+	}
 
-		free(Out);
+	const char *Address = NULL;
 
-		return false;
-	} else if (strcasecmp(Subcommand, "disconnect") == 0) {
-		CUser *User;
+	if (argc > 2) {
+		Address = argv[2];
+	}
 
-		if (GetOwner()->IsAdmin() && argc >= 2) {
-			User = g_Bouncer->GetUser(argv[1]);
-		} else {
-			User = GetOwner();
-		}
+	bool SSL = false;
 
-		if (User == NULL) {
-			SENDUSER("There is no such user.");
-			return false;
+#ifdef USESSL
+	if (argc > 3) {
+		if (atoi(argv[3]) != 0 || strcasecmp(argv[3], "ssl") == 0) {
+			SSL = true;
 		}
+	}
+#endif
 
-		CIRCConnection *IRC = User->GetIRCConnection();
+	RESULT<bool> Result = g_Bouncer->AddAdditionalListener(Port, Address, SSL);
 
-		User->MarkQuitted(true);
+	if (IsError(Result)) {
+		SENDUSER(GETDESCRIPTION(Result));
 
-		if (IRC == NULL) {
-			if (User == GetOwner()) {
-				SENDUSER("You are not connected to a server.");
-			} else {
-				SENDUSER("The user is not connected to a server.");
-			}
+		return false;
+	}
 
-			return false;
-		}
+	SENDUSER("Done.");
 
-		IRC->Kill("Requested.");
+	return false;
+}
 
-		SENDUSER("Done.");
+/**
+ * DelListenerCommand
+ *
+ * Implements the "dellistener" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::DelListenerCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: dellistener <port>");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "jump") == 0) {
-		if (GetOwner()->GetIRCConnection()) {
-			GetOwner()->GetIRCConnection()->Kill("Reconnecting");
+	}
 
-			GetOwner()->SetIRCConnection(NULL);
-		}
+	RESULT<bool> Result = g_Bouncer->RemoveAdditionalListener(atoi(argv[1]));
 
-		if (GetOwner()->GetServer() == NULL) {
-			SENDUSER("Cannot reconnect: You haven't set a server yet.");
-		} else {
-			GetOwner()->ScheduleReconnect(5);
-		}
+	if (Result) {
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There is no such listener.");
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "status") == 0) {
-		rc = asprintf(&Out, "Username: %s", GetOwner()->GetUsername());
-		if (!RcFailed(rc)) {
-			SENDUSER(Out);
-			free(Out);
-		}
+	return false;
+}
 
-		rc = asprintf(&Out, "This is shroudBNC %s", g_Bouncer->GetBouncerVersion());
-		if (!RcFailed(rc)) {
-			SENDUSER(Out);
-			free(Out);
-		}
+/**
+ * ExportConfigCommand
+ *
+ * Implements the "exportconfig" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ExportConfigCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
 
-		rc = asprintf(&Out, "You are %san admin.", GetOwner()->IsAdmin() ? "" : "not ");
-		if (!RcFailed(rc)) {
-			SENDUSER(Out);
-			free(Out);
-		}
+	int i = 0, Count = 0;
 
-		rc = asprintf(&Out, "Client: sendq: %d, recvq: %d", (int)GetSendqSize(), (int)GetRecvqSize());
-		if (!RcFailed(rc)) {
-			SENDUSER(Out);
-			free(Out);
-		}
+	while (hash_t<CUser *> *User = g_Bouncer->GetUsers()->Iterate(i++)) {
+		CConfig *Config = User->Value->GetConfig();
+		RESULT<bool> Result = Config->Export(Config->GetFilename());
 
-		CIRCConnection *IRC = GetOwner()->GetIRCConnection();
+		if (IsError(Result)) {
+			rc = asprintf(&Out, "Could not export settings for user %s: %s", User->Name, GETDESCRIPTION(Result));
 
-		if (IRC) {
-			rc = asprintf(&Out, "IRC: sendq: %d, recvq: %d", (int)IRC->GetSendqSize(), (int)IRC->GetRecvqSize());
 			if (!RcFailed(rc)) {
 				SENDUSER(Out);
 				free(Out);
 			}
+		} else {
+			Count++;
+		}
+	}
 
-			SENDUSER("Channels:");
+	rc = asprintf(&Out, "Exported the settings of %d users.", Count);
 
-			int a = 0;
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
 
-			while (hash_t<CChannel *> *Chan = IRC->GetChannels()->Iterate(a++)) {
-				SENDUSER(Chan->Name);
-			}
+	return false;
+}
 
-			SENDUSER("End of CHANNELS.");
-		}
+/**
+ * ListenersCommand
+ *
+ * Implements the "listeners" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ListenersCommand(int argc, const char **argv, bool NoticeUser) {
+	char *Out;
+	int rc;
+
+	if (g_Bouncer->GetMainListener() != NULL) {
+		rc = asprintf(&Out, "Main listener: port %d", g_Bouncer->GetMainListener()->GetPort());
+	} else {
+		Out = strdup("Main listener: none");
+		rc = (Out == NULL) ? -1 : 0;
+	}
+
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
+
+#ifdef USESSL
+	if (g_Bouncer->GetMainSSLListener() != NULL) {
+		rc = asprintf(&Out, "Main SSL listener: port %d", g_Bouncer->GetMainSSLListener()->GetPort());
+	} else {
+		Out = strdup("Main SSL listener: none");
+		rc = (Out == NULL) ? -1 : 0;
+	}
+
+	if (!RcFailed(rc)) {
+		SENDUSER(Out);
+		free(Out);
+	}
+#endif
+
+	SENDUSER("---");
+	SENDUSER("Additional listeners:");
+
+	CVector<additionallistener_t> *Listeners = g_Bouncer->GetAdditionalListeners();
 
-		rc = asprintf(&Out, "IRC Uptime: %d seconds", GetOwner()->GetIRCUptime());
+	for (int i = 0; i < Listeners->GetLength(); i++) {
+#ifdef USESSL
+		if ((*Listeners)[i].SSL) {
+			if ((*Listeners)[i].BindAddress != NULL) {
+				rc = asprintf(&Out, "Port: %d (SSL, bound to %s)", (*Listeners)[i].Port, (*Listeners)[i].BindAddress);
+			} else {
+				rc = asprintf(&Out, "Port: %d (SSL)", (*Listeners)[i].Port);
+			}
+		} else {
+#endif
+			if ((*Listeners)[i].BindAddress != NULL) {
+				rc = asprintf(&Out, "Port: %d (bound to %s)", (*Listeners)[i].Port, (*Listeners)[i].BindAddress);
+			} else {
+				rc = asprintf(&Out, "Port: %d", (*Listeners)[i].Port);
+			}
+#ifdef USESSL
+		}
+#endif
 		if (!RcFailed(rc)) {
 			SENDUSER(Out);
 			free(Out);
 		}
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "impulse") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: impulse command");
+	SENDUSER("End of LISTENERS.");
 
-			return false;
-		}
+	return false;
+}
+
+/**
+ * ReadCommand
+ *
+ * Implements the "read" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ReadCommand(int argc, const char **argv, bool NoticeUser) {
+	PlayLogCommand(GetOwner()->GetLog(), argc, argv, NoticeUser, "read", "erase", "Your personal log is empty.");
 
-		const char *Reply = g_Bouncer->DebugImpulse(atoi(argv[1]));
+	return false;
+}
 
-		if (Reply != NULL) {
-			SENDUSER(Reply);
-		} else {
-			SENDUSER("No return value.");
-		}
+/**
+ * EraseCommand
+ *
+ * Implements the "erase" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::EraseCommand(int argc, const char **argv, bool NoticeUser) {
+	if (GetOwner()->GetLog()->IsEmpty()) {
+		SENDUSER("Your personal log is empty.");
+	} else {
+		GetOwner()->GetLog()->Clear();
+		SENDUSER("Done.");
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "who") == 0 && GetOwner()->IsAdmin()) {
-		char **Keys = g_Bouncer->GetUsers()->GetSortedKeys();
-		int Count = g_Bouncer->GetUsers()->GetLength();
+	return false;
+}
 
-		for (int i = 0; i < Count; i++) {
-			const char *Server, *ClientAddr;
-			CUser *User = g_Bouncer->GetUser(Keys[i]);
+/**
+ * PlayMainLogCommand
+ *
+ * Implements the "playmainlog" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::PlayMainLogCommand(int argc, const char **argv, bool NoticeUser) {
+	PlayLogCommand(g_Bouncer->GetLog(), argc, argv, NoticeUser, "playmainlog", "erasemainlog", "The main log is empty.");
 
-			if (User == NULL) {
-				continue;
-			}
+	return false;
+}
 
-			if (User->GetIRCConnection()) {
-				Server = User->GetIRCConnection()->GetServer();
-			} else {
-				Server = NULL;
-			}
+/**
+ * EraseMainLogCommand
+ *
+ * Implements the "erasemainlog" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::EraseMainLogCommand(int argc, const char **argv, bool NoticeUser) {
+	g_Bouncer->GetLog()->Clear();
+	g_Bouncer->Log("User %s erased the main log", GetOwner()->GetUsername());
+	SENDUSER("Done.");
 
-			if (User->GetPrimaryClientConnection() != NULL) {
-				ClientAddr = User->GetPrimaryClientConnection()->GetPeerName();
-			} else {
-				ClientAddr = NULL;
-			}
+	return false;
+}
+
+/**
+ * AdminCommand
+ *
+ * Implements the "admin" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::AdminCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: ADMIN username");
 
-			const char *LastSeen;
-			tm SeenTm;
-			time_t SeenTime;
-			char strSeenTime[100];
+		return false;
+	}
 
-			if (User->GetLastSeen() == 0) {
-				LastSeen = "Never";
-			} else if (User->GetPrimaryClientConnection() != NULL) {
-				LastSeen = "Now";
-			} else {
-				SeenTime = User->GetLastSeen();
-				SeenTm = *localtime(&SeenTime);
+	CUser *User = g_Bouncer->GetUser(argv[1]);
 
-#ifdef _WIN32
-				strftime(strSeenTime, sizeof(strSeenTime), "%#c" , &SeenTm);
-#else
-				strftime(strSeenTime, sizeof(strSeenTime), "%a %B %d %Y %H:%M:%S" , &SeenTm);
-#endif
+	if (User) {
+		User->SetAdmin(true);
+
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There's no such user.");
+	}
 
-				LastSeen = strSeenTime;
-			}
+	return false;
+}
 
-			CIRCConnection *IRC = User->GetIRCConnection();
+/**
+ * UnadminCommand
+ *
+ * Implements the "unadmin" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::UnadminCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: UNADMIN username");
 
-			rc = asprintf(&Out, "%s%s%s%s(%s)@%s [%s] [Last seen: %s] :%s",
-				User->IsLocked() ? "!" : "",
-				User->IsAdmin() ? "@" : "",
-				ClientAddr ? "*" : "",
-				User->GetUsername(),
-				IRC ? (IRC->GetCurrentNick() ? IRC->GetCurrentNick() : "<none>") : User->GetNick(),
-				ClientAddr ? ClientAddr : "",
-				Server ? Server : "",
-				LastSeen,
-				User->GetRealname());
+		return false;
+	}
 
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
-		}
+	CUser *User = g_Bouncer->GetUser(argv[1]);
+	
+	if (User) {
+		User->SetAdmin(false);
+
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There's no such user.");
+	}
 
-		free(Keys);
+	return false;
+}
 
-		SENDUSER("End of USERS.");
+/**
+ * SuspendCommand
+ *
+ * Implements the "suspend" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::SuspendCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: SUSPEND username :reason");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "addlistener") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-#ifdef USESSL
-			SENDUSER("Syntax: addlistener <port> [address] [ssl]");
-#else
-			SENDUSER("Syntax: addlistener <port> [address]");
-#endif
+	}
 
-			return false;
-		}
+	CUser *User = g_Bouncer->GetUser(argv[1]);
 
-		unsigned int Port = atoi(argv[1]);
+	if (User) {
+		User->Lock();
 
-		if (Port <= 1024 || Port >= 65534) {
-			SENDUSER("You did not specify a valid port.");
+		if (User->GetClientConnectionMultiplexer() != NULL) {
+			User->GetClientConnectionMultiplexer()->Kill("Your account has been suspended.");
+		}
 
-			return false;
+		if (User->GetIRCConnection() != NULL) {
+			User->GetIRCConnection()->Kill("Requested.");
 		}
 
-		const char *Address = NULL;
+		User->MarkQuitted(true);
 
 		if (argc > 2) {
-			Address = argv[2];
+			ArgRejoinArray(argv, 2);
+			User->SetSuspendReason(argv[2]);
+		} else {
+			User->SetSuspendReason("Suspended.");
 		}
 
-		bool SSL = false;
+		g_Bouncer->Log("User %s has been suspended.", User->GetUsername());
 
-#ifdef USESSL
-		if (argc > 3) {
-			if (atoi(argv[3]) != 0 || strcasecmp(argv[3], "ssl") == 0) {
-				SSL = true;
-			}
-		}
-#endif
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There's no such fnord.");
+	}
 
-		RESULT<bool> Result = g_Bouncer->AddAdditionalListener(Port, Address, SSL);
+	return false;
+}
 
-		if (IsError(Result)) {
-			SENDUSER(GETDESCRIPTION(Result));
+/**
+ * UnsuspendCommand
+ *
+ * Implements the "unsuspend" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::UnsuspendCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: UNSUSPEND username");
 
-			return false;
-		}
+		return false;
+	}
 
-		SENDUSER("Done.");
+	CUser *User = g_Bouncer->GetUser(argv[1]);
+	
+	if (User) {
+		User->Unlock();
 
-		return false;
-	} else if (strcasecmp(Subcommand, "dellistener") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: dellistener <port>");
+		g_Bouncer->Log("User %s has been unsuspended.", User->GetUsername());
 
-			return false;
-		}
+		User->SetSuspendReason(NULL);
 
-		RESULT<bool> Result = g_Bouncer->RemoveAdditionalListener(atoi(argv[1]));
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There's no such user.");
+	}
 
-		if (Result) {
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There is no such listener.");
-		}
+	return false;
+}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "listeners") == 0 && GetOwner()->IsAdmin()) {
-		if (g_Bouncer->GetMainListener() != NULL) {
-			rc = asprintf(&Out, "Main listener: port %d", g_Bouncer->GetMainListener()->GetPort());
-		} else {
-			Out = strdup("Main listener: none");
-			rc = (Out == NULL) ? -1 : 0;
-		}
+/**
+ * ResetPassCommand
+ *
+ * Implements the "resetpass" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::ResetPassCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 3) {
+		SENDUSER("Syntax: RESETPASS username new-password");
 
-		if (!RcFailed(rc)) {
-			SENDUSER(Out);
-			free(Out);
-		}
+		return false;
+	}
 
-#ifdef USESSL
-		if (g_Bouncer->GetMainSSLListener() != NULL) {
-			rc = asprintf(&Out, "Main SSL listener: port %d", g_Bouncer->GetMainSSLListener()->GetPort());
-		} else {
-			Out = strdup("Main SSL listener: none");
-			rc = (Out == NULL) ? -1 : 0;
-		}
+	CUser *User = g_Bouncer->GetUser(argv[1]);
+	
+	if (User) {
+		User->SetPassword(argv[2]);
 
-		if (!RcFailed(rc)) {
-			SENDUSER(Out);
-			free(Out);
-		}
-#endif
+		SENDUSER("Done.");
+	} else {
+		SENDUSER("There's no such user.");
+	}
 
-		SENDUSER("---");
-		SENDUSER("Additional listeners:");
+	return false;
+}
 
-		CVector<additionallistener_t> *Listeners = g_Bouncer->GetAdditionalListeners();
+/**
+ * PartAllCommand
+ *
+ * Implements the "partall" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::PartAllCommand(int argc, const char **argv, bool NoticeUser) {
+	if (GetOwner()->GetIRCConnection()) {
+		const char *Channels = GetOwner()->GetConfigChannels();
 
-		for (int i = 0; i < Listeners->GetLength(); i++) {
-#ifdef USESSL
-			if ((*Listeners)[i].SSL) {
-				if ((*Listeners)[i].BindAddress != NULL) {
-					rc = asprintf(&Out, "Port: %d (SSL, bound to %s)", (*Listeners)[i].Port, (*Listeners)[i].BindAddress);
-				} else {
-					rc = asprintf(&Out, "Port: %d (SSL)", (*Listeners)[i].Port);
-				}
-			} else {
-#endif
-				if ((*Listeners)[i].BindAddress != NULL) {
-					rc = asprintf(&Out, "Port: %d (bound to %s)", (*Listeners)[i].Port, (*Listeners)[i].BindAddress);
-				} else {
-					rc = asprintf(&Out, "Port: %d", (*Listeners)[i].Port);
-				}
-#ifdef USESSL
-			}
-#endif
-			if (!RcFailed(rc)) {
-				SENDUSER(Out);
-				free(Out);
-			}
+		if (Channels != NULL) {
+			GetOwner()->GetIRCConnection()->WriteLine("PART %s", Channels);
 		}
+	}
 
-		SENDUSER("End of LISTENERS.");
+	GetOwner()->SetConfigChannels(NULL);
 
-		return false;
-	} else if (strcasecmp(Subcommand, "read") == 0) {
-		GetOwner()->GetLog()->PlayToUser(this, NoticeUser ? Log_Notice : Log_Message);
+	SENDUSER("Done.");
 
-		if (!GetOwner()->GetLog()->IsEmpty()) {
-			if (NoticeUser) {
-				RealNotice("End of LOG. Use '/sbnc erase' to remove this log.");
-			} else {
-				Privmsg("End of LOG. Use '/msg -sBNC erase' to remove this log.");
-			}
-		} else {
-			SENDUSER("Your personal log is empty.");
-		}
+	return false;
+}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "erase") == 0) {
-		if (GetOwner()->GetLog()->IsEmpty()) {
-			SENDUSER("Your personal log is empty.");
-		} else {
-			GetOwner()->GetLog()->Clear();
-			SENDUSER("Done.");
-		}
+/**
+ * BacklogCommand
+ *
+ * Implements the "backlog" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::BacklogCommand(int argc, const char **argv, bool NoticeUser) {
+	if (argc < 2) {
+		SENDUSER("Syntax: BACKLOG #channel");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "playmainlog") == 0 && GetOwner()->IsAdmin()) {
-		g_Bouncer->GetLog()->PlayToUser(this, NoticeUser ? Log_Notice : Log_Message);
+	}
 
-		if (!g_Bouncer->GetLog()->IsEmpty()) {
-			if (NoticeUser) {
-				RealNotice("End of LOG. Use /sbnc erasemainlog to remove this log.");
-			} else {
-				Privmsg("End of LOG. Use /msg -sBNC erasemainlog to remove this log.");
-			}
-		} else {
-			SENDUSER("The main log is empty.");
-		}
+	if (GetOwner()->GetIRCConnection() == NULL) {
+		SENDUSER("You need to be connected to an IRC server for this command to work.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "erasemainlog") == 0 && GetOwner()->IsAdmin()) {
-		g_Bouncer->GetLog()->Clear();
-		g_Bouncer->Log("User %s erased the main log", GetOwner()->GetUsername());
-		SENDUSER("Done.");
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "admin") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: ADMIN username");
+	CChannel *Channel = GetOwner()->GetIRCConnection()->GetChannel(argv[1]);
 
-			return false;
-		}
+	if (Channel == NULL) {
+		SENDUSER("You are not on the channel you specified.");
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
+		return false;
+	}
 
-		if (User) {
-			User->SetAdmin(true);
+	Channel->PlayBacklog(this);
 
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There's no such user.");
-		}
+	SENDUSER("Done.");
 
-		return false;
-	} else if (strcasecmp(Subcommand, "unadmin") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: UNADMIN username");
+	return false;
+}
 
-			return false;
-		}
+/**
+ * EraseBacklogCommand
+ *
+ * Implements the "erasebacklog" command.
+ *
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send replies as notices
+ */
+bool CClientConnection::EraseBacklogCommand(int argc, const char **argv, bool NoticeUser) {
+	CIRCConnection *IRC;
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
-		
-		if (User) {
-			User->SetAdmin(false);
+	IRC = GetOwner()->GetIRCConnection();
 
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There's no such user.");
-		}
+	if (IRC == NULL) {
+		SENDUSER("You need to be connected to an IRC server for this command to work.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "suspend") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: SUSPEND username :reason");
-
-			return false;
-		}
+	}
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
+	if (argc >= 2) {
+		CChannel *Channel = GetOwner()->GetIRCConnection()->GetChannel(argv[1]);
 
-		if (User) {
-			User->Lock();
+		if (Channel == NULL) {
+			SENDUSER("You are not on the channel you specified.");
 
-			if (User->GetClientConnectionMultiplexer() != NULL) {
-				User->GetClientConnectionMultiplexer()->Kill("Your account has been suspended.");
-			}
+			return false;
+		}
 
-			if (User->GetIRCConnection() != NULL) {
-				User->GetIRCConnection()->Kill("Requested.");
-			}
+		Channel->EraseBacklog();
+	} else {
+		int a = 0;
 
-			User->MarkQuitted(true);
+		while (hash_t<CChannel *> *Chan = IRC->GetChannels()->Iterate(a++)) {
+			Chan->Value->EraseBacklog();
+		}
+	}
 
-			if (argc > 2) {
-				ArgRejoinArray(argv, 2);
-				User->SetSuspendReason(argv[2]);
-			} else {
-				User->SetSuspendReason("Suspended.");
-			}
+	SENDUSER("Done.");
 
-			g_Bouncer->Log("User %s has been suspended.", User->GetUsername());
+	return false;
+}
 
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There's no such fnord.");
-		}
+/**
+ * PlayLogCommand
+ *
+ * Implements the "read" and "playmainlog" commands.
+ *
+ * @param Log the log which is to be played
+ * @param argc number of parameters for the command
+ * @param argv arguments for the command
+ * @param NoticeUser whether to send notices to the user
+ * @param Command the name of the command
+ * @param EraseCommand the name of the command which erases the log
+ * @param EmptyMessage the message which is sent if the log is empty
+ */
+void CClientConnection::PlayLogCommand(const CLog *Log, int argc, const char **argv, bool NoticeUser,
+		const char *Command, const char *EraseCommand, const char *EmptyMessage) {
+	char *Trailer;
+	int Lines, Offset, Count, rc;
 
-		return false;
-	} else if (strcasecmp(Subcommand, "unsuspend") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 2) {
-			SENDUSER("Syntax: UNSUSPEND username");
+	Lines = Log->GetLineCount();
 
-			return false;
-		}
+	if (Lines == 0) {
+		SENDUSER(EmptyMessage);
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
-		
-		if (User) {
-			User->Unlock();
+		return;
+	}
 
-			g_Bouncer->Log("User %s has been unsuspended.", User->GetUsername());
+	Offset = (argc > 1) ? atoi(argv[1]) : 0;
 
-			User->SetSuspendReason(NULL);
+	if (Offset < 0) {
+		Offset = max(Lines + Offset, 0);
+	}
 
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There's no such user.");
-		}
+	Count = (argc > 2) ? atoi(argv[2]) : Lines;
 
-		return false;
-	} else if (strcasecmp(Subcommand, "resetpass") == 0 && GetOwner()->IsAdmin()) {
-		if (argc < 3) {
-			SENDUSER("Syntax: RESETPASS username new-password");
+	if (Offset >= Lines || Count <= 0) {
+		rc = asprintf(&Trailer, "Syntax: %s [offset] [count] - the log has %d lines.", Command, Lines);
 
-			return false;
+		if (!RcFailed(rc)) {
+			SENDUSER(Trailer);
+			free(Trailer);
 		}
 
-		CUser *User = g_Bouncer->GetUser(argv[1]);
-		
-		if (User) {
-			User->SetPassword(argv[2]);
-
-			SENDUSER("Done.");
-		} else {
-			SENDUSER("There's no such user.");
-		}
+		return;
+	}
 
-		return false;
-	} else if (strcasecmp(Subcommand, "partall") == 0) {
-		if (GetOwner()->GetIRCConnection()) {
-			const char *Channels = GetOwner()->GetConfigChannels();
+	Count = min(Count, Lines - Offset);
 
-			if (Channels != NULL) {
-				GetOwner()->GetIRCConnection()->WriteLine("PART %s", Channels);
-			}
-		}
+	if (Offset + Count < Lines) {
+		rc = asprintf(&Trailer, "Displayed lines %d-%d of %d. Use '%s %s %d' to display more.",
+			Offset + 1, Offset + Count, Lines, NoticeUser ? "/sbnc" : "/msg -sBNC", Command, Offset + Count);
+	} else {
+		rc = asprintf(&Trailer, "End of LOG. Use '%s %s' to remove this log.",
+			NoticeUser ? "/sbnc" : "/msg -sBNC", EraseCommand);
+	}
 
-		GetOwner()->SetConfigChannels(NULL);
+	if (RcFailed(rc)) {
+		return;
+	}
 
-		SENDUSER("Done.");
+	PlayLog(Log, NoticeUser, Offset, Count, Trailer);
 
-		return false;
-	} else if (strcasecmp(Subcommand, "backlog") == 0) {
-		if (argc < 2) {
-			SENDUSER("Syntax: BACKLOG #channel");
+	free(Trailer);
+}
 
-			return false;
-		}
+/**
+ * PlayLog
+ *
+ * Starts sending a range of lines from a log to the client. The lines
+ * are queued page by page as the client's sendq drains.
+ *
+ * @param Log the log
+ * @param NoticeUser whether to use notices rather than messages
+ * @param Offset the first line
+ * @param Count the number of lines
+ * @param Trailer a message which is sent after the last line, or NULL
+ */
+void CClientConnection::PlayLog(const CLog *Log, bool NoticeUser, int Offset, int Count, const char *Trailer) {
+	CLogPlayback *Playback;
 
-		if (GetOwner()->GetIRCConnection() == NULL) {
-			SENDUSER("You need to be connected to an IRC server for this command to work.");
+	Playback = new CLogPlayback(Log, this, NoticeUser ? Log_Notice : Log_Message, Offset, Count, Trailer);
 
-			return false;
-		}
+	if (AllocFailed(Playback)) {
+		return;
+	}
 
-		CChannel *Channel = GetOwner()->GetIRCConnection()->GetChannel(argv[1]);
+	AddProducer(Playback);
+}
 
-		if (Channel == NULL) {
-			SENDUSER("You are not on the channel you specified.");
+/**
+ * AddProducer
+ *
+ * Queues a producer for the client. Producers are run one after another
+ * whenever the client's sendq has drained. Lines which are written for the
+ * client while there are producers are sent after the producers have finished.
+ * The client takes ownership of the producer.
+ *
+ * @param Producer the producer
+ */
+void CClientConnection::AddProducer(COutputProducer *Producer) {
+	/* connections without a socket never become writable */
+	if (GetSocket() == INVALID_SOCKET && m_Producers.GetHead() == NULL) {
+		m_Producing = true;
 
-			return false;
+		while (GetOwner() != NULL && Producer->Produce(PRODUCER_BUDGET)) {
+			/* do nothing */
 		}
 
-		Channel->PlayBacklog(this);
+		m_Producing = false;
 
-		SENDUSER("Done.");
+		delete Producer;
 
-		return false;
-	} else if (strcasecmp(Subcommand, "erasebacklog") == 0) {
-		CIRCConnection *IRC;
+		return;
+	}
+
+	if (IsError(m_Producers.Insert(Producer))) {
+		delete Producer;
+	}
+}
 
-		IRC = GetOwner()->GetIRCConnection();
+/**
+ * RunProducers
+ *
+ * Lets the client's producers queue up to PRODUCER_BUDGET bytes.
+ */
+void CClientConnection::RunProducers(void) {
+	link_t<COutputProducer *> *Head;
+	size_t Limit = GetSendqSize() + PRODUCER_BUDGET;
+	bool More;
 
-		if (IRC == NULL) {
-			SENDUSER("You need to be connected to an IRC server for this command to work.");
+	while ((Head = m_Producers.GetHead()) != NULL && GetSendqSize() < Limit) {
+		if (GetOwner() == NULL) {
+			ClearProducers();
 
-			return false;
+			return;
 		}
 
-		if (argc >= 2) {
-			CChannel *Channel = GetOwner()->GetIRCConnection()->GetChannel(argv[1]);
+		m_Producing = true;
+		More = Head->Value->Produce(Limit - GetSendqSize());
+		m_Producing = false;
 
-			if (Channel == NULL) {
-				SENDUSER("You are not on the channel you specified.");
+		if (More) {
+			break;
+		}
 
-				return false;
-			}
+		delete Head->Value;
+		m_Producers.Remove(Head);
+	}
 
-			Channel->EraseBacklog();
-		} else {
-			int a = 0;
+	if (m_Producers.GetHead() == NULL && m_DeferredQ != NULL && m_DeferredQ->GetSize() > 0) {
+		m_SendQ->Append(m_DeferredQ);
+	}
+}
 
-			while (hash_t<CChannel *> *Chan = IRC->GetChannels()->Iterate(a++)) {
-				Chan->Value->EraseBacklog();
-			}
-		}
+/**
+ * ClearProducers
+ *
+ * Removes all producers and queues the lines which have been
+ * deferred because of them.
+ */
+void CClientConnection::ClearProducers(void) {
+	link_t<COutputProducer *> *Head;
 
-		SENDUSER("Done.");
+	while ((Head = m_Producers.GetHead()) != NULL) {
+		delete Head->Value;
+		m_Producers.Remove(Head);
+	}
 
-		return false;
+	if (m_DeferredQ != NULL && m_DeferredQ->GetSize() > 0) {
+		m_SendQ->Append(m_DeferredQ);
 	}
+}
 
-	if (NoticeUser) {
-		RealNotice("Unknown command. Try /sbnc help");
-	} else {
-		Privmsg("Unknown command. Try /msg -sBNC help");
+/**
+ * GetDeferredQ
+ *
+ * Returns the queue for lines which are deferred because of producers.
+ */
+CFIFOBuffer *CClientConnection::GetDeferredQ(void) {
+	if (m_DeferredQ == NULL) {
+		m_DeferredQ = new CFIFOBuffer();
+
+		if (AllocFailed(m_DeferredQ)) {
+			g_Bouncer->Fatal();
+		}
 	}
 
-	return false;
+	return m_DeferredQ;
 }
 
 /**
@@ -1571,7 +2545,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 			if (m_Nick != NULL && m_Username != NULL) {
 				ValidSSLCert = ValidateUser();
 
-				if (!ValidSSLCert) {
+				if (!ValidSSLCert && m_PasswordCheck == NULL && GetOwner() == NULL) {
 					WriteUnformattedLine(":shroudbnc.info NOTICE AUTH :*** This server requires "
 						"a password. Use /QUOTE PASS thepassword to supply a password now.");
 				}
@@ -1598,8 +2572,10 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 				char caps[512];
 
 				caps[0] = '\0';
-				int i;
-				while (hash_t<const char *> *CapHash = m_Capabilities->Iterate(i++)) {
+				int i = 0;
+				hash_t<const char *> *CapHash;
+
+				while (m_Capabilities != NULL && (CapHash = m_Capabilities->Iterate(i++)) != NULL) {
 					strcat(caps, CapHash->Value);
 					strcat(caps, " ");
 				}
@@ -1609,13 +2585,17 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 				char caps[512];
 
 				caps[0] = '\0';
-				int i;
-				while (hash_t<const char *> *CapHash = m_Capabilities->Iterate(i++)) {
+				int i = 0;
+				hash_t<const char *> *CapHash;
+
+				while (m_Capabilities != NULL && (CapHash = m_Capabilities->Iterate(i++)) != NULL) {
 					strcat(caps, CapHash->Value);
 					strcat(caps, " ");
 				}
 
-				m_Capabilities->Clear();
+				if (m_Capabilities != NULL) {
+					m_Capabilities->Clear();
+				}
 
 				WriteLine(":shroudbnc.info CAP * ACK :%s", caps);
 			} else if (argc > 1 && strcasecmp(argv[1], "end") == 0) {
@@ -1658,7 +2638,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 						for (int i = 0; i < g_Bouncer->GetCapabilities()->GetLength(); i++) {
 							const char *cap = g_Bouncer->GetCapabilities()->Get(i);
 							if (strcasecmp(cap, capsv[a]) == 0) {
-								m_Capabilities->Add(cap, cap);
+								GetCapabilities()->Add(cap, cap);
 								break;
 							}
 						}
@@ -1894,82 +2874,11 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 					CChannel *Chan = IRC->GetChannel(argv[2]);
 
 					if (Chan && Chan->HasNames() != 0) {
-						char *Nicks = (char *)malloc(1);
-
-						if (Nicks == NULL) {
-							Kill("CClientConnection::ParseLineArgV: malloc() failed. Please reconnect.");
-
-							return false;
-						}
-
-						Nicks[0] = '\0';
-
-						const CHashtable<CNick *, false> *H = Chan->GetNames();
-
-						int a = 0;
-
-						while (hash_t<CNick *> *NickHash = H->Iterate(a++)) {
-							size_t Size;
-							CNick *NickObj = NickHash->Value;
-
-							const char *Prefix = NickObj->GetPrefixes();
-							const char *Nick = NickObj->GetNick();
-
-							const char *outPref;
-							char outPrefTemp[2] = { IRC->GetHighestUserFlag(Prefix), '\0' };
-
-							if (m_NamesXSupport) {
-								if (Prefix != NULL) {
-									outPref = Prefix;
-								} else {
-									outPref = "";
-								}
-							} else {
-								outPref = outPrefTemp;
-							}
-
-							if (Nick == NULL) {
-								continue;
-							}
-
-							Size = strlen(Nicks) + strlen(outPref) + strlen(Nick) + 2;
-							Nicks = (char *)realloc(Nicks, Size);
-
-							if (Nicks == NULL) {
-								Kill("CClientConnection::ParseLineArgV: realloc() failed. Please reconnect.");
-
-								return false;
-							}
-
-							if (Nicks[0] != '\0') {
-								strmcat(Nicks, " ", Size);
-							}
-
-							strmcat(Nicks, outPref, Size);
-							strmcat(Nicks, Nick, Size);
-
-							if (strlen(Nicks) > 400) {
-								WriteLine(":%s 353 %s = %s :%s", IRC->GetServer(), IRC->GetCurrentNick(), argv[2], Nicks);
-
-								Nicks = (char *)realloc(Nicks, 1);
-
-								if (Nicks == NULL) {
-									Kill("CClientConnection::ParseLineArgV: realloc() failed. Please reconnect.");
-
-									return false;
-								}
+						CNamesProducer *Names = new CNamesProducer(this, argv[2]);
 
-								*Nicks = '\0';
-							}
-						}
-
-						if (Nicks[0] != '\0') {
-							WriteLine(":%s 353 %s = %s :%s", IRC->GetServer(), IRC->GetCurrentNick(), argv[2], Nicks);
+						if (!AllocFailed(Names)) {
+							AddProducer(Names);
 						}
-
-						free(Nicks);
-
-						WriteLine(":%s 366 %s %s :End of /NAMES list.", IRC->GetServer(), IRC->GetCurrentNick(), argv[2]);
 					} else {
 						IRC->WriteLine("NAMES %s", argv[2]);
 					}
@@ -2168,10 +3077,10 @@ void CClientConnection::ParseLine(const char *Line) {
 bool CClientConnection::ValidateUser(void) {
 	bool Force = false;
 	CUser *User;
-	bool Blocked = true, Valid = false;
+	bool Blocked = false, Valid = false;
 	sockaddr *Remote;
 
-	if (m_CapabilitiesEnd || m_Username == NULL || m_Password == NULL) {
+	if (m_CapabilitiesEnd || m_Username == NULL || m_Password == NULL || m_PasswordCheck != NULL || m_LoginPending) {
 		return false;
 	}
 
@@ -2202,25 +3111,23 @@ bool CClientConnection::ValidateUser(void) {
 	CUser *AuthUser = NULL;
 
 	if (IsSSL() && (PeerCert = (X509 *)GetPeerCertificate()) != NULL) {
-		int i = 0;
+		const CVector<CUser *> *CertUsers = g_Bouncer->GetCertificateUsers(PeerCert);
 
-		if (!g_Bouncer->GetDontMatchUser()) {
-			CUser *User = g_Bouncer->GetUser(m_Username);
+		for (int i = 0; CertUsers != NULL && i < CertUsers->GetLength(); i++) {
+			CUser *CertUser = (*CertUsers)[i];
 
-			if (User != NULL && User->FindClientCertificate(PeerCert)) {
-				AuthUser = User;
-				MatchUsername = true;
-				Count = 1;
-			}
-		} else {
-			while (hash_t<CUser *> *UserHash = g_Bouncer->GetUsers()->Iterate(i++)) {
-				if (UserHash->Value->FindClientCertificate(PeerCert)) {
-					AuthUser = UserHash->Value;
-					Count++;
+			if (!g_Bouncer->GetDontMatchUser()) {
+				if (strcasecmp(CertUser->GetUsername(), m_Username) == 0) {
+					AuthUser = CertUser;
+					MatchUsername = true;
+					Count = 1;
+				}
+			} else {
+				AuthUser = CertUser;
+				Count++;
 
-					if (strcasecmp(UserHash->Name, m_Username) == 0) {
-						MatchUsername = true;
-					}
+				if (strcasecmp(CertUser->GetUsername(), m_Username) == 0) {
+					MatchUsername = true;
 				}
 			}
 		}
@@ -2246,17 +3153,130 @@ bool CClientConnection::ValidateUser(void) {
 
 	if (User) {
 		Blocked = User->IsIpBlocked(Remote);
+
+		// hashing the password is expensive, so it's done by a worker thread
+		if (!Force && !Blocked && User->CheckPasswordAsync(m_Password, this)) {
+			return (m_PasswordCheck == NULL && (m_LoginPending || GetOwner() != NULL));
+		}
+
 		Valid = (Force || User->CheckPassword(m_Password));
 	}
 
 	if ((m_Password || Force) && User && !Blocked && Valid) {
-		User->Attach(this);
+		LoginSucceeded();
 	} else {
-		if (User != NULL) {
-			if (!Blocked) {
-				User->LogBadLogin(Remote);
-			}
+		LoginFailed(User, Blocked);
+
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * PasswordChecked
+ *
+ * Called when the password which was supplied by the client has been
+ * checked by a worker thread. Completes the login if the password is
+ * correct.
+ *
+ * @param Valid whether the password is correct
+ */
+void CClientConnection::PasswordChecked(bool Valid) {
+	CUser *User;
+
+	if (m_Shutdown) {
+		return;
+	}
+
+	// the user might have been removed in the meantime
+	User = g_Bouncer->GetUser(m_Username);
+
+	if (User != NULL && Valid) {
+		LoginSucceeded();
+	} else {
+		LoginFailed(User, false);
+	}
+}
+
+/**
+ * LoginSucceeded
+ *
+ * Looks up the client's hostname after it has been authenticated. The
+ * client is attached to the user once the lookup has finished or after
+ * CLIENT_LOOKUPTIMEOUT seconds.
+ */
+void CClientConnection::LoginSucceeded(void) {
+	sockaddr *Remote = GetRemoteAddress();
+
+	if (Remote == NULL) {
+		Kill("Internal error: GetRemoteAddress() failed. Could not look up your hostname.");
+
+		return;
+	}
+
+	m_ClientLookup = new CDnsQuery(this, USE_DNSEVENTPROXY(CClientConnection, AsyncDnsFinishedClient));
+	m_LoginPending = true;
+
+	// the client has already logged in, so it only waits a short time for its hostname
+	delete m_AuthTimer;
+	m_AuthTimer = new CTimer(CLIENT_LOOKUPTIMEOUT, false, ClientLookupTimer, this);
+
+	WriteLine(":shroudbnc.info NOTICE AUTH :*** Doing reverse DNS lookup on %s...", IpToString(Remote));
+
+	// answers from the dns cache are delivered immediately
+	m_ClientLookup->GetHostByAddr(Remote);
+}
+
+/**
+ * FinishLogin
+ *
+ * Attaches the client to the user and creates the state which is
+ * only needed for logged-in clients.
+ */
+void CClientConnection::FinishLogin(void) {
+	CUser *User;
 
+	m_LoginPending = false;
+
+	// the user might have been removed in the meantime
+	User = g_Bouncer->GetUser(m_Username);
+
+	if (User == NULL) {
+		Kill("*** Unknown user or wrong password.");
+
+		return;
+	}
+
+	delete m_AuthTimer;
+	m_AuthTimer = NULL;
+
+	m_LastResponse = g_CurrentTime;
+	m_PingTimer = new CTimer(45, true, ClientPingTimer, this);
+
+	User->Attach(this);
+
+	ReleasePreAuth();
+}
+
+/**
+ * LoginFailed
+ *
+ * Logs a failed login attempt and closes the connection.
+ *
+ * @param User the user, or NULL if the user does not exist
+ * @param Blocked whether the client's IP address is blocked
+ */
+void CClientConnection::LoginFailed(CUser *User, bool Blocked) {
+	sockaddr *Remote = GetRemoteAddress();
+
+	if (Remote != NULL) {
+		// guessing usernames counts against the address as well
+		if (!Blocked) {
+			g_Bouncer->GetReputationTable()->LogBadLogin(Remote);
+		}
+
+		if (User != NULL) {
 			if (Blocked) {
 				g_Bouncer->Log("Blocked login attempt from %s[%s] for user %s", m_PeerName, IpToString(Remote), m_Username);
 			} else {
@@ -2265,16 +3285,28 @@ bool CClientConnection::ValidateUser(void) {
 		} else {
 			g_Bouncer->Log("Login attempt for unknown user %s (Nick: %s) from %s[%s]", m_Username, m_Nick, m_PeerName, IpToString(Remote));
 		}
+	}
 
-		Kill("*** Unknown user or wrong password.");
+	Kill("*** Unknown user or wrong password.");
+}
 
-		return false;
+/**
+ * ReleasePreAuth
+ *
+ * Removes the client from the reputation table's unauthenticated
+ * connections.
+ */
+void CClientConnection::ReleasePreAuth(void) {
+	if (m_PreAuthAddress == NULL) {
+		return;
 	}
 
-	delete m_AuthTimer;
-	m_AuthTimer = NULL;
+	if (g_Bouncer != NULL) {
+		g_Bouncer->GetReputationTable()->RemovePreAuth(m_PreAuthAddress);
+	}
 
-	return true;
+	free(m_PreAuthAddress);
+	m_PreAuthAddress = NULL;
 }
 
 /**
@@ -2315,6 +3347,10 @@ void CClientConnection::SetPeerName(const char *PeerName, bool LookupFailure) {
 
 	m_PeerName = strdup(PeerName);
 
+	if (m_LoginPending && !m_Shutdown) {
+		FinishLogin();
+	}
+
 	ProcessBuffer();
 }
 
@@ -2381,11 +3417,12 @@ void CClientConnection::AsyncDnsFinishedClient(hostent *Response) {
 				}
 
 				if (CompareAddress(saddr, Remote) == 0) {
-					SetPeerName(m_PeerNameTemp, false);
-
 					WriteLine(":shroudbnc.info NOTICE AUTH :*** Forward DNS reply received (%s).", m_PeerNameTemp);
 
+					SetPeerName(m_PeerNameTemp, false);
+
 					free(m_PeerNameTemp);
+					m_PeerNameTemp = NULL;
 
 					return;
 				}
@@ -2428,20 +3465,32 @@ const char *CClientConnection::GetClassName(void) const {
  */
 int CClientConnection::Read(bool DontProcess) {
 	int ReturnValue;
+	size_t Limit = 5120;
 
-	if (m_PeerName != NULL) {
-		ReturnValue = CConnection::Read(false);
-	} else {
-		return CConnection::Read(true);
+	ReturnValue = CConnection::Read(false);
+
+	// unauthenticated clients have their lines parsed right away
+	if (GetOwner() == NULL && !IsParsingSuspended()) {
+		Limit = CLIENT_PREAUTHRECVQ;
 	}
 
-	if (ReturnValue == 0 && GetRecvqSize() > 5120) {
+	if (ReturnValue == 0 && GetRecvqSize() > Limit) {
 		Kill("RecvQ exceeded.");
 	}
 
 	return ReturnValue;
 }
 
+/**
+ * IsParsingSuspended
+ *
+ * Returns whether the client's lines are kept in the recvq because its
+ * login is still being processed.
+ */
+bool CClientConnection::IsParsingSuspended(void) const {
+	return (m_PasswordCheck != NULL || m_LoginPending);
+}
+
 /**
  * WriteUnformattedLine
  *
@@ -2450,15 +3499,88 @@ int CClientConnection::Read(bool DontProcess) {
  * @param Line the line
  */
 void CClientConnection::WriteUnformattedLine(const char *Line) {
-	CConnection::WriteUnformattedLine(Line);
+	// keep the order of lines while producers are waiting for the sendq
+	if (m_Producers.GetHead() != NULL && !m_Producing) {
+		GetDeferredQ()->WriteUnformattedLine(Line);
+	} else {
+		CConnection::WriteUnformattedLine(Line);
+	}
+
+	CheckSendQ();
+}
+
+/**
+ * WriteBlock
+ *
+ * Sends a shared block to the client.
+ *
+ * @param Block the block
+ */
+void CClientConnection::WriteBlock(fifo_block_t *Block) {
+	if (m_Producers.GetHead() != NULL && !m_Producing) {
+		GetDeferredQ()->WriteBlock(Block);
+	} else {
+		CConnection::WriteBlock(Block);
+	}
+
+	CheckSendQ();
+}
+
+/**
+ * CheckSendQ
+ *
+ * Disconnects the client if its sendq has exceeded the limit. Output
+ * from producers doesn't count towards the limit.
+ */
+void CClientConnection::CheckSendQ(void) {
+	if (m_Producing) {
+		return;
+	}
 
-	if (GetOwner() != NULL && !GetOwner()->IsAdmin() && GetSendqSize() > g_Bouncer->GetSendqSize() * 1024) {
+	if (GetOwner() != NULL && !GetOwner()->IsAdmin() && GetSendqSize() + (m_DeferredQ != NULL ? m_DeferredQ->GetSize() : 0) > g_Bouncer->GetSendqSize() * 1024) {
+		ClearProducers();
 		FlushSendQ();
 		CConnection::WriteUnformattedLine("");
 		Kill("SendQ exceeded.");
 	}
 }
 
+/**
+ * HasQueuedData
+ *
+ * Checks whether there is data which can be sent to the client.
+ */
+bool CClientConnection::HasQueuedData(void) const {
+	if (m_Producers.GetHead() != NULL && GetSendqSize() < PRODUCER_LOWWATER) {
+		return true;
+	} else {
+		return CConnection::HasQueuedData();
+	}
+}
+
+/**
+ * Write
+ *
+ * Writes data for the socket.
+ */
+int CClientConnection::Write(void) {
+	if (m_Producers.GetHead() != NULL && GetSendqSize() < PRODUCER_LOWWATER) {
+		RunProducers();
+	}
+
+	int ReturnValue = CConnection::Write();
+
+	if (m_AttachStarted != 0 && GetSendqSize() == 0 && m_Producers.GetHead() == NULL) {
+		g_Bouncer->Log("Client for user %s became usable %u msecs after attaching (%d channels).",
+			GetOwner() ? GetOwner()->GetUsername() : "<unknown>",
+			(unsigned int)(UtilMsecTime() - m_AttachStarted), m_AttachChannels);
+
+		m_AttachStarted = 0;
+	}
+
+	return ReturnValue;
+}
+
 /**
  * Kill
  *
@@ -2467,6 +3589,8 @@ void CClientConnection::WriteUnformattedLine(const char *Line) {
  * @param Error the error message
  */
 void CClientConnection::Kill(const char *ErrorMessage) {
+	ClearProducers();
+
 	if (GetOwner() != NULL) {
 		GetOwner()->RemoveClientConnection(this);
 		SetOwner(NULL);
@@ -2528,6 +3652,8 @@ bool DestroyClientTimer(time_t Now, void *Client) {
 clientdata_t CClientConnection::Hijack(void) {
 	clientdata_t ClientData;
 
+	ClearProducers();
+
 	ClientData.Socket = GetSocket();
 	g_Bouncer->UnregisterSocket(ClientData.Socket);
 	SetSocket(INVALID_SOCKET);
@@ -2568,6 +3694,39 @@ bool ClientAuthTimer(time_t Now, void *Client) {
 	return false;
 }
 
+/**
+ * ClientLookupTimer
+ *
+ * Attaches clients whose hostname lookup takes too long, using their
+ * IP address as their hostname.
+ *
+ * @param Now the current time
+ * @param Client the client connection object
+ */
+bool ClientLookupTimer(time_t Now, void *Client) {
+	CClientConnection *ClientConnection = (CClientConnection *)Client;
+	sockaddr *Remote = ClientConnection->GetRemoteAddress();
+
+	ClientConnection->m_AuthTimer = NULL;
+
+	// late replies are ignored
+	delete ClientConnection->m_ClientLookup;
+	ClientConnection->m_ClientLookup = NULL;
+
+	free(ClientConnection->m_PeerNameTemp);
+	ClientConnection->m_PeerNameTemp = NULL;
+
+	ClientConnection->WriteLine(":shroudbnc.info NOTICE AUTH :*** DNS lookup timed out. Using IP address as your hostname.");
+
+	if (Remote != NULL) {
+		ClientConnection->SetPeerName(IpToString(Remote), true);
+	} else {
+		ClientConnection->Kill("Failed to look up IP address.");
+	}
+
+	return false;
+}
+
 void CClientConnection::ChangeNick(const char *NewNick) {
 	CIRCConnection *IRC;
 	const char *Site = NULL;
@@ -2674,10 +3833,6 @@ void CClientConnection::Error(int ErrorCode) {
 bool ClientPingTimer(time_t Now, void *ClientConnection) {
 	CClientConnection *Client = (CClientConnection *)ClientConnection;
 
-	if (Client->m_AuthTimer != NULL) {
-		return true;
-	}
-
 	if (Client->GetSocket() == INVALID_SOCKET) {
 		return true;
 	}
@@ -2697,10 +3852,41 @@ bool ClientPingTimer(time_t Now, void *ClientConnection) {
 }
 
 CHashtable<const char *, false> *CClientConnection::GetCapabilities(void) {
+	if (m_Capabilities == NULL) {
+		m_Capabilities = new CHashtable<const char *, false>();
+
+		if (AllocFailed(m_Capabilities)) {
+			g_Bouncer->Fatal();
+		}
+	}
+
 	return m_Capabilities;
 }
 
 bool CClientConnection::HasCapability(const char *cap) const {
-	return m_Capabilities->Get(cap) != NULL;
+	return m_Capabilities != NULL && m_Capabilities->Get(cap) != NULL;
+}
+
+/**
+ * GetNamesXSupport
+ *
+ * Checks whether the client has enabled NAMESX.
+ */
+bool CClientConnection::GetNamesXSupport(void) const {
+	return m_NamesXSupport;
+}
+
+/**
+ * SetAttachStarted
+ *
+ * Records when the client was attached. The time it took until the
+ * attach burst has been sent to the client is logged.
+ *
+ * @param Started when the client was attached (in msecs)
+ * @param Channels the number of channels in the attach burst
+ */
+void CClientConnection::SetAttachStarted(uint64_t Started, int Channels) {
+	m_AttachStarted = Started;
+	m_AttachChannels = Channels;
 }
 
@@ -20,12 +20,19 @@
 #ifndef CLIENTCONNECTION_H
 #define CLIENTCONNECTION_H
 
+#define CLIENT_PREAUTHRECVQ 1024 /**< maximum size of an unauthenticated client's recvq (in bytes) */
+#define CLIENT_LOOKUPTIMEOUT 3 /**< number of seconds an authenticated client waits for its hostname */
+
 #ifdef SWIGINTERFACE
 %template(COwnedObjectCUser) COwnedObject<class CUser>;
 #endif /* SWIGINTERFACE */
 
+class COutputProducer;
+struct passwordcheck_s;
+
 #ifndef SWIG
 bool ClientAuthTimer(time_t Now, void *Client);
+bool ClientLookupTimer(time_t Now, void *Client);
 bool ClientPingTimer(time_t Now, void *ClientConnection);
 #endif /* SWIG */
 
@@ -55,21 +62,31 @@ private:
 	char *m_PeerNameTemp; /**< a temporary variable for the hostname */
 	commandlist_t m_CommandList; /**< a list of commands used by the "help" command */
 	bool m_NamesXSupport; /**< does this client support NAMESX? */
-	CDnsQuery *m_ClientLookup; /**< dns query for looking up the user's hostname */
+	CDnsQuery *m_ClientLookup; /**< dns query for looking up the user's hostname, created when the login has succeeded */
 	char *m_QuitReason; /**< reason why the client was removed */
 	CTimer* m_PingTimer; /**< timer for sending regular PINGs to the client */
 	time_t m_LastResponse; /**< last response from the client */
 	CTimer* m_DestroyClientTimer; /**< used by Hijack() to destroy the client connection */
 	bool m_CapabilitiesEnd; /**< whether the client has issues the CAP LS command */
-	CHashtable<const char *, false> *m_Capabilities; /**< IRCv3 capabilities */
+	CHashtable<const char *, false> *m_Capabilities; /**< IRCv3 capabilities, or NULL if none have been requested */
+	CList<COutputProducer *> m_Producers; /**< producers which are waiting for the sendq to drain */
+	CFIFOBuffer *m_DeferredQ; /**< lines which are sent after the producers have finished, or NULL */
+	bool m_Producing; /**< whether a producer is running */
+	uint64_t m_AttachStarted; /**< when the client was attached (in msecs), or 0 once its producers and sendq have drained */
+	int m_AttachChannels; /**< the number of channels in the attach burst */
+	struct passwordcheck_s *m_PasswordCheck; /**< the password check which is being performed, or NULL */
+	sockaddr *m_PreAuthAddress; /**< the address which counts towards the pre-auth limits until the client has logged in, or NULL */
+	bool m_LoginPending; /**< whether the client is attached once the reverse DNS lookup has finished */
 
 #ifndef SWIG
 	friend bool ClientAuthTimer(time_t Now, void *Client);
+	friend bool ClientLookupTimer(time_t Now, void *Client);
 	friend bool ClientPingTimer(time_t Now, void *ClientConnection);
 	friend bool DestroyClientTimer(time_t Now, void *ClientConnection);
+	friend class CUser;
 
 protected:
-	CTimer *m_AuthTimer; /**< used for timing out unauthed connections */
+	CTimer *m_AuthTimer; /**< used for timing out unauthed connections and their hostname lookups */
 
 public:
 	void AsyncDnsFinishedClient(hostent *response);
@@ -78,15 +95,87 @@ private:
 #endif /*SWIG */
 
 	bool ValidateUser(void);
+	void PasswordChecked(bool Valid);
+	void LoginSucceeded(void);
+	void LoginFailed(CUser *User, bool Blocked);
+	void FinishLogin(void);
+	void ReleasePreAuth(void);
 	void SetPeerName(const char *PeerName, bool LookupFailure);
+	void CheckSendQ(void);
+	void RunProducers(void);
+	void ClearProducers(void);
+	CFIFOBuffer *GetDeferredQ(void);
+	virtual bool IsParsingSuspended(void) const;
 	virtual int Read(bool DontProcess = false);
 	virtual const char *GetClassName(void) const;
 	bool ParseLineArgV(int argc, const char **argv);
 	bool ProcessBncCommand(const char *Subcommand, int argc, const char **argv, bool NoticeUser);
+	command_t *GetCommand(const char *Name);
+	bool HelpCommand(int argc, const char **argv, bool NoticeUser);
+	bool LsmodCommand(int argc, const char **argv, bool NoticeUser);
+	bool InsmodCommand(int argc, const char **argv, bool NoticeUser);
+	bool RmmodCommand(int argc, const char **argv, bool NoticeUser);
+	bool GlobalUnsetCommand(int argc, const char **argv, bool NoticeUser);
+	bool GlobalSetCommand(int argc, const char **argv, bool NoticeUser);
+	bool UnsetCommand(int argc, const char **argv, bool NoticeUser);
+	bool SetCommand(int argc, const char **argv, bool NoticeUser);
+#ifdef HAVE_LIBSSL
+	bool SaveCertCommand(int argc, const char **argv, bool NoticeUser);
+	bool ShowCertCommand(int argc, const char **argv, bool NoticeUser);
+	bool DelCertCommand(int argc, const char **argv, bool NoticeUser);
+#endif /* HAVE_LIBSSL */
+	bool DieCommand(int argc, const char **argv, bool NoticeUser);
+	bool AddUserCommand(int argc, const char **argv, bool NoticeUser);
+	bool DelUserCommand(int argc, const char **argv, bool NoticeUser);
+	bool SimulCommand(int argc, const char **argv, bool NoticeUser);
+	bool DirectCommand(int argc, const char **argv, bool NoticeUser);
+	bool BroadcastCommand(int argc, const char **argv, bool NoticeUser);
+	bool KillCommand(int argc, const char **argv, bool NoticeUser);
+	bool DisconnectCommand(int argc, const char **argv, bool NoticeUser);
+	bool JumpCommand(int argc, const char **argv, bool NoticeUser);
+	bool StatusCommand(int argc, const char **argv, bool NoticeUser);
+	bool ImpulseCommand(int argc, const char **argv, bool NoticeUser);
+	bool WhoCommand(int argc, const char **argv, bool NoticeUser);
+	bool ReconnectsCommand(int argc, const char **argv, bool NoticeUser);
+	bool AddListenerCommand(int argc, const char **argv, bool NoticeUser);
+	bool DelListenerCommand(int argc, const char **argv, bool NoticeUser);
+	bool ExportConfigCommand(int argc, const char **argv, bool NoticeUser);
+	bool ListenersCommand(int argc, const char **argv, bool NoticeUser);
+	bool ReadCommand(int argc, const char **argv, bool NoticeUser);
+	bool EraseCommand(int argc, const char **argv, bool NoticeUser);
+	bool PlayMainLogCommand(int argc, const char **argv, bool NoticeUser);
+	bool EraseMainLogCommand(int argc, const char **argv, bool NoticeUser);
+	bool AdminCommand(int argc, const char **argv, bool NoticeUser);
+	bool UnadminCommand(int argc, const char **argv, bool NoticeUser);
+	bool SuspendCommand(int argc, const char **argv, bool NoticeUser);
+	bool UnsuspendCommand(int argc, const char **argv, bool NoticeUser);
+	bool ResetPassCommand(int argc, const char **argv, bool NoticeUser);
+	bool PartAllCommand(int argc, const char **argv, bool NoticeUser);
+	bool BacklogCommand(int argc, const char **argv, bool NoticeUser);
+	bool EraseBacklogCommand(int argc, const char **argv, bool NoticeUser);
+	void PlayLogCommand(const CLog *Log, int argc, const char **argv, bool NoticeUser,
+		const char *Command, const char *EraseCommand, const char *EmptyMessage);
+
+#ifndef SWIG
+	/**
+	 * BuiltinCommand
+	 *
+	 * Calls the handler of a built-in command.
+	 *
+	 * @param Client the client which issued the command
+	 * @param argc number of parameters for the command
+	 * @param argv arguments for the command
+	 * @param NoticeUser whether to send replies as notices
+	 */
+	template<bool (CClientConnection::*Handler)(int argc, const char **argv, bool NoticeUser)>
+	static bool BuiltinCommand(CClientConnection *Client, int argc, const char **argv, bool NoticeUser) {
+		return (Client->*Handler)(argc, argv, NoticeUser);
+	}
+#endif /* SWIG */
 
 public:
 #ifndef SWIG
-	CClientConnection(SOCKET Socket, bool SSL = false);
+	CClientConnection(SOCKET Socket, bool SSL = false, const sockaddr *PreAuthAddress = NULL);
 	virtual ~CClientConnection(void);
 #endif /* SWIG */
 
@@ -100,6 +189,7 @@ public:
 	virtual void Error(int ErrorCode);
 
 	virtual commandlist_t *GetCommandList(void);
+	static void RegisterCommands(commandlist_t *Commands);
 
 	virtual clientdata_t Hijack(void);
 
@@ -113,9 +203,19 @@ public:
 	virtual const char *GetQuitReason(void) const;
 
 	virtual void WriteUnformattedLine(const char *Line);
+	virtual void WriteBlock(fifo_block_t *Block);
+
+	virtual int Write(void);
+	virtual bool HasQueuedData(void) const;
+
+	void PlayLog(const CLog *Log, bool NoticeUser, int Offset, int Count, const char *Trailer);
+	void AddProducer(COutputProducer *Producer);
 
 	virtual CHashtable<const char *, false> *GetCapabilities(void);
 	virtual bool HasCapability(const char *cap) const;
+
+	bool GetNamesXSupport(void) const;
+	void SetAttachStarted(uint64_t Started, int Channels);
 };
 
 #ifdef SBNC
@@ -138,6 +238,17 @@ class SBNCAPI CFakeClient : public CClientConnection {
 	virtual void WriteUnformattedLine(const char *Line) {
 		m_Queue.WriteUnformattedLine(Line);
 	}
+
+	/**
+	 * WriteBlock
+	 *
+	 * Re-implementation of CClientConnection::WriteBlock.
+	 *
+	 * @param Block the block
+	 */
+	virtual void WriteBlock(fifo_block_t *Block) {
+		m_Queue.Write(Block->Data, Block->Size);
+	}
 public:
 	/**
 	 * CFakeClient
@@ -20,8 +20,6 @@
 
 CClientConnectionMultiplexer::CClientConnectionMultiplexer(CUser *User) : CClientConnection(INVALID_SOCKET) {
 	SetOwner(User);
-
-	delete m_AuthTimer;
 }
 
 void CClientConnectionMultiplexer::ParseLine(const char *Line) {
@@ -91,12 +89,36 @@ void CClientConnectionMultiplexer::RealNotice(const char *Text) {
 
 void CClientConnectionMultiplexer::WriteUnformattedLine(const char *Line) {
 	CVector<client_t> *Clients = GetOwner()->GetClientConnections();
+	fifo_block_t *Block;
+
+	if (Clients->GetLength() > 1) {
+		// the clients' sendqs share a single copy of the line
+		Block = CFIFOBuffer::CreateBlock(Line);
+
+		if (Block != NULL) {
+			for (int i = 0; i < Clients->GetLength(); i++) {
+				(*Clients)[i].Client->WriteBlock(Block);
+			}
+
+			CFIFOBuffer::ReleaseBlock(Block);
+
+			return;
+		}
+	}
 
 	for (int i = 0; i < Clients->GetLength(); i++) {
 		(*Clients)[i].Client->WriteUnformattedLine(Line);
 	}
 }
 
+void CClientConnectionMultiplexer::WriteBlock(fifo_block_t *Block) {
+	CVector<client_t> *Clients = GetOwner()->GetClientConnections();
+
+	for (int i = 0; i < Clients->GetLength(); i++) {
+		(*Clients)[i].Client->WriteBlock(Block);
+	}
+}
+
 void CClientConnectionMultiplexer::Shutdown(void) {
 
 }
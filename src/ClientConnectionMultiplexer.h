@@ -50,6 +50,7 @@ public:
 	virtual void Shutdown(void);
 
 	virtual void WriteUnformattedLine(const char *Line);
+	virtual void WriteBlock(fifo_block_t *Block);
 };
 
 #endif /* CLIENTCONNECTIONMULTIPLEXER_H */
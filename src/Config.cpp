@@ -19,6 +19,9 @@
 
 #include "StdAfx.h"
 
+static CList<CConfig *> *g_DirtyConfigs = NULL; /**< configs with unsaved changes */
+static bool g_FlushScheduled = false; /**< whether the flush timer is running */
+
 /**
  * CConfig
  *
@@ -27,14 +30,26 @@
  * configuration object is constructed. Changes made to such an object
  * are not stored to disk.
  *
+ * If a store is specified the settings are kept in the store (using the
+ * filename as the namespace) instead. Existing configuration files are
+ * imported into the store the first time they are used.
+ *
  * @param Filename the filename of the configuration file, can be NULL
+ * @param Owner the owner of the configuration object
+ * @param Store the store which should be used, or NULL
+ * @param Settings settings which have already been parsed (using ParseFile)
+ *                 from the configuration file, or NULL; the config object
+ *                 takes ownership of the hashtable
  */
-CConfig::CConfig(const char *Filename, CUser *Owner) {
+CConfig::CConfig(const char *Filename, CUser *Owner, CConfigStore *Store, CHashtable<char *, false> *Settings) {
 	SetOwner(Owner);
 
 	m_WriteLock = false;
+	m_DirtyLink = NULL;
 
-	m_Settings.RegisterValueDestructor(FreeString);
+	m_FlushCount = 0;
+	m_LastFlushTime = 0;
+	m_MaxFlushTime = 0;
 
 	if (Filename != NULL) {
 		m_Filename = strdup(g_Bouncer->BuildPathConfig(Filename));
@@ -46,58 +61,138 @@ CConfig::CConfig(const char *Filename, CUser *Owner) {
 		m_Filename = NULL;
 	}
 
-	Reload();
+	if (Store != NULL && Filename != NULL) {
+		/* the store has its own copy of the settings */
+		delete Settings;
+
+		m_Store = Store;
+		m_Namespace = strdup(Filename);
+
+		if (AllocFailed(m_Namespace)) {
+			g_Bouncer->Fatal();
+		}
+
+		m_Settings = Store->GetNamespace(m_Namespace);
+
+		if (m_Settings == NULL) {
+			RESULT<bool> Result = Store->Import(m_Namespace, m_Filename);
+
+			if (!IsError(Result)) {
+				g_Bouncer->Log("Imported %s into the config store.", m_Filename);
+			}
+
+			m_Settings = Store->GetNamespace(m_Namespace, true);
+		}
+
+		if (AllocFailed(m_Settings)) {
+			g_Bouncer->Fatal();
+		}
+	} else {
+		m_Store = NULL;
+		m_Namespace = NULL;
+
+		if (Settings != NULL) {
+			m_Settings = Settings;
+		} else {
+			m_Settings = new CHashtable<char *, false>();
+
+			if (AllocFailed(m_Settings)) {
+				g_Bouncer->Fatal();
+			}
+
+			m_Settings->RegisterValueDestructor(FreeString);
+
+			Reload();
+		}
+	}
 }
 
 /**
  * ParseConfig
  *
- * Parses a configuration file. Valid lines of the configuration file
- * have this syntax:
- *
- * setting=value
+ * Parses the configuration file and replaces the current settings.
  */
 bool CConfig::ParseConfig(void) {
-	const size_t LineLength = 131072;
-	char *Line;
-	char *dupEq;
-	FILE *ConfigFile;
-
 	if (m_Filename == NULL) {
 		return false;
 	}
 
-	Line = (char *)malloc(LineLength);
+	RESULT<confighash_t *> Settings = ParseFile(m_Filename);
+
+	if (IsError(Settings)) {
+		g_Bouncer->Log("Config file %s could not be parsed: %s", m_Filename, GETDESCRIPTION(Settings));
+
+		g_Bouncer->Fatal();
+	}
 
-	if (AllocFailed(Line)) {
+	if (Settings == NULL) {
 		return false;
 	}
 
-	ConfigFile = fopen(m_Filename, "r");
+	delete m_Settings;
+	m_Settings = Settings;
+
+	return true;
+}
+
+/**
+ * ParseFile
+ *
+ * Parses a configuration file into a new hashtable. Valid lines of the
+ * configuration file have this syntax:
+ *
+ * setting=value
+ *
+ * This function does not use any global state and can therefore be
+ * used by worker threads. NULL is returned if the file does not exist.
+ *
+ * @param Filename the path of the configuration file
+ */
+RESULT<confighash_t *> CConfig::ParseFile(const char *Filename) {
+	const size_t LineLength = 131072;
+	char *Line;
+	char *dupEq;
+	FILE *ConfigFile;
+	confighash_t *Settings;
+
+	ConfigFile = fopen(Filename, "r");
 
 	if (ConfigFile == NULL) {
+		RETURN(confighash_t *, NULL);
+	}
+
+	Line = (char *)malloc(LineLength);
+	Settings = new confighash_t();
+
+	if (Line == NULL || Settings == NULL) {
+		fclose(ConfigFile);
 		free(Line);
+		delete Settings;
 
-		return false;
+		THROW(confighash_t *, Generic_OutOfMemory, "Out of memory.");
 	}
 
-	m_WriteLock = true;
+	Settings->RegisterValueDestructor(FreeString);
 
 	while (feof(ConfigFile) == 0) {
+		size_t Length;
+
 		if (fgets(Line, LineLength, ConfigFile) == NULL) {
 			break;
 		}
 
-		if (strlen(Line) == 0) {
-			continue;
+		Length = strlen(Line);
+
+		if (Length > 0 && Line[Length - 1] == '\n') {
+			Line[--Length] = '\0';
 		}
 
-		if (Line[strlen(Line) - 1] == '\n') {
-			Line[strlen(Line) - 1] = '\0';
+		if (Length > 0 && Line[Length - 1] == '\r') {
+			Line[--Length] = '\0';
 		}
 
-		if (Line[strlen(Line) - 1] == '\r') {
-			Line[strlen(Line) - 1] = '\0';
+		if (Length == 0) {
+			continue;
 		}
 
 		char *Eq = strchr(Line, '=');
@@ -107,30 +202,22 @@ bool CConfig::ParseConfig(void) {
 
 			dupEq = strdup(++Eq);
 
-			if (AllocFailed(dupEq)) {
-				if (g_Bouncer != NULL) {
-					g_Bouncer->Fatal();
-				} else {
-					exit(0);
-				}
-			}
-
-			if (m_Settings.Add(Line, dupEq) == false) {
-				g_Bouncer->Log("CHashtable::Add failed. Config could not be parsed"
-					" (%s, %s).", Line, Eq);
+			if (dupEq == NULL || IsError(Settings->Add(Line, dupEq))) {
+				free(dupEq);
+				fclose(ConfigFile);
+				free(Line);
+				delete Settings;
 
-				g_Bouncer->Fatal();
+				THROW(confighash_t *, Generic_OutOfMemory, "CHashtable::Add failed.");
 			}
 		}
 	}
 
 	fclose(ConfigFile);
 
-	m_WriteLock = false;
-
 	free(Line);
 
-	return true;
+	RETURN(confighash_t *, Settings);
 }
 
 /**
@@ -139,7 +226,24 @@ bool CConfig::ParseConfig(void) {
  * Destructs the configuration object.
  */
 CConfig::~CConfig() {
+	if (IsDirty() && IsError(Flush()) && g_Bouncer != NULL) {
+		g_Bouncer->Log("Unsaved changes for %s were lost.", m_Filename);
+	}
+
+	if (m_DirtyLink != NULL) {
+		g_DirtyConfigs->Remove(m_DirtyLink);
+	}
+
+	while (m_Caches.GetLength() > 0) {
+		m_Caches[0]->Detach();
+	}
+
+	if (m_Store == NULL) {
+		delete m_Settings;
+	}
+
 	free(m_Filename);
+	free(m_Namespace);
 }
 
 /**
@@ -151,7 +255,49 @@ CConfig::~CConfig() {
  * @param Setting the configuration setting
  */
 RESULT<const char *> CConfig::ReadString(const char *Setting) const {
-	const char *Value = m_Settings.Get(Setting);
+	const char *Value = m_Settings->Get(Setting);
+
+	if (Value != NULL && Value[0] != '\0') {
+		RETURN(const char *, Value);
+	} else {
+		THROW(const char *, Generic_Unknown, "There is no such setting.");
+	}
+}
+
+/**
+ * ReadPrefixedString
+ *
+ * Reads a configuration setting whose name consists of a prefix and
+ * a suffix (e.g. "tag." and the name of a tag) as a string. Unlike
+ * ReadString this does not require the caller to allocate the
+ * setting's name.
+ *
+ * @param Prefix the prefix of the setting's name
+ * @param Setting the rest of the setting's name
+ */
+RESULT<const char *> CConfig::ReadPrefixedString(const char *Prefix, const char *Setting) const {
+	char Buffer[128];
+	char *Name = Buffer;
+	size_t PrefixLength = strlen(Prefix);
+	size_t Length = PrefixLength + strlen(Setting) + 1;
+	const char *Value;
+
+	if (Length > sizeof(Buffer)) {
+		Name = (char *)malloc(Length);
+
+		if (AllocFailed(Name)) {
+			THROW(const char *, Generic_OutOfMemory, "malloc() failed.");
+		}
+	}
+
+	memcpy(Name, Prefix, PrefixLength);
+	strcpy(Name + PrefixLength, Setting);
+
+	Value = m_Settings->Get(Name);
+
+	if (Name != Buffer) {
+		free(Name);
+	}
 
 	if (Value != NULL && Value[0] != '\0') {
 		RETURN(const char *, Value);
@@ -169,7 +315,7 @@ RESULT<const char *> CConfig::ReadString(const char *Setting) const {
  * @param Setting the configuration setting
  */
 RESULT<int> CConfig::ReadInteger(const char *Setting) const {
-	const char *Value = m_Settings.Get(Setting);
+	const char *Value = m_Settings->Get(Setting);
 
 	if (Value != NULL) {
 		RETURN(int, atoi(Value));
@@ -197,16 +343,22 @@ RESULT<bool> CConfig::WriteString(const char *Setting, const char *Value) {
 		RETURN(bool, true);
 	}
 
-	if (Value != NULL) {
-		ReturnValue = m_Settings.Add(Setting, strdup(Value));
+	if (m_Store != NULL) {
+		ReturnValue = m_Store->Put(m_Namespace, Setting, Value);
+	} else if (Value != NULL) {
+		ReturnValue = m_Settings->Add(Setting, strdup(Value));
 	} else {
-		ReturnValue = m_Settings.Remove(Setting);
+		ReturnValue = m_Settings->Remove(Setting);
 	}
 
 	THROWIFERROR(bool, ReturnValue);
 
-	if (!m_WriteLock && IsError(Persist())) {
-		g_Bouncer->Fatal();
+	for (int i = 0; i < m_Caches.GetLength(); i++) {
+		m_Caches[i]->SettingChanged(Setting);
+	}
+
+	if (!m_WriteLock) {
+		SetDirty();
 	}
 
 	RETURN(bool, true);
@@ -248,19 +400,35 @@ RESULT<bool> CConfig::WriteInteger(const char *Setting, const int Value) {
  * unless the configuration object is non-persistant.
  */
 RESULT<bool> CConfig::Persist(void) const {
+	if (m_Filename == NULL) {
+		RETURN(bool, false);
+	}
+
+	if (m_Store != NULL) {
+		return m_Store->Sync();
+	}
+
+	return Export(m_Filename);
+}
+
+/**
+ * Export
+ *
+ * Writes the settings to a configuration file.
+ *
+ * @param TargetFilename the name of the configuration file
+ */
+RESULT<bool> CConfig::Export(const char *TargetFilename) const {
 	static char *Error;
 	char *Filename;
 	int rc;
 
 	free(Error);
-
-	if (m_Filename == NULL) {
-		RETURN(bool, false);
-	}
+	Error = NULL;
 
 	/* Rationale for not using mkstemp()/etc.: if your config dir doesn't belong to the
 	   proper user you're screwed anyway. */
-	rc = asprintf(&Filename, "%s.tmp", m_Filename);
+	rc = asprintf(&Filename, "%s.tmp", TargetFilename);
 
 	if (RcFailed(rc)) {
 		THROW(bool, Generic_OutOfMemory, "asprintf() failed");
@@ -271,7 +439,7 @@ RESULT<bool> CConfig::Persist(void) const {
 	if (AllocFailed(ConfigFile)) {
 		free(Filename);
 
-		int rc = asprintf(&Error, "Could not open config file: %s", m_Filename);
+		int rc = asprintf(&Error, "Could not open config file: %s", TargetFilename);
 
 		if (RcFailed(rc)) {}
 
@@ -281,19 +449,33 @@ RESULT<bool> CConfig::Persist(void) const {
 	SetPermissions(Filename, S_IRUSR | S_IWUSR);
 
 	int i = 0;
-	while (hash_t<char *> *SettingHash = m_Settings.Iterate(i++)) {
+	while (hash_t<char *> *SettingHash = m_Settings->Iterate(i++)) {
 		if (SettingHash->Name != NULL && SettingHash->Value != NULL) {
 			fprintf(ConfigFile, "%s=%s\n", SettingHash->Name, SettingHash->Value);
 		}
 	}
 
+	/* make sure the data is on disk before the old config is replaced */
+#ifndef _WIN32
+	if (fflush(ConfigFile) != 0 || fsync(fileno(ConfigFile)) != 0) {
+#else /* _WIN32 */
+	if (fflush(ConfigFile) != 0 || _commit(_fileno(ConfigFile)) != 0) {
+#endif /* _WIN32 */
+		fclose(ConfigFile);
+		unlink(Filename);
+
+		free(Filename);
+
+		THROW(bool, Generic_Unknown, "Could not write config file.");
+	}
+
 	fclose(ConfigFile);
 
 #ifdef _WIN32
-	unlink(m_Filename);
+	unlink(TargetFilename);
 #endif
 
-	rc = rename(Filename, m_Filename);
+	rc = rename(Filename, TargetFilename);
 
 	if (RcFailed(rc)) {
 		unlink(Filename);
@@ -326,7 +508,7 @@ const char *CConfig::GetFilename(void) const {
  * @param Index specifies the index of the setting which is to be returned
  */
 hash_t<char *> *CConfig::Iterate(int Index) const {
-	return m_Settings.Iterate(Index);
+	return m_Settings->Iterate(Index);
 }
 
 /**
@@ -335,11 +517,24 @@ hash_t<char *> *CConfig::Iterate(int Index) const {
  * Reloads all settings from disk.
  */
 void CConfig::Reload(void) {
-	m_Settings.Clear();
+	if (IsDirty()) {
+		Flush();
+	}
+
+	/* the store's settings are always up-to-date */
+	if (m_Store != NULL) {
+		return;
+	}
+
+	m_Settings->Clear();
 
 	if (m_Filename != NULL) {
 		ParseConfig();
 	}
+
+	for (int i = 0; i < m_Caches.GetLength(); i++) {
+		m_Caches[i]->Reload();
+	}
 }
 
 /**
@@ -348,7 +543,7 @@ void CConfig::Reload(void) {
  * Returns the number of items in the config.
  */
 unsigned int CConfig::GetLength(void) const {
-	return m_Settings.GetLength();
+	return m_Settings->GetLength();
 }
 
 
@@ -358,23 +553,185 @@ unsigned int CConfig::GetLength(void) const {
  * Returns the hashtable which is used for caching the settings.
  */
 CHashtable<char *, false> *CConfig::GetInnerHashtable(void) {
-	return &m_Settings;
+	return m_Settings;
 }
 
 /**
- * CanUseCache
+ * Destroy
  *
- * Checks whether a cached version of this Setting can be used.
+ * Destroys the config object.
  */
-bool CConfig::CanUseCache(void) {
-	return true;
+void CConfig::Destroy(void) {
+	delete this;
 }
 
 /**
- * Destroy
+ * SetDirty
  *
- * Destroys the config object.
+ * Marks the config as having unsaved changes and schedules a flush.
  */
-void CConfig::Destroy(void) {
-	delete this;
+void CConfig::SetDirty(void) {
+	if (m_Filename == NULL || m_DirtyLink != NULL) {
+		return;
+	}
+
+	if (g_DirtyConfigs == NULL) {
+		g_DirtyConfigs = new CList<CConfig *>();
+
+		if (AllocFailed(g_DirtyConfigs)) {
+			g_Bouncer->Fatal();
+		}
+	}
+
+	RESULT<link_t<CConfig *> *> Link = g_DirtyConfigs->Insert(this);
+
+	if (IsError(Link)) {
+		/* fall back to writing the config immediately */
+		if (IsError(Persist())) {
+			g_Bouncer->Fatal();
+		}
+
+		return;
+	}
+
+	m_DirtyLink = Link;
+
+	if (!g_FlushScheduled) {
+		new CTimer(CONFIG_FLUSH_DELAY, false, ConfigFlushTimer, NULL);
+
+		g_FlushScheduled = true;
+	}
+}
+
+/**
+ * Flush
+ *
+ * Synchronously writes any unsaved changes to disk.
+ */
+RESULT<bool> CConfig::Flush(void) {
+	uint64_t Start;
+	RESULT<bool> Result;
+
+	if (m_DirtyLink == NULL) {
+		RETURN(bool, true);
+	}
+
+	Start = UtilMsecTime();
+
+	Result = Persist();
+
+	THROWIFERROR(bool, Result);
+
+	m_LastFlushTime = (unsigned int)(UtilMsecTime() - Start);
+	m_MaxFlushTime = max(m_MaxFlushTime, m_LastFlushTime);
+	m_FlushCount++;
+
+	if (m_LastFlushTime > CONFIG_SLOW_FLUSH && g_Bouncer != NULL) {
+		g_Bouncer->Log("Writing %s took %u msecs.", m_Filename, m_LastFlushTime);
+	}
+
+	g_DirtyConfigs->Remove(m_DirtyLink);
+	m_DirtyLink = NULL;
+
+	RETURN(bool, true);
+}
+
+/**
+ * IsDirty
+ *
+ * Checks whether the config has unsaved changes.
+ */
+bool CConfig::IsDirty(void) const {
+	return (m_DirtyLink != NULL);
+}
+
+/**
+ * GetFlushCount
+ *
+ * Returns the number of times the config was written to disk.
+ */
+unsigned int CConfig::GetFlushCount(void) const {
+	return m_FlushCount;
+}
+
+/**
+ * GetLastFlushTime
+ *
+ * Returns the duration of the last flush (in msecs).
+ */
+unsigned int CConfig::GetLastFlushTime(void) const {
+	return m_LastFlushTime;
+}
+
+/**
+ * GetMaxFlushTime
+ *
+ * Returns the duration of the slowest flush (in msecs).
+ */
+unsigned int CConfig::GetMaxFlushTime(void) const {
+	return m_MaxFlushTime;
+}
+
+/**
+ * FlushAll
+ *
+ * Writes all configs with unsaved changes to disk.
+ */
+void CConfig::FlushAll(void) {
+	if (g_DirtyConfigs == NULL) {
+		return;
+	}
+
+	for (CListCursor<CConfig *> ConfigCursor(g_DirtyConfigs); ConfigCursor.IsValid(); ConfigCursor.Proceed()) {
+		RESULT<bool> Result = (*ConfigCursor)->Flush();
+
+		if (IsError(Result) && g_Bouncer != NULL) {
+			g_Bouncer->Log("Could not write %s: %s", (*ConfigCursor)->GetFilename(), GETDESCRIPTION(Result));
+		}
+	}
+}
+
+/**
+ * ConfigFlushTimer
+ *
+ * Writes configs with unsaved changes to disk. Configs which could not be
+ * written are retried the next time the timer runs.
+ *
+ * @param Now the current time
+ * @param Cookie not used
+ */
+bool ConfigFlushTimer(time_t Now, void *Cookie) {
+	g_FlushScheduled = false;
+
+	CConfig::FlushAll();
+
+	if (g_DirtyConfigs != NULL && g_DirtyConfigs->GetHead() != NULL && !g_FlushScheduled) {
+		new CTimer(CONFIG_FLUSH_DELAY, false, ConfigFlushTimer, NULL);
+
+		g_FlushScheduled = true;
+	}
+
+	return false;
+}
+
+/**
+ * RegisterCache
+ *
+ * Registers a settings cache which is notified whenever a setting is changed.
+ *
+ * @param Cache the cache
+ */
+void CConfig::RegisterCache(CSettingsCache *Cache) {
+	m_Caches.Insert(Cache);
+}
+
+/**
+ * UnregisterCache
+ *
+ * Removes a settings cache.
+ *
+ * @param Cache the cache
+ */
+void CConfig::UnregisterCache(CSettingsCache *Cache) {
+	m_Caches.Remove(Cache);
 }
@@ -20,6 +20,23 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#define CONFIG_FLUSH_DELAY 2 /**< number of seconds after which changes are written to disk */
+#define CONFIG_SLOW_FLUSH 100 /**< flushes taking longer than this (in msecs) are logged */
+
+class CConfigStore;
+class CSettingsCache;
+
+/**
+ * confighash_t
+ *
+ * A hashtable which holds the settings of a configuration file.
+ */
+typedef CHashtable<char *, false> confighash_t;
+
+#ifndef SWIG
+bool ConfigFlushTimer(time_t Now, void *Cookie);
+#endif /* SWIG */
+
 /**
  * CConfig
  *
@@ -27,18 +44,30 @@
  */
 class SBNCAPI CConfig : public CObject<CConfig, CUser> {
 private:
-	CHashtable<char *, false> m_Settings; /**< the settings */
+	CHashtable<char *, false> *m_Settings; /**< the settings */
 
 	char *m_Filename; /**< the filename of the config */
+	CConfigStore *m_Store; /**< the store which holds the settings, or NULL */
+	char *m_Namespace; /**< the config's namespace in the store */
 	bool m_WriteLock; /**< marks whether the configuration file should be
 						   updated when settings are added/removed */
+	link_t<CConfig *> *m_DirtyLink; /**< the config's entry in the list of dirty configs,
+									 or NULL if there are no unsaved changes */
+
+	unsigned int m_FlushCount; /**< the number of times the config was written to disk */
+	unsigned int m_LastFlushTime; /**< the duration of the last flush (in msecs) */
+	unsigned int m_MaxFlushTime; /**< the duration of the slowest flush (in msecs) */
+
+	CVector<CSettingsCache *> m_Caches; /**< caches which are notified about changes */
 
 	bool ParseConfig(void);
 	RESULT<bool> Persist(void) const;
+	void SetDirty(void);
 
 public:
 #ifndef SWIG
-	CConfig(const char *Filename, CUser *Owner);
+	CConfig(const char *Filename, CUser *Owner, CConfigStore *Store = NULL,
+		CHashtable<char *, false> *Settings = NULL);
 	virtual ~CConfig(void);
 #endif /* SWIG */
 
@@ -46,6 +75,7 @@ public:
 
 	virtual RESULT<int> ReadInteger(const char *Setting) const;
 	virtual RESULT<const char *> ReadString(const char *Setting) const;
+	RESULT<const char *> ReadPrefixedString(const char *Prefix, const char *Setting) const;
 
 	virtual RESULT<bool> WriteInteger(const char *Setting, const int Value);
 	virtual RESULT<bool> WriteString(const char *Setting, const char *Value);
@@ -58,7 +88,19 @@ public:
 	virtual hash_t<char *> *Iterate(int Index) const;
 	virtual unsigned int GetLength(void) const;
 
-	virtual bool CanUseCache(void);
+	virtual RESULT<bool> Flush(void);
+	virtual RESULT<bool> Export(const char *Filename) const;
+	virtual bool IsDirty(void) const;
+
+	unsigned int GetFlushCount(void) const;
+	unsigned int GetLastFlushTime(void) const;
+	unsigned int GetMaxFlushTime(void) const;
+
+	void RegisterCache(CSettingsCache *Cache);
+	void UnregisterCache(CSettingsCache *Cache);
+
+	static void FlushAll(void);
+	static RESULT<confighash_t *> ParseFile(const char *Filename);
 };
 
 #endif /* CONFIG_H */
@@ -0,0 +1,662 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/**
+ * ConfigStoreChecksum
+ *
+ * Calculates the FNV-1a checksum of a buffer.
+ *
+ * @param Data the buffer
+ * @param Length the length of the buffer
+ */
+static uint32_t ConfigStoreChecksum(const char *Data, size_t Length) {
+	uint32_t Hash = 2166136261U;
+
+	for (size_t i = 0; i < Length; i++) {
+		Hash ^= (unsigned char)Data[i];
+		Hash *= 16777619U;
+	}
+
+	return Hash;
+}
+
+/**
+ * ConfigStoreRecordSize
+ *
+ * Returns the size of a record (including its header).
+ *
+ * @param Namespace the namespace
+ * @param Key the key
+ * @param Value the value
+ */
+static size_t ConfigStoreRecordSize(const char *Namespace, const char *Key, const char *Value) {
+	return sizeof(configstore_record_t) + strlen(Namespace) + strlen(Key) + strlen(Value) + 3;
+}
+
+/**
+ * DestroyNamespace
+ *
+ * Destroys the hashtable of a namespace.
+ *
+ * @param Namespace the namespace
+ */
+static void DestroyNamespace(CHashtable<char *, false> *Namespace) {
+	delete Namespace;
+}
+
+/**
+ * CConfigStore
+ *
+ * Constructs a new config store object. Open() must be called before
+ * the store can be used.
+ *
+ * @param Filename the filename of the store
+ */
+CConfigStore::CConfigStore(const char *Filename) {
+	m_Filename = strdup(Filename);
+
+	if (AllocFailed(m_Filename)) {
+		g_Bouncer->Fatal();
+	}
+
+	m_File = NULL;
+	m_FileSize = 0;
+	m_LiveSize = 0;
+	m_Dirty = false;
+
+	m_Namespaces.RegisterValueDestructor(DestroyNamespace);
+}
+
+/**
+ * ~CConfigStore
+ *
+ * Destructs the config store object.
+ */
+CConfigStore::~CConfigStore(void) {
+	if (m_File != NULL) {
+		Sync();
+
+		fclose(m_File);
+	}
+
+	free(m_Filename);
+}
+
+/**
+ * Open
+ *
+ * Loads the store's records and opens the file for appending new records.
+ */
+RESULT<bool> CConfigStore::Open(void) {
+	RESULT<bool> Result = Load();
+
+	THROWIFERROR(bool, Result);
+
+	if (m_File == NULL) {
+		m_File = fopen(m_Filename, "ab");
+
+		if (m_File == NULL) {
+			THROW(bool, Generic_Unknown, "Could not open config store.");
+		}
+
+		SetPermissions(m_Filename, S_IRUSR | S_IWUSR);
+	}
+
+	RETURN(bool, true);
+}
+
+/**
+ * UnmapStore
+ *
+ * Releases the view of the store which was created by Load(). On Win32
+ * the store is read into a heap buffer instead.
+ *
+ * @param Data the view
+ * @param Size the size of the view
+ */
+static void UnmapStore(char *Data, size_t Size) {
+#ifndef _WIN32
+	munmap(Data, Size);
+#else /* _WIN32 */
+	free(Data);
+#endif /* _WIN32 */
+}
+
+/**
+ * Load
+ *
+ * Maps the whole store and replays its records. A truncated or corrupted
+ * tail (e.g. from a crash while appending) is discarded by compacting the
+ * store.
+ */
+RESULT<bool> CConfigStore::Load(void) {
+	FILE *StoreFile;
+	char *Data;
+	size_t Size, Offset;
+	struct stat StatBuf;
+
+	StoreFile = fopen(m_Filename, "rb");
+
+	if (StoreFile == NULL) {
+		if (errno != ENOENT) {
+			THROW(bool, Generic_Unknown, "Could not open config store.");
+		}
+
+		/* a new store; Compact() writes the header */
+		return Compact();
+	}
+
+	if (fstat(fileno(StoreFile), &StatBuf) < 0) {
+		fclose(StoreFile);
+
+		THROW(bool, Generic_Unknown, "fstat() failed.");
+	}
+
+	Size = StatBuf.st_size;
+
+	if (Size < strlen(CONFIGSTORE_MAGIC)) {
+		fclose(StoreFile);
+
+		THROW(bool, Generic_Unknown, "The file is not a config store.");
+	}
+
+#ifndef _WIN32
+	Data = (char *)mmap(NULL, Size, PROT_READ, MAP_PRIVATE, fileno(StoreFile), 0);
+
+	fclose(StoreFile);
+
+	if (Data == MAP_FAILED) {
+		THROW(bool, Generic_Unknown, "Could not map config store.");
+	}
+#else /* _WIN32 */
+	Data = (char *)malloc(Size);
+
+	if (AllocFailed(Data)) {
+		fclose(StoreFile);
+
+		THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+	}
+
+	if (fread(Data, 1, Size, StoreFile) != Size) {
+		free(Data);
+		fclose(StoreFile);
+
+		THROW(bool, Generic_Unknown, "Could not read config store.");
+	}
+
+	fclose(StoreFile);
+#endif /* _WIN32 */
+
+	if (memcmp(Data, CONFIGSTORE_MAGIC, strlen(CONFIGSTORE_MAGIC)) != 0) {
+		UnmapStore(Data, Size);
+
+		THROW(bool, Generic_Unknown, "The file is not a config store.");
+	}
+
+	Offset = strlen(CONFIGSTORE_MAGIC);
+
+	while (Size - Offset >= sizeof(configstore_record_t)) {
+		configstore_record_t Record;
+		const char *Namespace, *Key, *Value, *End;
+
+		memcpy(&Record, Data + Offset, sizeof(Record));
+
+		if (Record.Length > Size - Offset - sizeof(Record)) {
+			break;
+		}
+
+		Namespace = Data + Offset + sizeof(Record);
+		End = Namespace + Record.Length;
+
+		if (ConfigStoreChecksum(Namespace, Record.Length) != Record.Checksum) {
+			break;
+		}
+
+		Key = (const char *)memchr(Namespace, '\0', End - Namespace);
+
+		if (Key == NULL) {
+			break;
+		}
+
+		Key++;
+		Value = (const char *)memchr(Key, '\0', End - Key);
+
+		if (Value == NULL) {
+			break;
+		}
+
+		Value++;
+
+		if (memchr(Value, '\0', End - Value) == NULL) {
+			break;
+		}
+
+		Apply((configstore_op_e)Record.Op, Namespace, Key, Value);
+
+		Offset += sizeof(Record) + Record.Length;
+	}
+
+	UnmapStore(Data, Size);
+
+	m_FileSize = Offset;
+
+	if (Offset != Size) {
+		g_Bouncer->Log("Config store %s has a damaged tail (%u bytes). Discarding it.",
+			m_Filename, (unsigned int)(Size - Offset));
+
+		return Compact();
+	}
+
+	RETURN(bool, true);
+}
+
+/**
+ * Apply
+ *
+ * Applies a record to the in-memory settings.
+ *
+ * @param Op the type of the record
+ * @param Namespace the namespace
+ * @param Key the key
+ * @param Value the value
+ */
+void CConfigStore::Apply(configstore_op_e Op, const char *Namespace, const char *Key, const char *Value) {
+	CHashtable<char *, false> *Settings;
+	const char *OldValue;
+	size_t OldSize;
+
+	if (Op == ConfigStore_Drop) {
+		Settings = m_Namespaces.Get(Namespace);
+
+		if (Settings != NULL) {
+			int i = 0;
+
+			while (hash_t<char *> *Setting = Settings->Iterate(i++)) {
+				m_LiveSize -= ConfigStoreRecordSize(Namespace, Setting->Name, Setting->Value);
+			}
+
+			m_Namespaces.Remove(Namespace);
+		}
+
+		return;
+	}
+
+	if (Op != ConfigStore_Put && Op != ConfigStore_Delete) {
+		return;
+	}
+
+	Settings = GetNamespace(Namespace, true);
+
+	if (Settings == NULL) {
+		return;
+	}
+
+	OldValue = Settings->Get(Key);
+	OldSize = (OldValue != NULL) ? ConfigStoreRecordSize(Namespace, Key, OldValue) : 0;
+
+	if (Op == ConfigStore_Put) {
+		char *NewValue = strdup(Value);
+
+		// the old value is kept
+		if (AllocFailed(NewValue)) {
+			return;
+		}
+
+		// Add() removes the old value even if it fails
+		if (IsError(Settings->Add(Key, NewValue))) {
+			free(NewValue);
+		} else {
+			m_LiveSize += ConfigStoreRecordSize(Namespace, Key, Value);
+		}
+	} else {
+		Settings->Remove(Key);
+	}
+
+	m_LiveSize -= OldSize;
+}
+
+/**
+ * Append
+ *
+ * Appends a record to the store's file.
+ *
+ * @param Op the type of the record
+ * @param Namespace the namespace
+ * @param Key the key
+ * @param Value the value
+ */
+RESULT<bool> CConfigStore::Append(configstore_op_e Op, const char *Namespace, const char *Key, const char *Value) {
+	configstore_record_t Record;
+	char *Data;
+	size_t Length, NamespaceLength, KeyLength;
+
+	if (m_File == NULL) {
+		THROW(bool, Generic_Unknown, "The config store is not open.");
+	}
+
+	NamespaceLength = strlen(Namespace) + 1;
+	KeyLength = strlen(Key) + 1;
+	Length = NamespaceLength + KeyLength + strlen(Value) + 1;
+
+	Data = (char *)malloc(Length);
+
+	if (AllocFailed(Data)) {
+		THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+	}
+
+	memcpy(Data, Namespace, NamespaceLength);
+	memcpy(Data + NamespaceLength, Key, KeyLength);
+	memcpy(Data + NamespaceLength + KeyLength, Value, Length - NamespaceLength - KeyLength);
+
+	Record.Length = Length;
+	Record.Checksum = ConfigStoreChecksum(Data, Length);
+	Record.Op = Op;
+
+	if (fwrite(&Record, sizeof(Record), 1, m_File) != 1 || fwrite(Data, Length, 1, m_File) != 1) {
+		free(Data);
+
+		THROW(bool, Generic_Unknown, "Could not write to config store.");
+	}
+
+	free(Data);
+
+	m_FileSize += sizeof(Record) + Length;
+	m_Dirty = true;
+
+	RETURN(bool, true);
+}
+
+/**
+ * Compact
+ *
+ * Rewrites the store so that it only contains current settings.
+ */
+RESULT<bool> CConfigStore::Compact(void) {
+	char *Filename;
+	FILE *StoreFile, *OldFile;
+	size_t OldFileSize;
+	int rc;
+
+	rc = asprintf(&Filename, "%s.tmp", m_Filename);
+
+	if (RcFailed(rc)) {
+		THROW(bool, Generic_OutOfMemory, "asprintf() failed.");
+	}
+
+	StoreFile = fopen(Filename, "wb");
+
+	if (StoreFile == NULL) {
+		free(Filename);
+
+		THROW(bool, Generic_Unknown, "Could not create temporary config store.");
+	}
+
+	SetPermissions(Filename, S_IRUSR | S_IWUSR);
+
+	OldFile = m_File;
+	OldFileSize = m_FileSize;
+
+	m_File = StoreFile;
+	m_FileSize = fwrite(CONFIGSTORE_MAGIC, 1, strlen(CONFIGSTORE_MAGIC), StoreFile);
+
+	int i = 0;
+	while (hash_t<CHashtable<char *, false> *> *Namespace = m_Namespaces.Iterate(i++)) {
+		int a = 0;
+
+		while (hash_t<char *> *Setting = Namespace->Value->Iterate(a++)) {
+			if (IsError(Append(ConfigStore_Put, Namespace->Name, Setting->Name, Setting->Value))) {
+				break;
+			}
+		}
+	}
+
+	m_File = OldFile;
+
+#ifndef _WIN32
+	if (fflush(StoreFile) != 0 || fsync(fileno(StoreFile)) != 0 || m_FileSize != m_LiveSize + strlen(CONFIGSTORE_MAGIC)) {
+#else /* _WIN32 */
+	if (fflush(StoreFile) != 0 || _commit(_fileno(StoreFile)) != 0 || m_FileSize != m_LiveSize + strlen(CONFIGSTORE_MAGIC)) {
+#endif /* _WIN32 */
+		fclose(StoreFile);
+		unlink(Filename);
+		free(Filename);
+
+		m_FileSize = OldFileSize;
+
+		THROW(bool, Generic_Unknown, "Could not write temporary config store.");
+	}
+
+	fclose(StoreFile);
+
+#ifdef _WIN32
+	if (m_File != NULL) {
+		fclose(m_File);
+		m_File = NULL;
+	}
+
+	unlink(m_Filename);
+#endif
+
+	rc = rename(Filename, m_Filename);
+
+	if (RcFailed(rc)) {
+		unlink(Filename);
+		free(Filename);
+
+		m_FileSize = OldFileSize;
+
+		THROW(bool, Generic_Unknown, "Could not rename() config store.");
+	}
+
+	free(Filename);
+
+	if (m_File != NULL) {
+		fclose(m_File);
+	}
+
+	m_File = fopen(m_Filename, "ab");
+
+	if (m_File == NULL) {
+		THROW(bool, Generic_Unknown, "Could not open config store.");
+	}
+
+	m_Dirty = false;
+
+	RETURN(bool, true);
+}
+
+/**
+ * GetNamespace
+ *
+ * Returns the settings of a namespace, or NULL if the namespace
+ * does not exist.
+ *
+ * @param Namespace the namespace
+ * @param Create whether to create the namespace if it does not exist
+ */
+CHashtable<char *, false> *CConfigStore::GetNamespace(const char *Namespace, bool Create) {
+	CHashtable<char *, false> *Settings = m_Namespaces.Get(Namespace);
+
+	if (Settings == NULL && Create) {
+		Settings = new CHashtable<char *, false>();
+
+		if (AllocFailed(Settings)) {
+			return NULL;
+		}
+
+		Settings->RegisterValueDestructor(FreeString);
+
+		if (IsError(m_Namespaces.Add(Namespace, Settings))) {
+			delete Settings;
+
+			return NULL;
+		}
+	}
+
+	return Settings;
+}
+
+/**
+ * Put
+ *
+ * Sets a value.
+ *
+ * @param Namespace the namespace
+ * @param Key the key
+ * @param Value the new value, or NULL if the value is to be removed
+ */
+RESULT<bool> CConfigStore::Put(const char *Namespace, const char *Key, const char *Value) {
+	RESULT<bool> Result;
+
+	if (Value != NULL) {
+		Result = Append(ConfigStore_Put, Namespace, Key, Value);
+	} else {
+		Result = Append(ConfigStore_Delete, Namespace, Key, "");
+	}
+
+	THROWIFERROR(bool, Result);
+
+	Apply(Value != NULL ? ConfigStore_Put : ConfigStore_Delete, Namespace, Key, Value);
+
+	RETURN(bool, true);
+}
+
+/**
+ * RemoveNamespace
+ *
+ * Removes a namespace and all of its settings.
+ *
+ * @param Namespace the namespace
+ */
+RESULT<bool> CConfigStore::RemoveNamespace(const char *Namespace) {
+	RESULT<bool> Result;
+
+	if (m_Namespaces.Get(Namespace) == NULL) {
+		RETURN(bool, true);
+	}
+
+	Result = Append(ConfigStore_Drop, Namespace, "", "");
+
+	THROWIFERROR(bool, Result);
+
+	Apply(ConfigStore_Drop, Namespace, "", "");
+
+	return Sync();
+}
+
+/**
+ * Sync
+ *
+ * Makes sure that all records have been written to disk. The store is
+ * compacted if it has accumulated enough stale records.
+ */
+RESULT<bool> CConfigStore::Sync(void) {
+	if (m_File == NULL || !m_Dirty) {
+		RETURN(bool, true);
+	}
+
+#ifndef _WIN32
+	if (fflush(m_File) != 0 || fsync(fileno(m_File)) != 0) {
+#else /* _WIN32 */
+	if (fflush(m_File) != 0 || _commit(_fileno(m_File)) != 0) {
+#endif /* _WIN32 */
+		THROW(bool, Generic_Unknown, "Could not write to config store.");
+	}
+
+	m_Dirty = false;
+
+	if (m_FileSize > CONFIGSTORE_COMPACT_SIZE && m_FileSize > 2 * m_LiveSize) {
+		return Compact();
+	}
+
+	RETURN(bool, true);
+}
+
+/**
+ * Import
+ *
+ * Imports the settings from a classic configuration file into a namespace.
+ *
+ * @param Namespace the namespace
+ * @param Filename the configuration file
+ */
+RESULT<bool> CConfigStore::Import(const char *Namespace, const char *Filename) {
+	CConfig *Source;
+	FILE *SourceFile;
+
+	SourceFile = fopen(Filename, "r");
+
+	if (SourceFile == NULL) {
+		THROW(bool, Generic_Unknown, "Could not open configuration file.");
+	}
+
+	fclose(SourceFile);
+
+	Source = new CConfig(Filename, NULL);
+
+	if (AllocFailed(Source)) {
+		THROW(bool, Generic_OutOfMemory, "new operator failed.");
+	}
+
+	GetNamespace(Namespace, true);
+
+	int i = 0;
+	while (hash_t<char *> *Setting = Source->Iterate(i++)) {
+		RESULT<bool> Result = Put(Namespace, Setting->Name, Setting->Value);
+
+		if (IsError(Result)) {
+			Source->Destroy();
+
+			THROWRESULT(bool, Result);
+		}
+	}
+
+	Source->Destroy();
+
+	return Sync();
+}
+
+/**
+ * GetFilename
+ *
+ * Returns the filename of the store.
+ */
+const char *CConfigStore::GetFilename(void) const {
+	return m_Filename;
+}
+
+/**
+ * GetFileSize
+ *
+ * Returns the size of the store's file.
+ */
+size_t CConfigStore::GetFileSize(void) const {
+	return m_FileSize;
+}
+
+/**
+ * GetLiveSize
+ *
+ * Returns the size of all records which are still current.
+ */
+size_t CConfigStore::GetLiveSize(void) const {
+	return m_LiveSize;
+}
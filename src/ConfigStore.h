@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef CONFIGSTORE_H
+#define CONFIGSTORE_H
+
+#define CONFIGSTORE_MAGIC "SBNCSTORE1\n" /**< identifies a config store file */
+#define CONFIGSTORE_COMPACT_SIZE (64 * 1024) /**< minimum file size before compaction is considered */
+
+/**
+ * configstore_op_e
+ *
+ * The type of a record in a config store.
+ */
+enum configstore_op_e {
+	ConfigStore_Put = 1, /**< sets a value */
+	ConfigStore_Delete = 2, /**< removes a value */
+	ConfigStore_Drop = 3 /**< removes a namespace */
+};
+
+/**
+ * configstore_record_t
+ *
+ * The header of a record in a config store. The header is followed by
+ * the namespace, the key and the value (each zero-terminated).
+ */
+typedef struct configstore_record_s {
+	uint32_t Length; /**< the length of the data following the header */
+	uint32_t Checksum; /**< FNV-1a checksum of the data */
+	uint32_t Op; /**< the type of the record (see configstore_op_e) */
+} configstore_record_t;
+
+/**
+ * CConfigStore
+ *
+ * A single-file, log-structured store for configuration settings. Every
+ * change is appended to the file; the file is compacted when it contains
+ * too many stale records. Settings are grouped into namespaces (e.g. one
+ * for each user).
+ */
+class SBNCAPI CConfigStore {
+private:
+	char *m_Filename; /**< the filename of the store */
+	FILE *m_File; /**< the file which new records are appended to */
+	CHashtable<CHashtable<char *, false> *, false> m_Namespaces; /**< the current settings */
+	size_t m_FileSize; /**< the size of the file */
+	size_t m_LiveSize; /**< the size of all records which are still current */
+	bool m_Dirty; /**< whether there are records which have not been synced yet */
+
+	RESULT<bool> Load(void);
+	RESULT<bool> Append(configstore_op_e Op, const char *Namespace, const char *Key, const char *Value);
+	RESULT<bool> Compact(void);
+	void Apply(configstore_op_e Op, const char *Namespace, const char *Key, const char *Value);
+
+public:
+#ifndef SWIG
+	CConfigStore(const char *Filename);
+	virtual ~CConfigStore(void);
+#endif /* SWIG */
+
+	RESULT<bool> Open(void);
+
+	CHashtable<char *, false> *GetNamespace(const char *Namespace, bool Create = false);
+
+	RESULT<bool> Put(const char *Namespace, const char *Key, const char *Value);
+	RESULT<bool> RemoveNamespace(const char *Namespace);
+
+	RESULT<bool> Sync(void);
+
+	RESULT<bool> Import(const char *Namespace, const char *Filename);
+
+	const char *GetFilename(void) const;
+	size_t GetFileSize(void) const;
+	size_t GetLiveSize(void) const;
+};
+
+#endif /* CONFIGSTORE_H */
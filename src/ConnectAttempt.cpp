@@ -0,0 +1,289 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+CHashtable<time_t *, false> *CConnectAttempt::m_Failures; /**< when connections to addresses last failed */
+
+/**
+ * CConnectAttempt
+ *
+ * Constructs a new connection attempt object and registers the socket.
+ *
+ * @param Owner the connection which started the attempt
+ * @param Socket the (connecting) socket
+ * @param Address the remote address
+ */
+CConnectAttempt::CConnectAttempt(CConnection *Owner, SOCKET Socket, const sockaddr *Address) {
+	m_Owner = Owner;
+	m_Socket = Socket;
+
+	memset(&m_Address, 0, sizeof(m_Address));
+	memcpy(&m_Address, Address, SOCKADDR_LEN(Address->sa_family));
+
+	g_Bouncer->RegisterSocket(m_Socket, this);
+}
+
+/**
+ * ~CConnectAttempt
+ *
+ * Destructs the connection attempt object.
+ */
+CConnectAttempt::~CConnectAttempt(void) {
+	Close();
+}
+
+/**
+ * Detach
+ *
+ * Unregisters the socket and returns it. The caller is responsible
+ * for closing the socket.
+ */
+SOCKET CConnectAttempt::Detach(void) {
+	SOCKET Socket = m_Socket;
+
+	if (m_Socket != INVALID_SOCKET) {
+		g_Bouncer->UnregisterSocket(m_Socket);
+	}
+
+	m_Socket = INVALID_SOCKET;
+
+	return Socket;
+}
+
+/**
+ * Close
+ *
+ * Aborts the connection attempt.
+ */
+void CConnectAttempt::Close(void) {
+	SOCKET Socket = Detach();
+
+	if (Socket != INVALID_SOCKET) {
+		closesocket(Socket);
+	}
+}
+
+/**
+ * IsPending
+ *
+ * Checks whether the connection attempt is still in progress.
+ */
+bool CConnectAttempt::IsPending(void) const {
+	return (m_Socket != INVALID_SOCKET);
+}
+
+/**
+ * GetAddress
+ *
+ * Returns the remote address.
+ */
+const sockaddr *CConnectAttempt::GetAddress(void) const {
+	return (const sockaddr *)&m_Address;
+}
+
+/**
+ * Finished
+ *
+ * Reports the result of the connection attempt to the owner.
+ *
+ * @param ErrorCode the error code (or 0 if the connection was established)
+ */
+void CConnectAttempt::Finished(int ErrorCode) {
+	if (m_Socket == INVALID_SOCKET) {
+		return;
+	}
+
+	if (ErrorCode == 0) {
+		RecordSuccess(GetAddress());
+	} else {
+		RecordFailure(GetAddress());
+	}
+
+	m_Owner->AsyncConnectFinished(this, ErrorCode);
+}
+
+/**
+ * Destroy
+ *
+ * Called by the core when the socket has failed. The object itself is
+ * destroyed by its owner.
+ */
+void CConnectAttempt::Destroy(void) {
+	Close();
+}
+
+/**
+ * Read
+ *
+ * Called when the socket is readable, i.e. when the connection has
+ * been established (and the server has already sent data) or has failed.
+ *
+ * @param DontProcess unused
+ */
+int CConnectAttempt::Read(bool DontProcess) {
+	return Write();
+}
+
+/**
+ * Write
+ *
+ * Called when the socket is writable, i.e. when the connection has
+ * been established or has failed.
+ */
+int CConnectAttempt::Write(void) {
+	int ErrorCode = 0;
+	socklen_t ErrorCodeLength = sizeof(ErrorCode);
+
+	if (m_Socket == INVALID_SOCKET) {
+		return 0;
+	}
+
+	if (getsockopt(m_Socket, SOL_SOCKET, SO_ERROR, (char *)&ErrorCode, &ErrorCodeLength) != 0) {
+		ErrorCode = -1;
+	}
+
+	Finished(ErrorCode);
+
+	return 0;
+}
+
+/**
+ * Error
+ *
+ * Called when the connection attempt has failed.
+ *
+ * @param ErrorCode the error code
+ */
+void CConnectAttempt::Error(int ErrorCode) {
+	Finished(ErrorCode != 0 ? ErrorCode : -1);
+}
+
+/**
+ * HasQueuedData
+ *
+ * Connecting sockets become writable once the connection has been
+ * established.
+ */
+bool CConnectAttempt::HasQueuedData(void) const {
+	return true;
+}
+
+/**
+ * ShouldDestroy
+ *
+ * Connection attempts are destroyed by their owner.
+ */
+bool CConnectAttempt::ShouldDestroy(void) const {
+	return false;
+}
+
+/**
+ * GetClassName
+ *
+ * Returns the class' name.
+ */
+const char *CConnectAttempt::GetClassName(void) const {
+	return "CConnectAttempt";
+}
+
+/**
+ * RecordFailure
+ *
+ * Remembers that a connection to an address has failed. Such addresses
+ * are tried last for the next CONNECT_FAILURE_MEMORY seconds.
+ *
+ * @param Address the address
+ */
+void CConnectAttempt::RecordFailure(const sockaddr *Address) {
+	time_t *Failed;
+	char **Keys;
+	char *Key;
+	int i = 0;
+
+	if (m_Failures == NULL) {
+		m_Failures = new CHashtable<time_t *, false>();
+
+		if (AllocFailed(m_Failures)) {
+			return;
+		}
+
+		m_Failures->RegisterValueDestructor(DestroyObject<time_t>);
+	}
+
+	Keys = m_Failures->GetSortedKeys();
+
+	// removing an entry only frees that entry's key
+	while (Keys != NULL && (Key = Keys[i++]) != NULL) {
+		if (*(m_Failures->Get(Key)) + CONNECT_FAILURE_MEMORY < g_CurrentTime) {
+			m_Failures->Remove(Key);
+		}
+	}
+
+	free(Keys);
+
+	Failed = new time_t;
+
+	if (AllocFailed(Failed)) {
+		return;
+	}
+
+	*Failed = g_CurrentTime;
+
+	if (IsError(m_Failures->Add(IpToString((sockaddr *)Address), Failed))) {
+		delete Failed;
+	}
+}
+
+/**
+ * RecordSuccess
+ *
+ * Forgets about previous failures for an address.
+ *
+ * @param Address the address
+ */
+void CConnectAttempt::RecordSuccess(const sockaddr *Address) {
+	if (m_Failures != NULL) {
+		m_Failures->Remove(IpToString((sockaddr *)Address));
+	}
+}
+
+/**
+ * GetFailureTime
+ *
+ * Returns when the last connection to an address failed, or 0 if
+ * there was no recent failure.
+ *
+ * @param Address the address
+ */
+time_t CConnectAttempt::GetFailureTime(const sockaddr *Address) {
+	time_t *Failed;
+
+	if (m_Failures == NULL) {
+		return 0;
+	}
+
+	Failed = m_Failures->Get(IpToString((sockaddr *)Address));
+
+	if (Failed == NULL || *Failed + CONNECT_FAILURE_MEMORY < g_CurrentTime) {
+		return 0;
+	}
+
+	return *Failed;
+}
@@ -0,0 +1,82 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef CONNECTATTEMPT_H
+#define CONNECTATTEMPT_H
+
+#define CONNECT_ATTEMPT_DELAY 250 /**< number of msecs between two connection attempts */
+#define CONNECT_RESOLUTION_DELAY 50 /**< number of msecs to wait for ipv6 addresses */
+#define CONNECT_FAILURE_MEMORY 600 /**< number of seconds failed addresses are tried last */
+
+class CConnection;
+
+/**
+ * connect_candidate_t
+ *
+ * An address to which a connection can be attempted.
+ */
+typedef struct connect_candidate_s {
+	sockaddr_storage Address; /**< the address */
+	int Rank; /**< the position of the address in the dns response */
+	time_t Failed; /**< when the last connection to this address failed (or 0) */
+} connect_candidate_t;
+
+/**
+ * CConnectAttempt
+ *
+ * A non-blocking connection attempt to one of the addresses of a
+ * remote host. The attempt reports its result to the connection object
+ * which started it.
+ */
+class CConnectAttempt : public CSocketEvents {
+private:
+	CConnection *m_Owner; /**< the connection which started this attempt */
+	SOCKET m_Socket; /**< the socket */
+	sockaddr_storage m_Address; /**< the remote address */
+
+	static CHashtable<time_t *, false> *m_Failures; /**< when connections to addresses last failed */
+
+	void Finished(int ErrorCode);
+public:
+	CConnectAttempt(CConnection *Owner, SOCKET Socket, const sockaddr *Address);
+	virtual ~CConnectAttempt(void);
+
+	SOCKET Detach(void);
+	void Close(void);
+
+	bool IsPending(void) const;
+	const sockaddr *GetAddress(void) const;
+
+	void Destroy(void);
+
+	int Read(bool DontProcess = false);
+	int Write(void);
+	void Error(int ErrorCode);
+
+	bool HasQueuedData(void) const;
+	bool ShouldDestroy(void) const;
+
+	const char *GetClassName(void) const;
+
+	static void RecordFailure(const sockaddr *Address);
+	static void RecordSuccess(const sockaddr *Address);
+	static time_t GetFailureTime(const sockaddr *Address);
+};
+
+#endif /* CONNECTATTEMPT_H */
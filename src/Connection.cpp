@@ -24,6 +24,49 @@
 IMPL_DNSEVENTPROXY(CConnection, AsyncDnsFinished);
 IMPL_DNSEVENTPROXY(CConnection, AsyncBindIpDnsFinished);
 
+/**
+ * ConnectAttemptTimer
+ *
+ * Starts the next connection attempt.
+ *
+ * @param Now the current time
+ * @param Connection the connection object
+ */
+bool ConnectAttemptTimer(time_t Now, void *Connection) {
+	((CConnection *)Connection)->m_AttemptTimer = NULL;
+	((CConnection *)Connection)->AsyncConnect();
+
+	return false;
+}
+
+/**
+ * CmpCandidate
+ *
+ * Compares two connect_candidate_t structures. Addresses which have not
+ * failed recently come first, ipv6 and ipv4 addresses are interleaved.
+ *
+ * @param pA the first candidate
+ * @param pB the second candidate
+ */
+static int CmpCandidate(const void *pA, const void *pB) {
+	const connect_candidate_t *a = (const connect_candidate_t *)pA;
+	const connect_candidate_t *b = (const connect_candidate_t *)pB;
+
+	if (a->Failed != b->Failed) {
+		return (a->Failed < b->Failed) ? -1 : 1;
+	}
+
+	if (a->Rank != b->Rank) {
+		return a->Rank - b->Rank;
+	}
+
+	if (a->Address.ss_family != b->Address.ss_family) {
+		return (a->Address.ss_family == AF_INET) ? 1 : -1;
+	}
+
+	return 0;
+}
+
 /**
  * CConnection
  *
@@ -73,11 +116,47 @@ CConnection::CConnection(const char *Host, unsigned int Port, const char *BindIp
 	m_BindDnsQuery = NULL;
 
 	if (Host != NULL) {
+		sockaddr_storage Literal;
+
+		if (SSL && asprintf(&m_SSLSessionKey, "%s:%u", Host, Port) < 0) {
+			m_SSLSessionKey = NULL;
+		}
+
+		// there's no need to look up ip addresses for both families
+		if (Family == AF_UNSPEC && StringToIp(Host, AF_INET, (sockaddr *)&Literal, sizeof(Literal))) {
+			Family = AF_INET;
+#ifdef HAVE_IPV6
+		} else if (Family == AF_UNSPEC && StringToIp(Host, AF_INET6, (sockaddr *)&Literal, sizeof(Literal))) {
+			Family = AF_INET6;
+#else /* HAVE_IPV6 */
+		} else if (Family == AF_UNSPEC) {
+			Family = AF_INET;
+#endif /* HAVE_IPV6 */
+		}
+
+		// the queries might be answered immediately, so all of them
+		// have to be created before starting the first one
+		if (m_BindIpCache != NULL) {
+			m_BindDnsQuery = new CDnsQuery(this, USE_DNSEVENTPROXY(CConnection, AsyncBindIpDnsFinished));
+		}
+
 		m_DnsQuery = new CDnsQuery(this, USE_DNSEVENTPROXY(CConnection, AsyncDnsFinished));
-		m_DnsQuery->GetHostByName(Host, Family);
 
-		// try to connect.. maybe we already have both addresses
-		AsyncConnect();
+		if (Family == AF_UNSPEC) {
+			m_DnsQueryV4 = new CDnsQuery(this, USE_DNSEVENTPROXY(CConnection, AsyncDnsFinished));
+			m_PendingLookups = 2;
+
+			m_DnsQuery->GetHostByName(Host, AF_INET6);
+			m_DnsQueryV4->GetHostByName(Host, AF_INET);
+		} else {
+			m_PendingLookups = 1;
+
+			m_DnsQuery->GetHostByName(Host, Family);
+		}
+
+		if (m_BindDnsQuery != NULL) {
+			m_BindDnsQuery->GetHostByName(m_BindIpCache, Family);
+		}
 	}
 }
 
@@ -98,16 +177,27 @@ void CConnection::InitConnection(SOCKET Client, bool SSL) {
 	m_Traffic = NULL;
 
 	m_DnsQuery = NULL;
+	m_DnsQueryV4 = NULL;
 	m_BindDnsQuery = NULL;
+	m_PendingLookups = 0;
+	m_FirstResponse = 0;
 
-	m_HostAddr = NULL;
 	m_BindAddr = NULL;
+	m_BindFamily = AF_UNSPEC;
+
+	m_NextCandidate = 0;
+	m_AttemptTimer = NULL;
+	m_LastError = 0;
 
 	m_BindIpCache = NULL;
 	m_PortCache = 0;
 
 	m_LatchedDestruction = false;
 	m_Connected = false;
+	m_ProcessingBuffer = false;
+
+	m_SSLSessionKey = NULL;
+	m_Handshake = NULL;
 
 	m_InboundTrafficReset = g_CurrentTime;
 	m_InboundTraffic = 0;
@@ -141,17 +231,33 @@ CConnection::~CConnection(void) {
 	g_Bouncer->UnregisterSocket(m_Socket);
 
 	delete m_DnsQuery;
+	delete m_DnsQueryV4;
 	delete m_BindDnsQuery;
 
+	for (int i = 0; i < m_Attempts.GetLength(); i++) {
+		delete m_Attempts[i];
+	}
+
+	if (m_AttemptTimer != NULL) {
+		m_AttemptTimer->Destroy();
+	}
+
 	free(m_BindIpCache);
 
+	if (m_Handshake != NULL) {
+		// the handshake's completion function closes the socket
+		m_Handshake->Connection = NULL;
+		m_Socket = INVALID_SOCKET;
+		m_SSL = NULL;
+	}
+
 	if (m_Socket != INVALID_SOCKET) {
 		shutdown(m_Socket, SD_BOTH);
 		closesocket(m_Socket);
 	}
-	
-	free(m_HostAddr);
+
 	free(m_BindAddr);
+	free(m_SSLSessionKey);
 
 	delete m_SendQ;
 	delete m_RecvQ;
@@ -203,6 +309,10 @@ void CConnection::InitSocket(void) {
 			}
 
 			SSL_set_ex_data(m_SSL, g_Bouncer->GetSSLCustomIndex(), this);
+
+			if (m_SSLSessionKey != NULL && g_Bouncer->GetSSLSessionCache() != NULL) {
+				g_Bouncer->GetSSLSessionCache()->ResumeClientSession(m_SSL, m_SSLSessionKey);
+			}
 		}
 	} else {
 		m_SSL = NULL;
@@ -212,6 +322,118 @@ void CConnection::InitSocket(void) {
 	g_Bouncer->RegisterSocket(m_Socket, (CSocketEvents *)this);
 }
 
+#ifdef HAVE_LIBSSL
+/**
+ * SSLHandshakeProc
+ *
+ * Continues a TLS handshake on a worker thread using whatever data is
+ * currently available on the (non-blocking) socket.
+ *
+ * @param Handshake the handshake
+ */
+static void SSLHandshakeProc(void *Handshake) {
+	sslhandshake_t *Job = (sslhandshake_t *)Handshake;
+	int Result;
+
+	Result = SSL_do_handshake(Job->SSLObject);
+
+	if (Result == 1) {
+		Job->Error = SSL_ERROR_NONE;
+	} else {
+		Job->Error = SSL_get_error(Job->SSLObject, Result);
+
+		// the error queue is per-thread
+		ERR_clear_error();
+	}
+}
+#endif /* HAVE_LIBSSL */
+
+/**
+ * OffloadHandshake
+ *
+ * Passes the next step of an inbound connection's TLS handshake to one
+ * of the bouncer's handshake threads (if there are any). The socket is
+ * not polled until that step has been completed. Returns false if the
+ * handshake should be continued by the main loop instead.
+ */
+bool CConnection::OffloadHandshake(void) {
+#ifdef HAVE_LIBSSL
+	CThreadPool *Pool = g_Bouncer->GetHandshakePool();
+	sslhandshake_t *Handshake;
+
+	if (Pool == NULL || Pool->GetThreadCount() == 0) {
+		return false;
+	}
+
+	Handshake = (sslhandshake_t *)malloc(sizeof(sslhandshake_t));
+
+	if (AllocFailed(Handshake)) {
+		return false;
+	}
+
+	Handshake->SSLObject = m_SSL;
+	Handshake->Socket = m_Socket;
+	Handshake->Connection = this;
+	Handshake->Error = SSL_ERROR_NONE;
+
+	m_Handshake = Handshake;
+
+	// the connection might be destroyed while the worker is using the SSL object
+	SSL_set_ex_data(m_SSL, g_Bouncer->GetSSLCustomIndex(), NULL);
+
+	g_Bouncer->UnregisterSocket(m_Socket);
+
+	if (IsError(Pool->Submit(SSLHandshakeProc, Handshake, HandshakeCompleted))) {
+		m_Handshake = NULL;
+		free(Handshake);
+
+		SSL_set_ex_data(m_SSL, g_Bouncer->GetSSLCustomIndex(), this);
+
+		g_Bouncer->RegisterSocket(m_Socket, (CSocketEvents *)this);
+
+		return false;
+	}
+
+	return true;
+#else /* HAVE_LIBSSL */
+	return false;
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * HandshakeCompleted
+ *
+ * Returns a connection to the main loop after a handshake thread has
+ * continued its TLS handshake. Connections whose handshake failed are
+ * destroyed by the main loop.
+ *
+ * @param Handshake the handshake
+ */
+void CConnection::HandshakeCompleted(void *Handshake) {
+#ifdef HAVE_LIBSSL
+	sslhandshake_t *Job = (sslhandshake_t *)Handshake;
+	CConnection *Connection = Job->Connection;
+
+	if (Connection == NULL) {
+		SSL_free(Job->SSLObject);
+		shutdown(Job->Socket, SD_BOTH);
+		closesocket(Job->Socket);
+	} else {
+		Connection->m_Handshake = NULL;
+
+		SSL_set_ex_data(Job->SSLObject, g_Bouncer->GetSSLCustomIndex(), Connection);
+
+		if (Job->Error != SSL_ERROR_NONE && Job->Error != SSL_ERROR_WANT_READ && Job->Error != SSL_ERROR_WANT_WRITE) {
+			Connection->m_LatchedDestruction = true;
+		}
+
+		g_Bouncer->RegisterSocket(Connection->m_Socket, (CSocketEvents *)Connection);
+	}
+
+	free(Job);
+#endif /* HAVE_LIBSSL */
+}
+
 /**
  * SetSocket
  *
@@ -250,7 +472,7 @@ int CConnection::Read(bool DontProcess) {
 
 	m_Connected = true;
 
-	if (m_Shutdown) {
+	if (m_Shutdown || m_Handshake != NULL) {
 		return 0;
 	}
 
@@ -263,6 +485,11 @@ int CConnection::Read(bool DontProcess) {
 	}
 
 #ifdef HAVE_LIBSSL
+	// handshakes for inbound connections can be performed by worker threads
+	if (IsSSL() && GetRole() == Role_Server && !SSL_is_init_finished(m_SSL) && OffloadHandshake()) {
+		return 0;
+	}
+
 	if (IsSSL()) {
 		ReadResult = SSL_read(m_SSL, Buffer, BufferSize);
 
@@ -304,6 +531,13 @@ int CConnection::Read(bool DontProcess) {
 		int ErrorCode;
 
 		if (ReadResult == 0) {
+#ifdef HAVE_LIBSSL
+			// sessions of connections which weren't shut down cleanly can't be resumed
+			if (IsSSL()) {
+				SSL_shutdown(m_SSL);
+			}
+#endif
+
 			return -1;
 		}
 
@@ -344,9 +578,22 @@ int CConnection::Write(void) {
 	size_t Size;
 	int ReturnValue = 0;
 
-	Size = m_SendQ->GetSize();
+	// the socket's SSL object is in use by a handshake thread
+	if (m_Handshake != NULL) {
+		return 0;
+	}
 
-	if (Size > 0) {
+#ifdef HAVE_LIBSSL
+	// the handshake for outgoing connections starts once the socket is writable
+	if (IsSSL() && GetRole() == Role_Client && SSL_in_before(m_SSL)) {
+		SSL_do_handshake(m_SSL);
+
+		return 0;
+	}
+#endif
+
+	// the sendq may consist of several chunks when it contains shared blocks
+	while ((Size = m_SendQ->GetChunkSize()) > 0) {
 		int WriteResult;
 
 #ifdef HAVE_LIBSSL
@@ -377,8 +624,20 @@ int CConnection::Write(void) {
 			}
 
 			m_SendQ->Read(WriteResult);
-		} else if (WriteResult < 0) {
-			Shutdown();
+
+			if ((size_t)WriteResult < Size) {
+				break;
+			}
+		} else {
+#ifdef _WIN32
+			if (WriteResult < 0 && ReturnValue != WSAEWOULDBLOCK) {
+#else
+			if (WriteResult < 0 && ReturnValue != EAGAIN) {
+#endif
+				Shutdown();
+			}
+
+			break;
 		}
 	}
 
@@ -401,12 +660,20 @@ int CConnection::Write(void) {
 /**
  * ProcessBuffer
  *
- * Processes the data which is in the recvq.
+ * Processes the data which is in the recvq. Lines which are received
+ * while parsing is suspended stay in the recvq.
  */
 void CConnection::ProcessBuffer(void) {
 	char *RecvQ, *Line;
 	size_t Size;
-	
+
+	// a nested call would parse the current line again
+	if (m_ProcessingBuffer || IsParsingSuspended()) {
+		return;
+	}
+
+	m_ProcessingBuffer = true;
+
 	Line = RecvQ = m_RecvQ->Peek();
 
 	Size = m_RecvQ->GetSize();
@@ -416,7 +683,7 @@ void CConnection::ProcessBuffer(void) {
 			char *dupLine = (char *)malloc(&(RecvQ[i]) - Line + 1);
 
 			if (AllocFailed(dupLine)) {
-				return;
+				break;
 			}
 
 			memcpy(dupLine, Line, &(RecvQ[i]) - Line);
@@ -429,10 +696,26 @@ void CConnection::ProcessBuffer(void) {
 			free(dupLine);
 
 			Line = &RecvQ[i + 1];
+
+			if (IsParsingSuspended()) {
+				break;
+			}
 		}
 	}
 
 	m_RecvQ->Read(Line - RecvQ);
+
+	m_ProcessingBuffer = false;
+}
+
+/**
+ * IsParsingSuspended
+ *
+ * Returns whether ProcessBuffer() should leave the lines in the recvq
+ * for now.
+ */
+bool CConnection::IsParsingSuspended(void) const {
+	return false;
 }
 
 /**
@@ -500,6 +783,18 @@ void CConnection::WriteUnformattedLine(const char *Line) {
 	m_SendQ->WriteUnformattedLine(Line);
 }
 
+/**
+ * WriteBlock
+ *
+ * Queues a shared block for the connection. The block is referenced
+ * rather than copied.
+ *
+ * @param Block the block
+ */
+void CConnection::WriteBlock(fifo_block_t *Block) {
+	m_SendQ->WriteBlock(Block);
+}
+
 /**
  * WriteLine
  *
@@ -591,6 +886,11 @@ bool CConnection::HasQueuedData(void) const {
 			return true;
 		}
 
+		// outgoing connections have to send the first handshake message
+		if (GetRole() == Role_Client && SSL_in_before(m_SSL)) {
+			return true;
+		}
+
 		if (SSL_get_state(m_SSL) != TLS_ST_OK) {
 			return false;
 		}
@@ -723,6 +1023,16 @@ const X509 *CConnection::GetPeerCertificate(void) const {
 	return NULL;
 }
 
+/**
+ * GetSSLSessionKey
+ *
+ * Returns the key which is used for resuming TLS sessions with the
+ * remote server, or NULL if sessions are not resumed for this connection.
+ */
+const char *CConnection::GetSSLSessionKey(void) const {
+	return m_SSLSessionKey;
+}
+
 /**
  * SSLVerify
  *
@@ -735,108 +1045,257 @@ int CConnection::SSLVerify(int PreVerifyOk, X509_STORE_CTX *Context) const {
 /**
  * AsyncConnect
  *
- * Tries to establish a connection.
+ * Starts the next connection attempt unless the connection has already
+ * been established or another attempt has been scheduled.
  */
 void CConnection::AsyncConnect(void) {
-	if (m_HostAddr != NULL && (m_BindAddr != NULL || m_BindIpCache == NULL)) {
-		sockaddr *Remote = NULL, *Bind = NULL;
-		sockaddr_in RemoteV4, BindV4;
-		sockaddr_in6 RemoteV6, BindV6;
-
-		if (m_Family == AF_INET) {
-			memset(&RemoteV4, 0, sizeof(RemoteV4));
-			RemoteV4.sin_family = m_Family;
-			RemoteV4.sin_port = htons(m_PortCache);
-			RemoteV4.sin_addr.s_addr = ((in_addr *)m_HostAddr)->s_addr;
-
-			Remote = (sockaddr *)&RemoteV4;
-
-			if (m_BindAddr != NULL) {
-				memset(&BindV4, 0, sizeof(BindV4));
-				BindV4.sin_family = m_Family;
-				BindV4.sin_port = 0;
-				BindV4.sin_addr.s_addr = ((in_addr *)m_BindAddr)->s_addr;
-
-				Bind = (sockaddr *)&BindV4;
+	int Pending = 0;
+
+	if (m_Socket != INVALID_SOCKET || m_BindIpCache != NULL || m_AttemptTimer != NULL || m_LatchedDestruction) {
+		return;
+	}
+
+	for (int i = 0; i < m_Attempts.GetLength(); i++) {
+		if (m_Attempts[i]->IsPending()) {
+			Pending++;
+		}
+	}
+
+	// give the ipv6 lookup a chance to finish if the ipv4 addresses are known
+	if (m_Attempts.GetLength() == 0 && m_PendingLookups > 0 && m_NextCandidate < m_Candidates.GetLength() &&
+			m_Candidates[m_NextCandidate].Address.ss_family == AF_INET) {
+		uint64_t Now = UtilMsecTime();
+
+		if (Now < m_FirstResponse + CONNECT_RESOLUTION_DELAY) {
+			ScheduleAttempt((unsigned int)(m_FirstResponse + CONNECT_RESOLUTION_DELAY - Now));
+
+			return;
+		}
+	}
+
+	if (StartAttempt()) {
+		if (m_NextCandidate < m_Candidates.GetLength() || m_PendingLookups > 0) {
+			ScheduleAttempt(CONNECT_ATTEMPT_DELAY);
+		}
+	} else if (Pending == 0 && m_PendingLookups == 0) {
+		// there are no more addresses
+		if (m_Attempts.GetLength() > 0) {
+#ifndef _WIN32
+			if (m_LastError == 0) {
+				m_LastError = -1;
 			}
-#ifdef HAVE_IPV6
-		} else if (m_Family == AF_INET6) {
-			memset(&RemoteV6, 0, sizeof(RemoteV6));
-			RemoteV6.sin6_family = m_Family;
-			RemoteV6.sin6_port = htons(m_PortCache);
-			memcpy(&(RemoteV6.sin6_addr), m_HostAddr, sizeof(in6_addr));
+#endif
 
-			Remote = (sockaddr *)&RemoteV6;
+			Error(m_LastError);
+		}
 
-			if (m_BindAddr != NULL) {
-				memset(&BindV6, 0, sizeof(BindV6));
-				BindV6.sin6_family = m_Family;
-				BindV6.sin6_port = 0;
-				memcpy(&(BindV6.sin6_addr), m_BindAddr, sizeof(in6_addr));
+		// we cannot destroy the object here as there might still be the other
+		// dns query (bind ip) in the queue which would get destroyed in the
+		// destructor; this causes a crash in the StartMainLoop() function
+		m_LatchedDestruction = true;
+	}
+}
 
-				Bind = (sockaddr *)&BindV6;
+/**
+ * StartAttempt
+ *
+ * Starts a connection attempt to the next address. Returns false if
+ * there are no more addresses.
+ */
+bool CConnection::StartAttempt(void) {
+	while (m_NextCandidate < m_Candidates.GetLength()) {
+		sockaddr *Remote = (sockaddr *)&(m_Candidates[m_NextCandidate++].Address), *Bind = NULL;
+		sockaddr_storage BindAddress;
+		SOCKET Socket;
+		int ErrorCode;
+
+		if (m_BindAddr != NULL) {
+			// we can't use the bind address for the other address family
+			if (Remote->sa_family != m_BindFamily) {
+				continue;
 			}
+
+			memset(&BindAddress, 0, sizeof(BindAddress));
+			BindAddress.ss_family = m_BindFamily;
+
+			if (m_BindFamily == AF_INET) {
+				memcpy(&(((sockaddr_in *)&BindAddress)->sin_addr), m_BindAddr, sizeof(in_addr));
+#ifdef HAVE_IPV6
+			} else {
+				memcpy(&(((sockaddr_in6 *)&BindAddress)->sin6_addr), m_BindAddr, sizeof(in6_addr));
 #endif /* HAVE_IPV6 */
-		} else {
-			Error(0);
+			}
+
+			Bind = (sockaddr *)&BindAddress;
+		}
+
+		Socket = SocketAndConnectResolved(Remote, Bind, &ErrorCode);
+
+		if (Socket == INVALID_SOCKET) {
+			CConnectAttempt::RecordFailure(Remote);
+			m_LastError = ErrorCode;
+
+			continue;
+		}
+
+		CConnectAttempt *Attempt = new CConnectAttempt(this, Socket, Remote);
+
+		if (AllocFailed(Attempt)) {
+			closesocket(Socket);
+
+			return false;
+		}
+
+		if (IsError(m_Attempts.Insert(Attempt))) {
+			delete Attempt;
+
+			return false;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * ScheduleAttempt
+ *
+ * Schedules the next connection attempt.
+ *
+ * @param Delay the number of msecs until the next attempt
+ */
+void CConnection::ScheduleAttempt(unsigned int Delay) {
+	if (m_AttemptTimer == NULL) {
+		m_AttemptTimer = new CTimer(0, false, ConnectAttemptTimer, this);
 
+		if (AllocFailed(m_AttemptTimer)) {
 			return;
 		}
+	}
 
-		int ErrorCode;
-		m_Socket = SocketAndConnectResolved(Remote, Bind, &ErrorCode);
+	m_AttemptTimer->RescheduleMsec(UtilMsecTime() + Delay);
+}
 
-		free(m_HostAddr);
-		m_HostAddr = NULL;
+/**
+ * AsyncConnectFinished
+ *
+ * Called when a connection attempt has succeeded or failed.
+ *
+ * @param Attempt the connection attempt
+ * @param ErrorCode the error code (or 0 if the connection was established)
+ */
+void CConnection::AsyncConnectFinished(CConnectAttempt *Attempt, int ErrorCode) {
+	if (ErrorCode != 0) {
+		Attempt->Close();
 
-		if (m_Socket == INVALID_SOCKET) {
-#ifndef _WIN32
-			if (ErrorCode == 0) {
-				ErrorCode = -1;
-			}
-#endif
+		m_LastError = ErrorCode;
 
-			Error(ErrorCode);
+		// don't wait for the timer if the attempt failed early
+		if (m_AttemptTimer != NULL) {
+			m_AttemptTimer->Destroy();
+			m_AttemptTimer = NULL;
+		}
 
-			m_LatchedDestruction = true;
-		} else {
-			InitSocket();
+		AsyncConnect();
+
+		return;
+	}
+
+	bool Earlier = true;
+
+	for (int i = 0; i < m_Attempts.GetLength(); i++) {
+		if (m_Attempts[i] == Attempt) {
+			Earlier = false;
+
+			continue;
+		}
+
+		// attempts which were started earlier and are still pending are
+		// tried later next time
+		if (Earlier && m_Attempts[i]->IsPending()) {
+			CConnectAttempt::RecordFailure(m_Attempts[i]->GetAddress());
 		}
+
+		m_Attempts[i]->Close();
+	}
+
+	if (m_AttemptTimer != NULL) {
+		m_AttemptTimer->Destroy();
+		m_AttemptTimer = NULL;
 	}
+
+	m_Family = Attempt->GetAddress()->sa_family;
+	m_Socket = Attempt->Detach();
+
+	InitSocket();
 }
 
 /**
- * AsyncDnsFinished
+ * AddCandidates
  *
- * Called when the DNS query for the remote host is finished.
+ * Adds the addresses from a dns response to the list of addresses
+ * which should be tried.
  *
  * @param Response the response
  */
-void CConnection::AsyncDnsFinished(hostent *Response) {
-	if (Response == NULL || Response->h_addr_list[0] == NULL) {
-		// we cannot destroy the object here as there might still be the other
-		// dns query (bind ip) in the queue which would get destroyed in the
-		// destructor; this causes a crash in the StartMainLoop() function
-		m_LatchedDestruction = true;
+void CConnection::AddCandidates(hostent *Response) {
+	connect_candidate_t Candidate;
 
-		return;
-	 }
+	for (int i = 0; Response->h_addr_list[i] != NULL; i++) {
+		memset(&Candidate, 0, sizeof(Candidate));
 
-	int Size = INADDR_LEN(Response->h_addrtype);
+		Candidate.Address.ss_family = Response->h_addrtype;
+		Candidate.Rank = i;
 
-	m_HostAddr = malloc(Size);
+		if (Response->h_addrtype == AF_INET) {
+			((sockaddr_in *)&(Candidate.Address))->sin_port = htons(m_PortCache);
+			memcpy(&(((sockaddr_in *)&(Candidate.Address))->sin_addr), Response->h_addr_list[i], sizeof(in_addr));
+#ifdef HAVE_IPV6
+		} else if (Response->h_addrtype == AF_INET6) {
+			((sockaddr_in6 *)&(Candidate.Address))->sin6_port = htons(m_PortCache);
+			memcpy(&(((sockaddr_in6 *)&(Candidate.Address))->sin6_addr), Response->h_addr_list[i], sizeof(in6_addr));
+#endif /* HAVE_IPV6 */
+		} else {
+			continue;
+		}
 
-	if (AllocFailed(m_HostAddr)) {
-		m_LatchedDestruction = true;
-		return;
+		Candidate.Failed = CConnectAttempt::GetFailureTime((sockaddr *)&(Candidate.Address));
+
+		m_Candidates.Insert(Candidate);
 	}
 
-	m_Family = Response->h_addrtype;
-	memcpy(m_HostAddr, Response->h_addr_list[0], Size);
+	// only the addresses which haven't been tried yet are re-ordered
+	qsort(m_Candidates.GetList() + m_NextCandidate, m_Candidates.GetLength() - m_NextCandidate,
+		sizeof(connect_candidate_t), CmpCandidate);
+}
+
+/**
+ * LookupFailed
+ *
+ * Checks whether all hostname lookups have been completed without
+ * returning any addresses.
+ */
+bool CConnection::LookupFailed(void) const {
+	return (m_PendingLookups == 0 && m_Candidates.GetLength() == 0);
+}
 
-	 if (m_BindIpCache != NULL) {
-		m_BindDnsQuery = new CDnsQuery(this, USE_DNSEVENTPROXY(CConnection, AsyncBindIpDnsFinished));
-		m_BindDnsQuery->GetHostByName(m_BindIpCache, Response->h_addrtype);
+/**
+ * AsyncDnsFinished
+ *
+ * Called when a DNS query for the remote host is finished.
+ *
+ * @param Response the response
+ */
+void CConnection::AsyncDnsFinished(hostent *Response) {
+	m_PendingLookups--;
+
+	if (m_FirstResponse == 0) {
+		m_FirstResponse = UtilMsecTime();
+	}
+
+	if (Response != NULL) {
+		AddCandidates(Response);
 	}
 
 	AsyncConnect();
@@ -857,6 +1316,7 @@ void CConnection::AsyncBindIpDnsFinished(hostent *Response) {
 		m_BindAddr = malloc(Size);
 
 		if (!AllocFailed(m_BindAddr)) {
+			m_BindFamily = Response->h_addrtype;
 			memcpy(m_BindAddr, Response->h_addr_list[0], Size);
 		}
 	}
@@ -988,5 +1448,10 @@ void CConnection::SetSSLObject(void *SSLObject) {
 	}
 
 	m_SSL = (SSL *)SSLObject;
+
+	// the object might still point to the connection it was taken from
+	if (m_SSL != NULL) {
+		SSL_set_ex_data(m_SSL, g_Bouncer->GetSSLCustomIndex(), this);
+	}
 #endif
 }
@@ -23,6 +23,8 @@
 class CUser;
 class CTrafficStats;
 class CFIFOBuffer;
+class CConnectAttempt;
+class CConnection;
 
 /**
  * connection_role_e
@@ -35,15 +37,36 @@ enum connection_role_e {
 	Role_Client
 };
 
+#ifndef SWIG
+bool ConnectAttemptTimer(time_t Now, void *Connection);
+
+/**
+ * sslhandshake_t
+ *
+ * A step of a TLS handshake which is performed by a worker thread. The
+ * socket and the SSL object belong to the worker until the step is completed.
+ */
+typedef struct sslhandshake_s {
+	SSL *SSLObject; /**< the SSL object */
+	SOCKET Socket; /**< the socket */
+	CConnection *Connection; /**< the connection, or NULL if it was destroyed in the meantime */
+	int Error; /**< the result of SSL_get_error(), or SSL_ERROR_NONE if the handshake is finished */
+} sslhandshake_t;
+#endif /* SWIG */
+
 /**
  * CConnection
  *
- * A base class for connections.
+ * A base class for connections. Outbound connections are attempted to
+ * all addresses of the remote host (ipv6 and ipv4 addresses are looked up
+ * in parallel), starting a new attempt every CONNECT_ATTEMPT_DELAY msecs
+ * until one of them succeeds.
  */
 class SBNCAPI CConnection : public CSocketEvents {
 #ifndef SWIG
 	friend class CCore;
 	friend class CUser;
+	friend bool ConnectAttemptTimer(time_t Now, void *Connection);
 #endif /* SWIG */
 protected:
 	virtual void ParseLine(const char *Line);
@@ -55,14 +78,17 @@ protected:
 	void InitSocket(void);
 
 	void ProcessBuffer(void);
+	virtual bool IsParsingSuspended(void) const;
 
 	void AsyncConnect(void);
+	bool LookupFailed(void) const;
 
 	bool m_Shutdown; /**< are we about to close this socket? */
 	time_t m_Timeout; /**< timeout for this socket */
 
 	bool m_HasSSL; /**< is this an ssl-enabled connection? */
 	SSL *m_SSL; /**< SSL context for this connection */
+	char *m_SSLSessionKey; /**< the server's name and port for resuming TLS sessions, or NULL */
 
 	CFIFOBuffer *m_SendQ; /**< send queue */
 	CFIFOBuffer *m_RecvQ; /**< receive queue */
@@ -72,9 +98,13 @@ protected:
 public:
 	virtual void AsyncDnsFinished(hostent *Response);
 	virtual void AsyncBindIpDnsFinished(hostent *Response);
+	void AsyncConnectFinished(CConnectAttempt *Attempt, int ErrorCode);
 
 private:
 	CDnsQuery *m_DnsQuery; /**< the dns query for looking up the hostname */
+	CDnsQuery *m_DnsQueryV4; /**< the dns query for ipv4 addresses when both families are used */
+	int m_PendingLookups; /**< the number of hostname lookups which are in progress */
+	uint64_t m_FirstResponse; /**< when the first hostname lookup was completed */
 	CDnsQuery *m_BindDnsQuery; /**< the dns query for looking up the bind address */
 	unsigned int m_PortCache; /**< the port or -1 if the cache is invalided */
 	char *m_BindIpCache; /**< the bind address */
@@ -82,7 +112,13 @@ private:
 	CTrafficStats *m_Traffic; /**< the traffic statistics for this connection */
 
 	void *m_BindAddr; /**< the bind address (an in_addr or in_addr6) */
-	void *m_HostAddr; /** the remote address (an in_addr or in_addr6) */
+	int m_BindFamily; /**< the bind address' family */
+
+	CVector<connect_candidate_t> m_Candidates; /**< the remote addresses */
+	int m_NextCandidate; /**< the next address which should be tried */
+	CVector<CConnectAttempt *> m_Attempts; /**< the connection attempts */
+	CTimer *m_AttemptTimer; /**< starts the next connection attempt */
+	int m_LastError; /**< the error code of the last failed attempt */
 
 	connection_role_e m_Role; /**< the role of this connection */
 
@@ -90,11 +126,24 @@ private:
 	int m_Family; /**< the socket's address family */
 
 	bool m_Connected; /**< is the object connected? */
+	bool m_ProcessingBuffer; /**< whether ProcessBuffer() is running */
 
 	time_t m_InboundTrafficReset; /**< when the inbound traffic was last reset */
 	size_t m_InboundTraffic; /**< inbound traffic (in bytes) since last reset */
 
+#ifndef SWIG
+	sslhandshake_t *m_Handshake; /**< the TLS handshake which is in progress on a worker thread, or NULL */
+#endif /* SWIG */
+
 	void InitConnection(SOCKET Client, bool SSL);
+	bool OffloadHandshake(void);
+
+#ifndef SWIG
+	static void HandshakeCompleted(void *Handshake);
+#endif /* SWIG */
+	void AddCandidates(hostent *Response);
+	bool StartAttempt(void);
+	void ScheduleAttempt(unsigned int Delay);
 
 	virtual const char *GetClassName(void) const;
 public:
@@ -108,6 +157,7 @@ public:
 	SOCKET GetSocket(void) const;
 
 	virtual void WriteUnformattedLine(const char *Line);
+	virtual void WriteBlock(fifo_block_t *Block);
 	virtual void WriteLine(const char *Format, ...);
 	virtual bool ReadLine(char **Out);
 
@@ -127,6 +177,7 @@ public:
 
 	bool IsSSL(void) const;
 	const X509 *GetPeerCertificate(void) const;
+	const char *GetSSLSessionKey(void) const;
 	virtual int SSLVerify(int PreVerifyOk, X509_STORE_CTX *Context) const;
 
 	sockaddr *GetRemoteAddress(void) const;
@@ -28,18 +28,18 @@ int SSLVerifyCertificate(int preverify_ok, X509_STORE_CTX *x509ctx);
 int g_SSLCustomIndex; /**< custom SSL index */
 #endif
 
-time_t g_LastReconnect = 0; /**< time of the last reconnect */
-
 static struct reslimit_s {
 	const char *Resource;
 	unsigned int DefaultLimit;
+	int SystemOption;
+	int UserOption;
 } g_ResourceLimits[] = {
-		{ "channels", 50 },
-		{ "nicks", 5000 },
-		{ "bans", 100 },
-		{ "keys", 50 },
-		{ "clients", 5 },
-		{ NULL, 0 }
+		{ "channels", 50, CacheId(System, maxchannels), CacheId(User, maxchannels) },
+		{ "nicks", 5000, CacheId(System, maxnicks), CacheId(User, maxnicks) },
+		{ "bans", 100, CacheId(System, maxbans), CacheId(User, maxbans) },
+		{ "keys", 50, CacheId(System, maxkeys), CacheId(User, maxkeys) },
+		{ "clients", 5, CacheId(System, maxclients), CacheId(User, maxclients) },
+		{ NULL, 0, 0, 0 }
 	};
 
 /**
@@ -52,8 +52,6 @@ static struct reslimit_s {
  * @param argv program arguments
  */
 CCore::CCore(CConfig *Config, int argc, char **argv) {
-	int i;
-
 	m_Log = NULL;
 
 	m_PidFile = NULL;
@@ -64,10 +62,12 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 
 	m_SSLContext = NULL;
 	m_SSLClientContext = NULL;
+	m_SSLSessionCache = NULL;
+	m_HandshakePool = NULL;
 
 	m_Status = Status_Running; 
 
-	CacheInitialize(m_ConfigCache, Config, "system.");
+	CacheInitialize(m_ConfigCache, Config);
 
 	char *SourcePath = strdup(BuildPathLog("sbnc.log"));
 	rename(SourcePath, BuildPathLog("sbnc.log.old"));
@@ -94,11 +94,22 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 
 	m_Ident = new CIdentSupport();
 
+	m_ReconnectPlanner = new CReconnectPlanner();
+
+	if (AllocFailed(m_ReconnectPlanner)) {
+		Fatal();
+	}
+
+	m_ReputationTable = new CReputationTable();
+
+	if (AllocFailed(m_ReputationTable)) {
+		Fatal();
+	}
+
 	m_Config = new CConfig("sbnc.conf", NULL);
-	CacheInitialize(m_ConfigCache, m_Config, "system.");
+	CacheInitialize(m_ConfigCache, m_Config);
 
 	const char *Users;
-	CUser *User;
 
 	if ((Users = m_Config->ReadString("system.users")) == NULL) {
 		if (!MakeConfig()) {
@@ -111,30 +122,29 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 		exit(EXIT_SUCCESS);
 	}
 
-	const char *Args;
-	int Count;
-
-	Args = ArgTokenize(Users);
+	const char *StoreFile = m_Config->ReadString("system.configstore");
 
-	if (AllocFailed(Args)) {
-		Fatal();
-	}
+	if (StoreFile != NULL) {
+		m_ConfigStore = new CConfigStore(BuildPathConfig(StoreFile));
 
-	Count = ArgCount(Args);
+		if (AllocFailed(m_ConfigStore)) {
+			Fatal();
+		}
 
-	for (i = 0; i < Count; i++) {
-		const char *Name = ArgGet(Args, i + 1);
+		RESULT<bool> Result = m_ConfigStore->Open();
 
-		User = new CUser(Name);
+		if (IsError(Result)) {
+			Log("Could not open config store %s: %s", m_ConfigStore->GetFilename(), GETDESCRIPTION(Result));
 
-		if (AllocFailed(User)) {
 			Fatal();
 		}
-
-		m_Users.Add(Name, User);
+	} else {
+		m_ConfigStore = NULL;
 	}
 
-	ArgFree(Args);
+	m_CertificateIndex.RegisterValueDestructor(DestroyObject<CVector<CUser *> >);
+
+	LoadUsers(Users);
 
 	m_Listener = NULL;
 	m_ListenerV6 = NULL;
@@ -148,9 +158,195 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 
 	InitializeSocket();
 
+	unsigned int Threads = CacheGetInteger(m_ConfigCache, workerthreads);
+
+	if (Threads == 0) {
+		Threads = CThreadPool::GetProcessorCount();
+	}
+
+	m_WorkerPool = new CThreadPool(Threads);
+
+	if (AllocFailed(m_WorkerPool)) {
+		Fatal();
+	}
+
 	m_Capabilities = new CVector<const char *>();
 	m_Capabilities->Insert("multi-prefix");
 	m_Capabilities->Insert("znc.in/server-time-iso");
+	m_Capabilities->Insert("batch");
+
+	m_Commands = NULL;
+	CClientConnection::RegisterCommands(&m_Commands);
+}
+
+/**
+ * LoadUserSnapshot
+ *
+ * Loads the settings and certificates of a user. This function is
+ * run by the worker threads which are used by CCore::LoadUsers.
+ *
+ * @param Cookie the user's snapshot
+ */
+static void LoadUserSnapshot(void *Cookie) {
+	usersnapshot_t *Snapshot = (usersnapshot_t *)Cookie;
+
+	if (Snapshot->ConfigPath != NULL) {
+		RESULT<confighash_t *> Settings = CConfig::ParseFile(Snapshot->ConfigPath);
+
+		if (IsError(Settings)) {
+			Snapshot->Failed = true;
+		} else {
+			Snapshot->Settings = Settings;
+		}
+	}
+
+	CUser::LoadCertificates(Snapshot->CertificatePath, &Snapshot->Certificates);
+}
+
+/**
+ * LoadUsers
+ *
+ * Creates the user objects. The users' configuration files and certificates
+ * are read and parsed by a pool of worker threads first, afterwards the
+ * user objects are created from these snapshots.
+ *
+ * @param Users a space-delimited list of users
+ */
+void CCore::LoadUsers(const char *Users) {
+	char *UserList, *Name, *Out;
+	usersnapshot_t *Snapshots;
+	CThreadPool *Pool;
+	unsigned int Threads;
+	uint64_t Start, Parsed, Wired;
+	int Count = 0, i, rc;
+
+	UserList = strdup(Users);
+
+	if (AllocFailed(UserList)) {
+		Fatal();
+	}
+
+	for (Name = UserList; *Name != '\0'; Name++) {
+		if (*Name != ' ' && (Name == UserList || *(Name - 1) == ' ')) {
+			Count++;
+		}
+	}
+
+	if (Count == 0) {
+		free(UserList);
+
+		return;
+	}
+
+	Snapshots = new usersnapshot_t[Count];
+
+	if (AllocFailed(Snapshots)) {
+		Fatal();
+	}
+
+	i = 0;
+
+	for (Name = strtok(UserList, " "); Name != NULL; Name = strtok(NULL, " ")) {
+		usersnapshot_t *Snapshot = &Snapshots[i++];
+
+		Snapshot->Name = Name;
+		Snapshot->ConfigPath = NULL;
+		Snapshot->Settings = NULL;
+		Snapshot->Failed = false;
+
+		// the settings are already in memory if the config store is used
+		if (m_ConfigStore == NULL) {
+			rc = asprintf(&Out, "users/%s.conf", Name);
+
+			if (RcFailed(rc)) {
+				Fatal();
+			}
+
+			Snapshot->ConfigPath = strdup(BuildPathConfig(Out));
+
+			free(Out);
+
+			if (AllocFailed(Snapshot->ConfigPath)) {
+				Fatal();
+			}
+		}
+
+		rc = asprintf(&Out, "users/%s.pem", Name);
+
+		if (RcFailed(rc)) {
+			Fatal();
+		}
+
+		Snapshot->CertificatePath = strdup(BuildPathConfig(Out));
+
+		free(Out);
+
+		if (AllocFailed(Snapshot->CertificatePath)) {
+			Fatal();
+		}
+	}
+
+	Start = UtilMsecTime();
+
+	Threads = CacheGetInteger(m_ConfigCache, loadthreads);
+
+	if (Threads == 0) {
+		Threads = CThreadPool::GetProcessorCount();
+	}
+
+	if (Threads > (unsigned int)Count) {
+		Threads = Count;
+	}
+
+	Pool = new CThreadPool(Threads);
+
+	if (AllocFailed(Pool)) {
+		Fatal();
+	}
+
+	for (i = 0; i < Count; i++) {
+		if (IsError(Pool->Submit(LoadUserSnapshot, &Snapshots[i]))) {
+			LoadUserSnapshot(&Snapshots[i]);
+		}
+	}
+
+	Pool->Wait();
+
+	Threads = Pool->GetThreadCount();
+
+	delete Pool;
+
+	Parsed = UtilMsecTime();
+
+	for (i = 0; i < Count; i++) {
+		if (Snapshots[i].Failed) {
+			Log("Config file %s could not be parsed.", Snapshots[i].ConfigPath);
+
+			Fatal();
+		}
+
+		CUser *User = new CUser(Snapshots[i].Name, &Snapshots[i]);
+
+		if (AllocFailed(User)) {
+			Fatal();
+		}
+
+		m_Users.Add(Snapshots[i].Name, User);
+
+		free(Snapshots[i].ConfigPath);
+		free(Snapshots[i].CertificatePath);
+	}
+
+	delete[] Snapshots;
+
+	free(UserList);
+
+	Wired = UtilMsecTime();
+
+	Log("Loaded %d user%s in %u msecs (parsing: %u msecs using %u thread%s, setup: %u msecs).",
+		Count, Count != 1 ? "s" : "", (unsigned int)(Wired - Start),
+		(unsigned int)(Parsed - Start), Threads, Threads != 1 ? "s" : "",
+		(unsigned int)(Wired - Parsed));
 }
 
 /**
@@ -167,6 +363,9 @@ CCore::~CCore(void) {
 
 	m_Modules.Clear();
 
+	delete m_WorkerPool;
+	delete m_HandshakePool;
+
 	UninitializeAdditionalListeners();
 
 	for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
@@ -180,11 +379,23 @@ CCore::~CCore(void) {
 		delete User->Value;
 	}
 
+	CConfig::FlushAll();
+
+	delete m_ConfigStore;
+	delete m_ReconnectPlanner;
+	delete m_ReputationTable;
+
+#ifdef HAVE_LIBSSL
+	delete m_SSLSessionCache;
+#endif /* HAVE_LIBSSL */
+
 	CTimer::DestroyAllTimers();
 
 	delete m_Log;
 	delete m_Ident;
 
+	FlushCommands(&m_Commands);
+
 	g_Bouncer = NULL;
 
 	UnlockPidFile();
@@ -301,6 +512,22 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	} else {
 		SSL_CTX_set_verify(m_SSLClientContext, SSL_VERIFY_PEER, SSLVerifyCertificate);
 	}
+
+	m_SSLSessionCache = new CSSLSessionCache(m_SSLContext, m_SSLClientContext);
+
+	if (AllocFailed(m_SSLSessionCache)) {
+		Fatal();
+	}
+
+	RESULT<int> HandshakeThreads = m_Config->ReadInteger("system.sslhandshakethreads");
+
+	if (!IsError(HandshakeThreads) && HandshakeThreads > 0 && m_SSLContext != NULL) {
+		m_HandshakePool = new CThreadPool(HandshakeThreads);
+
+		if (AllocFailed(m_HandshakePool)) {
+			Fatal();
+		}
+	}
 #endif
 
 	if (Port != 0 && m_Listener != NULL && m_Listener->IsValid()) {
@@ -382,7 +609,9 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	time_t Last = 0;
 
 	while (GetStatus() == Status_Running || --m_ShutdownLoop) {
-		time_t Now, Best = 0, SleepInterval = 0;
+		time_t Now;
+		uint64_t Best, NowMsec;
+		int SleepInterval;
 
 #if defined(_WIN32) && defined(_DEBUG)
 		DWORD TickCount = GetTickCount();
@@ -408,8 +637,6 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 			}
 		}
 
-		CUser::RescheduleReconnectTimer();
-
 		time(&Now);
 
 		if (g_CurrentTime - 5 > Now) {
@@ -418,26 +645,21 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 
 		g_CurrentTime = Now;
 
-		Best = CTimer::GetNextCall();
+		Best = CTimer::GetNextCallMsec();
+		NowMsec = UtilMsecTime();
 
-		if (Best <= g_CurrentTime) {
+		if (Best <= NowMsec) {
 #ifdef _DEBUG
-			if (g_CurrentTime - 1 > Best) {
+			if (NowMsec - 1000 > Best) {
 #else
-			if (g_CurrentTime - 5 > Best) {
+			if (NowMsec - 5000 > Best) {
 #endif
-				Log("Time warp detected: %d seconds", g_CurrentTime - Best);
+				Log("Time warp detected: %d seconds", (int)((NowMsec - Best) / 1000));
 			}
 
 			CTimer::CallTimers();
-
-			Best = CTimer::GetNextCall();
 		}
 
-		SleepInterval = Best - g_CurrentTime;
-
-		DnsSocketCookie *DnsCookie = CDnsQuery::RegisterSockets();
-
 		for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
 			if (SocketCursor->PollFd->fd == INVALID_SOCKET) {
 				continue;
@@ -462,27 +684,32 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	                }
 	        }
 
-		if (SleepInterval <= 0 || GetStatus() != Status_Running || ModulesBusy) {
-			SleepInterval = 1;
-		}
+		// sockets may have scheduled timers when checking for queued data
+		Best = CTimer::GetNextCallMsec();
+		NowMsec = UtilMsecTime();
 
-		if (GetStatus() != Status_Running && SleepInterval > 3) {
-			SleepInterval = 3;
+		// timers which are still due have an interval of 0 seconds
+		if (Best > NowMsec) {
+			SleepInterval = (int)min(Best - NowMsec, (uint64_t)INT_MAX);
+		} else {
+			SleepInterval = 0;
 		}
 
-		timeval interval = { (long)SleepInterval, 0 };
+		if ((GetStatus() != Status_Running || ModulesBusy) && SleepInterval > 1000) {
+			SleepInterval = 1000;
+		}
 
 		time(&Last);
 
 #ifdef _DEBUG
-		//printf("poll: %d seconds\n", SleepInterval);
+		//printf("poll: %d msecs\n", SleepInterval);
 #endif
 
 #if defined(_WIN32) && defined(_DEBUG)
 		DWORD TimeDiff = GetTickCount();
 #endif
 
-		int ready = poll(m_PollFds.GetList(), m_PollFds.GetLength(), interval.tv_sec * 1000);
+		int ready = poll(m_PollFds.GetList(), m_PollFds.GetLength(), SleepInterval);
 
 #if defined(_WIN32) && defined(_DEBUG)
 		TickCount += GetTickCount() - TimeDiff;
@@ -561,9 +788,6 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 			}
 		}
 
-		CDnsQuery::ProcessTimeouts();
-		CDnsQuery::UnregisterSockets(DnsCookie);
-
 #if defined(_WIN32) && defined(_DEBUG)
 		DWORD Ticks = GetTickCount() - TickCount;
 
@@ -669,6 +893,18 @@ const CVector<CModule *> *CCore::GetModules(void) const {
 	return &m_Modules;
 }
 
+/**
+ * GetCommands
+ *
+ * Returns the list of built-in bouncer commands. The list is only
+ * available to the core: its handlers have to outlive every client, so
+ * modules provide their commands through CModule::InterceptClientCommand
+ * instead.
+ */
+commandlist_t *CCore::GetCommands(void) {
+	return &m_Commands;
+}
+
 /**
  * LoadModule
  *
@@ -869,9 +1105,35 @@ void CCore::UnregisterSocket(SOCKET Socket) {
  * @param Port the port for the listener
  * @param BindIp bind address (or NULL)
  * @param Family socket family (AF_INET or AF_INET6)
+ * @param ReusePort whether other sockets may be bound to the same port
  */
-SOCKET CCore::CreateListener(unsigned int Port, const char *BindIp, int Family) const {
-	return ::CreateListener(Port, BindIp, Family);
+SOCKET CCore::CreateListener(unsigned int Port, const char *BindIp, int Family, bool ReusePort) const {
+	RESULT<int> Backlog = m_Config->ReadInteger("system.listenbacklog");
+
+	if (IsError(Backlog) || Backlog <= 0) {
+		return ::CreateListener(Port, BindIp, Family, SOMAXCONN, ReusePort);
+	}
+
+	return ::CreateListener(Port, BindIp, Family, Backlog, ReusePort);
+}
+
+/**
+ * GetListenerSockets
+ *
+ * Returns the number of sockets which should be used for each listener.
+ */
+int CCore::GetListenerSockets(void) const {
+#ifdef SO_REUSEPORT
+	RESULT<int> Sockets = m_Config->ReadInteger("system.listenersockets");
+
+	if (IsError(Sockets) || Sockets <= 0) {
+		return 1;
+	}
+
+	return min((int)Sockets, LISTENER_MAXSOCKETS);
+#else /* SO_REUSEPORT */
+	return 1;
+#endif /* SO_REUSEPORT */
 }
 
 /**
@@ -1024,6 +1286,16 @@ CConfig *CCore::GetConfig(void) {
 	return m_Config;
 }
 
+/**
+ * GetConfigStore
+ *
+ * Returns the store which holds the users' settings, or NULL
+ * if the users' settings are kept in individual files.
+ */
+CConfigStore *CCore::GetConfigStore(void) {
+	return m_ConfigStore;
+}
+
 /**
  * GetLog
  *
@@ -1110,7 +1382,7 @@ RESULT<bool> CCore::RemoveUser(const char *Username, bool RemoveConfig) {
 	RESULT<bool> Result;
 	CUser *User;
 	char *UsernameCopy;
-	char *ConfigCopy = NULL, *LogCopy = NULL;
+	char *ConfigCopy = NULL, *LogCopy = NULL, *Namespace = NULL;
 	
 	User = GetUser(Username);
 
@@ -1127,6 +1399,15 @@ RESULT<bool> CCore::RemoveUser(const char *Username, bool RemoveConfig) {
 	if (RemoveConfig) {
 		ConfigCopy = strdup(User->GetConfig()->GetFilename());
 		LogCopy = strdup(User->GetLog()->GetFilename());
+
+		// the store's namespace uses the stored spelling of the name
+		if (m_ConfigStore != NULL) {
+			int rc = asprintf(&Namespace, "users/%s.conf", User->GetUsername());
+
+			if (RcFailed(rc)) {
+				Namespace = NULL;
+			}
+		}
 	}
 
 	delete User;
@@ -1137,6 +1418,7 @@ RESULT<bool> CCore::RemoveUser(const char *Username, bool RemoveConfig) {
 		free(UsernameCopy);
 		free(ConfigCopy);
 		free(LogCopy);
+		free(Namespace);
 
 		THROWRESULT(bool, Result);
 	}
@@ -1149,10 +1431,15 @@ RESULT<bool> CCore::RemoveUser(const char *Username, bool RemoveConfig) {
 	if (RemoveConfig) {
 		unlink(ConfigCopy);
 		unlink(LogCopy);
+
+		if (Namespace != NULL) {
+			m_ConfigStore->RemoveNamespace(Namespace);
+		}
 	}
 
 	free(ConfigCopy);
 	free(LogCopy);
+	free(Namespace);
 
 	UpdateUserConfig();
 
@@ -1232,6 +1519,8 @@ void CCore::UpdateUserConfig(void) {
 
 	if (m_Config != NULL) {
 		CacheSetString(m_ConfigCache, users, Out);
+
+		m_Config->Flush();
 	}
 
 	free(Out);
@@ -1499,11 +1788,33 @@ int CCore::GetSSLCustomIndex(void) const {
 #endif
 }
 
+/**
+ * GetSSLSessionCache
+ *
+ * Returns the object which handles TLS session resumption, or NULL if
+ * SSL is not available.
+ */
+CSSLSessionCache *CCore::GetSSLSessionCache(void) {
+	return m_SSLSessionCache;
+}
+
+/**
+ * GetHandshakePool
+ *
+ * Returns the thread pool which performs TLS handshakes for inbound
+ * connections, or NULL if handshakes are performed by the main loop.
+ */
+CThreadPool *CCore::GetHandshakePool(void) {
+	return m_HandshakePool;
+}
+
 #ifdef HAVE_LIBSSL
 /**
  * SSLVerifyCertificate
  *
- * Checks whether an SSL certificate is valid.
+ * Checks whether an SSL certificate is valid. Inbound handshakes which are
+ * continued by a handshake thread have no connection object attached, so
+ * their certificates are accepted just like CConnection::SSLVerify() does.
  *
  * @param preverify_ok was the preverification of the certificate successful
  * @param x509ctx X509 context
@@ -1514,6 +1825,8 @@ int SSLVerifyCertificate(int preverify_ok, X509_STORE_CTX *x509ctx) {
 
 	if (Ptr != NULL) {
 		return Ptr->SSLVerify(preverify_ok, x509ctx);
+	} else if (SSL_is_server(ssl)) {
+		return 1;
 	} else {
 		return 0;
 	}
@@ -1696,7 +2009,17 @@ bool CCore::MakeConfig(void) {
 
 	UserConfig = new CConfig(File, NULL);
 
-	UserConfig->WriteString("user.password", UtilMd5(Password, GenerateSalt()));
+	char *Hash = UtilHashPassword(Password, GenerateSalt());
+
+	if (AllocFailed(Hash)) {
+		UserConfig->Destroy();
+
+		return false;
+	}
+
+	UserConfig->WriteString("user.password", Hash);
+	free(Hash);
+
 	UserConfig->WriteInteger("user.admin", 1);
 
 	printf("Writing first user's configuration file...");
@@ -1718,24 +2041,11 @@ bool CCore::MakeConfig(void) {
  * @param Tag name of the tag
  */
 const char *CCore::GetTagString(const char *Tag) const {
-	const char *Value;
-	char *Setting;
-
 	if (Tag == NULL) {
 		return NULL;
 	}
 
-	int rc = asprintf(&Setting, "tag.%s", Tag);
-
-	if (RcFailed(rc)) {
-		return NULL;
-	}
-
-	Value = m_Config->ReadString(Setting);
-
-	free(Setting);
-
-	return Value;
+	return m_Config->ReadPrefixedString("tag.", Tag);
 }
 
 /**
@@ -1971,6 +2281,159 @@ CVector<CUser *> *CCore::GetAdminUsers(void) {
 	return &m_AdminUsers;
 }
 
+#ifdef HAVE_LIBSSL
+/**
+ * CertificateFingerprint
+ *
+ * Calculates the SHA-256 fingerprint of a certificate.
+ *
+ * @param Certificate the certificate
+ * @param Fingerprint a buffer for the hex representation of the
+ *                    fingerprint (at least 65 characters)
+ */
+static bool CertificateFingerprint(const X509 *Certificate, char *Fingerprint) {
+	unsigned char Digest[EVP_MAX_MD_SIZE];
+	unsigned int Length;
+
+	if (X509_digest(const_cast<X509 *>(Certificate), EVP_sha256(), Digest, &Length) != 1) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < Length; i++) {
+		sprintf(Fingerprint + i * 2, "%02x", Digest[i]);
+	}
+
+	return true;
+}
+#endif /* HAVE_LIBSSL */
+
+/**
+ * AddCertificateUser
+ *
+ * Adds a user to the list of users who are using the specified
+ * client certificate.
+ *
+ * @param Certificate the certificate
+ * @param User the user
+ */
+void CCore::AddCertificateUser(const X509 *Certificate, CUser *User) {
+#ifdef HAVE_LIBSSL
+	char Fingerprint[2 * EVP_MAX_MD_SIZE + 1];
+	CVector<CUser *> *Users;
+
+	if (!CertificateFingerprint(Certificate, Fingerprint)) {
+		return;
+	}
+
+	Users = m_CertificateIndex.Get(Fingerprint);
+
+	if (Users == NULL) {
+		Users = new CVector<CUser *>();
+
+		if (AllocFailed(Users)) {
+			return;
+		}
+
+		if (IsError(m_CertificateIndex.Add(Fingerprint, Users))) {
+			delete Users;
+
+			return;
+		}
+	}
+
+	for (int i = 0; i < Users->GetLength(); i++) {
+		if ((*Users)[i] == User) {
+			return;
+		}
+	}
+
+	Users->Insert(User);
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * RemoveCertificateUser
+ *
+ * Removes a user from the list of users who are using the specified
+ * client certificate.
+ *
+ * @param Certificate the certificate
+ * @param User the user
+ */
+void CCore::RemoveCertificateUser(const X509 *Certificate, CUser *User) {
+#ifdef HAVE_LIBSSL
+	char Fingerprint[2 * EVP_MAX_MD_SIZE + 1];
+	CVector<CUser *> *Users;
+
+	if (!CertificateFingerprint(Certificate, Fingerprint)) {
+		return;
+	}
+
+	Users = m_CertificateIndex.Get(Fingerprint);
+
+	if (Users == NULL) {
+		return;
+	}
+
+	Users->Remove(User);
+
+	if (Users->GetLength() == 0) {
+		m_CertificateIndex.Remove(Fingerprint);
+	}
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * GetCertificateUsers
+ *
+ * Returns the users who are using the specified client certificate, or
+ * NULL if there are no such users.
+ *
+ * @param Certificate the certificate
+ */
+const CVector<CUser *> *CCore::GetCertificateUsers(const X509 *Certificate) const {
+#ifdef HAVE_LIBSSL
+	char Fingerprint[2 * EVP_MAX_MD_SIZE + 1];
+
+	if (!CertificateFingerprint(Certificate, Fingerprint)) {
+		return NULL;
+	}
+
+	return m_CertificateIndex.Get(Fingerprint);
+#else /* HAVE_LIBSSL */
+	return NULL;
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * GetReconnectPlanner
+ *
+ * Returns the object which decides when users are reconnected.
+ */
+CReconnectPlanner *CCore::GetReconnectPlanner(void) {
+	return m_ReconnectPlanner;
+}
+
+/**
+ * GetReputationTable
+ *
+ * Returns the table which limits unauthenticated connections and keeps
+ * track of failed logins.
+ */
+CReputationTable *CCore::GetReputationTable(void) {
+	return m_ReputationTable;
+}
+
+/**
+ * GetWorkerPool
+ *
+ * Returns the thread pool which is used for expensive tasks like
+ * password hashing.
+ */
+CThreadPool *CCore::GetWorkerPool(void) {
+	return m_WorkerPool;
+}
+
 /**
  * AddAdditionalListener
  *
@@ -2245,7 +2708,7 @@ CClientListener *CCore::GetMainSSLListenerV6(void) const {
 }
 
 int CCore::GetResourceLimit(const char *Resource, CUser *User) {
-	int i = 0, rc;
+	int i = 0;
 
 	if (Resource == NULL || (User != NULL && User->IsAdmin())) {
 		if (Resource != NULL && strcasecmp(Resource, "clients") == 0) {
@@ -2257,31 +2720,11 @@ int CCore::GetResourceLimit(const char *Resource, CUser *User) {
 
 	while (g_ResourceLimits[i].Resource != NULL) {
 		if (strcasecmp(g_ResourceLimits[i].Resource, Resource) == 0) {
-			char *Name;
-
-			if (User != NULL) {
-				rc = asprintf(&Name, "user.max%s", Resource);
-
-				if (!RcFailed(rc)) {
-					CResult<int> UserLimit = User->GetConfig()->ReadInteger(Name);
-
-					if (!IsError(UserLimit)) {
-						return UserLimit;
-					}
-
-					free(Name);
-				}
+			if (User != NULL && User->m_ConfigCache.Bg.IsSet(g_ResourceLimits[i].UserOption)) {
+				return User->m_ConfigCache.Bg.GetInteger(g_ResourceLimits[i].UserOption);
 			}
 
-			rc = asprintf(&Name, "system.max%s", Resource);
-
-			if (RcFailed(rc)) {
-				return g_ResourceLimits[i].DefaultLimit;
-			}
-
-			int Value = m_Config->ReadInteger(Name);
-
-			free(Name);
+			int Value = m_ConfigCache.Bg.GetInteger(g_ResourceLimits[i].SystemOption);
 
 			if (Value == 0) {
 				return g_ResourceLimits[i].DefaultLimit;
@@ -2316,6 +2759,8 @@ void CCore::SetResourceLimit(const char *Resource, int Limit, CUser *User) {
 	}
 
 	Config->WriteInteger(Name, Limit);
+
+	free(Name);
 }
 
 int CCore::GetInterval(void) const {
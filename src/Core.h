@@ -29,6 +29,10 @@ class CClientListener;
 class CClientConnection;
 class CIRCConnection;
 class CIdentSupport;
+class CReconnectPlanner;
+class CThreadPool;
+class CReputationTable;
+class CSSLSessionCache;
 class CModule;
 class CConnection;
 class CTimer;
@@ -41,19 +45,27 @@ struct sockaddr_in;
  *
  * Commonly used settings are cached.
  */
-DEFINE_CACHE(System)
-	DEFINE_OPTION_INT(dontmatchuser);
-	DEFINE_OPTION_INT(port);
-	DEFINE_OPTION_INT(sslport);
-	DEFINE_OPTION_INT(sendq);
-	DEFINE_OPTION_INT(md5);
-	DEFINE_OPTION_INT(interval);
-
-	DEFINE_OPTION_STRING(vhost);
-	DEFINE_OPTION_STRING(users);
-	DEFINE_OPTION_STRING(ip);
-	DEFINE_OPTION_STRING(motd);
-END_DEFINE_CACHE
+#define SYSTEM_OPTIONS(INT, STRING) \
+	INT(dontmatchuser) \
+	INT(port) \
+	INT(sslport) \
+	INT(sendq) \
+	INT(md5) \
+	INT(interval) \
+	INT(loadthreads) \
+	INT(workerthreads) \
+	INT(maxchannels) \
+	INT(maxnicks) \
+	INT(maxbans) \
+	INT(maxkeys) \
+	INT(maxclients) \
+	\
+	STRING(vhost) \
+	STRING(users) \
+	STRING(ip) \
+	STRING(motd)
+
+DEFINE_CACHE(System, "system.", SYSTEM_OPTIONS)
 
 /**
  * socket_t
@@ -102,6 +114,7 @@ class SBNCAPI CCore {
 
 	FILE *m_PidFile; /**< sbnc.pid file */
 	CConfig *m_Config; /**< sbnc.conf object */
+	CConfigStore *m_ConfigStore; /**< the store for the users' settings, or NULL */
 
 	CClientListener *m_Listener, *m_ListenerV6; /**< the main unencrypted listeners */
 	CClientListener *m_SSLListener, *m_SSLListenerV6; /**< the main ssl listeners */
@@ -116,6 +129,9 @@ class SBNCAPI CCore {
 	CLog *m_Log; /**< the bouncer's main log */
 
 	CIdentSupport *m_Ident; /**< ident support interface */
+	CReconnectPlanner *m_ReconnectPlanner; /**< decides when users are reconnected */
+	CReputationTable *m_ReputationTable; /**< unauthenticated connections and failed logins per address */
+	CThreadPool *m_WorkerPool; /**< worker threads for expensive tasks (e.g. password hashing) */
 
 	bool m_LoadingModules; /**< are we currently loading modules? */
 	bool m_LoadingListeners; /**< are we currently loading listeners */
@@ -126,6 +142,8 @@ class SBNCAPI CCore {
 
 	SSL_CTX *m_SSLContext; /**< SSL context for client listeners */
 	SSL_CTX *m_SSLClientContext; /**< SSL context for IRC connections */
+	CSSLSessionCache *m_SSLSessionCache; /**< TLS session resumption for both SSL contexts */
+	CThreadPool *m_HandshakePool; /**< threads for TLS handshakes of inbound connections, or NULL */
 
 	CVector<additionallistener_t> m_AdditionalListeners; /**< a list of additional listeners */
 
@@ -137,6 +155,10 @@ class SBNCAPI CCore {
 
 	CVector<const char *> *m_Capabilities;
 
+	commandlist_t m_Commands; /**< the bouncer commands */
+
+	CHashtable<CVector<CUser *> *, false> m_CertificateIndex; /**< maps client certificate fingerprints to users */
+
 	void UpdateModuleConfig(void);
 	void UpdateUserConfig(void);
 	void UnlockPidFile(void);
@@ -144,6 +166,7 @@ class SBNCAPI CCore {
 	bool MakeConfig(void);
 
 	void InitializeSocket(void);
+	void LoadUsers(const char *Users);
 	void UninitializeSocket(void);
 
 	void InitializeAdditionalListeners(void);
@@ -169,15 +192,21 @@ public:
 	bool UnloadModule(CModule *Module);
 	const CVector<CModule *> *GetModules(void) const;
 
+#ifdef SBNC
+	commandlist_t *GetCommands(void);
+#endif /* SBNC */
+
 	void SetIdent(const char *Ident);
 	const char *GetIdent(void) const;
 
 	CConfig *GetConfig(void);
+	CConfigStore *GetConfigStore(void);
 
 	void RegisterSocket(SOCKET Socket, CSocketEvents *EventInterface);
 	void UnregisterSocket(SOCKET Socket);
 
-	SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET) const;
+	SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET, bool ReusePort = false) const;
+	int GetListenerSockets(void) const;
 
 	void Log(const char *Format, ...);
 	void LogUser(CUser *User, const char *Format, ...);
@@ -218,6 +247,8 @@ public:
 	SSL_CTX *GetSSLContext(void) ;
 	SSL_CTX *GetSSLClientContext(void);
 	int GetSSLCustomIndex(void) const;
+	CSSLSessionCache *GetSSLSessionCache(void);
+	CThreadPool *GetHandshakePool(void);
 
 	const char *DebugImpulse(int impulse);
 
@@ -243,6 +274,12 @@ public:
 	void DeleteFakeClient(CFakeClient *FakeClient) const;
 
 	CVector<CUser *> *GetAdminUsers(void);
+	void AddCertificateUser(const X509 *Certificate, CUser *User);
+	void RemoveCertificateUser(const X509 *Certificate, CUser *User);
+	const CVector<CUser *> *GetCertificateUsers(const X509 *Certificate) const;
+	CReconnectPlanner *GetReconnectPlanner(void);
+	CReputationTable *GetReputationTable(void);
+	CThreadPool *GetWorkerPool(void);
 
 	RESULT<bool> AddAdditionalListener(unsigned int Port, const char *BindAddress = NULL, bool SSL = false);
 	RESULT<bool> RemoveAdditionalListener(unsigned int Port);
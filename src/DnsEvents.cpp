@@ -20,6 +20,250 @@
 #include "StdAfx.h"
 
 ares_channel CDnsQuery::m_DnsChannel; /**< ares channel object */
+CHashtable<dnscacheentry_t *, false> *CDnsQuery::m_Cache; /**< cached dns responses */
+dnscachestats_t CDnsQuery::m_CacheStats; /**< statistics for the dns cache */
+CVector<CDnsSocket *> CDnsQuery::m_Sockets; /**< the sockets which are used by the ares channel */
+CTimer *CDnsQuery::m_TimeoutTimer; /**< processes timeouts for pending queries */
+
+#define DNS_CLASS_IN 1 /**< the "internet" class */
+#define DNS_TYPE_A 1 /**< ipv4 address records */
+#define DNS_TYPE_AAAA 28 /**< ipv6 address records */
+#define DNS_MAX_ADDRESSES 32 /**< maximum number of addresses for which the ttl is checked */
+
+/**
+ * dnslookup_t
+ *
+ * A forward lookup which is in progress.
+ */
+typedef struct dnslookup_s {
+	char *Key; /**< the key of the cache entry */
+	char *Host; /**< the hostname */
+	int Family; /**< the address family which is currently being queried */
+	bool Unspec; /**< whether the caller accepts any address family */
+	ares_channel Channel; /**< the ares channel which is used for the lookup */
+} dnslookup_t;
+
+void GenericDnsQueryCallback(void *Cookie, int Status, int Timeouts, hostent *HostEntity);
+void DnsSocketStateCallback(void *Data, ares_socket_t Socket, int Readable, int Writable);
+
+/**
+ * CopyHostent
+ *
+ * Creates a copy of a hostent structure. The copy can be freed using
+ * FreeHostent.
+ *
+ * @param Response the hostent structure
+ */
+static hostent *CopyHostent(const hostent *Response) {
+	hostent *Copy;
+	int Count = 0;
+	char *Addresses;
+
+	while (Response->h_addr_list[Count] != NULL) {
+		Count++;
+	}
+
+	Copy = (hostent *)malloc(sizeof(hostent));
+
+	if (AllocFailed(Copy)) {
+		return NULL;
+	}
+
+	Copy->h_name = strdup(Response->h_name ? Response->h_name : "");
+	Copy->h_aliases = (char **)malloc(sizeof(char *));
+	Copy->h_addrtype = Response->h_addrtype;
+	Copy->h_length = Response->h_length;
+	Copy->h_addr_list = (char **)malloc(sizeof(char *) * (Count + 1));
+	Addresses = (char *)malloc(Response->h_length * Count + 1);
+
+	if (AllocFailed(Copy->h_name) || AllocFailed(Copy->h_aliases) ||
+			AllocFailed(Copy->h_addr_list) || AllocFailed(Addresses)) {
+		free(Copy->h_name);
+		free(Copy->h_aliases);
+		free(Copy->h_addr_list);
+		free(Addresses);
+		free(Copy);
+
+		return NULL;
+	}
+
+	// aliases are not used by any of the callers
+	Copy->h_aliases[0] = NULL;
+
+	for (int i = 0; i < Count; i++) {
+		Copy->h_addr_list[i] = Addresses + i * Response->h_length;
+		memcpy(Copy->h_addr_list[i], Response->h_addr_list[i], Response->h_length);
+	}
+
+	Copy->h_addr_list[Count] = NULL;
+
+	// make sure the address buffer can always be found
+	if (Count == 0) {
+		Copy->h_addr_list[1] = Addresses;
+	}
+
+	return Copy;
+}
+
+/**
+ * FreeHostent
+ *
+ * Frees a hostent structure which was created by CopyHostent.
+ *
+ * @param Response the hostent structure
+ */
+static void FreeHostent(hostent *Response) {
+	if (Response == NULL) {
+		return;
+	}
+
+	free(Response->h_name);
+	free(Response->h_aliases);
+	free(Response->h_addr_list[0] != NULL ? Response->h_addr_list[0] : Response->h_addr_list[1]);
+	free(Response->h_addr_list);
+	free(Response);
+}
+
+/**
+ * DestroyDnsCacheEntry
+ *
+ * Frees a dns cache entry.
+ *
+ * @param Entry the cache entry
+ */
+static void DestroyDnsCacheEntry(dnscacheentry_t *Entry) {
+	FreeHostent(Entry->Response);
+
+	delete Entry;
+}
+
+/**
+ * DnsCacheFinished
+ *
+ * Stores the response for a query in the cache and notifies all queries
+ * which are waiting for it.
+ *
+ * @param Key the key of the cache entry
+ * @param Status the status of the query
+ * @param Response the response (can be NULL)
+ * @param Ttl the number of seconds the response should be cached
+ */
+void DnsCacheFinished(const char *Key, int Status, hostent *Response, int Ttl) {
+	dnscacheentry_t *Entry;
+	DnsEventCookie **Waiters;
+	int Count;
+
+	if (CDnsQuery::m_Cache == NULL) {
+		return;
+	}
+
+	Entry = CDnsQuery::m_Cache->Get(Key);
+
+	if (Entry == NULL || !Entry->Pending) {
+		return;
+	}
+
+	Count = Entry->Waiters.GetLength();
+	Waiters = (DnsEventCookie **)malloc(sizeof(DnsEventCookie *) * Count);
+
+	if (AllocFailed(Waiters)) {
+		g_Bouncer->Fatal();
+	}
+
+	memcpy(Waiters, Entry->Waiters.GetList(), sizeof(DnsEventCookie *) * Count);
+	Entry->Waiters.Clear();
+	Entry->Pending = false;
+
+	if (Status == ARES_SUCCESS && Response != NULL) {
+		Entry->Response = CopyHostent(Response);
+		Entry->Expires = g_CurrentTime + min(max(Ttl, DNS_MIN_TTL), DNS_MAX_TTL);
+	} else if (Status == ARES_ENOTFOUND || Status == ARES_ENODATA) {
+		Entry->Expires = g_CurrentTime + DNS_NEGATIVE_TTL;
+	} else {
+		// don't cache errors like timeouts
+		CDnsQuery::m_Cache->Remove(Key);
+	}
+
+	// the waiters get the original response because the cache entry might
+	// be removed by one of the callbacks
+	for (int i = 0; i < Count; i++) {
+		GenericDnsQueryCallback(Waiters[i], Status, 0, Response);
+	}
+
+	free(Waiters);
+}
+
+/**
+ * DnsSearchCallback
+ *
+ * Called by c-ares when a forward lookup has been completed.
+ *
+ * @param Cookie the dnslookup_t structure for the lookup
+ * @param Status the status of the query
+ * @param Timeouts the number of timeouts
+ * @param Buffer the raw answer
+ * @param Length the length of the answer
+ */
+static void DnsSearchCallback(void *Cookie, int Status, int Timeouts, unsigned char *Buffer, int Length) {
+	dnslookup_t *Lookup = (dnslookup_t *)Cookie;
+	hostent *Response = NULL;
+	int Ttl = DNS_MAX_TTL, Count = DNS_MAX_ADDRESSES;
+
+	if (Status == ARES_SUCCESS) {
+		if (Lookup->Family == AF_INET6) {
+			ares_addr6ttl Ttls[DNS_MAX_ADDRESSES];
+
+			Status = ares_parse_aaaa_reply(Buffer, Length, &Response, Ttls, &Count);
+
+			for (int i = 0; Status == ARES_SUCCESS && i < Count; i++) {
+				Ttl = min(Ttl, Ttls[i].ttl);
+			}
+		} else {
+			ares_addrttl Ttls[DNS_MAX_ADDRESSES];
+
+			Status = ares_parse_a_reply(Buffer, Length, &Response, Ttls, &Count);
+
+			for (int i = 0; Status == ARES_SUCCESS && i < Count; i++) {
+				Ttl = min(Ttl, Ttls[i].ttl);
+			}
+		}
+	}
+
+	// like ares_gethostbyname() we fall back to ipv4 if there are no ipv6 addresses
+	if (Status != ARES_SUCCESS && Lookup->Unspec && Lookup->Family == AF_INET6 &&
+			Status != ARES_EDESTRUCTION && Status != ARES_ECANCELLED) {
+		Lookup->Family = AF_INET;
+		ares_search(Lookup->Channel, Lookup->Host, DNS_CLASS_IN, DNS_TYPE_A, DnsSearchCallback, Lookup);
+
+		return;
+	}
+
+	DnsCacheFinished(Lookup->Key, Status, Response, Ttl);
+
+	if (Response != NULL) {
+		ares_free_hostent(Response);
+	}
+
+	free(Lookup->Key);
+	free(Lookup->Host);
+	free(Lookup);
+}
+
+/**
+ * DnsReverseCallback
+ *
+ * Called by c-ares when a reverse lookup has been completed.
+ *
+ * @param Key the key of the cache entry
+ * @param Status the status of the query
+ * @param Timeouts the number of timeouts
+ * @param Response the response
+ */
+static void DnsReverseCallback(void *Key, int Status, int Timeouts, hostent *Response) {
+	DnsCacheFinished((char *)Key, Status, Response, DNS_STATIC_TTL);
+
+	free(Key);
+}
 
 /**
  * GenericDnsQueryCallback
@@ -35,13 +279,11 @@ ares_channel CDnsQuery::m_DnsChannel; /**< ares channel object */
 void GenericDnsQueryCallback(void *CookieRaw, int Status, int Timeouts, hostent *HostEntity) {
 	DnsEventCookie *Cookie = (DnsEventCookie *)CookieRaw;
 
-	if (Cookie->Query == NULL) {
-		return;
+	if (Cookie->Query != NULL) {
+		Cookie->Query->AsyncDnsEvent(Status, HostEntity);
+		Cookie->Query->m_PendingQueries--;
 	}
 
-	Cookie->Query->AsyncDnsEvent(Status, HostEntity);
-	Cookie->Query->m_PendingQueries--;
-
 	Cookie->RefCount--;
 
 	if (Cookie->RefCount <= 0) {
@@ -76,9 +318,73 @@ CDnsQuery::CDnsQuery(void *EventInterface, DnsEventFunction EventFunction, int T
 
 	if (m_DnsChannel == NULL) {
 		ares_options Options;
+		int Mask = ARES_OPT_TIMEOUT | ARES_OPT_SOCK_STATE_CB;
+		ares_addr_node Servers[DNS_MAXSERVERS];
+		char *ServerList, *Server;
+		int ServerCount = 0;
 
 		Options.timeout = m_Timeout;
-		ares_init_options(&m_DnsChannel, &Options, ARES_OPT_TIMEOUT);
+
+		// sockets are registered with the main loop when c-ares opens them
+		Options.sock_state_cb = DnsSocketStateCallback;
+		Options.sock_state_cb_data = NULL;
+
+		// system.dnsserver and system.dnsport can be used to query a
+		// specific (e.g. local) resolver instead of the system's resolvers
+		if (g_Bouncer->GetConfig()->ReadString("system.dnsserver") != NULL) {
+			ServerList = strdup(g_Bouncer->GetConfig()->ReadString("system.dnsserver"));
+
+			if (!AllocFailed(ServerList)) {
+				Server = strtok(ServerList, ", ");
+
+				while (Server != NULL && ServerCount < DNS_MAXSERVERS) {
+					ares_addr_node *Node = &Servers[ServerCount];
+
+					if (inet_pton(AF_INET, Server, &Node->addr.addr4) > 0) {
+						Node->family = AF_INET;
+					} else if (inet_pton(AF_INET6, Server, &Node->addr.addr6) > 0) {
+						Node->family = AF_INET6;
+					} else {
+						Node = NULL;
+					}
+
+					if (Node != NULL) {
+						Node->next = NULL;
+
+						if (ServerCount > 0) {
+							Servers[ServerCount - 1].next = Node;
+						}
+
+						ServerCount++;
+					}
+
+					Server = strtok(NULL, ", ");
+				}
+
+				free(ServerList);
+			}
+		}
+
+		RESULT<int> Port = g_Bouncer->GetConfig()->ReadInteger("system.dnsport");
+
+		if (!IsError(Port) && Port > 0) {
+			// older versions of c-ares expect the port in network byte order
+#if ARES_VERSION >= 0x010b00
+			Options.udp_port = Port;
+			Options.tcp_port = Port;
+#else /* ARES_VERSION */
+			Options.udp_port = htons(Port);
+			Options.tcp_port = htons(Port);
+#endif /* ARES_VERSION */
+			Mask |= ARES_OPT_UDP_PORT | ARES_OPT_TCP_PORT;
+		}
+
+		ares_init_options(&m_DnsChannel, &Options, Mask);
+
+		// the servers are copied by c-ares
+		if (m_DnsChannel != NULL && ServerCount > 0) {
+			ares_set_servers(m_DnsChannel, Servers);
+		}
 	}
 }
 
@@ -142,9 +448,61 @@ void CDnsQuery::GetHostByName(const char *Host, int Family) {
 		return;
 	}
 
-	m_PendingQueries++;
-	m_EventCookie->RefCount++;
-	ares_gethostbyname(m_DnsChannel, Host, Family, GenericDnsQueryCallback, m_EventCookie);
+	char *Key;
+	hostent *Response;
+	dnslookup_t *Lookup;
+	int rc = asprintf(&Key, "%d/%s", Family, Host);
+
+	if (RcFailed(rc)) {
+		g_Bouncer->Fatal();
+	}
+
+	if (QueryCache(Key)) {
+		free(Key);
+
+		return;
+	}
+
+	// names from the hosts file don't have a ttl
+	if (Family == AF_UNSPEC) {
+		rc = ares_gethostbyname_file(m_DnsChannel, Host, AF_INET6, &Response);
+
+		if (rc != ARES_SUCCESS) {
+			rc = ares_gethostbyname_file(m_DnsChannel, Host, AF_INET, &Response);
+		}
+	} else {
+		rc = ares_gethostbyname_file(m_DnsChannel, Host, Family, &Response);
+	}
+
+	if (rc == ARES_SUCCESS) {
+		DnsCacheFinished(Key, ARES_SUCCESS, Response, DNS_STATIC_TTL);
+
+		ares_free_hostent(Response);
+		free(Key);
+
+		return;
+	}
+
+	Lookup = (dnslookup_t *)malloc(sizeof(dnslookup_t));
+
+	if (AllocFailed(Lookup)) {
+		g_Bouncer->Fatal();
+	}
+
+	Lookup->Key = Key;
+	Lookup->Host = strdup(Host);
+	Lookup->Family = (Family == AF_INET) ? AF_INET : AF_INET6;
+	Lookup->Unspec = (Family == AF_UNSPEC);
+	Lookup->Channel = m_DnsChannel;
+
+	if (AllocFailed(Lookup->Host)) {
+		g_Bouncer->Fatal();
+	}
+
+	ares_search(m_DnsChannel, Host, DNS_CLASS_IN, (Lookup->Family == AF_INET6) ? DNS_TYPE_AAAA : DNS_TYPE_A,
+		DnsSearchCallback, Lookup);
+
+	ScheduleTimeouts();
 }
 
 /**
@@ -168,10 +526,175 @@ void CDnsQuery::GetHostByAddr(sockaddr *Address) {
 	}
 #endif /* HAVE_IPV6 */
 
+	char *Key;
+	int rc = asprintf(&Key, "ptr/%s", IpToString(Address));
+
+	if (RcFailed(rc)) {
+		g_Bouncer->Fatal();
+	}
+
+	if (QueryCache(Key)) {
+		free(Key);
+
+		return;
+	}
+
+	ares_gethostbyaddr(m_DnsChannel, IpAddr, INADDR_LEN(Address->sa_family),
+		Address->sa_family, DnsReverseCallback, Key);
+
+	ScheduleTimeouts();
+}
+
+/**
+ * QueryCache
+ *
+ * Answers a query from the cache. Returns true if the query has been
+ * answered or if it is waiting for an identical query which is already
+ * in progress. Otherwise a new (pending) cache entry is created and the
+ * caller has to start the query.
+ *
+ * @param Key the key of the cache entry
+ */
+bool CDnsQuery::QueryCache(const char *Key) {
+	dnscacheentry_t *Entry;
+
+	if (m_Cache == NULL) {
+		m_Cache = new CHashtable<dnscacheentry_t *, false>();
+
+		if (AllocFailed(m_Cache)) {
+			g_Bouncer->Fatal();
+		}
+
+		m_Cache->RegisterValueDestructor(DestroyDnsCacheEntry);
+	}
+
+	Entry = m_Cache->Get(Key);
+
+	if (Entry != NULL && !Entry->Pending && Entry->Expires <= g_CurrentTime) {
+		m_Cache->Remove(Key);
+
+		Entry = NULL;
+	}
+
 	m_PendingQueries++;
 	m_EventCookie->RefCount++;
-	ares_gethostbyaddr(m_DnsChannel, IpAddr, INADDR_LEN(Address->sa_family),
-		Address->sa_family, GenericDnsQueryCallback, m_EventCookie);
+
+	if (Entry != NULL && !Entry->Pending) {
+		if (Entry->Response != NULL) {
+			m_CacheStats.Hits++;
+		} else {
+			m_CacheStats.NegativeHits++;
+		}
+
+		GenericDnsQueryCallback(m_EventCookie, Entry->Response != NULL ? ARES_SUCCESS : ARES_ENOTFOUND, 0, Entry->Response);
+
+		return true;
+	}
+
+	if (Entry != NULL) {
+		m_CacheStats.Coalesced++;
+	} else {
+		if (m_Cache->GetLength() >= DNS_CACHE_SIZE) {
+			ExpireCache();
+		}
+
+		Entry = new dnscacheentry_t;
+
+		if (AllocFailed(Entry)) {
+			g_Bouncer->Fatal();
+		}
+
+		Entry->Response = NULL;
+		Entry->Expires = 0;
+		Entry->Pending = true;
+
+		if (IsError(m_Cache->Add(Key, Entry))) {
+			g_Bouncer->Fatal();
+		}
+
+		m_CacheStats.Misses++;
+	}
+
+	if (IsError(Entry->Waiters.Insert(m_EventCookie))) {
+		g_Bouncer->Fatal();
+	}
+
+	return (Entry->Waiters.GetLength() > 1);
+}
+
+/**
+ * ExpireCache
+ *
+ * Removes expired entries from the cache. If the cache is still full
+ * afterwards all entries which are not pending are removed.
+ */
+void CDnsQuery::ExpireCache(void) {
+	dnscacheentry_t *Entry;
+	char **Keys = m_Cache->GetSortedKeys();
+	char *Key;
+	int i = 0;
+
+	if (Keys == NULL) {
+		return;
+	}
+
+	// removing an entry only frees that entry's key
+	while ((Key = Keys[i++]) != NULL) {
+		Entry = m_Cache->Get(Key);
+
+		if (!Entry->Pending && Entry->Expires <= g_CurrentTime) {
+			m_Cache->Remove(Key);
+		}
+	}
+
+	free(Keys);
+
+	if (m_Cache->GetLength() >= DNS_CACHE_SIZE) {
+		FlushCache();
+	}
+}
+
+/**
+ * FlushCache
+ *
+ * Removes all entries from the dns cache (except for queries which
+ * are still in progress).
+ */
+void CDnsQuery::FlushCache(void) {
+	char **Keys;
+	char *Key;
+	int i = 0;
+
+	if (m_Cache == NULL || (Keys = m_Cache->GetSortedKeys()) == NULL) {
+		return;
+	}
+
+	// removing an entry only frees that entry's key
+	while ((Key = Keys[i++]) != NULL) {
+		if (!m_Cache->Get(Key)->Pending) {
+			m_Cache->Remove(Key);
+		}
+	}
+
+	free(Keys);
+}
+
+/**
+ * GetCacheSize
+ *
+ * Returns the number of entries in the dns cache.
+ */
+int CDnsQuery::GetCacheSize(void) {
+	return (m_Cache != NULL) ? m_Cache->GetLength() : 0;
+}
+
+/**
+ * GetCacheStats
+ *
+ * Returns statistics for the dns cache.
+ */
+const dnscachestats_t *CDnsQuery::GetCacheStats(void) {
+	return &m_CacheStats;
 }
 
 /**
@@ -190,89 +713,124 @@ void CDnsQuery::AsyncDnsEvent(int Status, hostent *Response) {
 }
 
 /**
- * RegisterSockets
+ * DnsSocketStateCallback
  *
- * Registers all DNS sockets and returns a cookie that can be used to
- * unregister the sockets later on - or NULL if no sockets were registered.
+ * Called by c-ares when it opens or closes a socket or when it changes
+ * the events it is interested in.
  *
- * @return DnsSocketCookie a cookie
+ * @param Data user data (unused)
+ * @param Socket the socket
+ * @param Readable whether c-ares wants to read from the socket
+ * @param Writable whether c-ares wants to write to the socket
  */
-DnsSocketCookie *CDnsQuery::RegisterSockets() {
-	SOCKET Sockets[ARES_GETSOCK_MAXNUM];
-	int Bitmask, Count = 0;
-	DnsSocketCookie *Cookie;
-
-	if (m_DnsChannel == NULL) {
-		return NULL;
-	}
-
-	Bitmask = ares_getsock(m_DnsChannel, Sockets, sizeof(Sockets) / sizeof(*Sockets));
+void DnsSocketStateCallback(void *Data, ares_socket_t Socket, int Readable, int Writable) {
+	CDnsSocket *DnsSocket = NULL;
 
-	Cookie = new DnsSocketCookie;
+	for (int i = 0; i < CDnsQuery::m_Sockets.GetLength(); i++) {
+		if (CDnsQuery::m_Sockets[i]->GetSocket() == Socket) {
+			DnsSocket = CDnsQuery::m_Sockets[i];
 
-	if (AllocFailed(Cookie)) {
-		g_Bouncer->Fatal();
+			break;
+		}
 	}
 
-	for (int i = 0; i < (int)(sizeof(Sockets) / sizeof(*Sockets)); i++) {
-		if (!ARES_GETSOCK_READABLE(Bitmask, i) && !ARES_GETSOCK_WRITABLE(Bitmask, i)) {
-			continue;
+	if (!Readable && !Writable) {
+		// the socket might be in use by the main loop right now so it
+		// is only unregistered here and freed by the timeout timer
+		if (DnsSocket != NULL) {
+			DnsSocket->Destroy();
 		}
 
-		Count++;
-		// ctor takes care of registering the socket
-#ifdef _MSC_VER
-#	pragma warning( push )
-#	pragma warning( disable : 4800 )
-#endif /* _MSC_VER */
-		Cookie->Sockets[Count - 1] = new CDnsSocket(Sockets[i], ARES_GETSOCK_WRITABLE(Bitmask, i));
-#ifdef _MSC_VER
-#	pragma warning( pop ) 
-#endif /* _MSC_VER */
+		CDnsQuery::ScheduleTimeouts();
+
+		return;
 	}
 
-	if (Count == 0) {
-		delete Cookie;
+	if (DnsSocket != NULL) {
+		DnsSocket->SetOutbound(Writable != 0);
 
-		return NULL;
+		return;
 	}
 
-	Cookie->Count = Count;
+	// ctor takes care of registering the socket
+	DnsSocket = new CDnsSocket(Socket, Writable != 0);
 
-	return Cookie;
+	if (AllocFailed(DnsSocket) || IsError(CDnsQuery::m_Sockets.Insert(DnsSocket))) {
+		g_Bouncer->Fatal();
+	}
 }
 
 /**
- * UnregisterSockets
+ * DnsTimeoutTimer
  *
- * Unregisters a set of DNS sockets.
+ * Processes timeouts for pending queries and frees sockets which have
+ * been closed by c-ares.
  *
- * @param Cookie a cookie returned by RegisterSockets
+ * @param Now the current time
+ * @param Cookie unused
  */
-void CDnsQuery::UnregisterSockets(DnsSocketCookie *Cookie) {
-	if (Cookie == NULL) {
-		return;
+bool DnsTimeoutTimer(time_t Now, void *Cookie) {
+	CDnsQuery::m_TimeoutTimer = NULL;
+
+	if (CDnsQuery::m_DnsChannel != NULL) {
+		ares_process_fd(CDnsQuery::m_DnsChannel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);
 	}
 
-	for (int i = 0; i < Cookie->Count; i++) {
-		// dtor takes care of un-registering the socket
-		Cookie->Sockets[i]->Destroy();
+	for (int i = CDnsQuery::m_Sockets.GetLength() - 1; i >= 0; i--) {
+		if (CDnsQuery::m_Sockets[i]->GetSocket() == INVALID_SOCKET) {
+			delete CDnsQuery::m_Sockets[i];
 
-		delete Cookie->Sockets[i];
+			CDnsQuery::m_Sockets.Remove(i);
+		}
 	}
 
-	delete Cookie;
+	CDnsQuery::ScheduleTimeouts();
+
+	return false;
 }
 
 /**
- * ProcessTimeouts
+ * ScheduleTimeouts
  *
- * Processes timeouts for the DNS sockets.
+ * Makes sure that the timeout timer is called when the next pending
+ * query times out. The timer is not used while there are no pending
+ * queries.
  */
-void CDnsQuery::ProcessTimeouts(void) {
-	if (m_DnsChannel != NULL) {
-		ares_process_fd(m_DnsChannel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);
+void CDnsQuery::ScheduleTimeouts(void) {
+	timeval Timeout;
+	uint64_t When;
+	bool Closed = false;
+
+	for (int i = 0; i < m_Sockets.GetLength(); i++) {
+		if (m_Sockets[i]->GetSocket() == INVALID_SOCKET) {
+			Closed = true;
+
+			break;
+		}
+	}
+
+	if (m_DnsChannel != NULL && ares_timeout(m_DnsChannel, NULL, &Timeout) != NULL) {
+		When = UtilMsecTime() + Timeout.tv_sec * 1000 + (Timeout.tv_usec + 999) / 1000;
+	} else if (Closed) {
+		When = UtilMsecTime();
+	} else {
+		if (m_TimeoutTimer != NULL) {
+			m_TimeoutTimer->Destroy();
+			m_TimeoutTimer = NULL;
+		}
+
+		return;
+	}
+
+	if (m_TimeoutTimer == NULL) {
+		m_TimeoutTimer = new CTimer(0, false, DnsTimeoutTimer, NULL);
+
+		if (AllocFailed(m_TimeoutTimer)) {
+			return;
+		}
 	}
+
+	m_TimeoutTimer->RescheduleMsec(When);
 }
 
 /**
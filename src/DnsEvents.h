@@ -20,6 +20,13 @@
 #ifndef DNSEVENTS_H
 #define DNSEVENTS_H
 
+#define DNS_CACHE_SIZE 1024 /**< maximum number of cached dns responses */
+#define DNS_MIN_TTL 10 /**< minimum number of seconds a response is cached */
+#define DNS_MAX_TTL 3600 /**< maximum number of seconds a response is cached */
+#define DNS_NEGATIVE_TTL 30 /**< number of seconds a non-existing name is cached */
+#define DNS_STATIC_TTL 300 /**< number of seconds reverse lookups and hosts file entries are cached */
+#define DNS_MAXSERVERS 8 /**< maximum number of resolvers which can be set using system.dnsserver */
+
 #ifndef SWIG
 /**
  * DnsEventFunction
@@ -36,6 +43,30 @@ typedef struct {
 	CDnsQuery *Query;
 } DnsEventCookie;
 
+/**
+ * dnscacheentry_t
+ *
+ * A cached dns response.
+ */
+typedef struct dnscacheentry_s {
+	hostent *Response; /**< the response, or NULL if the name does not exist */
+	time_t Expires; /**< when the response expires */
+	bool Pending; /**< whether the query is still in progress */
+	CVector<DnsEventCookie *> Waiters; /**< the queries which are waiting for the response */
+} dnscacheentry_t;
+
+/**
+ * dnscachestats_t
+ *
+ * Statistics for the dns cache.
+ */
+typedef struct dnscachestats_s {
+	unsigned int Hits; /**< the number of queries which were answered from the cache */
+	unsigned int NegativeHits; /**< the number of hits for names which do not exist */
+	unsigned int Misses; /**< the number of queries which were sent to the dns servers */
+	unsigned int Coalesced; /**< the number of queries which waited for another identical query */
+} dnscachestats_t;
+
 /**
  * CDnsQuery
  *
@@ -43,7 +74,10 @@ typedef struct {
  */
 class SBNCAPI CDnsQuery {
 	friend void GenericDnsQueryCallback(void *Cookie, int Status, int Timeouts, hostent *HostEntity);
+	friend void DnsCacheFinished(const char *Key, int Status, hostent *Response, int Ttl);
 	friend bool DestroyDnsChannelTimer(time_t Now, void *Cookie);
+	friend void DnsSocketStateCallback(void *Data, ares_socket_t Socket, int Readable, int Writable);
+	friend bool DnsTimeoutTimer(time_t Now, void *Cookie);
 	friend class CDnsSocket;
 
 	DnsEventCookie *m_EventCookie;
@@ -53,9 +87,16 @@ class SBNCAPI CDnsQuery {
 	unsigned int m_PendingQueries; /**< number of pending queries */
 
 	static ares_channel m_DnsChannel; /**< the ares channel object */
+	static CHashtable<dnscacheentry_t *, false> *m_Cache; /**< cached dns responses */
+	static dnscachestats_t m_CacheStats; /**< statistics for the dns cache */
+	static CVector<CDnsSocket *> m_Sockets; /**< the sockets which are used by the ares channel */
+	static CTimer *m_TimeoutTimer; /**< processes timeouts for pending queries */
 
 	void AsyncDnsEvent(int Status, hostent *Response);
 	static ares_channel GetDnsChannel(void);
+	bool QueryCache(const char *Key);
+	static void ExpireCache(void);
+	static void ScheduleTimeouts(void);
 public:
 	CDnsQuery(void *EventInterface, DnsEventFunction EventFunction, int Timeout = 5);
 	~CDnsQuery(void);
@@ -63,9 +104,9 @@ public:
 	void GetHostByName(const char *Host, int Family = AF_INET);
 	void GetHostByAddr(sockaddr *Address);
 
-	static DnsSocketCookie *RegisterSockets(void);
-	static void UnregisterSockets(DnsSocketCookie *Cookie);
-	static void ProcessTimeouts(void);
+	static int GetCacheSize(void);
+	static const dnscachestats_t *GetCacheStats(void);
+	static void FlushCache(void);
 };
 
 /**
@@ -27,22 +27,41 @@ CDnsSocket::CDnsSocket(SOCKET Socket, bool Outbound) {
 }
 
 void CDnsSocket::Destroy(void) {
-	g_Bouncer->UnregisterSocket(m_Socket);
+	if (m_Socket != INVALID_SOCKET) {
+		g_Bouncer->UnregisterSocket(m_Socket);
+	}
+
+	// the object itself is freed by CDnsQuery once c-ares has closed the socket
+	m_Socket = INVALID_SOCKET;
+}
+
+SOCKET CDnsSocket::GetSocket(void) const {
+	return m_Socket;
+}
+
+void CDnsSocket::SetOutbound(bool Outbound) {
+	m_Outbound = Outbound;
 }
 
 int CDnsSocket::Read(bool DontProcess) {
 	ares_process_fd(CDnsQuery::GetDnsChannel(), m_Socket, ARES_SOCKET_BAD);
+	CDnsQuery::ScheduleTimeouts();
 
 	return 0;
 }
 
 int CDnsSocket::Write(void) {
 	ares_process_fd(CDnsQuery::GetDnsChannel(), ARES_SOCKET_BAD, m_Socket);
+	CDnsQuery::ScheduleTimeouts();
 
 	return 0;
 }
 
 void CDnsSocket::Error(int ErrorCode) {
+	// let c-ares notice the error so it can close the socket
+	if (m_Socket != INVALID_SOCKET) {
+		ares_process_fd(CDnsQuery::GetDnsChannel(), m_Socket, ARES_SOCKET_BAD);
+	}
 }
 
 bool CDnsSocket::HasQueuedData(void) const {
@@ -29,6 +29,9 @@ public:
 
         void Destroy(void);
 
+        SOCKET GetSocket(void) const;
+        void SetOutbound(bool Outbound);
+
         int Read(bool DontProcess = false);
         int Write(void);
         void Error(int ErrorCode);
@@ -39,9 +42,4 @@ public:
         const char *GetClassName(void) const;
 };
 
-typedef struct {
-        CDnsSocket *Sockets[ARES_GETSOCK_MAXNUM];
-	int Count;
-} DnsSocketCookie;
-
 #endif /* DNSSOCKET_H */
@@ -28,6 +28,10 @@ CFIFOBuffer::CFIFOBuffer() {
 	m_Buffer = NULL;
 	m_BufferSize = 0;
 	m_Offset = 0;
+
+	m_Head = NULL;
+	m_Tail = NULL;
+	m_SegmentSize = 0;
 }
 
 /**
@@ -36,15 +40,34 @@ CFIFOBuffer::CFIFOBuffer() {
  * Destructs a fifo buffer.
  */
 CFIFOBuffer::~CFIFOBuffer() {
+	while (m_Head != NULL) {
+		RemoveSegment();
+	}
+
 	free(m_Buffer);
 }
 
+/**
+ * RoundBufferSize
+ *
+ * Returns the number of bytes which are allocated for a buffer. Small
+ * buffers (e.g. those of unauthenticated clients) are rounded up to a
+ * multiple of SMALLBLOCKSIZE, all others to a multiple of BLOCKSIZE.
+ *
+ * @param Size the size of the buffer's data
+ */
+static size_t RoundBufferSize(size_t Size) {
+	size_t Granularity = (Size < BLOCKSIZE) ? SMALLBLOCKSIZE : BLOCKSIZE;
+
+	return Size + Granularity - (Size % Granularity);
+}
+
 /**
  * ResizeBuffer
  *
  * Resizes a buffer. The new size of the buffer will be a multiple
- * of BLOCKSIZE. NULL is returned if the buffer could not be successfully
- * resized.
+ * of SMALLBLOCKSIZE or BLOCKSIZE. NULL is returned if the buffer could
+ * not be successfully resized.
  *
  * @param Buffer the buffer which is to be resized
  * @param OldSize the old size of the buffer
@@ -52,21 +75,18 @@ CFIFOBuffer::~CFIFOBuffer() {
  */
 void *CFIFOBuffer::ResizeBuffer(void *Buffer, size_t OldSize, size_t NewSize) {
 	if (OldSize != 0) {
-		OldSize += BLOCKSIZE - (OldSize % BLOCKSIZE);
+		OldSize = RoundBufferSize(OldSize);
 	}
 
-	size_t CeilNewSize = NewSize + BLOCKSIZE - (NewSize % BLOCKSIZE);
-
-	size_t OldBlocks = OldSize / BLOCKSIZE;
-	size_t NewBlocks = CeilNewSize / BLOCKSIZE;
+	size_t CeilNewSize = RoundBufferSize(NewSize);
 
-	if (NewBlocks != OldBlocks) {
+	if (CeilNewSize != OldSize) {
 		if (NewSize == 0) {
 			free(Buffer);
 
 			return NULL;
 		} else {
-			return realloc(Buffer, NewBlocks * BLOCKSIZE);
+			return realloc(Buffer, CeilNewSize);
 		}
 	} else {
 		return Buffer;
@@ -86,54 +106,95 @@ void CFIFOBuffer::Optimize(void) {
 	}
 
 	if (m_BufferSize - m_Offset <= 0) {
-		free(m_Buffer);
+		NewBuffer = NULL;
+	} else {
+		NewBuffer = (char *)ResizeBuffer(NULL, 0, m_BufferSize - m_Offset);
 
-		m_Buffer = NULL;
-		m_BufferSize = 0;
-		m_Offset = 0;
+		if (AllocFailed(NewBuffer)) {
+			return;
+		}
 
-		return;
+		memcpy(NewBuffer, m_Buffer + m_Offset, m_BufferSize - m_Offset);
 	}
 
-	NewBuffer = (char *)ResizeBuffer(NULL, 0, m_BufferSize - m_Offset);
-
-	if (AllocFailed(NewBuffer)) {
-		return;
+	// shared blocks are positioned relative to the start of the buffer
+	for (fifo_segment_t *Segment = m_Head; Segment != NULL; Segment = Segment->Next) {
+		Segment->Position -= m_Offset;
 	}
 
-	memcpy(NewBuffer, m_Buffer + m_Offset, m_BufferSize - m_Offset);
-
 	free(m_Buffer);
 	m_Buffer = NewBuffer;
 	m_BufferSize -= m_Offset;
 	m_Offset = 0;
 }
 
+/**
+ * RemoveSegment
+ *
+ * Removes the first shared block from the buffer.
+ */
+void CFIFOBuffer::RemoveSegment(void) {
+	fifo_segment_t *Segment = m_Head;
+
+	m_SegmentSize -= Segment->Block->Size - Segment->Offset;
+
+	m_Head = Segment->Next;
+
+	if (m_Head == NULL) {
+		m_Tail = NULL;
+	}
+
+	ReleaseBlock(Segment->Block);
+	free(Segment);
+}
+
 /**
  * GetSize
  *
  * Returns the size of the buffer.
  */
 size_t CFIFOBuffer::GetSize(void) const {
-	return m_BufferSize - m_Offset;
+	return m_BufferSize - m_Offset + m_SegmentSize;
+}
+
+/**
+ * GetChunkSize
+ *
+ * Returns the number of bytes which can be read from the pointer
+ * returned by Peek(). Unless the buffer contains shared blocks this
+ * is the size of the buffer.
+ */
+size_t CFIFOBuffer::GetChunkSize(void) const {
+	if (m_Head == NULL) {
+		return m_BufferSize - m_Offset;
+	} else if (m_Offset < m_Head->Position) {
+		return m_Head->Position - m_Offset;
+	} else {
+		return m_Head->Block->Size - m_Head->Offset;
+	}
 }
 
 /**
  * Peek
  *
  * Returns a pointer to the buffer's data without advancing the read pointer (or
- * NULL if there is no data left in the buffer).
+ * NULL if there is no data left in the buffer). Only GetChunkSize() bytes are
+ * contiguous.
  */
 char *CFIFOBuffer::Peek(void) const {
 	if (GetSize() == 0) {
 		return NULL;
+	} else if (m_Head != NULL && m_Offset == m_Head->Position) {
+		return m_Head->Block->Data + m_Head->Offset;
 	} else {
 		return m_Buffer + m_Offset;
 	}
 }
 
 /**
- * Reads and returns the specified amount of bytes from the buffer.
+ * Reads and returns the specified amount of bytes from the buffer. The
+ * returned pointer is only valid for buffers which don't contain shared
+ * blocks.
  *
  * @param Bytes the number of bytes which should be read from the buffer.
  *              If this value is greater than the size of the buffer,
@@ -141,15 +202,37 @@ char *CFIFOBuffer::Peek(void) const {
  */
 char *CFIFOBuffer::Read(size_t Bytes) {
 	char *ReturnValue;
+	size_t Chunk;
 
 	Optimize();
 
 	ReturnValue = m_Buffer + m_Offset;
 
-	if (Bytes > GetSize()) {
-		m_Offset += GetSize();
-	} else {
-		m_Offset += Bytes;
+	if (m_Head == NULL) {
+		if (Bytes > GetSize()) {
+			m_Offset += GetSize();
+		} else {
+			m_Offset += Bytes;
+		}
+
+		return ReturnValue;
+	}
+
+	while (Bytes > 0 && GetSize() > 0) {
+		Chunk = min(Bytes, GetChunkSize());
+
+		if (m_Head != NULL && m_Offset == m_Head->Position) {
+			m_Head->Offset += Chunk;
+			m_SegmentSize -= Chunk;
+
+			if (m_Head->Offset == m_Head->Block->Size) {
+				RemoveSegment();
+			}
+		} else {
+			m_Offset += Chunk;
+		}
+
+		Bytes -= Chunk;
 	}
 
 	return ReturnValue;
@@ -211,5 +294,134 @@ RESULT<bool> CFIFOBuffer::WriteUnformattedLine(const char *Line) {
  * Removes all data which is currently stored in the buffer.
  */
 void CFIFOBuffer::Flush(void) {
+	while (m_Head != NULL) {
+		RemoveSegment();
+	}
+
 	Read(GetSize());
 }
+
+/**
+ * WriteBlock
+ *
+ * Appends a reference to a shared block to the buffer.
+ *
+ * @param Block the block
+ */
+RESULT<bool> CFIFOBuffer::WriteBlock(fifo_block_t *Block) {
+	fifo_segment_t *Segment;
+
+	Segment = (fifo_segment_t *)malloc(sizeof(fifo_segment_t));
+
+	if (AllocFailed(Segment)) {
+		THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+	}
+
+	Segment->Block = Block;
+	Segment->Position = m_BufferSize;
+	Segment->Offset = 0;
+	Segment->Next = NULL;
+
+	Block->RefCount++;
+
+	if (m_Tail != NULL) {
+		m_Tail->Next = Segment;
+	} else {
+		m_Head = Segment;
+	}
+
+	m_Tail = Segment;
+	m_SegmentSize += Block->Size;
+
+	RETURN(bool, true);
+}
+
+/**
+ * Append
+ *
+ * Moves all data from another buffer to the end of this buffer. Shared
+ * blocks are moved as references.
+ *
+ * @param Source the buffer
+ */
+void CFIFOBuffer::Append(CFIFOBuffer *Source) {
+	size_t Size;
+
+	while ((Size = Source->GetChunkSize()) > 0) {
+		fifo_segment_t *Head = Source->m_Head;
+
+		if (Head != NULL && Source->m_Offset == Head->Position && Head->Offset == 0) {
+			WriteBlock(Head->Block);
+		} else {
+			Write(Source->Peek(), Size);
+		}
+
+		Source->Read(Size);
+	}
+}
+
+/**
+ * CreateBlock
+ *
+ * Creates a shared block which contains a line. The caller holds one
+ * reference to the block and has to release it using ReleaseBlock().
+ *
+ * @param Line the line
+ */
+fifo_block_t *CFIFOBuffer::CreateBlock(const char *Line) {
+	size_t Length = strlen(Line);
+	fifo_block_t *Block;
+
+	Block = (fifo_block_t *)malloc(sizeof(fifo_block_t) + Length + 2);
+
+	if (AllocFailed(Block)) {
+		return NULL;
+	}
+
+	Block->RefCount = 1;
+	Block->Size = Length + 2;
+	memcpy(Block->Data, Line, Length);
+	memcpy(Block->Data + Length, "\r\n", 2);
+
+	return Block;
+}
+
+/**
+ * CreateBlock
+ *
+ * Creates a shared block which contains a copy of the specified data.
+ * The caller holds one reference to the block and has to release it
+ * using ReleaseBlock().
+ *
+ * @param Data the data
+ * @param Size the size of the data
+ */
+fifo_block_t *CFIFOBuffer::CreateBlock(const char *Data, size_t Size) {
+	fifo_block_t *Block;
+
+	Block = (fifo_block_t *)malloc(sizeof(fifo_block_t) + Size);
+
+	if (AllocFailed(Block)) {
+		return NULL;
+	}
+
+	Block->RefCount = 1;
+	Block->Size = Size;
+	memcpy(Block->Data, Data, Size);
+
+	return Block;
+}
+
+/**
+ * ReleaseBlock
+ *
+ * Releases a reference to a shared block. The block is freed when
+ * the last reference is released.
+ *
+ * @param Block the block
+ */
+void CFIFOBuffer::ReleaseBlock(fifo_block_t *Block) {
+	if (--Block->RefCount == 0) {
+		free(Block);
+	}
+}
@@ -21,11 +21,36 @@
 #define FIFOBUFFER_H
 
 #define BLOCKSIZE 4096
+#define SMALLBLOCKSIZE 256 /**< allocation granularity for buffers which are smaller than BLOCKSIZE */
+
+/**
+ * fifo_block_t
+ *
+ * An immutable block of data which can be shared by several fifo buffers.
+ */
+typedef struct fifo_block_s {
+	unsigned int RefCount; /**< the number of references to the block */
+	size_t Size; /**< the size of the data */
+	char Data[1]; /**< the data */
+} fifo_block_t;
+
+/**
+ * fifo_segment_t
+ *
+ * A reference to a shared block in a fifo buffer.
+ */
+typedef struct fifo_segment_s {
+	fifo_block_t *Block; /**< the shared block */
+	size_t Position; /**< the position in the buffer's own data at which the block was inserted */
+	size_t Offset; /**< the number of bytes which have already been read from the block */
+	struct fifo_segment_s *Next; /**< the next segment */
+} fifo_segment_t;
 
 /**
  * CFIFOBuffer
  *
- * A fifo buffer.
+ * A fifo buffer. Apart from its own data a buffer can hold references
+ * to shared blocks, which are read in the order in which they were written.
  */
 class SBNCAPI CFIFOBuffer {
 	char *m_Buffer; /**< the fifo buffer's data */
@@ -33,8 +58,13 @@ class SBNCAPI CFIFOBuffer {
 	size_t m_Offset; /**< the number of unused bytes at the
 								beginning of the buffer */
 
+	fifo_segment_t *m_Head; /**< the first shared block */
+	fifo_segment_t *m_Tail; /**< the last shared block */
+	size_t m_SegmentSize; /**< the number of unread bytes in shared blocks */
+
 	void *ResizeBuffer(void *Buffer, size_t OldSize, size_t NewSize);
 	inline void Optimize(void);
+	void RemoveSegment(void);
 public:
 #ifndef SWIG
 	CFIFOBuffer(void);
@@ -42,6 +72,7 @@ public:
 #endif /* SWIG */
 
 	size_t GetSize(void) const;
+	size_t GetChunkSize(void) const;
 
 	char *Peek(void) const;
 	char *Read(size_t Bytes);
@@ -49,6 +80,12 @@ public:
 
 	RESULT<bool> Write(const char *Data, size_t Size);
 	RESULT<bool> WriteUnformattedLine(const char *Line);
+	RESULT<bool> WriteBlock(fifo_block_t *Block);
+	void Append(CFIFOBuffer *Source);
+
+	static fifo_block_t *CreateBlock(const char *Line);
+	static fifo_block_t *CreateBlock(const char *Data, size_t Size);
+	static void ReleaseBlock(fifo_block_t *Block);
 };
 
 #endif /* FIFOBUFFER_H */
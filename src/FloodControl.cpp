@@ -19,6 +19,38 @@
 
 #include "StdAfx.h"
 
+/**
+ * FloodSetting
+ *
+ * Reads a flood control setting from the main config.
+ *
+ * @param Setting the name of the setting
+ * @param Default the default value
+ */
+static unsigned int FloodSetting(const char *Setting, unsigned int Default) {
+	RESULT<int> Value = g_Bouncer->GetConfig()->ReadInteger(Setting);
+
+	if (IsError(Value) || Value < 0) {
+		return Default;
+	}
+
+	return Value;
+}
+
+/**
+ * FloodControlTimer
+ *
+ * Wakes up the main loop when the next line may be sent.
+ *
+ * @param Now the current time
+ * @param FloodControl the flood control object
+ */
+bool FloodControlTimer(time_t Now, void *FloodControl) {
+	((CFloodControl *)FloodControl)->m_WakeTimer = NULL;
+
+	return false;
+}
+
 /**
  * CFloodControl
  *
@@ -28,6 +60,33 @@ CFloodControl::CFloodControl(void) {
 	m_BytesSent = 0;
 	m_Enabled = true;
 	m_Plugged = false;
+
+	m_MaxBytes = FloodSetting("system.floodbytes", FLOOD_DEFAULTBYTES);
+	m_MaxLines = FloodSetting("system.floodlines", FLOOD_DEFAULTLINES);
+	m_Window = FloodSetting("system.floodwindow", FLOOD_DEFAULTWINDOW);
+	m_Probe = (FloodSetting("system.floodprobe", 0) != 0);
+
+	if (m_Window == 0) {
+		m_Window = FLOOD_DEFAULTWINDOW;
+	}
+
+	m_ByteLevel = (uint64_t)m_MaxBytes * m_Window;
+	m_LineLevel = (uint64_t)m_MaxLines * m_Window;
+	m_LastRefill = UtilMsecTime();
+
+	m_WakeTimer = NULL;
+	m_WakeTime = 0;
+}
+
+/**
+ * ~CFloodControl
+ *
+ * Destructs the flood control object.
+ */
+CFloodControl::~CFloodControl(void) {
+	if (m_WakeTimer != NULL) {
+		m_WakeTimer->Destroy();
+	}
 }
 
 /**
@@ -47,6 +106,97 @@ void CFloodControl::AttachInputQueue(CQueue *Queue, int Priority) {
 	m_Queues.Insert(IrcQueue);
 }
 
+/**
+ * GetNextQueue
+ *
+ * Returns the non-empty queue with the highest priority, or NULL
+ * if all queues are empty.
+ */
+irc_queue_t *CFloodControl::GetNextQueue(void) {
+	int LowestPriority = 100;
+	irc_queue_t *ThatQueue = NULL;
+
+	for (int i = 0; i < m_Queues.GetLength(); i++) {
+		if (m_Queues[i].Priority < LowestPriority && m_Queues[i].Queue->GetLength() > 0) {
+			LowestPriority = m_Queues[i].Priority;
+			ThatQueue = &m_Queues[i];
+		}
+	}
+
+	return ThatQueue;
+}
+
+/**
+ * Refill
+ *
+ * Adds the tokens which have accumulated since the last refill
+ * to the buckets.
+ */
+void CFloodControl::Refill(void) {
+	uint64_t Now = UtilMsecTime();
+	uint64_t Elapsed = Now - m_LastRefill;
+
+	m_LastRefill = Now;
+
+	m_ByteLevel = min(m_ByteLevel + Elapsed * m_MaxBytes, (uint64_t)m_MaxBytes * m_Window);
+	m_LineLevel = min(m_LineLevel + Elapsed * m_MaxLines, (uint64_t)m_MaxLines * m_Window);
+}
+
+/**
+ * GetDelay
+ *
+ * Returns the number of msecs until there are enough tokens
+ * for sending a line.
+ *
+ * @param Line the line
+ */
+unsigned int CFloodControl::GetDelay(const char *Line) const {
+	uint64_t Cost, Delay = 0;
+
+	if (m_MaxBytes > 0) {
+		// lines which are longer than the bucket need a full bucket
+		Cost = (uint64_t)min(strlen(Line) + 2, (size_t)m_MaxBytes) * m_Window;
+
+		if (Cost > m_ByteLevel) {
+			Delay = (Cost - m_ByteLevel + m_MaxBytes - 1) / m_MaxBytes;
+		}
+	}
+
+	if (m_MaxLines > 0) {
+		Cost = m_Window;
+
+		if (Cost > m_LineLevel) {
+			Delay = max(Delay, (Cost - m_LineLevel + m_MaxLines - 1) / m_MaxLines);
+		}
+	}
+
+	return (unsigned int)Delay;
+}
+
+/**
+ * ScheduleWakeup
+ *
+ * Makes sure that the main loop wakes up when the next line may be sent.
+ *
+ * @param Delay the number of msecs until the next line may be sent
+ */
+void CFloodControl::ScheduleWakeup(unsigned int Delay) {
+	uint64_t When = UtilMsecTime() + Delay;
+
+	if (m_WakeTimer == NULL) {
+		m_WakeTimer = new CTimer(0, false, FloodControlTimer, this);
+
+		if (AllocFailed(m_WakeTimer)) {
+			return;
+		}
+	} else if (m_WakeTime <= When) {
+		return;
+	}
+
+	m_WakeTime = When;
+	m_WakeTimer->RescheduleMsec(When);
+}
+
 /**
  * DequeueItem
  *
@@ -55,19 +205,14 @@ void CFloodControl::AttachInputQueue(CQueue *Queue, int Priority) {
  * @param Peek determines whether to actually remove the item
  */
 RESULT<char *> CFloodControl::DequeueItem(bool Peek) {
-	int LowestPriority = 100;
-	irc_queue_t *ThatQueue = NULL;
+	irc_queue_t *ThatQueue;
+	size_t Length;
 
 	if (m_Enabled && m_Plugged) {
 		RETURN(char *, NULL);
 	}
 
-	for (int i = 0; i < m_Queues.GetLength(); i++) {
-		if (m_Queues[i].Priority < LowestPriority && m_Queues[i].Queue->GetLength() > 0) {
-			LowestPriority = m_Queues[i].Priority;
-			ThatQueue = &m_Queues[i];
-		}
-	}
+	ThatQueue = GetNextQueue();
 
 	if (ThatQueue == NULL) {
 		RETURN(char *, NULL);
@@ -85,17 +230,30 @@ RESULT<char *> CFloodControl::DequeueItem(bool Peek) {
 		RETURN(char *, const_cast<char *>((const char *)PeekItem));
 	}
 
-	if (m_Enabled && m_BytesSent > 0 && m_BytesSent + strlen(PeekItem) + 2 + strlen(FLOODMSG) + 2 > FLOODBYTES) {
-		Plug();
+	Length = strlen(PeekItem) + 2;
+
+	if (m_Enabled) {
+		Refill();
+
+		if (GetDelay(PeekItem) > 0) {
+			RETURN(char *, NULL);
+		}
+
+		if (m_Probe && m_BytesSent > 0 && m_BytesSent + Length + strlen(FLOODMSG) + 2 > FLOODBYTES) {
+			Plug();
+
+			RETURN(char *, strdup(FLOODMSG));
+		}
 
-		RETURN(char *, strdup(FLOODMSG));
+		m_ByteLevel -= (uint64_t)min(Length, (size_t)m_MaxBytes) * m_Window;
+		m_LineLevel -= min((uint64_t)m_Window, m_LineLevel);
 	}
 
 	RESULT<char *> Item = ThatQueue->Queue->DequeueItem();
 
 	THROWIFERROR(char *, Item);
 
-	m_BytesSent += strlen(Item) + 2;
+	m_BytesSent += Length;
 
 	RETURN(char *, Item);
 }
@@ -107,12 +265,26 @@ RESULT<char *> CFloodControl::DequeueItem(bool Peek) {
  * could be immediately retrieved using DequeueItem().
  */
 int CFloodControl::GetQueueSize(void) {
-	if (m_Plugged)
+	unsigned int Delay;
+
+	if (m_Plugged) {
 		return 0;
-	else
+	}
+
+	if (!m_Enabled) {
 		return (GetRealLength() > 0);
-}
+	}
+
+	Delay = GetDelay();
+
+	if (Delay > 0) {
+		ScheduleWakeup(Delay);
+
+		return 0;
+	}
 
+	return (GetNextQueue() != NULL);
+}
 /**
  * GetRealLength
  *
@@ -175,3 +347,51 @@ void CFloodControl::Enable(void) {
 void CFloodControl::Disable(void) {
 	m_Enabled = false;
 }
+
+/**
+ * GetByteLevel
+ *
+ * Returns the number of bytes which are currently available in
+ * the byte bucket.
+ */
+unsigned int CFloodControl::GetByteLevel(void) {
+	Refill();
+
+	return (unsigned int)(m_ByteLevel / m_Window);
+}
+
+/**
+ * GetLineLevel
+ *
+ * Returns the number of lines which are currently available in
+ * the line bucket.
+ */
+unsigned int CFloodControl::GetLineLevel(void) {
+	Refill();
+
+	return (unsigned int)(m_LineLevel / m_Window);
+}
+
+/**
+ * GetDelay
+ *
+ * Returns the number of msecs until the next queued line may be
+ * sent, or 0 if there are no queued lines.
+ */
+unsigned int CFloodControl::GetDelay(void) {
+	irc_queue_t *ThatQueue = GetNextQueue();
+
+	if (ThatQueue == NULL) {
+		return 0;
+	}
+
+	RESULT<const char *> PeekItem = ThatQueue->Queue->PeekItem();
+
+	if (IsError(PeekItem)) {
+		return 0;
+	}
+
+	Refill();
+
+	return GetDelay(PeekItem);
+}
@@ -21,7 +21,11 @@
 #define FLOODCONTROL_H
 
 #define FLOODMSG "SBNCFLOODCHECK"
-#define FLOODBYTES 1024
+#define FLOODBYTES 1024 /**< number of bytes after which the round-trip probe is sent */
+
+#define FLOOD_DEFAULTBYTES 2560 /**< default number of bytes per window */
+#define FLOOD_DEFAULTLINES 10 /**< default number of lines per window */
+#define FLOOD_DEFAULTWINDOW 10000 /**< default size of the window (in msecs) */
 
 /**
  * irc_queue_t
@@ -33,22 +37,49 @@ typedef struct queue_s {
 	CQueue *Queue; /**< the queue object */
 } irc_queue_t;
 
+#ifndef SWIG
+bool FloodControlTimer(time_t Now, void *FloodControl);
+#endif /* SWIG */
+
 /**
  * CFloodControl
  *
- * A queue which tries to avoid "Excess Flood" errors.
+ * A queue which tries to avoid "Excess Flood" errors. Lines are sent
+ * as long as there are enough tokens in two token buckets (one for bytes
+ * and one for lines) which are refilled continuously. Optionally the
+ * queue is also plugged after FLOODBYTES bytes until the server has
+ * answered a probe message.
  */
 class SBNCAPI CFloodControl {
+#ifndef SWIG
+	friend bool FloodControlTimer(time_t Now, void *FloodControl);
+#endif /* SWIG */
+
 	CVector<irc_queue_t> m_Queues; /**< a list of queues which have been
 								attached to this object */
-	size_t m_BytesSent; /**< the number of bytes which have recently been sent */
+	size_t m_BytesSent; /**< the number of bytes which have been sent since the last probe */
 	bool m_Enabled; /**< determines whether this object is delaying the output */
 	bool m_Plugged; /**< determines whether the queue is plugged */
+	bool m_Probe; /**< determines whether the round-trip probe is used */
+
+	unsigned int m_MaxBytes; /**< the number of bytes per window (0 = unlimited) */
+	unsigned int m_MaxLines; /**< the number of lines per window (0 = unlimited) */
+	unsigned int m_Window; /**< the size of the window (in msecs) */
+	uint64_t m_ByteLevel; /**< available bytes, multiplied by the window size */
+	uint64_t m_LineLevel; /**< available lines, multiplied by the window size */
+	uint64_t m_LastRefill; /**< when the buckets were last refilled */
 
-	void ScheduleItem(void);
+	CTimer *m_WakeTimer; /**< wakes up the main loop when the next line may be sent */
+	uint64_t m_WakeTime; /**< when the wake timer is scheduled */
+
+	irc_queue_t *GetNextQueue(void);
+	void Refill(void);
+	unsigned int GetDelay(const char *Line) const;
+	void ScheduleWakeup(unsigned int Delay);
 public:
 #ifndef SWIG
 	CFloodControl(void);
+	virtual ~CFloodControl(void);
 #endif /* SWIG */
 
 	RESULT<char *> DequeueItem(bool Peek = false);
@@ -63,6 +94,10 @@ public:
 
 	void Enable(void);
 	void Disable(void);
+
+	unsigned int GetByteLevel(void);
+	unsigned int GetLineLevel(void);
+	unsigned int GetDelay(void);
 };
 
 #endif /* FLOODCONTROL_H */
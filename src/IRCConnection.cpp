@@ -22,8 +22,6 @@
 bool DelayJoinTimer(time_t Now, void *IRCConnection);
 bool IRCPingTimer(time_t Now, void *IRCConnection);
 
-extern time_t g_LastReconnect;
-
 /**
  * CIRCConnection
  *
@@ -43,12 +41,28 @@ CIRCConnection::CIRCConnection(const char *Host, unsigned int Port, CUser *Owner
 	SetRole(Role_Client);
 	SetOwner(Owner);
 
-	g_LastReconnect = g_CurrentTime;
-	m_LastResponse = g_LastReconnect;
+	m_LastResponse = g_CurrentTime;
 
 	m_State = State_Connecting;
 	m_SeenMotd = false;
 
+	// connections which can't be registered are destroyed, so the
+	// user can be reconnected
+	Timeout(IRC_REGISTRATIONTIMEOUT);
+
+	m_AdmissionKey = NULL;
+	m_Registering = false;
+	m_JoinWaiting = false;
+
+	if (Host != NULL) {
+		m_AdmissionKey = CReconnectPlanner::GetAdmissionKey(Host, BindIp);
+
+		if (m_AdmissionKey != NULL) {
+			g_Bouncer->GetReconnectPlanner()->BeginRegistration(m_AdmissionKey);
+			m_Registering = true;
+		}
+	}
+
 	m_CurrentNick = NULL;
 	m_Server = NULL;
 	m_ServerVersion = NULL;
@@ -160,6 +174,16 @@ CIRCConnection::~CIRCConnection(void) {
 		m_DelayJoinTimer->Destroy();
 	}
 
+	if (m_Registering) {
+		g_Bouncer->GetReconnectPlanner()->EndRegistration(m_AdmissionKey);
+	}
+
+	if (m_JoinWaiting) {
+		g_Bouncer->GetReconnectPlanner()->EndJoin(m_AdmissionKey);
+	}
+
+	free(m_AdmissionKey);
+
 	if (m_PingTimer != NULL) {
 		m_PingTimer->Destroy();
 	}
@@ -408,6 +432,10 @@ bool CIRCConnection::ParseLineArgV(int argc, const char **argv) {
 
 		return bRet;
 	} else if (argc > 2 && iRaw == 1) {
+		if (!m_Shutdown) {
+			m_Timeout = 0;
+		}
+
 		if (Client != NULL) {
 			if (strcmp(Client->GetNick(), argv[2]) != 0) {
 				Client->WriteLine(":%s!%s NICK :%s", Client->GetNick(), m_Site ? m_Site : "unknown@unknown.host", argv[2]);
@@ -430,12 +458,31 @@ bool CIRCConnection::ParseLineArgV(int argc, const char **argv) {
 		g_Bouncer->Log("User %s connected to an IRC server.",
 			GetOwner()->GetUsername());
 
+		if (m_Registering) {
+			g_Bouncer->GetReconnectPlanner()->EndRegistration(m_AdmissionKey);
+			m_Registering = false;
+		}
+
 		int DelayJoin = GetOwner()->GetDelayJoin();
 
-		if (DelayJoin == 1) {
-			m_DelayJoinTimer = g_Bouncer->CreateTimer(5, false, DelayJoinTimer, this);
-		} else if (DelayJoin == 0) {
-			JoinChannels();
+		if ((DelayJoin == 0 || DelayJoin == 1) && m_DelayJoinTimer == NULL && !m_JoinWaiting) {
+			time_t JoinSlot = g_CurrentTime;
+
+			// pace the join bursts of connections to the same server
+			if (m_AdmissionKey != NULL) {
+				JoinSlot = g_Bouncer->GetReconnectPlanner()->ReserveJoin(m_AdmissionKey);
+				m_JoinWaiting = (JoinSlot > g_CurrentTime);
+			}
+
+			if (DelayJoin == 1) {
+				JoinSlot = max(JoinSlot, g_CurrentTime + 5);
+			}
+
+			if (JoinSlot > g_CurrentTime) {
+				m_DelayJoinTimer = g_Bouncer->CreateTimer(JoinSlot - g_CurrentTime, false, DelayJoinTimer, this);
+			} else {
+				JoinChannels();
+			}
 		}
 
 		if (Client == NULL) {
@@ -830,8 +877,9 @@ void CIRCConnection::ParseLine(const char *Line) {
 		if (strcasecmp(argv[0], "ping") == 0 && argc > 1) {
 			int rc = asprintf(&Out, "PONG :%s", argv[1]);
 
+			// PONGs bypass the flood control queues
 			if (!RcFailed(rc)) {
-				m_QueueHigh->QueueItem(Out);
+				CConnection::WriteUnformattedLine(Out);
 				free(Out);
 			}
 
@@ -1301,12 +1349,19 @@ CFloodControl *CIRCConnection::GetFloodControl(void) {
 /**
  * WriteUnformattedLine
  *
- * Sends a line to the IRC server.
+ * Sends a line to the IRC server. Lines which are sent while the
+ * connection is still being registered bypass the flood control queues.
  *
  * @param In the line
  */
 void CIRCConnection::WriteUnformattedLine(const char *In) {
-	if (strlen(In) < 512) {
+	if (strlen(In) >= 512) {
+		return;
+	}
+
+	if (m_State != State_Connected) {
+		CConnection::WriteUnformattedLine(In);
+	} else {
 		m_QueueMiddle->QueueItem(In);
 	}
 }
@@ -1353,6 +1408,11 @@ void CIRCConnection::JoinChannels(void) {
 		m_DelayJoinTimer = NULL;
 	}
 
+	if (m_JoinWaiting) {
+		g_Bouncer->GetReconnectPlanner()->EndJoin(m_AdmissionKey);
+		m_JoinWaiting = false;
+	}
+
 	Channels = GetOwner()->GetConfigChannels();
 
 	if (Channels != NULL && Channels[0] != '\0') {
@@ -1542,11 +1602,11 @@ int CIRCConnection::SSLVerify(int PreVerifyOk, X509_STORE_CTX *Context) const {
  * @param Response the response from the DNS server
  */
 void CIRCConnection::AsyncDnsFinished(hostent *Response) {
-	if (Response == NULL && GetOwner() != NULL) {
+	CConnection::AsyncDnsFinished(Response);
+
+	if (Response == NULL && GetOwner() != NULL && LookupFailed()) {
 		g_Bouncer->LogUser(GetOwner(), "DNS request for user %s failed.", GetOwner()->GetUsername());
 	}
-
-	CConnection::AsyncDnsFinished(Response);
 }
 
 /**
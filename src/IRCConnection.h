@@ -20,6 +20,8 @@
 #ifndef IRCCONNECTION_H
 #define IRCCONNECTION_H
 
+#define IRC_REGISTRATIONTIMEOUT 90 /**< number of seconds a connection may take to be registered */
+
 /**
  * connection_state_e
  *
@@ -91,6 +93,10 @@ private:
 
 	bool m_EatPong; /**< whether to ignore the next PONG event from the IRC server */
 
+	char *m_AdmissionKey; /**< the key for the reconnect planner's admission state */
+	bool m_Registering; /**< whether the connection counts towards the registration limit */
+	bool m_JoinWaiting; /**< whether the connection is waiting for its join slot */
+
 	CChannel *AddChannel(const char *Channel);
 	void RemoveChannel(const char *Channel);
 
@@ -20,26 +20,107 @@
 #ifndef LISTENER_H
 #define LISTENER_H
 
+#define LISTENER_ACCEPTBUDGET 64 /**< maximum number of connections which are accepted per wakeup */
+#define LISTENER_MAXSOCKETS 16 /**< maximum number of SO_REUSEPORT sockets per listener */
+
 /**
  * CListenerBase<InheritedClass>
  *
- * Implements a generic socket listener.
+ * Implements a generic socket listener. Depending on the "system.listenersockets"
+ * setting a listener may use several SO_REUSEPORT sockets for the same port.
  */
 template<typename InheritedClass>
 class CListenerBase : public CSocketEvents {
 private:
+	/**
+	 * CListenerShard
+	 *
+	 * An additional socket for the listener's port.
+	 */
+	class CListenerShard : public CSocketEvents {
+		CListenerBase *m_Owner; /**< the listener */
+		SOCKET m_Socket; /**< the listening socket */
+
+		virtual int Read(bool DontProcess) {
+			m_Owner->AcceptConnections(m_Socket);
+
+			return 0;
+		}
+
+		virtual int Write(void) { return 0; }
+		virtual void Error(int ErrorCode) { }
+		virtual bool HasQueuedData(void) const { return false; }
+		virtual bool ShouldDestroy(void) const { return false; }
+
+		virtual const char *GetClassName(void) const { return "CListenerShard"; }
+
+	public:
+		CListenerShard(CListenerBase *Owner, SOCKET Socket) {
+			m_Owner = Owner;
+			m_Socket = Socket;
+
+			g_Bouncer->RegisterSocket(m_Socket, static_cast<CSocketEvents *>(this));
+		}
+
+		virtual ~CListenerShard(void) {
+			if (g_Bouncer != NULL) {
+				g_Bouncer->UnregisterSocket(m_Socket);
+			}
+
+			closesocket(m_Socket);
+		}
+
+		virtual void Destroy(void) {
+			delete this;
+		}
+	};
+
 	SOCKET m_Listener; /**< the listening socket */
+	CVector<CListenerShard *> m_Shards; /**< additional sockets for the same port */
 
-	virtual int Read(bool DontProcess) {
+	/**
+	 * AcceptConnections
+	 *
+	 * Accepts pending connections on one of the listener's sockets. At most
+	 * LISTENER_ACCEPTBUDGET connections are accepted so other sockets aren't
+	 * starved during connection floods.
+	 *
+	 * @param Listener the listening socket
+	 */
+	void AcceptConnections(SOCKET Listener) {
 		sockaddr_storage PeerAddress;
-		socklen_t PeerSize = sizeof(PeerAddress);
+		socklen_t PeerSize;
 		SOCKET Client;
 
-		Client = accept(m_Listener, (sockaddr *)&PeerAddress, &PeerSize);
+		for (int i = 0; i < LISTENER_ACCEPTBUDGET; i++) {
+			PeerSize = sizeof(PeerAddress);
+
+#ifdef HAVE_ACCEPT4
+			Client = accept4(Listener, (sockaddr *)&PeerAddress, &PeerSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else /* HAVE_ACCEPT4 */
+			Client = accept(Listener, (sockaddr *)&PeerAddress, &PeerSize);
+
+			if (Client != INVALID_SOCKET) {
+				unsigned long lTrue = 1;
+
+				ioctlsocket(Client, FIONBIO, &lTrue);
+
+#ifdef FD_CLOEXEC
+				fcntl(Client, F_SETFD, FD_CLOEXEC);
+#endif /* FD_CLOEXEC */
+			}
+#endif /* HAVE_ACCEPT4 */
+
+			if (Client == INVALID_SOCKET) {
+				break;
+			}
 
-		if (Client != INVALID_SOCKET) {
 			Accept(Client, (sockaddr *)&PeerAddress);
 		}
+	}
+
+	virtual int Read(bool DontProcess) {
+		AcceptConnections(m_Listener);
 
 		return 0;
 	}
@@ -65,14 +146,30 @@ public:
 	 * @param Family the socket family of the listener (AF_INET or AF_INET6)
 	 */
 	CListenerBase(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET) {
-		m_Listener = INVALID_SOCKET;
+		int Sockets = g_Bouncer->GetListenerSockets();
+		SOCKET Shard;
+
+		// additional sockets need a fixed port
+		if (Port == 0) {
+			Sockets = 1;
+		}
+
+		m_Listener = g_Bouncer->CreateListener(Port, BindIp, Family, Sockets > 1);
 
 		if (m_Listener == INVALID_SOCKET) {
-			m_Listener = g_Bouncer->CreateListener(Port, BindIp, Family);
+			return;
 		}
 
-		if (m_Listener != INVALID_SOCKET) {
-			g_Bouncer->RegisterSocket(m_Listener, static_cast<CSocketEvents *>(this));
+		g_Bouncer->RegisterSocket(m_Listener, static_cast<CSocketEvents *>(this));
+
+		for (int i = 1; i < Sockets; i++) {
+			Shard = g_Bouncer->CreateListener(Port, BindIp, Family, true);
+
+			if (Shard == INVALID_SOCKET) {
+				break;
+			}
+
+			m_Shards.Insert(new CListenerShard(this, Shard));
 		}
 	}
 
@@ -82,6 +179,10 @@ public:
 	 * Destructs a listener object.
 	 */
 	virtual ~CListenerBase(void) {
+		for (int i = 0; i < m_Shards.GetLength(); i++) {
+			m_Shards[i]->Destroy();
+		}
+
 		if (g_Bouncer != NULL && m_Listener != INVALID_SOCKET) {
 			g_Bouncer->UnregisterSocket(m_Listener);
 		}
@@ -122,6 +223,19 @@ public:
 		return m_Listener;
 	}
 
+	/**
+	 * GetSocketCount
+	 *
+	 * Returns the number of sockets which are used by the listener object.
+	 */
+	int GetSocketCount(void) const {
+		if (m_Listener == INVALID_SOCKET) {
+			return 0;
+		}
+
+		return 1 + m_Shards.GetLength();
+	}
+
 	virtual unsigned int GetPort(void) const {
 		sockaddr_storage Address;
 		socklen_t Length = sizeof(Address);
@@ -181,12 +295,16 @@ public:
 	 */
 	virtual void Accept(SOCKET Client, const sockaddr *PeerAddress) {
 		CClientConnection *ClientObject;
-		unsigned long lTrue = 1;
 
-		ioctlsocket(Client, FIONBIO, &lTrue);
+		// clients which exceed the limits for their address are turned away before anything is allocated
+		if (!g_Bouncer->GetReputationTable()->AddPreAuth(PeerAddress)) {
+			closesocket(Client);
+
+			return;
+		}
 
 		// destruction is controlled by the main loop
-		ClientObject = new CClientConnection(Client, m_SSL);
+		ClientObject = new CClientConnection(Client, m_SSL, PeerAddress);
 	}
 
 	/**
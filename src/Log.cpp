@@ -19,6 +19,141 @@
 
 #include "StdAfx.h"
 
+/**
+ * logmap_t
+ *
+ * A read-only view of a range of a log file.
+ */
+typedef struct logmap_s {
+	const char *Data; /**< the requested range */
+	void *Base; /**< the start of the mapping */
+	size_t BaseLength; /**< the length of the mapping */
+} logmap_t;
+
+/**
+ * LogMapRange
+ *
+ * Maps a range of a file into memory. On Win32 the range is read into
+ * a heap buffer instead.
+ *
+ * @param Filename the name of the file
+ * @param Offset the start of the range
+ * @param Length the length of the range
+ * @param Map the view which is to be initialized
+ */
+static bool LogMapRange(const char *Filename, off_t Offset, size_t Length, logmap_t *Map) {
+#ifndef _WIN32
+	int fd;
+	off_t PageOffset;
+	struct stat StatBuf;
+
+	fd = open(Filename, O_RDONLY);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	/* the file might have been truncated since it was indexed */
+	if (fstat(fd, &StatBuf) < 0 || StatBuf.st_size < Offset + (off_t)Length) {
+		close(fd);
+
+		return false;
+	}
+
+	PageOffset = Offset - Offset % sysconf(_SC_PAGESIZE);
+
+	Map->BaseLength = Length + (Offset - PageOffset);
+	Map->Base = mmap(NULL, Map->BaseLength, PROT_READ, MAP_SHARED, fd, PageOffset);
+
+	close(fd);
+
+	if (Map->Base == MAP_FAILED) {
+		return false;
+	}
+
+	Map->Data = (const char *)Map->Base + (Offset - PageOffset);
+
+	return true;
+#else /* _WIN32 */
+	FILE *File;
+
+	File = fopen(Filename, "rb");
+
+	if (File == NULL) {
+		return false;
+	}
+
+	Map->Base = malloc(Length);
+
+	if (AllocFailed(Map->Base)) {
+		fclose(File);
+
+		return false;
+	}
+
+	if (fseek(File, Offset, SEEK_SET) != 0 || fread(Map->Base, 1, Length, File) != Length) {
+		free(Map->Base);
+		fclose(File);
+
+		return false;
+	}
+
+	fclose(File);
+
+	Map->BaseLength = Length;
+	Map->Data = (const char *)Map->Base;
+
+	return true;
+#endif /* _WIN32 */
+}
+
+/**
+ * LogUnmapRange
+ *
+ * Releases a view which was created using LogMapRange().
+ *
+ * @param Map the view
+ */
+static void LogUnmapRange(logmap_t *Map) {
+#ifndef _WIN32
+	munmap(Map->Base, Map->BaseLength);
+#else /* _WIN32 */
+	free(Map->Base);
+#endif /* _WIN32 */
+}
+
+/**
+ * LogSendLine
+ *
+ * Sends a single log line to a client.
+ *
+ * @param Client the client
+ * @param Type specifies how the line should be sent
+ * @param Line the line
+ */
+static void LogSendLine(CClientConnection *Client, LogType Type, const char *Line) {
+	if (Type == Log_Notice) {
+		Client->RealNotice(Line);
+	} else if (Type == Log_Message) {
+		Client->Privmsg(Line);
+	} else if (Type == Log_Motd) {
+		CIRCConnection *IRC = Client->GetOwner()->GetIRCConnection();
+		const char *Nick, *Server;
+
+		if (IRC != NULL) {
+			Nick = IRC->GetCurrentNick();
+			Server = IRC->GetServer();
+		} else {
+			Nick = Client->GetNick();
+			Server = "bouncer.shroudbnc.info";
+		}
+
+		if (Nick != NULL) {
+			Client->WriteLine(":%s 372 %s :%s", Server, Nick, Line);
+		}
+	}
+}
+
 /**
  * CLog
  *
@@ -43,7 +178,13 @@ CLog::CLog(const char *Filename, bool KeepOpen) {
 #ifndef _WIN32
 	m_Inode = 0;
 	m_Dev = 0;
+	m_IndexInode = 0;
 #endif
+
+	m_LineIndex = NULL;
+	m_LineAlloc = 0;
+
+	ResetIndex();
 }
 
 /**
@@ -53,12 +194,114 @@ CLog::CLog(const char *Filename, bool KeepOpen) {
  */
 CLog::~CLog(void) {
 	free(m_Filename);
+	free(m_LineIndex);
 
 	if (m_File != NULL) {
 		fclose(m_File);
 	}
 }
 
+/**
+ * ResetIndex
+ *
+ * Discards the line index.
+ */
+void CLog::ResetIndex(void) const {
+	m_LineCount = 0;
+	m_IndexedSize = 0;
+	m_IndexLineStart = true;
+}
+
+/**
+ * UpdateIndex
+ *
+ * Adds lines which have been written since the index was last updated
+ * to the index. The index is rebuilt if the file was truncated or replaced.
+ */
+bool CLog::UpdateIndex(void) const {
+	struct stat StatBuf;
+	logmap_t Map;
+	size_t Length, Position;
+
+	if (m_Filename == NULL || stat(m_Filename, &StatBuf) < 0) {
+		ResetIndex();
+
+		return false;
+	}
+
+#ifndef _WIN32
+	if (StatBuf.st_ino != m_IndexInode) {
+		ResetIndex();
+		m_IndexInode = StatBuf.st_ino;
+	}
+#endif
+
+	if (StatBuf.st_size < m_IndexedSize) {
+		ResetIndex();
+	}
+
+	if (StatBuf.st_size == m_IndexedSize) {
+		return true;
+	}
+
+	Length = StatBuf.st_size - m_IndexedSize;
+
+	if (!LogMapRange(m_Filename, m_IndexedSize, Length, &Map)) {
+		return false;
+	}
+
+	Position = 0;
+
+	while (Position < Length) {
+		if (m_IndexLineStart) {
+			if (m_LineCount >= m_LineAlloc) {
+				int NewAlloc = (m_LineAlloc > 0) ? m_LineAlloc * 2 : 128;
+				off_t *NewIndex = (off_t *)realloc(m_LineIndex, sizeof(off_t) * NewAlloc);
+
+				if (AllocFailed(NewIndex)) {
+					m_IndexedSize += Position;
+
+					LogUnmapRange(&Map);
+
+					return false;
+				}
+
+				m_LineIndex = NewIndex;
+				m_LineAlloc = NewAlloc;
+			}
+
+			m_LineIndex[m_LineCount++] = m_IndexedSize + Position;
+			m_IndexLineStart = false;
+		}
+
+		const char *NewLine = (const char *)memchr(Map.Data + Position, '\n', Length - Position);
+
+		if (NewLine == NULL) {
+			break;
+		}
+
+		Position = NewLine - Map.Data + 1;
+		m_IndexLineStart = true;
+	}
+
+	m_IndexedSize = StatBuf.st_size;
+
+	LogUnmapRange(&Map);
+
+	return true;
+}
+
+/**
+ * GetLineCount
+ *
+ * Returns the number of lines in the log.
+ */
+int CLog::GetLineCount(void) const {
+	UpdateIndex();
+
+	return m_LineCount;
+}
+
 /**
  * PlayToUser
  *
@@ -71,63 +314,90 @@ CLog::~CLog(void) {
  *             Log_Motd - use IRC motd replies
  */
 void CLog::PlayToUser(CClientConnection *Client, LogType Type) const {
-	FILE *LogFile;
+	int Count = PlayToUser(Client, Type, 0, GetLineCount(), 0);
 
-	CIRCConnection *IRC = Client->GetOwner()->GetIRCConnection();
-	const char *Nick = NULL;
-	const char *Server = NULL;
+	if (Type == Log_Motd && Count > 0) {
+		CIRCConnection *IRC = Client->GetOwner()->GetIRCConnection();
+		const char *Nick, *Server;
 
-	if (m_File != NULL) {
-		fclose(m_File);
+		if (IRC != NULL) {
+			Nick = IRC->GetCurrentNick();
+			Server = IRC->GetServer();
+		} else {
+			Nick = Client->GetNick();
+			Server = "bouncer.shroudbnc.info";
+		}
+
+		if (Nick != NULL && Server != NULL) {
+			Client->WriteLine(":%s 376 %s :End of /MOTD command.", Server, Nick);
+		}
 	}
+}
 
-	if (m_Filename != NULL && (LogFile = fopen(m_Filename, "r")) != NULL) {
-		char Line[500];
+/**
+ * PlayToUser
+ *
+ * Sends a range of lines from the log to the specified user. Returns the
+ * number of lines which have been sent.
+ *
+ * @param Client the user who should receive the log
+ * @param Type specifies how the log should be sent
+ * @param Offset the first line which is to be sent
+ * @param Count the maximum number of lines
+ * @param MaxBytes the maximum number of bytes which should be read from
+ *                 the log (at least one line is always sent), or 0 for no limit
+ */
+int CLog::PlayToUser(CClientConnection *Client, LogType Type, int Offset, int Count, size_t MaxBytes) const {
+	logmap_t Map;
+	off_t Start, End;
+	int Last;
 
-		while (!feof(LogFile)) {
-			char *LinePtr = fgets(Line, sizeof(Line), LogFile);
+	if (!UpdateIndex() || Offset < 0 || Offset >= m_LineCount || Count <= 0) {
+		return 0;
+	}
 
-			if (LinePtr == NULL) {
-				continue;
-			}
-			char *TempLinePtr = Line;
+	if (Count > m_LineCount - Offset) {
+		Count = m_LineCount - Offset;
+	}
 
-			while (*TempLinePtr) {
-				if (*TempLinePtr == '\r' || *TempLinePtr == '\n') {
-					*TempLinePtr = '\0';
+	Start = m_LineIndex[Offset];
+	Last = Offset + 1;
 
-					break;
-				}
+	while (Last < Offset + Count && (MaxBytes == 0 || (size_t)(m_LineIndex[Last] - Start) < MaxBytes)) {
+		Last++;
+	}
 
-				TempLinePtr++;
-			}
+	End = (Last < m_LineCount) ? m_LineIndex[Last] : m_IndexedSize;
 
-			if (Type == Log_Notice) {
-				Client->RealNotice(Line);
-			} else if (Type == Log_Message) {
-				Client->Privmsg(Line);
-			} else if (Type == Log_Motd) {
-				if (IRC != NULL) {
-					Nick = IRC->GetCurrentNick();
-					Server = IRC->GetServer();
-				} else {
-					Nick = Client->GetNick();
-					Server = "bouncer.shroudbnc.info";
-				}
+	if (!LogMapRange(m_Filename, Start, End - Start, &Map)) {
+		return 0;
+	}
 
-				if (Nick != NULL) {
-					Client->WriteLine(":%s 372 %s :%s", Server, Nick, Line);
-				}
-			}
+	for (int i = Offset; i < Last; i++) {
+		const char *LinePtr = Map.Data + (m_LineIndex[i] - Start);
+		const char *LineEnd = Map.Data + (((i + 1 < m_LineCount) ? m_LineIndex[i + 1] : m_IndexedSize) - Start);
+		char Line[500];
+
+		while (LineEnd > LinePtr && (LineEnd[-1] == '\r' || LineEnd[-1] == '\n')) {
+			LineEnd--;
 		}
 
-		fclose(LogFile);
-		m_File = NULL;
-	}
+		/* long lines are split into several messages */
+		do {
+			size_t Length = min((size_t)(LineEnd - LinePtr), sizeof(Line) - 1);
+
+			memcpy(Line, LinePtr, Length);
+			Line[Length] = '\0';
 
-	if (Type == Log_Motd && Nick != NULL && Server != NULL) {
-		Client->WriteLine(":%s 376 %s :End of /MOTD command.", Server, Nick);
+			LinePtr += Length;
+
+			LogSendLine(Client, Type, Line);
+		} while (LinePtr < LineEnd);
 	}
+
+	LogUnmapRange(&Map);
+
+	return Last - Offset;
 }
 
 /**
@@ -271,6 +541,8 @@ void CLog::WriteLine(const char *Format, ...) {
 void CLog::Clear(void) {
 	FILE *LogFile;
 
+	ResetIndex();
+
 	if (m_File != NULL) {
 		fclose(m_File);
 	}
@@ -327,3 +599,85 @@ const char *CLog::GetFilename(void) const {
 		return NULL;
 	}
 }
+
+/**
+ * CLogPlayback
+ *
+ * Constructs a new log playback object.
+ *
+ * @param Log the log which is to be played
+ * @param Client the client which should receive the log
+ * @param Type specifies how the log should be sent
+ * @param Offset the first line
+ * @param Count the number of lines
+ * @param Trailer a message which is sent after the last line, or NULL
+ */
+CLogPlayback::CLogPlayback(const CLog *Log, CClientConnection *Client, LogType Type,
+		int Offset, int Count, const char *Trailer) : COutputProducer(Client) {
+	int Lines = Log->GetLineCount();
+
+	m_Log = Log;
+	m_Type = Type;
+	m_Line = min(max(Offset, 0), Lines);
+	m_End = m_Line + min(max(Count, 0), Lines - m_Line);
+
+	if (Trailer != NULL) {
+		m_Trailer = strdup(Trailer);
+
+		if (AllocFailed(m_Trailer)) {
+			g_Bouncer->Fatal();
+		}
+	} else {
+		m_Trailer = NULL;
+	}
+}
+
+/**
+ * ~CLogPlayback
+ *
+ * Destructs a log playback object.
+ */
+CLogPlayback::~CLogPlayback(void) {
+	free(m_Trailer);
+}
+
+/**
+ * Produce
+ *
+ * Sends the next page of the log to the client. Returns false when
+ * the playback is complete.
+ *
+ * @param Budget the maximum size of the page
+ */
+bool CLogPlayback::Produce(size_t Budget) {
+	int Count = 0;
+
+	if (m_Line < m_End) {
+		Count = m_Log->PlayToUser(m_Client, m_Type, m_Line, m_End - m_Line, Budget);
+
+		m_Line += Count;
+	}
+
+	if (Count > 0) {
+		return true;
+	}
+
+	if (m_Trailer != NULL) {
+		if (m_Type == Log_Notice) {
+			m_Client->RealNotice(m_Trailer);
+		} else if (m_Type == Log_Message) {
+			m_Client->Privmsg(m_Trailer);
+		}
+	}
+
+	return false;
+}
+
+/**
+ * GetLog
+ *
+ * Returns the log which is being played.
+ */
+const CLog *CLogPlayback::GetLog(void) const {
+	return m_Log;
+}
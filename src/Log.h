@@ -31,6 +31,8 @@ typedef enum {
 	Log_Motd,
 } LogType;
 
+class CClientConnection;
+
 /**
  * CLog
  *
@@ -43,7 +45,16 @@ class SBNCAPI CLog {
 #ifndef _WIN32
 	ino_t m_Inode;
 	dev_t m_Dev;
+	mutable ino_t m_IndexInode; /**< the inode of the indexed file */
 #endif
+	mutable off_t *m_LineIndex; /**< the offsets of all lines in the log */
+	mutable int m_LineCount; /**< the number of lines in the index */
+	mutable int m_LineAlloc; /**< the number of allocated index entries */
+	mutable off_t m_IndexedSize; /**< number of bytes which have been indexed */
+	mutable bool m_IndexLineStart; /**< whether the next byte starts a new line */
+
+	void ResetIndex(void) const;
+	bool UpdateIndex(void) const;
 public:
 #ifndef SWIG
 	CLog(const char *Filename, bool KeepOpen = false);
@@ -54,8 +65,33 @@ public:
 	void WriteLine(const char *Format,...);
 	void WriteUnformattedLine(const char *Line);
 	void PlayToUser(CClientConnection *Client, LogType Type) const;
+	int PlayToUser(CClientConnection *Client, LogType Type, int Offset, int Count, size_t MaxBytes) const;
+	int GetLineCount(void) const;
 	bool IsEmpty(void) const;
 	const char *GetFilename(void) const;
 };
 
+/**
+ * CLogPlayback
+ *
+ * Streams a range of lines from a log to a client as the client's
+ * sendq drains.
+ */
+class SBNCAPI CLogPlayback : public COutputProducer {
+	const CLog *m_Log; /**< the log which is being played */
+	LogType m_Type; /**< how the lines are sent */
+	int m_Line; /**< the next line which is to be sent */
+	int m_End; /**< the line at which playback stops */
+	char *m_Trailer; /**< the message which is sent after the last line */
+
+public:
+#ifndef SWIG
+	CLogPlayback(const CLog *Log, CClientConnection *Client, LogType Type, int Offset, int Count, const char *Trailer);
+	virtual ~CLogPlayback(void);
+#endif /* SWIG */
+
+	virtual bool Produce(size_t Budget);
+	const CLog *GetLog(void) const;
+};
+
 #endif /* LOG_H */
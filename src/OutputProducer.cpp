@@ -0,0 +1,504 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/**
+ * COutputProducer
+ *
+ * Constructs a new output producer.
+ *
+ * @param Client the client which receives the output
+ */
+COutputProducer::COutputProducer(CClientConnection *Client) {
+	m_Client = Client;
+	m_Batch = NULL;
+	m_Names = NULL;
+	m_NamesCount = 0;
+}
+
+/**
+ * ~COutputProducer
+ *
+ * Destructs an output producer.
+ */
+COutputProducer::~COutputProducer(void) {
+	free(m_Batch);
+
+	FreeNames();
+}
+
+/**
+ * WriteLine
+ *
+ * Appends a line to the producer's output. The line is tagged with the
+ * producer's batch reference (if there is one).
+ *
+ * @param Format the format string
+ * @param ... additional parameters used in the format string
+ */
+void COutputProducer::WriteLine(const char *Format, ...) {
+	va_list marker;
+	char *Line;
+	int rc;
+
+	va_start(marker, Format);
+	rc = vasprintf(&Line, Format, marker);
+	va_end(marker);
+
+	if (RcFailed(rc)) {
+		return;
+	}
+
+	if (m_Batch != NULL) {
+		m_Output.Write("@batch=", 7);
+		m_Output.Write(m_Batch, strlen(m_Batch));
+		m_Output.Write(" ", 1);
+	}
+
+	m_Output.WriteUnformattedLine(Line);
+
+	free(Line);
+}
+
+/**
+ * Flush
+ *
+ * Queues the producer's output for the client as a single block.
+ */
+void COutputProducer::Flush(void) {
+	fifo_block_t *Block;
+
+	if (m_Output.GetSize() == 0) {
+		return;
+	}
+
+	Block = CFIFOBuffer::CreateBlock(m_Output.Peek(), m_Output.GetSize());
+
+	m_Output.Flush();
+
+	if (AllocFailed(Block)) {
+		return;
+	}
+
+	m_Client->WriteBlock(Block);
+
+	CFIFOBuffer::ReleaseBlock(Block);
+}
+
+/**
+ * SnapshotNames
+ *
+ * Renders the nicks of a channel (including their prefixes). The NAMES
+ * reply is sent from this copy because joins and parts reorder the
+ * channel's hashtable while the reply is being sent.
+ *
+ * @param Channel the channel
+ */
+void COutputProducer::SnapshotNames(CChannel *Channel) {
+	CIRCConnection *IRC = m_Client->GetOwner()->GetIRCConnection();
+	bool NamesX = m_Client->GetNamesXSupport();
+	int i = 0, rc;
+
+	FreeNames();
+
+	m_Names = (char **)malloc(sizeof(char *) * max(Channel->GetNames()->GetLength(), 1));
+
+	if (AllocFailed(m_Names)) {
+		return;
+	}
+
+	while (hash_t<CNick *> *NickHash = Channel->GetNames()->Iterate(i++)) {
+		const char *Prefix = NickHash->Value->GetPrefixes();
+		const char *Nick = NickHash->Value->GetNick();
+		char PrefixTemp[2] = { IRC->GetHighestUserFlag(Prefix), '\0' };
+
+		if (Nick == NULL) {
+			continue;
+		}
+
+		if (NamesX) {
+			Prefix = (Prefix != NULL) ? Prefix : "";
+		} else {
+			Prefix = PrefixTemp;
+		}
+
+		rc = asprintf(&m_Names[m_NamesCount], "%s%s", Prefix, Nick);
+
+		if (!RcFailed(rc)) {
+			m_NamesCount++;
+		}
+	}
+}
+
+/**
+ * FreeNames
+ *
+ * Frees the rendered nicks.
+ */
+void COutputProducer::FreeNames(void) {
+	for (int i = 0; i < m_NamesCount; i++) {
+		free(m_Names[i]);
+	}
+
+	free(m_Names);
+
+	m_Names = NULL;
+	m_NamesCount = 0;
+}
+
+/**
+ * RenderNames
+ *
+ * Renders 353 replies for a channel's nicks, starting with the specified
+ * nick. The nicks are taken from a snapshot which is created when the
+ * first nick is rendered. Returns true when all nicks have been rendered.
+ *
+ * @param Channel the channel
+ * @param Index the index of the next nick, which is updated
+ * @param Budget the maximum size of the output
+ */
+bool COutputProducer::RenderNames(CChannel *Channel, int *Index, size_t Budget) {
+	CIRCConnection *IRC = m_Client->GetOwner()->GetIRCConnection();
+	char Nicks[1024];
+	size_t Length = 0, Needed;
+
+	if (m_Names == NULL) {
+		SnapshotNames(Channel);
+	}
+
+	while (*Index < m_NamesCount) {
+		const char *Name = m_Names[*Index];
+
+		if (Length == 0 && m_Output.GetSize() >= Budget) {
+			return false;
+		}
+
+		(*Index)++;
+
+		Needed = strlen(Name) + 1;
+
+		if (Needed >= sizeof(Nicks) / 2) {
+			continue;
+		}
+
+		if (Length > 0 && Length + Needed > 400) {
+			WriteLine(":%s 353 %s = %s :%s", IRC->GetServer(), IRC->GetCurrentNick(), Channel->GetName(), Nicks);
+
+			Length = 0;
+		}
+
+		Length += snprintf(Nicks + Length, sizeof(Nicks) - Length, "%s%s", (Length > 0) ? " " : "", Name);
+	}
+
+	if (Length > 0) {
+		WriteLine(":%s 353 %s = %s :%s", IRC->GetServer(), IRC->GetCurrentNick(), Channel->GetName(), Nicks);
+	}
+
+	FreeNames();
+
+	return true;
+}
+
+/**
+ * CAttachProducer
+ *
+ * Constructs a new attach producer. Clients which support the "batch"
+ * capability receive the replies in a batch.
+ *
+ * @param Client the client
+ * @param Channels the sorted list of channels
+ * @param Count the number of channels
+ * @param Backlog whether to play the channels' backlogs
+ */
+CAttachProducer::CAttachProducer(CClientConnection *Client, CChannel **Channels, int Count, bool Backlog) : COutputProducer(Client) {
+	static unsigned int BatchCounter = 0;
+	int rc;
+
+	m_Channels = (char **)malloc(sizeof(char *) * Count);
+
+	if (AllocFailed(m_Channels)) {
+		Count = 0;
+	}
+
+	m_Count = 0;
+
+	for (int i = 0; i < Count; i++) {
+		m_Channels[m_Count] = strdup(Channels[i]->GetName());
+
+		if (!AllocFailed(m_Channels[m_Count])) {
+			m_Count++;
+		}
+	}
+
+	m_Index = 0;
+	m_NamesIndex = -1;
+	m_Backlog = Backlog;
+	m_BacklogLines = NULL;
+	m_BacklogCount = 0;
+	m_BacklogIndex = 0;
+	m_Started = false;
+
+	if (Client->HasCapability("batch")) {
+		rc = asprintf(&m_Batch, "sbnc%u", ++BatchCounter);
+
+		if (RcFailed(rc)) {
+			m_Batch = NULL;
+		}
+	}
+}
+
+/**
+ * ~CAttachProducer
+ *
+ * Destructs an attach producer.
+ */
+CAttachProducer::~CAttachProducer(void) {
+	for (int i = 0; i < m_Count; i++) {
+		free(m_Channels[i]);
+	}
+
+	free(m_Channels);
+
+	FreeBacklog();
+}
+
+/**
+ * RenderBacklog
+ *
+ * Appends the current channel's backlog to the output, starting with the
+ * next backlog line. Returns true when the whole backlog has been sent.
+ *
+ * @param Budget the maximum size of the output
+ */
+bool CAttachProducer::RenderBacklog(size_t Budget) {
+	char *Batch = m_Batch;
+
+	// backlog lines may have their own tags, so they are not part of the batch
+	m_Batch = NULL;
+
+	while (m_BacklogIndex < m_BacklogCount && m_Output.GetSize() < Budget) {
+		WriteLine("%s", m_BacklogLines[m_BacklogIndex]);
+
+		m_BacklogIndex++;
+	}
+
+	m_Batch = Batch;
+
+	return (m_BacklogIndex >= m_BacklogCount);
+}
+
+/**
+ * FreeBacklog
+ *
+ * Frees the rendered backlog.
+ */
+void CAttachProducer::FreeBacklog(void) {
+	for (int i = 0; i < m_BacklogCount; i++) {
+		free(m_BacklogLines[i]);
+	}
+
+	free(m_BacklogLines);
+
+	m_BacklogLines = NULL;
+	m_BacklogCount = 0;
+	m_BacklogIndex = 0;
+}
+
+/**
+ * NextChannel
+ *
+ * Moves on to the next channel.
+ */
+void CAttachProducer::NextChannel(void) {
+	m_Index++;
+	m_NamesIndex = -1;
+
+	FreeNames();
+	FreeBacklog();
+}
+
+/**
+ * Produce
+ *
+ * Sends the replies for the next channels. Topics and names which aren't
+ * known yet are requested from the IRC server.
+ *
+ * @param Budget the number of bytes
+ */
+bool CAttachProducer::Produce(size_t Budget) {
+	CIRCConnection *IRC = m_Client->GetOwner()->GetIRCConnection();
+	CChannel *Channel;
+	const char *Name, *Site;
+	char *Batch;
+
+	if (IRC == NULL) {
+		m_Index = m_Count;
+	}
+
+	if (!m_Started && m_Index < m_Count && m_Batch != NULL) {
+		Batch = m_Batch;
+		m_Batch = NULL;
+
+		WriteLine(":%s BATCH +%s shroudbnc.info/attach", IRC->GetServer(), Batch);
+
+		m_Batch = Batch;
+		m_Started = true;
+	}
+
+	while (m_Index < m_Count && m_Output.GetSize() < Budget) {
+		Name = m_Channels[m_Index];
+		Channel = IRC->GetChannel(Name);
+
+		// the rest of the channel's backlog has already been rendered
+		if (m_BacklogLines != NULL) {
+			if (RenderBacklog(Budget)) {
+				NextChannel();
+			}
+
+			continue;
+		}
+
+		if (Channel == NULL) {
+			NextChannel();
+
+			continue;
+		}
+
+		if (m_NamesIndex == -1) {
+			Site = IRC->GetSite();
+
+			WriteLine(":%s!%s JOIN %s", IRC->GetCurrentNick(), Site ? Site : "unknown@unknown.host", Name);
+
+			if (Channel->HasTopic() != 0) {
+				if (Channel->GetTopic() != NULL && Channel->GetTopic()[0] != '\0') {
+					WriteLine(":%s 332 %s %s :%s", IRC->GetServer(), IRC->GetCurrentNick(), Name, Channel->GetTopic());
+					WriteLine(":%s 333 %s %s %s %d", IRC->GetServer(), IRC->GetCurrentNick(), Name,
+						Channel->GetTopicNick(), Channel->GetTopicStamp());
+				}
+			} else {
+				IRC->WriteLine("TOPIC %s", Name);
+			}
+
+			if (!Channel->HasNames()) {
+				IRC->WriteLine("NAMES %s", Name);
+			}
+
+			m_NamesIndex = 0;
+		}
+
+		if (Channel->HasNames()) {
+			if (!RenderNames(Channel, &m_NamesIndex, Budget)) {
+				break;
+			}
+
+			WriteLine(":%s 366 %s %s :End of /NAMES list.", IRC->GetServer(), IRC->GetCurrentNick(), Name);
+		}
+
+		if (m_Backlog) {
+			m_BacklogLines = Channel->RenderBacklog(m_Client->HasCapability("znc.in/server-time-iso"), &m_BacklogCount);
+		}
+
+		if (m_BacklogLines == NULL || RenderBacklog(Budget)) {
+			NextChannel();
+		}
+	}
+
+	if (m_Index < m_Count) {
+		Flush();
+
+		return true;
+	}
+
+	if (m_Started) {
+		Batch = m_Batch;
+		m_Batch = NULL;
+
+		WriteLine(":%s BATCH -%s", (IRC != NULL) ? IRC->GetServer() : "shroudbnc.info", Batch);
+
+		free(Batch);
+
+		m_Started = false;
+	}
+
+	Flush();
+
+	return false;
+}
+
+/**
+ * CNamesProducer
+ *
+ * Constructs a new names producer.
+ *
+ * @param Client the client
+ * @param Channel the name of the channel
+ */
+CNamesProducer::CNamesProducer(CClientConnection *Client, const char *Channel) : COutputProducer(Client) {
+	m_Channel = strdup(Channel);
+
+	if (AllocFailed(m_Channel)) {
+		g_Bouncer->Fatal();
+	}
+
+	m_Index = 0;
+}
+
+/**
+ * ~CNamesProducer
+ *
+ * Destructs a names producer.
+ */
+CNamesProducer::~CNamesProducer(void) {
+	free(m_Channel);
+}
+
+/**
+ * Produce
+ *
+ * Sends the next part of the NAMES reply.
+ *
+ * @param Budget the number of bytes
+ */
+bool CNamesProducer::Produce(size_t Budget) {
+	CIRCConnection *IRC = m_Client->GetOwner()->GetIRCConnection();
+	CChannel *Channel;
+
+	if (IRC == NULL) {
+		return false;
+	}
+
+	Channel = IRC->GetChannel(m_Channel);
+
+	if (Channel == NULL || !Channel->HasNames()) {
+		return false;
+	}
+
+	if (!RenderNames(Channel, &m_Index, Budget)) {
+		Flush();
+
+		return true;
+	}
+
+	WriteLine(":%s 366 %s %s :End of /NAMES list.", IRC->GetServer(), IRC->GetCurrentNick(), m_Channel);
+
+	Flush();
+
+	return false;
+}
@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef OUTPUTPRODUCER_H
+#define OUTPUTPRODUCER_H
+
+#define PRODUCER_BUDGET 8192 /**< number of bytes which producers may queue per wakeup */
+#define PRODUCER_LOWWATER 8192 /**< sendq size below which producers are resumed */
+
+class CClientConnection;
+class CChannel;
+
+/**
+ * COutputProducer
+ *
+ * Generates output for a client in steps. Producers are resumed
+ * whenever the client's sendq has drained, so large replies don't
+ * have to be queued at once.
+ */
+class SBNCAPI COutputProducer {
+protected:
+	CClientConnection *m_Client; /**< the client which receives the output */
+	CFIFOBuffer m_Output; /**< output which has not been queued for the client yet */
+	char *m_Batch; /**< the batch reference which is used for the output, or NULL */
+	char **m_Names; /**< the rendered nicks of the channel whose names are being sent, or NULL */
+	int m_NamesCount; /**< the number of rendered nicks */
+
+	void WriteLine(const char *Format, ...);
+	void Flush(void);
+	bool RenderNames(CChannel *Channel, int *Index, size_t Budget);
+	void SnapshotNames(CChannel *Channel);
+	void FreeNames(void);
+public:
+#ifndef SWIG
+	COutputProducer(CClientConnection *Client);
+	virtual ~COutputProducer(void);
+#endif /* SWIG */
+
+	/**
+	 * Produce
+	 *
+	 * Sends roughly the specified number of bytes to the client. Returns
+	 * false when the producer has finished.
+	 *
+	 * @param Budget the number of bytes
+	 */
+	virtual bool Produce(size_t Budget) = 0;
+};
+
+/**
+ * CAttachProducer
+ *
+ * Sends the JOIN, topic and NAMES replies (and optionally the backlog)
+ * for a user's channels to a client which has just been attached. Both
+ * the NAMES replies and the backlogs are sent in steps.
+ */
+class SBNCAPI CAttachProducer : public COutputProducer {
+	char **m_Channels; /**< the names of the channels */
+	int m_Count; /**< the number of channels */
+	int m_Index; /**< the channel which is being sent */
+	int m_NamesIndex; /**< the next nick of the current channel, or -1 */
+	bool m_Backlog; /**< whether to play the channels' backlogs */
+	char **m_BacklogLines; /**< the rendered backlog of the current channel, or NULL */
+	int m_BacklogCount; /**< the number of rendered backlog lines */
+	int m_BacklogIndex; /**< the next backlog line of the current channel */
+	bool m_Started; /**< whether the batch has been started */
+
+	bool RenderBacklog(size_t Budget);
+	void FreeBacklog(void);
+	void NextChannel(void);
+
+public:
+#ifndef SWIG
+	CAttachProducer(CClientConnection *Client, CChannel **Channels, int Count, bool Backlog);
+	virtual ~CAttachProducer(void);
+#endif /* SWIG */
+
+	virtual bool Produce(size_t Budget);
+};
+
+/**
+ * CNamesProducer
+ *
+ * Sends the NAMES reply for a channel from the cached channel state.
+ */
+class SBNCAPI CNamesProducer : public COutputProducer {
+	char *m_Channel; /**< the name of the channel */
+	int m_Index; /**< the next nick */
+
+public:
+#ifndef SWIG
+	CNamesProducer(CClientConnection *Client, const char *Channel);
+	virtual ~CNamesProducer(void);
+#endif /* SWIG */
+
+	virtual bool Produce(size_t Budget);
+};
+
+#endif /* OUTPUTPRODUCER_H */
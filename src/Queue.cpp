@@ -20,26 +20,244 @@
 #include "StdAfx.h"
 
 /**
- * PeekItems
+ * DestroyQueueTarget
  *
- * Retrieves the next item from the queue without removing it.
+ * Frees a target and all items which are still queued for it.
+ *
+ * @param Target the target
  */
-RESULT<const char *> CQueue::PeekItem(void) const {
-	int LowestPriority = 99999;
-	queue_item_t *ThatItem = NULL;
+static void DestroyQueueTarget(queue_target_t *Target) {
+	for (int i = 0; i < Target->Count; i++) {
+		free(Target->Items[(Target->Head + i) % Target->Capacity].Line);
+	}
+
+	free(Target->Items);
+	free(Target->Name);
+	free(Target);
+}
+
+/**
+ * CQueue
+ *
+ * Constructs an empty queue.
+ */
+CQueue::CQueue(void) {
+	m_Targets.RegisterValueDestructor(DestroyQueueTarget);
+	m_Current = NULL;
+	m_Count = 0;
+}
+
+/**
+ * ~CQueue
+ *
+ * Destructs the queue and all items which are still in it.
+ */
+CQueue::~CQueue(void) {
+	Clear();
+}
+
+/**
+ * GetTarget
+ *
+ * Returns the target for a line, i.e. the first parameter of the
+ * IRC command.
+ *
+ * @param Line the line
+ * @param Create determines whether the target should be created if
+ *               there are no items for it yet
+ */
+queue_target_t *CQueue::GetTarget(const char *Line, bool Create) {
+	char Name[128];
+	size_t Length;
+	queue_target_t *Target;
+
+	// skip the command
+	Line += strcspn(Line, " ");
+	Line += strspn(Line, " ");
+
+	if (*Line == ':') {
+		Length = 0;
+	} else {
+		Length = min(strcspn(Line, " "), sizeof(Name) - 1);
+	}
+
+	memcpy(Name, Line, Length);
+	Name[Length] = '\0';
+
+	Target = m_Targets.Get(Name);
+
+	if (Target != NULL || !Create) {
+		return Target;
+	}
+
+	Target = (queue_target_t *)malloc(sizeof(queue_target_t));
+
+	if (AllocFailed(Target)) {
+		return NULL;
+	}
+
+	Target->Name = strdup(Name);
+
+	if (AllocFailed(Target->Name)) {
+		free(Target);
+
+		return NULL;
+	}
+
+	Target->Items = NULL;
+	Target->Capacity = 0;
+	Target->Head = 0;
+	Target->Count = 0;
+
+	if (IsError(m_Targets.Add(Name, Target))) {
+		free(Target->Name);
+		free(Target);
+
+		return NULL;
+	}
+
+	// new targets are added at the end of the current round
+	if (m_Current == NULL) {
+		Target->Previous = Target;
+		Target->Next = Target;
+
+		m_Current = Target;
+	} else {
+		Target->Previous = m_Current->Previous;
+		Target->Next = m_Current;
+
+		m_Current->Previous->Next = Target;
+		m_Current->Previous = Target;
+	}
+
+	return Target;
+}
+
+/**
+ * RemoveTarget
+ *
+ * Removes a target which does not have any items left.
+ *
+ * @param Target the target
+ */
+void CQueue::RemoveTarget(queue_target_t *Target) {
+	if (Target->Next == Target) {
+		m_Current = NULL;
+	} else {
+		Target->Previous->Next = Target->Next;
+		Target->Next->Previous = Target->Previous;
+
+		if (m_Current == Target) {
+			m_Current = Target->Next;
+		}
+	}
+
+	m_Targets.Remove(Target->Name);
+}
+
+/**
+ * AddItem
+ *
+ * Makes room for a new item and returns it.
+ *
+ * @param Line the line
+ * @param Front determines whether the item is inserted at the front
+ *              of the target's queue
+ */
+RESULT<queue_item_t *> CQueue::AddItem(const char *Line, bool Front) {
+	queue_target_t *Target;
+	queue_item_t *Item, *NewItems;
+	int NewCapacity;
+
+	if (Line == NULL) {
+		THROW(queue_item_t *, Generic_InvalidArgument, "Line cannot be NULL.");
+	}
+
+	// ignore new items if the queue is full
+	if (m_Count >= MAX_QUEUE_SIZE) {
+		THROW(queue_item_t *, Generic_Unknown, "The queue is full.");
+	}
+
+	Target = GetTarget(Line, true);
+
+	if (Target == NULL) {
+		THROW(queue_item_t *, Generic_OutOfMemory, "GetTarget() failed.");
+	}
+
+	if (Target->Count >= MAX_TARGET_QUEUE_SIZE) {
+		THROW(queue_item_t *, Generic_Unknown, "The queue for this target is full.");
+	}
+
+	if (Target->Count == Target->Capacity) {
+		NewCapacity = (Target->Capacity == 0) ? 4 : Target->Capacity * 2;
+
+		if (NewCapacity > MAX_TARGET_QUEUE_SIZE) {
+			NewCapacity = MAX_TARGET_QUEUE_SIZE;
+		}
+
+		NewItems = (queue_item_t *)malloc(sizeof(queue_item_t) * NewCapacity);
+
+		if (AllocFailed(NewItems)) {
+			if (Target->Count == 0) {
+				RemoveTarget(Target);
+			}
+
+			THROW(queue_item_t *, Generic_OutOfMemory, "malloc() failed.");
+		}
 
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		if (m_Items[i].Priority < LowestPriority) {
-			LowestPriority = m_Items[i].Priority;
-			ThatItem = m_Items.GetAddressOf(i);
+		for (int i = 0; i < Target->Count; i++) {
+			NewItems[i] = Target->Items[(Target->Head + i) % Target->Capacity];
 		}
+
+		free(Target->Items);
+
+		Target->Items = NewItems;
+		Target->Capacity = NewCapacity;
+		Target->Head = 0;
 	}
 
-	if (ThatItem != NULL) {
-		RETURN(const char *, ThatItem->Line);
+	if (Front) {
+		Target->Head = (Target->Head + Target->Capacity - 1) % Target->Capacity;
+		Item = &Target->Items[Target->Head];
 	} else {
+		Item = &Target->Items[(Target->Head + Target->Count) % Target->Capacity];
+	}
+
+	Item->Line = strdup(Line);
+
+	if (AllocFailed(Item->Line)) {
+		if (Front) {
+			Target->Head = (Target->Head + 1) % Target->Capacity;
+		}
+
+		if (Target->Count == 0) {
+			RemoveTarget(Target);
+		}
+
+		THROW(queue_item_t *, Generic_OutOfMemory, "strdup() failed.");
+	}
+
+	Item->Time = UtilMsecTime();
+
+	Target->Count++;
+	m_Count++;
+
+	RETURN(queue_item_t *, Item);
+}
+
+/**
+ * PeekItem
+ *
+ * Retrieves the next item from the queue without removing it.
+ */
+RESULT<const char *> CQueue::PeekItem(void) const {
+	queue_target_t *Target = m_Current;
+
+	if (Target == NULL) {
 		THROW(const char *, Generic_Unknown, "The queue is empty.");
 	}
+
+	RETURN(const char *, Target->Items[Target->Head].Line);
 }
 
 /**
@@ -48,26 +266,27 @@ RESULT<const char *> CQueue::PeekItem(void) const {
  * Retrieves the next item from the queue and removes it.
  */
 RESULT<char *> CQueue::DequeueItem(void) {
-	int Index = 0;
-	queue_item_t *Item = NULL;
+	queue_target_t *Target = m_Current;
 	char *Line;
 
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		if (Item == NULL || m_Items[i].Priority < Item->Priority) {
-			Item = m_Items.GetAddressOf(i);
-			Index = i;
-		}
+	if (Target == NULL) {
+		THROW(char *, Generic_Unknown, "The queue is empty.");
 	}
 
-	if (Item != NULL) {
-		Line = Item->Line;
+	Line = Target->Items[Target->Head].Line;
 
-		m_Items.Remove(Index);
+	Target->Head = (Target->Head + 1) % Target->Capacity;
+	Target->Count--;
+	m_Count--;
 
-		RETURN(char *, Line);
+	// each target gets to send one line per round
+	if (Target->Count == 0) {
+		RemoveTarget(Target);
 	} else {
-		THROW(char *, Generic_Unknown, "The queue is empty.");
+		m_Current = Target->Next;
 	}
+
+	RETURN(char *, Line);
 }
 
 /**
@@ -78,45 +297,29 @@ RESULT<char *> CQueue::DequeueItem(void) {
  * @param Line the item which is to be inserted
  */
 RESULT<bool> CQueue::QueueItem(const char *Line) {
-	queue_item_t Item;
+	RESULT<queue_item_t *> Item = AddItem(Line, false);
 
-	if (Line == NULL) {
-		THROW(bool, Generic_InvalidArgument, "Line cannot be NULL.");
-	}
-
-	// ignore new items if the queue is full
-	if (m_Items.GetLength() >= MAX_QUEUE_SIZE) {
-		THROW(bool, Generic_Unknown, "The queue is full.");
-	}
-
-	Item.Line = strdup(Line);
-
-	if (AllocFailed(Item.Line)) {
-		THROW(bool, Generic_OutOfMemory, "strdup() failed.");
-	}
-
-	Item.Priority = 0;
+	THROWIFERROR(bool, Item);
 
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		m_Items[i].Priority--;
-	}
-
-	return m_Items.Insert(Item);
+	RETURN(bool, true);
 }
 
 /**
  * QueueItemNext
  *
- * Inserts a new item at the front of the queue.
+ * Inserts a new item so that it is the next item which is
+ * going to be removed from the queue.
  *
  * @param Line the item which is to be inserted
  */
 RESULT<bool> CQueue::QueueItemNext(const char *Line) {
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		m_Items[i].Priority += 2;
-	}
+	RESULT<queue_item_t *> Item = AddItem(Line, true);
+
+	THROWIFERROR(bool, Item);
+
+	m_Current = GetTarget(Line, false);
 
-	return QueueItem(Line);
+	RETURN(bool, true);
 }
 
 /**
@@ -125,7 +328,7 @@ RESULT<bool> CQueue::QueueItemNext(const char *Line) {
  * Returns the number of items which are in the queue.
  */
 int CQueue::GetLength(void) const {
-	return m_Items.GetLength();
+	return m_Count;
 }
 
 /**
@@ -134,9 +337,51 @@ int CQueue::GetLength(void) const {
  * Removes all items from the queue.
  */
 void CQueue::Clear(void) {
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		free(m_Items[i].Line);
+	m_Targets.Clear();
+
+	m_Current = NULL;
+	m_Count = 0;
+}
+
+/**
+ * GetTargetCount
+ *
+ * Returns the number of targets which have queued items.
+ */
+int CQueue::GetTargetCount(void) const {
+	return m_Targets.GetLength();
+}
+
+/**
+ * GetTargetAt
+ *
+ * Returns a target which has queued items. Targets are returned in the
+ * order in which they are going to be served.
+ *
+ * @param Index the index of the target
+ */
+const queue_target_t *CQueue::GetTargetAt(int Index) const {
+	queue_target_t *Target = m_Current;
+
+	if (Target == NULL || Index < 0 || Index >= m_Targets.GetLength()) {
+		return NULL;
 	}
 
-	m_Items.Clear();
+	while (Index-- > 0) {
+		Target = Target->Next;
+	}
+
+	return Target;
+}
+
+/**
+ * GetTargetWait
+ *
+ * Returns the number of msecs the oldest item for a target has been
+ * waiting in the queue.
+ *
+ * @param Target the target
+ */
+unsigned int CQueue::GetTargetWait(const queue_target_t *Target) const {
+	return (unsigned int)(UtilMsecTime() - Target->Items[Target->Head].Time);
 }
@@ -23,30 +23,67 @@
 /** Defines how many items can be stored in a single queue */
 #define MAX_QUEUE_SIZE 500
 
+/** Defines how many items can be stored for a single target */
+#define MAX_TARGET_QUEUE_SIZE 200
+
 /**
  * queue_item_t
  *
- * An item from a queue.
+ * An item in a queue.
  */
 typedef struct queue_item_s {
-	int Priority; /**< the priority of this item; 0 is the highest priority */
-	char *Line; /**< the string which is associated with this item */
+	char *Line; /**< the line */
+	uint64_t Time; /**< when the line was queued (in msecs) */
 } queue_item_t;
 
+/**
+ * queue_target_t
+ *
+ * The items which have been queued for a single target (e.g. a
+ * channel or a nick).
+ */
+typedef struct queue_target_s {
+	char *Name; /**< the name of the target, or an empty string */
+	queue_item_t *Items; /**< the ring buffer which holds the items */
+	int Capacity; /**< the size of the ring buffer */
+	int Head; /**< the index of the first item in the ring buffer */
+	int Count; /**< the number of items which are queued for this target */
+	struct queue_target_s *Previous; /**< the previous target in the round */
+	struct queue_target_s *Next; /**< the next target in the round */
+} queue_target_t;
+
 /**
  * CQueue
  *
- * A queue which can be used for storing strings.
+ * A queue which can be used for storing strings. Items are grouped by
+ * their target (i.e. the first parameter of the IRC command) and the
+ * targets are served in a round-robin fashion, one line per target and
+ * round. Each target keeps its items in a ring buffer.
  */
 class SBNCAPI CQueue {
-	CVector<queue_item_t> m_Items; /**< the items which are in the queue */
+	CHashtable<queue_target_t *, false> m_Targets; /**< the targets which have queued items */
+	queue_target_t *m_Current; /**< the target which is currently being served */
+	int m_Count; /**< the number of items which are in the queue */
+
+	queue_target_t *GetTarget(const char *Line, bool Create);
+	void RemoveTarget(queue_target_t *Target);
+	RESULT<queue_item_t *> AddItem(const char *Line, bool Front);
 public:
+#ifndef SWIG
+	CQueue(void);
+	virtual ~CQueue(void);
+#endif /* SWIG */
+
 	RESULT<char *> DequeueItem(void);
 	RESULT<const char *> PeekItem(void) const;
 	RESULT<bool> QueueItem(const char *Line);
 	RESULT<bool> QueueItemNext(const char *Line);
 	int GetLength(void) const;
 	void Clear(void);
+
+	int GetTargetCount(void) const;
+	const queue_target_t *GetTargetAt(int Index) const;
+	unsigned int GetTargetWait(const queue_target_t *Target) const;
 };
 
 #endif /* QUEUE_H */
@@ -0,0 +1,765 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+IMPL_DNSEVENTPROXY(CReconnectPlanner, AsyncDnsFinished);
+
+/**
+ * PlannerSetting
+ *
+ * Reads a positive integer setting from the main config.
+ *
+ * @param Setting the name of the setting
+ * @param Default the default value
+ */
+static int PlannerSetting(const char *Setting, int Default) {
+	RESULT<int> Value = g_Bouncer->GetConfig()->ReadInteger(Setting);
+
+	if (IsError(Value) || Value <= 0) {
+		return Default;
+	}
+
+	return Value;
+}
+
+/**
+ * ReconnectPlannerTimer
+ *
+ * Reconnects the users whose reconnects are due.
+ *
+ * @param Now the current time
+ * @param Planner the reconnect planner
+ */
+bool ReconnectPlannerTimer(time_t Now, void *Planner) {
+	((CReconnectPlanner *)Planner)->ProcessQueue();
+
+	return true;
+}
+
+/**
+ * CReconnectPlanner
+ *
+ * Constructs a new reconnect planner.
+ */
+CReconnectPlanner::CReconnectPlanner(void) {
+	m_Servers.RegisterValueDestructor(DestroyObject<reconnect_bucket_t>);
+	m_BindIps.RegisterValueDestructor(DestroyObject<reconnect_bucket_t>);
+	m_Admissions.RegisterValueDestructor(DestroyObject<admission_t>);
+
+	m_Timer = NULL;
+	m_DnsQuery = NULL;
+	m_Prefetches = 0;
+}
+
+/**
+ * ~CReconnectPlanner
+ *
+ * Destructs the reconnect planner.
+ */
+CReconnectPlanner::~CReconnectPlanner(void) {
+	if (m_Timer != NULL) {
+		m_Timer->Destroy();
+	}
+
+	delete m_DnsQuery;
+}
+
+/**
+ * GetInterval
+ *
+ * Returns the number of seconds between connects to the same server
+ * or from the same bind ip.
+ */
+int CReconnectPlanner::GetInterval(void) const {
+	int Interval = g_Bouncer->GetInterval();
+
+	if (Interval <= 0) {
+		Interval = RECONNECT_DEFAULTINTERVAL;
+	}
+
+	return Interval;
+}
+
+/**
+ * GetBurst
+ *
+ * Returns the number of connects which may be made to the same server
+ * or from the same bind ip at once.
+ */
+int CReconnectPlanner::GetBurst(void) const {
+	return PlannerSetting("system.reconnectburst", RECONNECT_DEFAULTBURST);
+}
+
+/**
+ * GetMaxRegistrations
+ *
+ * Returns the number of connections to the same server from the same
+ * bind ip which may be registering at once.
+ */
+int CReconnectPlanner::GetMaxRegistrations(void) const {
+	return PlannerSetting("system.maxregistrations", ADMISSION_DEFAULTREGISTRATIONS);
+}
+
+/**
+ * GetJoinInterval
+ *
+ * Returns the number of seconds between join bursts for connections
+ * to the same server from the same bind ip.
+ */
+int CReconnectPlanner::GetJoinInterval(void) const {
+	return PlannerSetting("system.joininterval", ADMISSION_DEFAULTJOININTERVAL);
+}
+
+/**
+ * GetJoinBurst
+ *
+ * Returns the number of join bursts which may be sent at once for
+ * connections to the same server from the same bind ip.
+ */
+int CReconnectPlanner::GetJoinBurst(void) const {
+	return PlannerSetting("system.joinburst", ADMISSION_DEFAULTJOINBURST);
+}
+
+/**
+ * Sift
+ *
+ * Moves a user to the right position in the queue.
+ *
+ * @param Index the user's current index
+ */
+void CReconnectPlanner::Sift(int Index) {
+	CUser *User = m_Queue[Index];
+	int Count = m_Queue.GetLength();
+	int Parent, Child;
+
+	while (Index > 0) {
+		Parent = (Index - 1) / 2;
+
+		if (m_Queue[Parent]->m_ReconnectTime <= User->m_ReconnectTime) {
+			break;
+		}
+
+		m_Queue[Index] = m_Queue[Parent];
+		m_Queue[Index]->m_ReconnectIndex = Index;
+		Index = Parent;
+	}
+
+	while ((Child = Index * 2 + 1) < Count) {
+		if (Child + 1 < Count && m_Queue[Child + 1]->m_ReconnectTime < m_Queue[Child]->m_ReconnectTime) {
+			Child++;
+		}
+
+		if (User->m_ReconnectTime <= m_Queue[Child]->m_ReconnectTime) {
+			break;
+		}
+
+		m_Queue[Index] = m_Queue[Child];
+		m_Queue[Index]->m_ReconnectIndex = Index;
+		Index = Child;
+	}
+
+	m_Queue[Index] = User;
+	User->m_ReconnectIndex = Index;
+}
+
+/**
+ * Queue
+ *
+ * Adds a user to the queue or updates its position if the user is
+ * already in the queue.
+ *
+ * @param User the user
+ */
+void CReconnectPlanner::Queue(CUser *User) {
+	if (User->m_ReconnectIndex == -1) {
+		if (IsError(m_Queue.Insert(User))) {
+			return;
+		}
+
+		User->m_ReconnectIndex = m_Queue.GetLength() - 1;
+	}
+
+	Sift(User->m_ReconnectIndex);
+}
+
+/**
+ * Unqueue
+ *
+ * Removes a user from the queue.
+ *
+ * @param User the user
+ */
+void CReconnectPlanner::Unqueue(CUser *User) {
+	int Index = User->m_ReconnectIndex, Last;
+
+	if (Index == -1) {
+		return;
+	}
+
+	User->m_ReconnectIndex = -1;
+	User->m_ReconnectReserved = false;
+
+	Last = m_Queue.GetLength() - 1;
+
+	if (Index != Last) {
+		m_Queue[Index] = m_Queue[Last];
+		m_Queue[Index]->m_ReconnectIndex = Index;
+	}
+
+	m_Queue.Remove(Last);
+
+	if (Index != Last) {
+		Sift(Index);
+	}
+}
+
+/**
+ * Reschedule
+ *
+ * Reschedules the planner's timer so that it is called when the next
+ * reconnect is due.
+ */
+void CReconnectPlanner::Reschedule(void) {
+	time_t Next;
+
+	if (m_Timer == NULL) {
+		m_Timer = new CTimer(20, true, ReconnectPlannerTimer, this);
+
+		if (AllocFailed(m_Timer)) {
+			return;
+		}
+	}
+
+	if (m_Queue.GetLength() == 0) {
+		Next = g_CurrentTime + 20;
+	} else {
+		Next = max(m_Queue[0]->m_ReconnectTime, g_CurrentTime);
+	}
+
+	m_Timer->Reschedule(Next);
+}
+
+/**
+ * GetBucket
+ *
+ * Returns the token bucket for a server or bind ip and creates it if
+ * necessary.
+ *
+ * @param Buckets the list of buckets
+ * @param Name the name of the server or bind ip
+ */
+reconnect_bucket_t *CReconnectPlanner::GetBucket(CHashtable<reconnect_bucket_t *, false> *Buckets, const char *Name) {
+	reconnect_bucket_t *Bucket = Buckets->Get(Name);
+
+	if (Bucket != NULL) {
+		return Bucket;
+	}
+
+	Bucket = new reconnect_bucket_t;
+
+	if (AllocFailed(Bucket)) {
+		return NULL;
+	}
+
+	Bucket->NextConnect = 0;
+	Bucket->LastPrefetch = 0;
+	Bucket->Connects = 0;
+
+	if (IsError(Buckets->Add(Name, Bucket))) {
+		delete Bucket;
+
+		return NULL;
+	}
+
+	return Bucket;
+}
+
+/**
+ * GetAvailableTime
+ *
+ * Returns the earliest time at which a bucket has a token.
+ *
+ * @param Bucket the bucket
+ */
+time_t CReconnectPlanner::GetAvailableTime(const reconnect_bucket_t *Bucket) const {
+	return max(Bucket->NextConnect - (time_t)(GetBurst() - 1) * GetInterval(), g_CurrentTime);
+}
+
+/**
+ * ConsumeToken
+ *
+ * Takes a token from a bucket for a connect at the specified time.
+ *
+ * @param Bucket the bucket
+ * @param When the time of the connect
+ */
+void CReconnectPlanner::ConsumeToken(reconnect_bucket_t *Bucket, time_t When) const {
+	Bucket->NextConnect = max(Bucket->NextConnect, When) + GetInterval();
+	Bucket->Connects++;
+}
+
+/**
+ * ExpireBuckets
+ *
+ * Removes buckets which are full and therefore do not need to be kept.
+ *
+ * @param Buckets the list of buckets
+ */
+void CReconnectPlanner::ExpireBuckets(CHashtable<reconnect_bucket_t *, false> *Buckets) {
+	time_t Full = g_CurrentTime - (time_t)GetBurst() * GetInterval();
+	reconnect_bucket_t *Bucket;
+	char **Keys = Buckets->GetSortedKeys();
+	char *Key;
+	int i = 0;
+
+	if (Keys == NULL) {
+		return;
+	}
+
+	// removing an entry only frees that entry's key
+	while ((Key = Keys[i++]) != NULL) {
+		Bucket = Buckets->Get(Key);
+
+		if (Bucket->NextConnect < Full && Bucket->LastPrefetch < g_CurrentTime - RECONNECT_PREFETCH) {
+			Buckets->Remove(Key);
+		}
+	}
+
+	free(Keys);
+}
+
+/**
+ * GetAdmissionKey
+ *
+ * Returns the key which is used for the admission state of a server
+ * and bind ip. The caller is responsible for freeing the key.
+ *
+ * @param Server the server
+ * @param BindIp the bind ip (or NULL)
+ */
+char *CReconnectPlanner::GetAdmissionKey(const char *Server, const char *BindIp) {
+	char *Key;
+	int rc;
+
+	rc = asprintf(&Key, "%s via %s", Server ? Server : "", BindIp ? BindIp : "(default)");
+
+	if (RcFailed(rc)) {
+		return NULL;
+	}
+
+	return Key;
+}
+
+/**
+ * GetAdmission
+ *
+ * Returns the admission state for a server and bind ip.
+ *
+ * @param Key the key
+ * @param Create whether to create the state if it doesn't exist
+ */
+admission_t *CReconnectPlanner::GetAdmission(const char *Key, bool Create) {
+	admission_t *Admission = m_Admissions.Get(Key);
+
+	if (Admission != NULL || !Create) {
+		return Admission;
+	}
+
+	Admission = new admission_t;
+
+	if (AllocFailed(Admission)) {
+		return NULL;
+	}
+
+	Admission->Registering = 0;
+	Admission->JoinsWaiting = 0;
+	Admission->NextJoin = 0;
+	Admission->Joins = 0;
+	Admission->Deferred = 0;
+
+	if (IsError(m_Admissions.Add(Key, Admission))) {
+		delete Admission;
+
+		return NULL;
+	}
+
+	return Admission;
+}
+
+/**
+ * ExpireAdmissions
+ *
+ * Removes admission states which are not in use.
+ */
+void CReconnectPlanner::ExpireAdmissions(void) {
+	admission_t *Admission;
+	char **Keys = m_Admissions.GetSortedKeys();
+	char *Key;
+	int i = 0;
+
+	if (Keys == NULL) {
+		return;
+	}
+
+	while ((Key = Keys[i++]) != NULL) {
+		Admission = m_Admissions.Get(Key);
+
+		if (Admission->Registering == 0 && Admission->JoinsWaiting == 0 && Admission->NextJoin <= g_CurrentTime) {
+			m_Admissions.Remove(Key);
+		}
+	}
+
+	free(Keys);
+}
+
+/**
+ * BeginRegistration
+ *
+ * Called when a connection to a server is started.
+ *
+ * @param Key the admission key
+ */
+void CReconnectPlanner::BeginRegistration(const char *Key) {
+	admission_t *Admission = GetAdmission(Key, true);
+
+	if (Admission != NULL) {
+		Admission->Registering++;
+	}
+}
+
+/**
+ * EndRegistration
+ *
+ * Called when a connection has been registered or when it has been
+ * closed before it could be registered.
+ *
+ * @param Key the admission key
+ */
+void CReconnectPlanner::EndRegistration(const char *Key) {
+	admission_t *Admission = GetAdmission(Key, false);
+
+	if (Admission != NULL && Admission->Registering > 0) {
+		Admission->Registering--;
+	}
+}
+
+/**
+ * ReserveJoin
+ *
+ * Reserves a slot for a connection's join burst and returns the time
+ * when the channels may be joined. If that time is in the future the
+ * caller has to call EndJoin() once the channels have been joined.
+ *
+ * @param Key the admission key
+ */
+time_t CReconnectPlanner::ReserveJoin(const char *Key) {
+	admission_t *Admission = GetAdmission(Key, true);
+	time_t Slot;
+
+	if (Admission == NULL) {
+		return g_CurrentTime;
+	}
+
+	Slot = GetNextJoinTime(Admission);
+
+	Admission->NextJoin = max(Admission->NextJoin, Slot) + GetJoinInterval();
+	Admission->Joins++;
+
+	if (Slot > g_CurrentTime) {
+		Admission->JoinsWaiting++;
+	}
+
+	return Slot;
+}
+
+/**
+ * EndJoin
+ *
+ * Called when a connection which had to wait for its join slot has
+ * joined its channels or has been closed.
+ *
+ * @param Key the admission key
+ */
+void CReconnectPlanner::EndJoin(const char *Key) {
+	admission_t *Admission = GetAdmission(Key, false);
+
+	if (Admission != NULL && Admission->JoinsWaiting > 0) {
+		Admission->JoinsWaiting--;
+	}
+}
+
+/**
+ * GetAdmissions
+ *
+ * Returns the admission states. The keys have the form
+ * "<server> via <bind ip>".
+ */
+const CHashtable<admission_t *, false> *CReconnectPlanner::GetAdmissions(void) const {
+	return &m_Admissions;
+}
+
+/**
+ * GetNextJoinTime
+ *
+ * Returns the earliest time at which another join burst may be sent.
+ *
+ * @param Admission the admission state
+ */
+time_t CReconnectPlanner::GetNextJoinTime(const admission_t *Admission) const {
+	return max(Admission->NextJoin - (time_t)(GetJoinBurst() - 1) * GetJoinInterval(), g_CurrentTime);
+}
+
+/**
+ * Prefetch
+ *
+ * Resolves the hostname of a user's server, so that it is in the dns
+ * resolver's cache when the user is connected.
+ *
+ * @param User the user
+ * @param Bucket the server's bucket
+ */
+void CReconnectPlanner::Prefetch(CUser *User, reconnect_bucket_t *Bucket) {
+	sockaddr_storage Literal;
+
+	if (g_CurrentTime - Bucket->LastPrefetch < RECONNECT_PREFETCH) {
+		return;
+	}
+
+	// ip addresses don't have to be resolved
+	if (StringToIp(User->GetServer(), AF_INET, (sockaddr *)&Literal, sizeof(Literal))) {
+		return;
+	}
+
+#ifdef HAVE_IPV6
+	if (StringToIp(User->GetServer(), AF_INET6, (sockaddr *)&Literal, sizeof(Literal))) {
+		return;
+	}
+#endif /* HAVE_IPV6 */
+
+	if (m_DnsQuery == NULL) {
+		m_DnsQuery = new CDnsQuery(this, USE_DNSEVENTPROXY(CReconnectPlanner, AsyncDnsFinished));
+
+		if (AllocFailed(m_DnsQuery)) {
+			return;
+		}
+	}
+
+	Bucket->LastPrefetch = g_CurrentTime;
+
+	// connections look up the addresses for both families
+#ifdef HAVE_IPV6
+	m_DnsQuery->GetHostByName(User->GetServer(), AF_INET6);
+#endif /* HAVE_IPV6 */
+	m_DnsQuery->GetHostByName(User->GetServer(), AF_INET);
+}
+
+/**
+ * AsyncDnsFinished
+ *
+ * Called when a dns prefetch has been completed.
+ *
+ * @param Response the response
+ */
+void CReconnectPlanner::AsyncDnsFinished(hostent *Response) {
+	if (Response != NULL) {
+		m_Prefetches++;
+	}
+}
+
+/**
+ * ProcessQueue
+ *
+ * Reconnects users whose reserved slots have been reached and reserves
+ * slots for users whose reconnects have become due.
+ */
+void CReconnectPlanner::ProcessQueue(void) {
+	CUser *User;
+	reconnect_bucket_t *Server, *BindIp;
+	const char *BindIpName;
+	time_t Earliest, Slot;
+
+	while (g_Bouncer->GetStatus() == Status_Running && m_Queue.GetLength() > 0) {
+		User = m_Queue[0];
+
+		if (User->m_ReconnectTime > g_CurrentTime) {
+			break;
+		}
+
+		if (User->m_IRC != NULL || User->GetServer() == NULL || User->IsQuitted() != 0) {
+			Unqueue(User);
+
+			continue;
+		}
+
+		// non-admins may only reconnect every 120 seconds
+		if (!User->IsAdmin()) {
+			Earliest = User->m_LastReconnect + 121;
+
+			if (Earliest > g_CurrentTime) {
+				User->m_ReconnectTime = Earliest;
+				User->m_ReconnectReserved = false;
+				Queue(User);
+
+				continue;
+			}
+		}
+
+		// wait for other connections to the same server which are
+		// still registering
+		char *Key = GetAdmissionKey(User->GetServer(), User->GetBindIp());
+		admission_t *Admission = (Key != NULL) ? GetAdmission(Key, false) : NULL;
+
+		free(Key);
+
+		if (Admission != NULL && Admission->Registering >= GetMaxRegistrations()) {
+			Admission->Deferred++;
+
+			User->m_ReconnectTime = g_CurrentTime + ADMISSION_RETRY;
+			Queue(User);
+
+			continue;
+		}
+
+		if (User->m_ReconnectReserved) {
+			Unqueue(User);
+			User->Reconnect();
+
+			continue;
+		}
+
+		BindIpName = User->GetBindIp();
+
+		Server = GetBucket(&m_Servers, User->GetServer());
+		BindIp = GetBucket(&m_BindIps, BindIpName ? BindIpName : "");
+
+		if (Server == NULL || BindIp == NULL) {
+			break;
+		}
+
+		Slot = max(GetAvailableTime(Server), GetAvailableTime(BindIp));
+
+		ConsumeToken(Server, Slot);
+		ConsumeToken(BindIp, Slot);
+
+		if (Slot <= g_CurrentTime) {
+			Unqueue(User);
+			User->Reconnect();
+		} else {
+			User->m_ReconnectTime = Slot;
+			User->m_ReconnectReserved = true;
+			Queue(User);
+
+			Prefetch(User, Server);
+		}
+	}
+
+	ExpireBuckets(&m_Servers);
+	ExpireBuckets(&m_BindIps);
+	ExpireAdmissions();
+
+	Reschedule();
+}
+
+/**
+ * GetQueueLength
+ *
+ * Returns the number of users which are waiting for a reconnect.
+ */
+int CReconnectPlanner::GetQueueLength(void) const {
+	return m_Queue.GetLength();
+}
+
+/**
+ * GetQueuedUser
+ *
+ * Returns a user which is waiting for a reconnect (in no particular order).
+ *
+ * @param Index the index of the user
+ */
+CUser *CReconnectPlanner::GetQueuedUser(int Index) const {
+	if (Index < 0 || Index >= m_Queue.GetLength()) {
+		return NULL;
+	}
+
+	return m_Queue[Index];
+}
+
+/**
+ * GetReservedCount
+ *
+ * Returns the number of users in the queue which have reserved a slot.
+ */
+int CReconnectPlanner::GetReservedCount(void) const {
+	int Count = 0;
+
+	for (int i = 0; i < m_Queue.GetLength(); i++) {
+		if (m_Queue[i]->m_ReconnectReserved) {
+			Count++;
+		}
+	}
+
+	return Count;
+}
+
+/**
+ * GetRecoveryTime
+ *
+ * Returns the time when the last user who is currently in the queue is
+ * going to be reconnected, or 0 if the queue is empty. Users whose
+ * reconnects are due have already reserved their slots, so this is
+ * the time when all of them have been reconnected.
+ */
+time_t CReconnectPlanner::GetRecoveryTime(void) const {
+	time_t Recovery = 0;
+
+	for (int i = 0; i < m_Queue.GetLength(); i++) {
+		Recovery = max(Recovery, m_Queue[i]->m_ReconnectTime);
+	}
+
+	return Recovery;
+}
+
+/**
+ * GetPrefetchCount
+ *
+ * Returns the number of successful dns prefetches.
+ */
+unsigned int CReconnectPlanner::GetPrefetchCount(void) const {
+	return m_Prefetches;
+}
+
+/**
+ * GetServerBuckets
+ *
+ * Returns the token buckets for servers.
+ */
+const CHashtable<reconnect_bucket_t *, false> *CReconnectPlanner::GetServerBuckets(void) const {
+	return &m_Servers;
+}
+
+/**
+ * GetBindIpBuckets
+ *
+ * Returns the token buckets for bind ips. The default bind ip is
+ * stored as an empty string.
+ */
+const CHashtable<reconnect_bucket_t *, false> *CReconnectPlanner::GetBindIpBuckets(void) const {
+	return &m_BindIps;
+}
@@ -0,0 +1,140 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef RECONNECTPLANNER_H
+#define RECONNECTPLANNER_H
+
+#define RECONNECT_DEFAULTINTERVAL 15 /**< default number of seconds between connects to a server or from a bind ip */
+#define RECONNECT_DEFAULTBURST 3 /**< default number of connects which may be made at once */
+#define RECONNECT_JITTER 10 /**< maximum random delay (in seconds) after a disconnect */
+#define RECONNECT_BACKOFF_MIN 15 /**< delay (in seconds) after the first failed connect */
+#define RECONNECT_BACKOFF_MAX 900 /**< maximum delay (in seconds) after failed connects */
+#define RECONNECT_STABLE 60 /**< connections which last at least this long (in seconds) reset the backoff */
+#define RECONNECT_PREFETCH 60 /**< minimum time (in seconds) between dns prefetches for a server */
+
+#define ADMISSION_DEFAULTREGISTRATIONS 3 /**< default number of concurrent registrations per server and bind ip */
+#define ADMISSION_DEFAULTJOININTERVAL 2 /**< default number of seconds between join bursts per server and bind ip */
+#define ADMISSION_DEFAULTJOINBURST 3 /**< default number of join bursts which may be sent at once */
+#define ADMISSION_RETRY 1 /**< delay (in seconds) for reconnects which exceed the registration limit */
+
+/**
+ * reconnect_bucket_t
+ *
+ * A token bucket which limits connects to a server or from a bind ip.
+ */
+typedef struct reconnect_bucket_s {
+	time_t NextConnect; /**< the theoretical time of the next connect; the bucket is
+						  full when this is at least one burst in the past */
+	time_t LastPrefetch; /**< when the server's hostname was last prefetched */
+	unsigned int Connects; /**< the number of connects which have been made */
+} reconnect_bucket_t;
+
+/**
+ * admission_t
+ *
+ * Limits registrations and join bursts for a server and bind ip.
+ */
+typedef struct admission_s {
+	int Registering; /**< the number of connections which have not been registered yet */
+	int JoinsWaiting; /**< the number of connections which are waiting to join their channels */
+	time_t NextJoin; /**< the theoretical time of the next join burst */
+	unsigned int Joins; /**< the number of join bursts which have been admitted */
+	unsigned int Deferred; /**< the number of times a reconnect had to wait for other registrations */
+} admission_t;
+
+#ifndef SWIG
+bool ReconnectPlannerTimer(time_t Now, void *Planner);
+#endif /* SWIG */
+
+class CDnsQuery;
+
+/**
+ * CReconnectPlanner
+ *
+ * Decides when users are reconnected to their IRC servers. Users which are
+ * waiting for a reconnect are kept in a min-heap ordered by their reconnect
+ * time. Every destination server and every bind ip has its own token bucket,
+ * so connects to different servers or from different bind ips do not have
+ * to wait for each other. Once a user is due, the planner reserves a slot
+ * in both buckets and the user is connected when that slot is reached.
+ *
+ * Additionally the planner limits the number of concurrent registrations
+ * for each combination of server and bind ip and paces the join bursts
+ * which are sent after connections have been registered.
+ */
+class SBNCAPI CReconnectPlanner {
+#ifndef SWIG
+	friend bool ReconnectPlannerTimer(time_t Now, void *Planner);
+#endif /* SWIG */
+
+	CVector<CUser *> m_Queue; /**< the users which are waiting for a reconnect */
+	CHashtable<reconnect_bucket_t *, false> m_Servers; /**< token buckets for servers */
+	CHashtable<reconnect_bucket_t *, false> m_BindIps; /**< token buckets for bind ips */
+	CHashtable<admission_t *, false> m_Admissions; /**< admission state for servers and bind ips */
+	CTimer *m_Timer; /**< the timer which processes the queue */
+	CDnsQuery *m_DnsQuery; /**< used for prefetching hostnames */
+	unsigned int m_Prefetches; /**< the number of dns prefetches which have been made */
+
+	void Sift(int Index);
+	void ProcessQueue(void);
+	void Prefetch(CUser *User, reconnect_bucket_t *Bucket);
+	reconnect_bucket_t *GetBucket(CHashtable<reconnect_bucket_t *, false> *Buckets, const char *Name);
+	void ConsumeToken(reconnect_bucket_t *Bucket, time_t When) const;
+	void ExpireBuckets(CHashtable<reconnect_bucket_t *, false> *Buckets);
+	admission_t *GetAdmission(const char *Key, bool Create);
+	void ExpireAdmissions(void);
+public:
+#ifndef SWIG
+	CReconnectPlanner(void);
+	virtual ~CReconnectPlanner(void);
+#endif /* SWIG */
+
+	void Queue(CUser *User);
+	void Unqueue(CUser *User);
+	void Reschedule(void);
+
+	int GetInterval(void) const;
+	int GetBurst(void) const;
+	int GetMaxRegistrations(void) const;
+	int GetJoinInterval(void) const;
+	int GetJoinBurst(void) const;
+
+	int GetQueueLength(void) const;
+	CUser *GetQueuedUser(int Index) const;
+	int GetReservedCount(void) const;
+	time_t GetRecoveryTime(void) const;
+	unsigned int GetPrefetchCount(void) const;
+
+	const CHashtable<reconnect_bucket_t *, false> *GetServerBuckets(void) const;
+	const CHashtable<reconnect_bucket_t *, false> *GetBindIpBuckets(void) const;
+	time_t GetAvailableTime(const reconnect_bucket_t *Bucket) const;
+
+	static char *GetAdmissionKey(const char *Server, const char *BindIp);
+	void BeginRegistration(const char *Key);
+	void EndRegistration(const char *Key);
+	time_t ReserveJoin(const char *Key);
+	void EndJoin(const char *Key);
+
+	const CHashtable<admission_t *, false> *GetAdmissions(void) const;
+	time_t GetNextJoinTime(const admission_t *Admission) const;
+
+	void AsyncDnsFinished(hostent *Response);
+};
+
+#endif /* RECONNECTPLANNER_H */
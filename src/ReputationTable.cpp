@@ -0,0 +1,466 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/**
+ * ReputationSetting
+ *
+ * Reads a connection limit from the main config. A value of 0 disables
+ * the limit.
+ *
+ * @param Setting the name of the setting
+ * @param Default the default value
+ */
+static unsigned int ReputationSetting(const char *Setting, unsigned int Default) {
+	RESULT<int> Value = g_Bouncer->GetConfig()->ReadInteger(Setting);
+
+	if (IsError(Value) || Value < 0) {
+		return Default;
+	}
+
+	return Value;
+}
+
+/**
+ * ReputationExpireTimer
+ *
+ * Removes unused entries from the reputation table.
+ *
+ * @param Now the current time
+ * @param Table the reputation table
+ */
+bool ReputationExpireTimer(time_t Now, void *Table) {
+	((CReputationTable *)Table)->ExpireEntries();
+
+	if (((CReputationTable *)Table)->m_Entries.GetLength() == 0) {
+		((CReputationTable *)Table)->m_ExpireTimer = NULL;
+
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * CReputationTable
+ *
+ * Constructs a new reputation table.
+ */
+CReputationTable::CReputationTable(void) {
+	m_Entries.RegisterValueDestructor(DestroyObject<reputation_t>);
+
+	m_ExpireTimer = NULL;
+
+	m_PreAuth = 0;
+	m_Rejected = 0;
+	m_Blocked = 0;
+}
+
+/**
+ * ~CReputationTable
+ *
+ * Destructs the reputation table.
+ */
+CReputationTable::~CReputationTable(void) {
+	if (m_ExpireTimer != NULL) {
+		m_ExpireTimer->Destroy();
+	}
+}
+
+/**
+ * GetPrefixKey
+ *
+ * Returns the key for an address' /64 prefix, or NULL if the address
+ * is not an ipv6 address.
+ *
+ * @param Address the address
+ */
+const char *CReputationTable::GetPrefixKey(const sockaddr *Address) {
+#ifdef HAVE_IPV6
+	static char Key[INET6_ADDRSTRLEN + 4];
+	sockaddr_in6 Prefix;
+	const char *PrefixString;
+
+	if (Address->sa_family != AF_INET6) {
+		return NULL;
+	}
+
+	memcpy(&Prefix, Address, sizeof(Prefix));
+
+	// mapped ipv4 addresses would all share the same prefix
+	if (IN6_IS_ADDR_V4MAPPED(&Prefix.sin6_addr)) {
+		return NULL;
+	}
+
+	memset(&Prefix.sin6_addr.s6_addr[8], 0, 8);
+
+	PrefixString = IpToString((sockaddr *)&Prefix);
+
+	if (PrefixString == NULL) {
+		return NULL;
+	}
+
+	snprintf(Key, sizeof(Key), "%s/64", PrefixString);
+
+	return Key;
+#else /* HAVE_IPV6 */
+	return NULL;
+#endif /* HAVE_IPV6 */
+}
+
+/**
+ * GetEntry
+ *
+ * Returns the entry for an address or a prefix.
+ *
+ * @param Key the address or prefix
+ * @param Create whether a new entry should be created if there is none
+ */
+reputation_t *CReputationTable::GetEntry(const char *Key, bool Create) {
+	reputation_t *Entry;
+
+	if (Key == NULL) {
+		return NULL;
+	}
+
+	Entry = m_Entries.Get(Key);
+
+	if (Entry != NULL || !Create) {
+		return Entry;
+	}
+
+	Entry = new reputation_t;
+
+	if (AllocFailed(Entry)) {
+		return NULL;
+	}
+
+	Entry->PreAuth = 0;
+	Entry->BadLogins = 0;
+	Entry->LastDecay = g_CurrentTime;
+
+	if (IsError(m_Entries.Add(Key, Entry))) {
+		delete Entry;
+
+		return NULL;
+	}
+
+	if (m_ExpireTimer == NULL) {
+		m_ExpireTimer = new CTimer(REPUTATION_EXPIREINTERVAL, true, ReputationExpireTimer, this);
+	}
+
+	return Entry;
+}
+
+/**
+ * ReleaseEntry
+ *
+ * Removes an entry if it is no longer needed.
+ *
+ * @param Key the address or prefix
+ */
+void CReputationTable::ReleaseEntry(const char *Key) {
+	reputation_t *Entry = GetEntry(Key, false);
+
+	if (Entry == NULL) {
+		return;
+	}
+
+	Decay(Entry);
+
+	if (Entry->PreAuth == 0 && Entry->BadLogins == 0) {
+		m_Entries.Remove(Key);
+	}
+}
+
+/**
+ * Decay
+ *
+ * Forgets one failed login for every REPUTATION_DECAYINTERVAL seconds
+ * which have passed since the last decay.
+ *
+ * @param Entry the entry
+ */
+void CReputationTable::Decay(reputation_t *Entry) const {
+	time_t Steps;
+
+	if (Entry->BadLogins == 0) {
+		Entry->LastDecay = g_CurrentTime;
+
+		return;
+	}
+
+	Steps = (g_CurrentTime - Entry->LastDecay) / REPUTATION_DECAYINTERVAL;
+
+	if (Steps >= (time_t)Entry->BadLogins) {
+		Entry->BadLogins = 0;
+		Entry->LastDecay = g_CurrentTime;
+	} else {
+		Entry->BadLogins -= Steps;
+		Entry->LastDecay += Steps * REPUTATION_DECAYINTERVAL;
+	}
+}
+
+/**
+ * ExpireEntries
+ *
+ * Removes entries which have neither connections nor recent failed logins.
+ */
+void CReputationTable::ExpireEntries(void) {
+	char **Keys = m_Entries.GetSortedKeys();
+	char *Key;
+	int i = 0;
+
+	if (Keys == NULL) {
+		return;
+	}
+
+	while ((Key = Keys[i++]) != NULL) {
+		ReleaseEntry(Key);
+	}
+
+	free(Keys);
+}
+
+/**
+ * GetMaxPerIp
+ *
+ * Returns the maximum number of unauthenticated connections per address,
+ * or 0 if there is no limit.
+ */
+unsigned int CReputationTable::GetMaxPerIp(void) const {
+	return ReputationSetting("system.preauthperip", REPUTATION_DEFAULTPERIP);
+}
+
+/**
+ * GetMaxPerPrefix
+ *
+ * Returns the maximum number of unauthenticated connections per ipv6 /64,
+ * or 0 if there is no limit.
+ */
+unsigned int CReputationTable::GetMaxPerPrefix(void) const {
+	return ReputationSetting("system.preauthperprefix", REPUTATION_DEFAULTPERPREFIX);
+}
+
+/**
+ * AddPreAuth
+ *
+ * Checks whether a new client may connect from the specified address and
+ * counts it as an unauthenticated connection. Returns false if the client
+ * should be refused. Every successful call has to be matched by a call
+ * to RemovePreAuth().
+ *
+ * @param Address the client's address
+ */
+bool CReputationTable::AddPreAuth(const sockaddr *Address) {
+	const char *PrefixKey = GetPrefixKey(Address);
+	const char *Key;
+	reputation_t *Entry, *Prefix;
+	unsigned int MaxPerIp, MaxPerPrefix;
+
+	if (IsBlocked(Address)) {
+		m_Blocked++;
+
+		return false;
+	}
+
+	MaxPerIp = GetMaxPerIp();
+	MaxPerPrefix = GetMaxPerPrefix();
+
+	Key = IpToString((sockaddr *)Address);
+	Entry = GetEntry(Key, true);
+
+	// addresses which can't be converted are not tracked
+	if (Entry == NULL) {
+		return (Key == NULL);
+	}
+
+	if (MaxPerIp > 0 && Entry->PreAuth >= MaxPerIp) {
+		m_Rejected++;
+
+		return false;
+	}
+
+	Prefix = GetEntry(PrefixKey, true);
+
+	if (Prefix != NULL && MaxPerPrefix > 0 && Prefix->PreAuth >= MaxPerPrefix) {
+		m_Rejected++;
+
+		ReleaseEntry(Key);
+
+		return false;
+	}
+
+	Entry->PreAuth++;
+
+	if (Prefix != NULL) {
+		Prefix->PreAuth++;
+	}
+
+	m_PreAuth++;
+
+	return true;
+}
+
+/**
+ * RemovePreAuth
+ *
+ * Removes an unauthenticated connection, e.g. because the client has
+ * logged in or has disconnected.
+ *
+ * @param Address the client's address
+ */
+void CReputationTable::RemovePreAuth(const sockaddr *Address) {
+	const char *PrefixKey = GetPrefixKey(Address);
+	const char *Key = IpToString((sockaddr *)Address);
+	reputation_t *Entry;
+
+	Entry = GetEntry(Key, false);
+
+	if (Entry != NULL && Entry->PreAuth > 0) {
+		Entry->PreAuth--;
+		m_PreAuth--;
+
+		ReleaseEntry(Key);
+	}
+
+	Entry = GetEntry(PrefixKey, false);
+
+	if (Entry != NULL && Entry->PreAuth > 0) {
+		Entry->PreAuth--;
+
+		ReleaseEntry(PrefixKey);
+	}
+}
+
+/**
+ * AddBadLogin
+ *
+ * Counts a failed login for an address or a prefix.
+ *
+ * @param Key the address or prefix
+ * @param Limit the number of failed logins after which the key is blocked
+ */
+void CReputationTable::AddBadLogin(const char *Key, unsigned int Limit) {
+	reputation_t *Entry = GetEntry(Key, true);
+
+	if (Entry == NULL) {
+		return;
+	}
+
+	Decay(Entry);
+
+	if (Entry->BadLogins < Limit) {
+		Entry->BadLogins++;
+	}
+}
+
+/**
+ * HasBadLogins
+ *
+ * Checks whether an address or a prefix has reached its limit of
+ * failed logins.
+ *
+ * @param Key the address or prefix
+ * @param Limit the number of failed logins after which the key is blocked
+ */
+bool CReputationTable::HasBadLogins(const char *Key, unsigned int Limit) {
+	reputation_t *Entry = GetEntry(Key, false);
+
+	if (Entry == NULL) {
+		return false;
+	}
+
+	Decay(Entry);
+
+	return (Entry->BadLogins >= Limit);
+}
+
+/**
+ * LogBadLogin
+ *
+ * Logs a failed login attempt. Failed logins from ipv6 addresses are
+ * also counted for their /64 so that clients can't avoid being blocked
+ * by changing the lower half of their address.
+ *
+ * @param Address the client's address
+ */
+void CReputationTable::LogBadLogin(const sockaddr *Address) {
+	const char *PrefixKey = GetPrefixKey(Address);
+
+	AddBadLogin(IpToString((sockaddr *)Address), REPUTATION_MAXBADLOGINS);
+	AddBadLogin(PrefixKey, REPUTATION_MAXPREFIXBADLOGINS);
+}
+
+/**
+ * IsBlocked
+ *
+ * Checks whether an address (or its ipv6 /64) is blocked due to failed
+ * logins.
+ *
+ * @param Address the address
+ */
+bool CReputationTable::IsBlocked(const sockaddr *Address) {
+	const char *PrefixKey = GetPrefixKey(Address);
+
+	if (HasBadLogins(PrefixKey, REPUTATION_MAXPREFIXBADLOGINS)) {
+		return true;
+	}
+
+	return HasBadLogins(IpToString((sockaddr *)Address), REPUTATION_MAXBADLOGINS);
+}
+
+/**
+ * GetPreAuthConnections
+ *
+ * Returns the number of connections which have not logged in yet.
+ */
+unsigned int CReputationTable::GetPreAuthConnections(void) const {
+	return m_PreAuth;
+}
+
+/**
+ * GetRejectedConnections
+ *
+ * Returns the number of connections which were refused because they
+ * exceeded the limits for their address or prefix.
+ */
+unsigned int CReputationTable::GetRejectedConnections(void) const {
+	return m_Rejected;
+}
+
+/**
+ * GetBlockedConnections
+ *
+ * Returns the number of connections which were refused because their
+ * address was blocked due to failed logins.
+ */
+unsigned int CReputationTable::GetBlockedConnections(void) const {
+	return m_Blocked;
+}
+
+/**
+ * GetAddressCount
+ *
+ * Returns the number of addresses and prefixes in the table.
+ */
+unsigned int CReputationTable::GetAddressCount(void) const {
+	return m_Entries.GetLength();
+}
@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef REPUTATIONTABLE_H
+#define REPUTATIONTABLE_H
+
+#define REPUTATION_DEFAULTPERIP 10 /**< default number of unauthenticated connections per address */
+#define REPUTATION_DEFAULTPERPREFIX 50 /**< default number of unauthenticated connections per ipv6 /64 */
+#define REPUTATION_MAXBADLOGINS 3 /**< number of failed logins after which an address is blocked */
+#define REPUTATION_MAXPREFIXBADLOGINS 10 /**< number of failed logins after which an ipv6 /64 is blocked */
+#define REPUTATION_DECAYINTERVAL 200 /**< number of seconds after which a failed login is forgotten */
+#define REPUTATION_EXPIREINTERVAL 60 /**< number of seconds between removals of unused entries */
+
+/**
+ * reputation_t
+ *
+ * The state of an ip address or an ipv6 /64 prefix.
+ */
+typedef struct reputation_s {
+	unsigned int PreAuth; /**< the number of unauthenticated connections */
+	unsigned int BadLogins; /**< the number of recent failed logins */
+	time_t LastDecay; /**< when the failed logins were last decreased */
+} reputation_t;
+
+#ifndef SWIG
+bool ReputationExpireTimer(time_t Now, void *Table);
+#endif /* SWIG */
+
+/**
+ * CReputationTable
+ *
+ * Keeps track of unauthenticated connections and failed logins for
+ * each client address. Listeners use the table to turn away clients
+ * before any objects are created for them: clients are refused if their
+ * address is blocked due to failed logins or if their address (or their
+ * ipv6 /64) already has too many connections which have not logged in yet.
+ * Failed logins are counted for both the address and its ipv6 /64 and
+ * decay over time.
+ */
+class SBNCAPI CReputationTable {
+#ifndef SWIG
+	friend bool ReputationExpireTimer(time_t Now, void *Table);
+#endif /* SWIG */
+
+	CHashtable<reputation_t *, false> m_Entries; /**< the addresses and prefixes */
+	CTimer *m_ExpireTimer; /**< removes unused entries */
+
+	unsigned int m_PreAuth; /**< the total number of unauthenticated connections */
+	unsigned int m_Rejected; /**< the number of connections which exceeded a limit */
+	unsigned int m_Blocked; /**< the number of connections from blocked addresses */
+
+	reputation_t *GetEntry(const char *Key, bool Create);
+	void ReleaseEntry(const char *Key);
+	void Decay(reputation_t *Entry) const;
+	void AddBadLogin(const char *Key, unsigned int Limit);
+	bool HasBadLogins(const char *Key, unsigned int Limit);
+	void ExpireEntries(void);
+
+	unsigned int GetMaxPerIp(void) const;
+	unsigned int GetMaxPerPrefix(void) const;
+
+	static const char *GetPrefixKey(const sockaddr *Address);
+public:
+#ifndef SWIG
+	CReputationTable(void);
+	virtual ~CReputationTable(void);
+#endif /* SWIG */
+
+	bool AddPreAuth(const sockaddr *Address);
+	void RemovePreAuth(const sockaddr *Address);
+
+	void LogBadLogin(const sockaddr *Address);
+	bool IsBlocked(const sockaddr *Address);
+
+	unsigned int GetPreAuthConnections(void) const;
+	unsigned int GetRejectedConnections(void) const;
+	unsigned int GetBlockedConnections(void) const;
+	unsigned int GetAddressCount(void) const;
+};
+
+#endif /* REPUTATIONTABLE_H */
@@ -56,6 +56,21 @@ public:
 		m_Description = Source.m_Description;
 	}
 
+	/**
+	 * operator =
+	 *
+	 * The assignment operator for result objects.
+	 *
+	 * @param Source the source object.
+	 */
+	CResult<Type> &operator =(const CResult<Type> &Source) {
+		m_Code = Source.m_Code;
+		m_Result = Source.m_Result;
+		m_Description = Source.m_Description;
+
+		return *this;
+	}
+
 	/**
 	 * CResult
 	 *
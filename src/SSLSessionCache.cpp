@@ -0,0 +1,357 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+#ifdef HAVE_LIBSSL
+/**
+ * SessionSetting
+ *
+ * Reads a session resumption setting from the main config.
+ *
+ * @param Setting the name of the setting
+ * @param Default the default value
+ */
+static unsigned int SessionSetting(const char *Setting, unsigned int Default) {
+	RESULT<int> Value = g_Bouncer->GetConfig()->ReadInteger(Setting);
+
+	if (IsError(Value) || Value < 0) {
+		return Default;
+	}
+
+	return Value;
+}
+
+/**
+ * InitTicketMAC
+ *
+ * Initializes the MAC context for a session ticket.
+ *
+ * @param MAC the MAC context
+ * @param Key the ticket key
+ */
+static bool InitTicketMAC(ticketmac_t *MAC, ticketkey_t *Key) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM Params[2];
+
+	Params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0);
+	Params[1] = OSSL_PARAM_construct_end();
+
+	return EVP_MAC_init(MAC, Key->HMACKey, sizeof(Key->HMACKey), Params) == 1;
+#else /* OPENSSL_VERSION_NUMBER */
+	return HMAC_Init_ex(MAC, Key->HMACKey, sizeof(Key->HMACKey), EVP_sha256(), NULL) == 1;
+#endif /* OPENSSL_VERSION_NUMBER */
+}
+
+/**
+ * TicketKeyTimer
+ *
+ * Rotates the session ticket keys.
+ *
+ * @param Now the current time
+ * @param SessionCache the session cache object
+ */
+bool TicketKeyTimer(time_t Now, void *SessionCache) {
+	((CSSLSessionCache *)SessionCache)->RotateTicketKeys();
+
+	return true;
+}
+
+/**
+ * CSSLSessionCache
+ *
+ * Constructs a new session cache and configures the SSL contexts.
+ *
+ * @param ServerContext the context for client connections, or NULL
+ * @param ClientContext the context for IRC connections, or NULL
+ */
+CSSLSessionCache::CSSLSessionCache(SSL_CTX *ServerContext, SSL_CTX *ClientContext) {
+	unsigned int CacheSize, KeyInterval;
+
+	m_ServerContext = ServerContext;
+	m_ClientContext = ClientContext;
+	m_KeyCount = 0;
+	m_KeyTimer = NULL;
+
+#ifdef HAVE_THREADS
+	pthread_mutex_init(&m_KeyMutex, NULL);
+#endif /* HAVE_THREADS */
+
+	m_ClientSessions.RegisterValueDestructor(SSL_SESSION_free);
+
+	if (m_ServerContext != NULL) {
+		// sessions can't be resumed if client certificates are verified and there's no session id context
+		SSL_CTX_set_session_id_context(m_ServerContext, (const unsigned char *)"shroudBNC", strlen("shroudBNC"));
+
+		CacheSize = SessionSetting("system.sslsessioncache", SSLSESSION_DEFAULTCACHESIZE);
+
+		if (CacheSize > 0) {
+			SSL_CTX_set_session_cache_mode(m_ServerContext, SSL_SESS_CACHE_SERVER);
+			SSL_CTX_sess_set_cache_size(m_ServerContext, CacheSize);
+		} else {
+			SSL_CTX_set_session_cache_mode(m_ServerContext, SSL_SESS_CACHE_OFF);
+		}
+
+		SSL_CTX_set_timeout(m_ServerContext, SessionSetting("system.sslsessiontimeout", SSLSESSION_DEFAULTTIMEOUT));
+
+		KeyInterval = SessionSetting("system.sslticketinterval", SSLSESSION_DEFAULTKEYINTERVAL);
+
+		if (KeyInterval > 0 && RotateTicketKeys()) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+			SSL_CTX_set_tlsext_ticket_key_evp_cb(m_ServerContext, TicketKeyCallback);
+#else /* OPENSSL_VERSION_NUMBER */
+			SSL_CTX_set_tlsext_ticket_key_cb(m_ServerContext, TicketKeyCallback);
+#endif /* OPENSSL_VERSION_NUMBER */
+
+			m_KeyTimer = new CTimer(KeyInterval, true, TicketKeyTimer, this);
+		} else {
+			SSL_CTX_set_options(m_ServerContext, SSL_OP_NO_TICKET);
+		}
+	}
+
+	if (m_ClientContext != NULL) {
+		// sessions are stored per server by NewClientSession()
+		SSL_CTX_set_session_cache_mode(m_ClientContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(m_ClientContext, NewClientSession);
+	}
+}
+
+/**
+ * ~CSSLSessionCache
+ *
+ * Destructs a session cache.
+ */
+CSSLSessionCache::~CSSLSessionCache(void) {
+	if (m_KeyTimer != NULL) {
+		m_KeyTimer->Destroy();
+	}
+
+	if (m_ServerContext != NULL) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(m_ServerContext, NULL);
+#else /* OPENSSL_VERSION_NUMBER */
+		SSL_CTX_set_tlsext_ticket_key_cb(m_ServerContext, NULL);
+#endif /* OPENSSL_VERSION_NUMBER */
+	}
+
+	if (m_ClientContext != NULL) {
+		SSL_CTX_sess_set_new_cb(m_ClientContext, NULL);
+	}
+
+	OPENSSL_cleanse(m_Keys, sizeof(m_Keys));
+
+#ifdef HAVE_THREADS
+	pthread_mutex_destroy(&m_KeyMutex);
+#endif /* HAVE_THREADS */
+}
+
+/**
+ * RotateTicketKeys
+ *
+ * Creates a new ticket key. Tickets which were encrypted using the
+ * previous key are still accepted (and renewed).
+ */
+bool CSSLSessionCache::RotateTicketKeys(void) {
+	ticketkey_t Key;
+
+	if (RAND_bytes(Key.Name, sizeof(Key.Name)) != 1 || RAND_bytes(Key.AESKey, sizeof(Key.AESKey)) != 1 ||
+			RAND_bytes(Key.HMACKey, sizeof(Key.HMACKey)) != 1) {
+		return false;
+	}
+
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&m_KeyMutex);
+#endif /* HAVE_THREADS */
+
+	m_Keys[1] = m_Keys[0];
+	m_Keys[0] = Key;
+
+	if (m_KeyCount < 2) {
+		m_KeyCount++;
+	}
+
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&m_KeyMutex);
+#endif /* HAVE_THREADS */
+
+	OPENSSL_cleanse(&Key, sizeof(Key));
+
+	return true;
+}
+
+/**
+ * TicketKeyCallback
+ *
+ * Sets up the cipher and MAC contexts for encrypting or decrypting
+ * a session ticket. This can be called by handshake threads.
+ *
+ * @param SSLObject the SSL connection
+ * @param Name the key name
+ * @param IV the initialization vector
+ * @param Cipher the cipher context
+ * @param MAC the MAC context
+ * @param Encrypt whether a ticket is encrypted or decrypted
+ */
+int CSSLSessionCache::TicketKeyCallback(SSL *SSLObject, unsigned char *Name, unsigned char *IV,
+		EVP_CIPHER_CTX *Cipher, ticketmac_t *MAC, int Encrypt) {
+	CSSLSessionCache *Cache = g_Bouncer->GetSSLSessionCache();
+	int Result;
+
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&Cache->m_KeyMutex);
+#endif /* HAVE_THREADS */
+
+	Result = Cache->UseTicketKey(Name, IV, Cipher, MAC, Encrypt);
+
+#ifdef HAVE_THREADS
+	pthread_mutex_unlock(&Cache->m_KeyMutex);
+#endif /* HAVE_THREADS */
+
+	return Result;
+}
+
+/**
+ * UseTicketKey
+ *
+ * Initializes the contexts for a session ticket using the current key (for
+ * new tickets) or the key whose name matches the ticket's key name.
+ *
+ * @param Name the key name
+ * @param IV the initialization vector
+ * @param Cipher the cipher context
+ * @param MAC the MAC context
+ * @param Encrypt whether a ticket is encrypted or decrypted
+ */
+int CSSLSessionCache::UseTicketKey(unsigned char *Name, unsigned char *IV,
+		EVP_CIPHER_CTX *Cipher, ticketmac_t *MAC, int Encrypt) {
+	ticketkey_t *Key;
+
+	if (Encrypt) {
+		Key = &m_Keys[0];
+
+		if (RAND_bytes(IV, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+			return -1;
+		}
+
+		memcpy(Name, Key->Name, sizeof(Key->Name));
+
+		if (EVP_EncryptInit_ex(Cipher, EVP_aes_256_cbc(), NULL, Key->AESKey, IV) != 1 || !InitTicketMAC(MAC, Key)) {
+			return -1;
+		}
+
+		return 1;
+	}
+
+	for (int i = 0; i < m_KeyCount; i++) {
+		Key = &m_Keys[i];
+
+		if (memcmp(Name, Key->Name, sizeof(Key->Name)) != 0) {
+			continue;
+		}
+
+		if (!InitTicketMAC(MAC, Key) || EVP_DecryptInit_ex(Cipher, EVP_aes_256_cbc(), NULL, Key->AESKey, IV) != 1) {
+			return -1;
+		}
+
+		// tickets which were encrypted using the previous key are renewed
+		return (i == 0) ? 1 : 2;
+	}
+
+	// unknown key, a full handshake is performed
+	return 0;
+}
+
+/**
+ * NewClientSession
+ *
+ * Remembers the session for an IRC connection.
+ *
+ * @param SSLObject the SSL connection
+ * @param Session the new session
+ */
+int CSSLSessionCache::NewClientSession(SSL *SSLObject, SSL_SESSION *Session) {
+	CConnection *Connection;
+	const char *Server;
+
+	Connection = (CConnection *)SSL_get_ex_data(SSLObject, g_Bouncer->GetSSLCustomIndex());
+
+	if (Connection == NULL || (Server = Connection->GetSSLSessionKey()) == NULL) {
+		return 0;
+	}
+
+	if (IsError(g_Bouncer->GetSSLSessionCache()->m_ClientSessions.Add(Server, Session))) {
+		return 0;
+	}
+
+	// the hashtable keeps the reference
+	return 1;
+}
+
+/**
+ * ResumeClientSession
+ *
+ * Tries to resume the most recent session for an IRC server.
+ *
+ * @param SSLObject the SSL connection
+ * @param Server the server's name and port
+ */
+void CSSLSessionCache::ResumeClientSession(SSL *SSLObject, const char *Server) {
+	SSL_SESSION *Session = m_ClientSessions.Get(Server);
+
+	if (Session != NULL) {
+		SSL_set_session(SSLObject, Session);
+	}
+}
+
+/**
+ * GetServerHandshakes
+ *
+ * Returns the number of successful handshakes with bouncer clients.
+ */
+unsigned int CSSLSessionCache::GetServerHandshakes(void) const {
+	return (m_ServerContext != NULL) ? SSL_CTX_sess_accept_good(m_ServerContext) : 0;
+}
+
+/**
+ * GetServerResumptions
+ *
+ * Returns the number of sessions which were resumed by bouncer clients.
+ */
+unsigned int CSSLSessionCache::GetServerResumptions(void) const {
+	return (m_ServerContext != NULL) ? SSL_CTX_sess_hits(m_ServerContext) : 0;
+}
+
+/**
+ * GetClientHandshakes
+ *
+ * Returns the number of successful handshakes with IRC servers.
+ */
+unsigned int CSSLSessionCache::GetClientHandshakes(void) const {
+	return (m_ClientContext != NULL) ? SSL_CTX_sess_connect_good(m_ClientContext) : 0;
+}
+
+/**
+ * GetClientResumptions
+ *
+ * Returns the number of sessions which were resumed with IRC servers.
+ */
+unsigned int CSSLSessionCache::GetClientResumptions(void) const {
+	return (m_ClientContext != NULL) ? SSL_CTX_sess_hits(m_ClientContext) : 0;
+}
+#endif /* HAVE_LIBSSL */
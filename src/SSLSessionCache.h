@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef SSLSESSIONCACHE_H
+#define SSLSESSIONCACHE_H
+
+#define SSLSESSION_DEFAULTCACHESIZE 20480 /**< default number of sessions in the server-side cache */
+#define SSLSESSION_DEFAULTTIMEOUT 3600 /**< default lifetime of sessions (in seconds) */
+#define SSLSESSION_DEFAULTKEYINTERVAL 3600 /**< default interval between ticket key rotations (in seconds) */
+
+#ifdef HAVE_LIBSSL
+/**
+ * ticketkey_t
+ *
+ * A key which is used for encrypting session tickets.
+ */
+typedef struct ticketkey_s {
+	unsigned char Name[16]; /**< the key's name, which is sent as part of the ticket */
+	unsigned char AESKey[32]; /**< the key for encrypting tickets */
+	unsigned char HMACKey[32]; /**< the key for authenticating tickets */
+} ticketkey_t;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX ticketmac_t; /**< the MAC context for session tickets */
+#else /* OPENSSL_VERSION_NUMBER */
+typedef HMAC_CTX ticketmac_t; /**< the MAC context for session tickets */
+#endif /* OPENSSL_VERSION_NUMBER */
+
+#ifndef SWIG
+bool TicketKeyTimer(time_t Now, void *SessionCache);
+#endif /* SWIG */
+
+/**
+ * CSSLSessionCache
+ *
+ * Enables TLS session resumption. Clients can resume sessions using the
+ * server-side session cache or using session tickets whose keys are
+ * rotated regularly. Sessions for IRC servers are remembered per server so
+ * that reconnects can resume them.
+ */
+class SBNCAPI CSSLSessionCache {
+#ifndef SWIG
+	friend bool TicketKeyTimer(time_t Now, void *SessionCache);
+#endif /* SWIG */
+
+	SSL_CTX *m_ServerContext; /**< the context for client connections, or NULL */
+	SSL_CTX *m_ClientContext; /**< the context for IRC connections, or NULL */
+
+	ticketkey_t m_Keys[2]; /**< the current and the previous ticket key */
+	int m_KeyCount; /**< the number of valid ticket keys */
+	CTimer *m_KeyTimer; /**< rotates the ticket keys */
+#ifdef HAVE_THREADS
+	pthread_mutex_t m_KeyMutex; /**< protects the ticket keys, which are also used by handshake threads */
+#endif /* HAVE_THREADS */
+
+	CHashtable<SSL_SESSION *, false> m_ClientSessions; /**< the most recent session for each IRC server */
+
+	bool RotateTicketKeys(void);
+	int UseTicketKey(unsigned char *Name, unsigned char *IV, EVP_CIPHER_CTX *Cipher,
+		ticketmac_t *MAC, int Encrypt);
+
+	static int TicketKeyCallback(SSL *SSLObject, unsigned char *Name, unsigned char *IV,
+		EVP_CIPHER_CTX *Cipher, ticketmac_t *MAC, int Encrypt);
+	static int NewClientSession(SSL *SSLObject, SSL_SESSION *Session);
+public:
+#ifndef SWIG
+	CSSLSessionCache(SSL_CTX *ServerContext, SSL_CTX *ClientContext);
+	virtual ~CSSLSessionCache(void);
+#endif /* SWIG */
+
+	void ResumeClientSession(SSL *SSLObject, const char *Server);
+
+	unsigned int GetServerHandshakes(void) const;
+	unsigned int GetServerResumptions(void) const;
+	unsigned int GetClientHandshakes(void) const;
+	unsigned int GetClientResumptions(void) const;
+};
+#endif /* HAVE_LIBSSL */
+
+#endif /* SSLSESSIONCACHE_H */
@@ -85,7 +85,13 @@ typedef lt_dlhandle HMODULE;
 #	include <openssl/bio.h>
 #	include <openssl/ssl.h>
 #	include <openssl/md5.h>
+#	include <openssl/evp.h>
+#	include <openssl/hmac.h>
+#	include <openssl/rand.h>
 #	include <openssl/err.h>
+#	if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#		include <openssl/core_names.h>
+#	endif /* OPENSSL_VERSION_NUMBER */
 #else /* HAVE_LIBSSL */
 typedef void SSL;
 typedef void BIO;
@@ -120,16 +126,21 @@ typedef void X509_STORE_CTX;
 #	include "DnsSocket.h"
 #	include "DnsEvents.h"
 #	include "Timer.h"
+#	include "ThreadPool.h"
 #	include "FIFOBuffer.h"
+#	include "OutputProducer.h"
 #	include "Queue.h"
+#	include "ConnectAttempt.h"
 #	include "Connection.h"
 #	include "Config.h"
+#	include "ConfigStore.h"
 #	include "Cache.h"
 #	include "Core.h"
 #	include "ClientConnection.h"
 #	include "ClientConnectionMultiplexer.h"
 #	include "IRCConnection.h"
 #	include "User.h"
+#	include "ReconnectPlanner.h"
 #	include "Log.h"
 #	include "ModuleFar.h"
 #	include "Module.h"
@@ -140,5 +151,7 @@ typedef void X509_STORE_CTX;
 #	include "IdentSupport.h"
 #	include "TrafficStats.h"
 #	include "FloodControl.h"
+#	include "SSLSessionCache.h"
+#	include "ReputationTable.h"
 #	include "Listener.h"
 #endif /* __cplusplus */
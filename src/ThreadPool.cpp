@@ -0,0 +1,438 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/**
+ * CThreadPool
+ *
+ * Creates a new thread pool.
+ *
+ * @param Threads the number of worker threads
+ */
+CThreadPool::CThreadPool(unsigned int Threads) {
+	m_ThreadCount = 0;
+	m_Head = NULL;
+	m_Tail = NULL;
+	m_DoneHead = NULL;
+	m_DoneTail = NULL;
+	m_Pending = 0;
+	m_Shutdown = false;
+	m_CompletionSocket = NULL;
+	m_WakeupSocket = INVALID_SOCKET;
+
+#ifdef HAVE_THREADS
+	if (Threads > THREADPOOL_MAXTHREADS) {
+		Threads = THREADPOOL_MAXTHREADS;
+	}
+
+	pthread_mutex_init(&m_Mutex, NULL);
+	pthread_cond_init(&m_JobCond, NULL);
+	pthread_cond_init(&m_IdleCond, NULL);
+
+	if (Threads == 0) {
+		m_Threads = NULL;
+
+		return;
+	}
+
+	m_Threads = (pthread_t *)malloc(sizeof(pthread_t) * Threads);
+
+	if (AllocFailed(m_Threads)) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < Threads; i++) {
+		if (pthread_create(&m_Threads[m_ThreadCount], NULL, WorkerThread, this) != 0) {
+			break;
+		}
+
+		m_ThreadCount++;
+	}
+#endif /* HAVE_THREADS */
+}
+
+/**
+ * ~CThreadPool
+ *
+ * Waits for all pending jobs, calls their completion functions and
+ * destroys the thread pool.
+ */
+CThreadPool::~CThreadPool(void) {
+	Wait();
+	RunCompletions();
+
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&m_Mutex);
+	m_Shutdown = true;
+	pthread_cond_broadcast(&m_JobCond);
+	pthread_mutex_unlock(&m_Mutex);
+
+	for (unsigned int i = 0; i < m_ThreadCount; i++) {
+		pthread_join(m_Threads[i], NULL);
+	}
+
+	free(m_Threads);
+
+	pthread_cond_destroy(&m_IdleCond);
+	pthread_cond_destroy(&m_JobCond);
+	pthread_mutex_destroy(&m_Mutex);
+#endif /* HAVE_THREADS */
+
+	if (m_CompletionSocket != NULL) {
+		m_CompletionSocket->Destroy();
+	}
+
+	if (m_WakeupSocket != INVALID_SOCKET) {
+		closesocket(m_WakeupSocket);
+	}
+}
+
+#ifdef HAVE_THREADS
+/**
+ * WorkerThread
+ *
+ * Runs jobs until the thread pool is destroyed.
+ *
+ * @param Pool the thread pool
+ */
+void *CThreadPool::WorkerThread(void *Pool) {
+	CThreadPool *Self = (CThreadPool *)Pool;
+	threadjob_t *Job;
+
+	pthread_mutex_lock(&Self->m_Mutex);
+
+	while (true) {
+		while (Self->m_Head == NULL && !Self->m_Shutdown) {
+			pthread_cond_wait(&Self->m_JobCond, &Self->m_Mutex);
+		}
+
+		if (Self->m_Head == NULL) {
+			break;
+		}
+
+		Job = Self->m_Head;
+		Self->m_Head = Job->Next;
+
+		if (Self->m_Head == NULL) {
+			Self->m_Tail = NULL;
+		}
+
+		pthread_mutex_unlock(&Self->m_Mutex);
+
+		Job->Proc(Job->Cookie);
+
+		pthread_mutex_lock(&Self->m_Mutex);
+
+		if (Job->Completion != NULL) {
+			Job->Next = NULL;
+
+			// the main loop only needs to be woken up for the first finished job
+			if (Self->m_DoneTail != NULL) {
+				Self->m_DoneTail->Next = Job;
+			} else {
+				Self->m_DoneHead = Job;
+
+				if (write(Self->m_WakeupSocket, "", 1) < 0) {
+					// the pipe is full, so the main loop is going to wake up anyway
+				}
+			}
+
+			Self->m_DoneTail = Job;
+		} else {
+			free(Job);
+		}
+
+		if (--Self->m_Pending == 0) {
+			pthread_cond_broadcast(&Self->m_IdleCond);
+		}
+	}
+
+	pthread_mutex_unlock(&Self->m_Mutex);
+
+	return NULL;
+}
+#endif /* HAVE_THREADS */
+
+/**
+ * CreateWakeupPipe
+ *
+ * Creates the pipe which is used for waking up the main loop when
+ * jobs have finished.
+ */
+bool CThreadPool::CreateWakeupPipe(void) {
+#if defined(HAVE_THREADS) && !defined(_WIN32)
+	int Pipe[2];
+	unsigned long lTrue = 1;
+
+	if (pipe(Pipe) != 0) {
+		return false;
+	}
+
+	ioctlsocket(Pipe[0], FIONBIO, &lTrue);
+	ioctlsocket(Pipe[1], FIONBIO, &lTrue);
+
+	m_CompletionSocket = new CCompletionSocket(this, Pipe[0]);
+
+	if (AllocFailed(m_CompletionSocket)) {
+		closesocket(Pipe[0]);
+		closesocket(Pipe[1]);
+
+		return false;
+	}
+
+	m_WakeupSocket = Pipe[1];
+
+	return true;
+#else /* defined(HAVE_THREADS) && !defined(_WIN32) */
+	return false;
+#endif /* defined(HAVE_THREADS) && !defined(_WIN32) */
+}
+
+/**
+ * Submit
+ *
+ * Queues a job. The job is run immediately if the pool does not
+ * have any worker threads.
+ *
+ * @param Proc the function which should be called
+ * @param Cookie a user-specific pointer which is passed to the function
+ * @param Completion a function which is called in the main thread
+ *                   after the job has finished, or NULL
+ */
+RESULT<bool> CThreadPool::Submit(ThreadJobProc Proc, void *Cookie, ThreadJobProc Completion) {
+	threadjob_t *Job;
+
+	if (Proc == NULL) {
+		THROW(bool, Generic_InvalidArgument, "Proc cannot be NULL.");
+	}
+
+	if (m_ThreadCount == 0 || (Completion != NULL && m_CompletionSocket == NULL && !CreateWakeupPipe())) {
+		Proc(Cookie);
+
+		if (Completion != NULL) {
+			Completion(Cookie);
+		}
+
+		RETURN(bool, true);
+	}
+
+	Job = (threadjob_t *)malloc(sizeof(threadjob_t));
+
+	if (AllocFailed(Job)) {
+		THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+	}
+
+	Job->Proc = Proc;
+	Job->Completion = Completion;
+	Job->Cookie = Cookie;
+	Job->Next = NULL;
+
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&m_Mutex);
+
+	if (m_Tail != NULL) {
+		m_Tail->Next = Job;
+	} else {
+		m_Head = Job;
+	}
+
+	m_Tail = Job;
+	m_Pending++;
+
+	pthread_cond_signal(&m_JobCond);
+	pthread_mutex_unlock(&m_Mutex);
+#endif /* HAVE_THREADS */
+
+	RETURN(bool, true);
+}
+
+/**
+ * Wait
+ *
+ * Blocks until all jobs which have been submitted so far are completed.
+ */
+void CThreadPool::Wait(void) {
+#ifdef HAVE_THREADS
+	pthread_mutex_lock(&m_Mutex);
+
+	while (m_Pending > 0) {
+		pthread_cond_wait(&m_IdleCond, &m_Mutex);
+	}
+
+	pthread_mutex_unlock(&m_Mutex);
+#endif /* HAVE_THREADS */
+}
+
+/**
+ * RunCompletions
+ *
+ * Calls the completion functions of the jobs which have finished.
+ */
+void CThreadPool::RunCompletions(void) {
+#ifdef HAVE_THREADS
+	threadjob_t *Job, *Next;
+
+	pthread_mutex_lock(&m_Mutex);
+
+	Job = m_DoneHead;
+	m_DoneHead = NULL;
+	m_DoneTail = NULL;
+
+	pthread_mutex_unlock(&m_Mutex);
+
+	while (Job != NULL) {
+		Next = Job->Next;
+
+		Job->Completion(Job->Cookie);
+		free(Job);
+
+		Job = Next;
+	}
+#endif /* HAVE_THREADS */
+}
+
+/**
+ * GetThreadCount
+ *
+ * Returns the number of worker threads.
+ */
+unsigned int CThreadPool::GetThreadCount(void) const {
+	return m_ThreadCount;
+}
+
+/**
+ * GetProcessorCount
+ *
+ * Returns the number of online processors (or 1 if this
+ * cannot be determined).
+ */
+unsigned int CThreadPool::GetProcessorCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO SystemInfo;
+
+	GetSystemInfo(&SystemInfo);
+
+	return SystemInfo.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long Count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (Count < 1) {
+		return 1;
+	}
+
+	return (unsigned int)Count;
+#else
+	return 1;
+#endif
+}
+
+/**
+ * CCompletionSocket
+ *
+ * Constructs a new completion socket and registers it with the main loop.
+ *
+ * @param Pool the thread pool
+ * @param Socket the read end of the wakeup pipe
+ */
+CThreadPool::CCompletionSocket::CCompletionSocket(CThreadPool *Pool, SOCKET Socket) {
+	m_Pool = Pool;
+	m_Socket = Socket;
+
+	g_Bouncer->RegisterSocket(m_Socket, this);
+}
+
+/**
+ * Destroy
+ *
+ * Unregisters and closes the socket.
+ */
+void CThreadPool::CCompletionSocket::Destroy(void) {
+	g_Bouncer->UnregisterSocket(m_Socket);
+	closesocket(m_Socket);
+
+	m_Pool->m_CompletionSocket = NULL;
+
+	delete this;
+}
+
+/**
+ * Read
+ *
+ * Empties the wakeup pipe and calls the pool's completion functions.
+ *
+ * @param DontProcess unused
+ */
+int CThreadPool::CCompletionSocket::Read(bool DontProcess) {
+	char Buffer[64];
+
+	while (read(m_Socket, Buffer, sizeof(Buffer)) > 0) {
+		// the number of wakeups does not matter
+	}
+
+	m_Pool->RunCompletions();
+
+	return 0;
+}
+
+/**
+ * Write
+ *
+ * Nothing is ever written to the read end of the pipe.
+ */
+int CThreadPool::CCompletionSocket::Write(void) {
+	return 0;
+}
+
+/**
+ * Error
+ *
+ * Called when an error occurred for the pipe.
+ *
+ * @param ErrorCode the error code
+ */
+void CThreadPool::CCompletionSocket::Error(int ErrorCode) {
+}
+
+/**
+ * HasQueuedData
+ *
+ * The pipe never has any outbound data.
+ */
+bool CThreadPool::CCompletionSocket::HasQueuedData(void) const {
+	return false;
+}
+
+/**
+ * ShouldDestroy
+ *
+ * The pipe is destroyed along with its thread pool.
+ */
+bool CThreadPool::CCompletionSocket::ShouldDestroy(void) const {
+	return false;
+}
+
+/**
+ * GetClassName
+ *
+ * Returns the class' name.
+ */
+const char *CThreadPool::CCompletionSocket::GetClassName(void) const {
+	return "CThreadPool::CCompletionSocket";
+}
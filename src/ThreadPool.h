@@ -0,0 +1,119 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#	define HAVE_THREADS
+#endif
+
+#define THREADPOOL_MAXTHREADS 16 /**< upper limit for the number of worker threads */
+
+typedef void (*ThreadJobProc)(void *Cookie);
+
+/**
+ * threadjob_t
+ *
+ * A job which is waiting to be run by a thread pool.
+ */
+typedef struct threadjob_s {
+	ThreadJobProc Proc; /**< the function which should be called */
+	ThreadJobProc Completion; /**< the function which is called in the main thread afterwards, or NULL */
+	void *Cookie; /**< a user-specific pointer which is passed to the function */
+	struct threadjob_s *Next; /**< the next job in the queue */
+} threadjob_t;
+
+/**
+ * CThreadPool
+ *
+ * A fixed set of worker threads which run jobs in the background. Jobs
+ * must not use any of the bouncer's objects (logging, timers, sockets,
+ * etc.) - they should only work on data which has been passed to them.
+ *
+ * Jobs can have a completion function which is called in the main thread
+ * once the job has finished, e.g. for passing its results back to the
+ * bouncer's objects.
+ *
+ * If threads are not supported on this platform jobs (and their completion
+ * functions) are run immediately when they are submitted.
+ */
+class SBNCAPI CThreadPool {
+#ifndef SWIG
+	/**
+	 * CCompletionSocket
+	 *
+	 * The read end of a pipe which wakes up the main loop when jobs
+	 * with completion functions have finished.
+	 */
+	class CCompletionSocket : public CSocketEvents {
+		CThreadPool *m_Pool; /**< the thread pool */
+		SOCKET m_Socket; /**< the read end of the pipe */
+
+	public:
+		CCompletionSocket(CThreadPool *Pool, SOCKET Socket);
+
+		virtual void Destroy(void);
+		virtual int Read(bool DontProcess = false);
+		virtual int Write(void);
+		virtual void Error(int ErrorCode);
+		virtual bool HasQueuedData(void) const;
+		virtual bool ShouldDestroy(void) const;
+		virtual const char *GetClassName(void) const;
+	};
+#endif /* SWIG */
+
+private:
+	unsigned int m_ThreadCount; /**< the number of worker threads */
+	threadjob_t *m_Head; /**< the first job in the queue */
+	threadjob_t *m_Tail; /**< the last job in the queue */
+	threadjob_t *m_DoneHead; /**< the first finished job whose completion function has not been called */
+	threadjob_t *m_DoneTail; /**< the last finished job */
+	unsigned int m_Pending; /**< the number of jobs which have not been completed yet */
+	bool m_Shutdown; /**< determines whether the workers should exit */
+	CCompletionSocket *m_CompletionSocket; /**< wakes up the main loop, or NULL */
+	SOCKET m_WakeupSocket; /**< the write end of the wakeup pipe */
+
+#ifdef HAVE_THREADS
+	pthread_t *m_Threads; /**< the worker threads */
+	pthread_mutex_t m_Mutex; /**< protects the job queue */
+	pthread_cond_t m_JobCond; /**< signalled when new jobs are available */
+	pthread_cond_t m_IdleCond; /**< signalled when all jobs have been completed */
+
+	static void *WorkerThread(void *Pool);
+#endif /* HAVE_THREADS */
+
+	bool CreateWakeupPipe(void);
+
+public:
+#ifndef SWIG
+	CThreadPool(unsigned int Threads);
+	virtual ~CThreadPool(void);
+#endif /* SWIG */
+
+	RESULT<bool> Submit(ThreadJobProc Proc, void *Cookie, ThreadJobProc Completion = NULL);
+	void Wait(void);
+	void RunCompletions(void);
+
+	unsigned int GetThreadCount(void) const;
+
+	static unsigned int GetProcessorCount(void);
+};
+
+#endif /* THREADPOOL_H */
@@ -19,7 +19,7 @@
 
 #include "StdAfx.h"
 
-static time_t g_NextCall = 0;
+static uint64_t g_NextCall = 0; /**< when the next timer is due (in msecs, see UtilMsecTime) */
 static CList<CTimer *> *g_Timers = NULL;
 
 /**
@@ -37,8 +37,9 @@ CTimer::CTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Coo
 	m_Repeat = Repeat;
 	m_Proc = Function;
 	m_Cookie = Cookie;
+	m_Next = 0;
 
-	Reschedule(g_CurrentTime + Interval);
+	RescheduleMsec(UtilMsecTime() + (uint64_t)Interval * 1000);
 
 	if (g_Timers == NULL) {
 		g_Timers = new CList<CTimer *>();
@@ -78,10 +79,12 @@ bool CTimer::Call(time_t Now) {
 	time_t ThisCall;
 	bool ReturnValue;
 
-	ThisCall = m_Next;
+	ThisCall = Now;
 
-	if (m_Interval != 0 && m_Repeat) {
-		Reschedule(Now + m_Interval);
+	if (m_Repeat) {
+		// repeating timers without an interval are called once per second,
+		// otherwise they would always be due and the main loop would spin
+		RescheduleMsec(UtilMsecTime() + (uint64_t)(m_Interval != 0 ? m_Interval : 1) * 1000);
 	}
 
 	if (m_Proc == NULL) {
@@ -111,8 +114,25 @@ bool CTimer::Call(time_t Now) {
  * Returns the next scheduled time of execution.
  */
 time_t CTimer::GetNextCall(void) {
+	uint64_t Now = UtilMsecTime();
+
 	if (g_NextCall == 0) {
 		return g_CurrentTime + 120;
+	} else if (g_NextCall <= Now) {
+		return g_CurrentTime;
+	} else {
+		return g_CurrentTime + (time_t)((g_NextCall - Now + 999) / 1000);
+	}
+}
+
+/**
+ * GetNextCallMsec
+ *
+ * Returns the next scheduled time of execution (in msecs, see UtilMsecTime).
+ */
+uint64_t CTimer::GetNextCallMsec(void) {
+	if (g_NextCall == 0) {
+		return UtilMsecTime() + 120 * 1000;
 	} else {
 		return g_NextCall;
 	}
@@ -144,10 +164,31 @@ bool CTimer::GetRepeat(void) const {
  * @param Next the next call
  */
 void CTimer::Reschedule(time_t Next) {
+	uint64_t Now = UtilMsecTime();
+
+	if (Next <= g_CurrentTime) {
+		RescheduleMsec(Now);
+	} else {
+		RescheduleMsec(Now + (uint64_t)(Next - g_CurrentTime) * 1000);
+	}
+}
+
+/**
+ * RescheduleMsec
+ *
+ * Reschedules the next call for the timer.
+ *
+ * @param Next the next call (in msecs, see UtilMsecTime)
+ */
+void CTimer::RescheduleMsec(uint64_t Next) {
+	bool WasNext = (m_Next == g_NextCall);
+
 	m_Next = Next;
 
 	if (Next < g_NextCall || g_NextCall == 0) {
 		g_NextCall = Next;
+	} else if (WasNext) {
+		RescheduleTimers();
 	}
 }
 
@@ -158,10 +199,12 @@ void CTimer::DestroyAllTimers(void) {
 }
 
 void CTimer::CallTimers(void) {
+	uint64_t Now = UtilMsecTime();
+
 	g_NextCall = 0;
 
 	for (CListCursor<CTimer *> TimerCursor(g_Timers); TimerCursor.IsValid(); TimerCursor.Proceed()) {
-		if (g_CurrentTime >= (*TimerCursor)->m_Next) {
+		if (Now >= (*TimerCursor)->m_Next) {
 			(*TimerCursor)->Call(g_CurrentTime);
 		} else if ((*TimerCursor)->m_Next < g_NextCall || g_NextCall == 0) {
 			g_NextCall = (*TimerCursor)->m_Next;
@@ -170,9 +213,9 @@ void CTimer::CallTimers(void) {
 }
 
 void CTimer::RescheduleTimers(void) {
-	time_t Best;
+	uint64_t Best;
 
-	Best = g_CurrentTime + 120;
+	Best = UtilMsecTime() + 120 * 1000;
 
 	for (CListCursor<CTimer *> TimerCursor(g_Timers); TimerCursor.IsValid(); TimerCursor.Proceed()) {
 		if ((*TimerCursor)->m_Next < Best) {
@@ -33,7 +33,7 @@ private:
 	void *m_Cookie; /**< a user-specific pointer which is passed to the timer's function */
 	unsigned int m_Interval; /**< the timer's interval */
 	bool m_Repeat; /**< determines whether the timer is executed repeatedly */
-	time_t m_Next; /**< the next scheduled time of execution */
+	uint64_t m_Next; /**< the next scheduled time of execution (in msecs, see UtilMsecTime) */
 	link_t<CTimer *> *m_Link; /**< link in the timer list */
 
 	bool Call(time_t Now);
@@ -46,6 +46,7 @@ public:
 #endif /* SWIG */
 
 	static time_t GetNextCall(void);
+	static uint64_t GetNextCallMsec(void);
 	static void DestroyAllTimers(void);
 	static void CallTimers(void);
 
@@ -53,6 +54,7 @@ public:
 	bool GetRepeat(void) const;
 
 	void Reschedule(time_t Next);
+	void RescheduleMsec(uint64_t Next);
 
 	void Destroy(void);
 };
@@ -19,9 +19,25 @@
 
 #include "StdAfx.h"
 
-extern time_t g_LastReconnect;
+/**
+ * UserSettingChanged
+ *
+ * Called when one of the user's cached settings has been changed.
+ *
+ * @param Option the ID of the setting
+ * @param Cookie the user
+ */
+static void UserSettingChanged(int Option, void *Cookie) {
+	CUser *User = (CUser *)Cookie;
 
-CTimer *g_ReconnectTimer = NULL;
+	if (Option == CacheId(User, admin)) {
+		g_Bouncer->GetAdminUsers()->Remove(User);
+
+		if (User->IsAdmin()) {
+			g_Bouncer->GetAdminUsers()->Insert(User);
+		}
+	}
+}
 
 /**
  * CUser
@@ -29,13 +45,13 @@ CTimer *g_ReconnectTimer = NULL;
  * Constructs a new user object.
  *
  * @param Name the name of the user
+ * @param Snapshot the user's settings and certificates if they have
+ *                 already been loaded, or NULL; the user object takes
+ *                 ownership of the snapshot's contents
  */
-CUser::CUser(const char *Name) {
+CUser::CUser(const char *Name, usersnapshot_t *Snapshot) {
 	char *Out;
-#ifdef HAVE_LIBSSL
-	X509 *Cert;
-	FILE *ClientCert;
-#endif
+	CHashtable<char *, false> *Settings = NULL;
 	int rc;
 
 	m_PrimaryClient = NULL;
@@ -53,7 +69,12 @@ CUser::CUser(const char *Name) {
 		g_Bouncer->Fatal();
 	}
 
-	m_Config = new CConfig(Out, this);
+	if (Snapshot != NULL) {
+		Settings = Snapshot->Settings;
+		Snapshot->Settings = NULL;
+	}
+
+	m_Config = new CConfig(Out, this, g_Bouncer->GetConfigStore(), Settings);
 
 	free(Out);
 
@@ -61,13 +82,16 @@ CUser::CUser(const char *Name) {
 		g_Bouncer->Fatal();
 	}
 
-	CacheInitialize(m_ConfigCache, m_Config, "user.");
+	CacheInitialize(m_ConfigCache, m_Config);
+	m_ConfigCache.Bg.RegisterCallback(UserSettingChanged, this);
 
 	m_IRC = NULL;
 
 	m_ReconnectTime = 0;
 	m_LastReconnect = 0;
-	m_NextProtocolFamily = AF_UNSPEC;
+	m_ReconnectIndex = -1;
+	m_ReconnectReserved = false;
+	m_ReconnectFailures = 0;
 
 	rc = asprintf(&Out, "users/%s.log", Name);
 
@@ -88,27 +112,28 @@ CUser::CUser(const char *Name) {
 
 	m_Keys = new CKeyring(m_Config, this);
 
-	m_BadLoginPulse = new CTimer(200, true, BadLoginTimer, this);
-
 #ifdef HAVE_LIBSSL
-	rc = asprintf(&Out, "users/%s.pem", Name);
-
-	if (RcFailed(rc)) {
-		g_Bouncer->Fatal();
-	}
-
-	ClientCert = fopen(g_Bouncer->BuildPathConfig(Out), "r");
+	if (Snapshot != NULL) {
+		for (int i = 0; i < Snapshot->Certificates.GetLength(); i++) {
+			m_ClientCertificates.Insert(Snapshot->Certificates[i]);
+		}
 
-	free(Out);
+		Snapshot->Certificates.Clear();
+	} else {
+		rc = asprintf(&Out, "users/%s.pem", Name);
 
-	if (ClientCert != NULL) {
-		while ((Cert = PEM_read_X509(ClientCert, NULL, NULL, NULL)) != NULL) {
-			m_ClientCertificates.Insert(Cert);
+		if (RcFailed(rc)) {
+			g_Bouncer->Fatal();
 		}
 
-		fclose(ClientCert);
+		LoadCertificates(g_Bouncer->BuildPathConfig(Out), &m_ClientCertificates);
+
+		free(Out);
 	}
 
+	for (int i = 0; i < m_ClientCertificates.GetLength(); i++) {
+		g_Bouncer->AddCertificateUser(m_ClientCertificates[i], this);
+	}
 #endif
 
 	if (IsQuitted() != 2) {
@@ -120,6 +145,36 @@ CUser::CUser(const char *Name) {
 	}
 }
 
+/**
+ * LoadCertificates
+ *
+ * Reads client certificates from a file. This function does not use
+ * any global state and can therefore be used by worker threads.
+ *
+ * @param Filename the path of the certificate file
+ * @param Certificates the list which the certificates are added to
+ */
+void CUser::LoadCertificates(const char *Filename, CVector<X509 *> *Certificates) {
+#ifdef HAVE_LIBSSL
+	X509 *Cert;
+	FILE *ClientCert;
+
+	ClientCert = fopen(Filename, "r");
+
+	if (ClientCert == NULL) {
+		return;
+	}
+
+	while ((Cert = PEM_read_X509(ClientCert, NULL, NULL, NULL)) != NULL) {
+		if (IsError(Certificates->Insert(Cert))) {
+			X509_free(Cert);
+		}
+	}
+
+	fclose(ClientCert);
+#endif
+}
+
 /**
  * ~CUser
  *
@@ -142,17 +197,17 @@ CUser::~CUser(void) {
 
 	free(m_Name);
 
-	if (m_BadLoginPulse != NULL) {
-		m_BadLoginPulse->Destroy();
-	}
-
 #ifdef HAVE_LIBSSL
 	for (int i = 0; i < m_ClientCertificates.GetLength(); i++) {
+		g_Bouncer->RemoveCertificateUser(m_ClientCertificates[i], this);
+
 		X509_free(m_ClientCertificates[i]);
 	}
 #endif
 
 	g_Bouncer->GetAdminUsers()->Remove(this);
+
+	g_Bouncer->GetReconnectPlanner()->Unqueue(this);
 }
 
 /**
@@ -217,6 +272,7 @@ void CUser::Attach(CClientConnection *Client) {
 	int i;
 	bool Added = false;
 	bool FirstClient;
+	uint64_t AttachStarted = UtilMsecTime();
 	int rc;
 
 	if (IsLocked()) {
@@ -328,33 +384,15 @@ void CUser::Attach(CClientConnection *Client) {
 
 			qsort(Channels, m_IRC->GetChannels()->GetLength(), sizeof(Channels[0]), SortFunction);
 
-			const char *Site = m_IRC->GetSite();
+			bool Backlog = Client->HasCapability("znc.in/server-time-iso") || (GetAutoBacklog() != NULL && strcasecmp(GetAutoBacklog(), "off") != 0);
 
-			i = 0;
-			for (i = 0; i < m_IRC->GetChannels()->GetLength(); i++) {
-				Client->WriteLine(":%s!%s JOIN %s", m_IRC->GetCurrentNick(), Site ? Site : "unknown@unknown.host", Channels[i]->GetName());
+			CAttachProducer *Burst = new CAttachProducer(Client, Channels, m_IRC->GetChannels()->GetLength(), Backlog);
 
-				rc = asprintf(&Out, "TOPIC %s", Channels[i]->GetName());
+			if (!AllocFailed(Burst)) {
+				Client->AddProducer(Burst);
 
-				if (RcFailed(rc)) {
-					Client->Kill("Internal error.");
-				} else {
-					Client->ParseLine(Out);
-					free(Out);
-				}
-
-				rc = asprintf(&Out, "NAMES %s", Channels[i]->GetName());
-
-				if (RcFailed(rc)) {
-					Client->Kill("Internal error.");
-				} else {
-					Client->ParseLine(Out);
-					free(Out);
-				}
-
-				if (Client->HasCapability("znc.in/server-time-iso") || (GetAutoBacklog() != NULL && strcasecmp(GetAutoBacklog(), "off") != 0)) {
-					Channels[i]->PlayBacklog(Client);
-				}
+				// the client is usable once the producer and the sendq have drained
+				Client->SetAttachStarted(AttachStarted, m_IRC->GetChannels()->GetLength());
 			}
 
 			free(Channels);
@@ -418,34 +456,153 @@ void CUser::Attach(CClientConnection *Client) {
  * @param Password a password
  */
 bool CUser::CheckPassword(const char *Password) {
-	const char *OriginalPassword = Password;
 	const char *RealPass = CacheGetString(m_ConfigCache, password);
+	bool Outdated;
 
 	if (RealPass == NULL || Password == NULL || strlen(Password) == 0) {
 		return false;
 	}
 
-	if (g_Bouncer->GetMD5()) {
-		Password = UtilMd5(Password, SaltFromHash(RealPass));
+	if (!g_Bouncer->GetMD5()) {
+		return (strcmp(RealPass, Password) == 0);
 	}
 
-	if (strcmp(RealPass, Password) == 0) {
-		return true;
-	} else {
-		if (g_Bouncer->GetMD5()) {
-			Password = UtilMd5(OriginalPassword, SaltFromHash(RealPass), true);
+	if (!UtilCheckPassword(Password, RealPass, &Outdated)) {
+		return false;
+	}
+
+	if (Outdated) {
+		SetPassword(Password);
 
-			if (strcmp(RealPass, Password) == 0) {
-				SetPassword(OriginalPassword);
+		g_Bouncer->Log("Updated password hash for user '%s'.", m_Name);
+	}
 
-				g_Bouncer->Log("Updated broken password for user '%s'.", m_Name);
+	return true;
+}
 
-				return true;
+/**
+ * FreePasswordCheck
+ *
+ * Frees a password check.
+ *
+ * @param Check the password check
+ */
+static void FreePasswordCheck(passwordcheck_t *Check) {
+	free(Check->User);
+	free(Check->Password);
+	free(Check->Hash);
+	free(Check->Salt);
+	free(Check->NewHash);
+	free(Check);
+}
+
+/**
+ * PasswordCheckProc
+ *
+ * Checks a password. This function is called by a worker thread.
+ *
+ * @param Cookie the password check
+ */
+static void PasswordCheckProc(void *Cookie) {
+	passwordcheck_t *Check = (passwordcheck_t *)Cookie;
+	bool Outdated;
+
+	Check->Valid = UtilCheckPassword(Check->Password, Check->Hash, &Outdated);
+
+	if (Check->Valid && Outdated) {
+		Check->NewHash = UtilHashPassword(Check->Password, Check->Salt);
+	}
+}
+
+/**
+ * PasswordCheckCompleted
+ *
+ * Stores the updated password hash (if any) and notifies the client
+ * about the result of a password check.
+ *
+ * @param Cookie the password check
+ */
+void CUser::PasswordCheckCompleted(void *Cookie) {
+	passwordcheck_t *Check = (passwordcheck_t *)Cookie;
+	CClientConnection *Client = Check->Client;
+	const char *RealPass;
+	CUser *User;
+
+	if (Check->NewHash != NULL) {
+		User = g_Bouncer->GetUser(Check->User);
+
+		if (User != NULL) {
+			RealPass = CacheGetString(User->m_ConfigCache, password);
+
+			// the password might have been changed in the meantime
+			if (RealPass != NULL && strcmp(RealPass, Check->Hash) == 0) {
+				CacheSetString(User->m_ConfigCache, password, Check->NewHash);
+				User->m_Config->Flush();
+
+				g_Bouncer->Log("Updated password hash for user '%s'.", User->GetUsername());
 			}
 		}
+	}
+
+	if (Client != NULL) {
+		Client->m_PasswordCheck = NULL;
+		Client->PasswordChecked(Check->Valid);
+	}
+
+	FreePasswordCheck(Check);
+}
+
+/**
+ * CheckPasswordAsync
+ *
+ * Checks whether this user's password and the supplied password match
+ * using a worker thread. CClientConnection::PasswordChecked() is called
+ * once the password has been checked. Returns false if the check could not
+ * be started, in which case CheckPassword() should be used instead.
+ *
+ * @param Password a password
+ * @param Client the client which supplied the password
+ */
+bool CUser::CheckPasswordAsync(const char *Password, CClientConnection *Client) {
+	const char *RealPass = CacheGetString(m_ConfigCache, password);
+	passwordcheck_t *Check;
+
+	if (RealPass == NULL || Password == NULL || strlen(Password) == 0 || !g_Bouncer->GetMD5()) {
+		return false;
+	}
+
+	Check = (passwordcheck_t *)malloc(sizeof(passwordcheck_t));
 
+	if (AllocFailed(Check)) {
 		return false;
 	}
+
+	Check->User = strdup(m_Name);
+	Check->Password = strdup(Password);
+	Check->Hash = strdup(RealPass);
+	Check->Salt = strdup(GenerateSalt());
+	Check->Valid = false;
+	Check->NewHash = NULL;
+	Check->Client = Client;
+
+	if (AllocFailed(Check->User) || AllocFailed(Check->Password) || AllocFailed(Check->Hash) || AllocFailed(Check->Salt)) {
+		FreePasswordCheck(Check);
+
+		return false;
+	}
+
+	// the completion might be called right away if there are no worker threads
+	Client->m_PasswordCheck = Check;
+
+	if (IsError(g_Bouncer->GetWorkerPool()->Submit(PasswordCheckProc, Check, PasswordCheckCompleted))) {
+		Client->m_PasswordCheck = NULL;
+
+		FreePasswordCheck(Check);
+
+		return false;
+	}
+
+	return true;
 }
 
 /**
@@ -597,7 +754,7 @@ bool CUser::IsRegisteredClientConnection(CClientConnection *Client) {
  */
 void CUser::Reconnect(void) {
 	const char *Server;
-	int Port, i;
+	int Port;
 
 	if (m_IRC != NULL) {
 		m_IRC->Kill("Reconnecting.");
@@ -616,28 +773,9 @@ void CUser::Reconnect(void) {
 
 	g_Bouncer->LogUser(this, "Trying to reconnect to [%s]:%d for user %s", Server, Port, m_Name);
 
-	i = 0;
-	while (hash_t<CUser *> *UserHash = g_Bouncer->GetUsers()->Iterate(i++)) {
-		CIRCConnection *IRC;
-
-		IRC = UserHash->Value->GetIRCConnection();
-
-		if (IRC != NULL && IRC->GetState() != State_Connected) {
-			IRC->Kill("Timed out.");
-		}
-	}
-
 	m_LastReconnect = g_CurrentTime;
 
-	const char *BindIp = GetVHost();
-
-	if (BindIp == NULL || BindIp[0] == '\0') {
-		BindIp = g_Bouncer->GetDefaultVHost();
-	}
-
-	if (BindIp != NULL && BindIp[0] == '\0') {
-		BindIp = NULL;
-	}
+	const char *BindIp = GetBindIp();
 
 	if (GetIdent() != NULL) {
 		g_Bouncer->SetIdent(GetIdent());
@@ -645,7 +783,7 @@ void CUser::Reconnect(void) {
 		g_Bouncer->SetIdent(m_Name);
 	}
 
-	CIRCConnection *Connection = new CIRCConnection(Server, Port, this, BindIp, GetSSL(), m_NextProtocolFamily);
+	CIRCConnection *Connection = new CIRCConnection(Server, Port, this, BindIp, GetSSL(), AF_UNSPEC);
 
 	if (AllocFailed(Connection)) {
 		return;
@@ -662,19 +800,12 @@ void CUser::Reconnect(void) {
  * Determines whether this user should reconnect (yet).
  */
 bool CUser::ShouldReconnect(void) const {
-	int Interval = g_Bouncer->GetInterval();
-
 	if (GetServer() == NULL) {
 		return false;
 	}
 
-	if (Interval == 0) {
-		Interval = 25;
-	}
-
 	if (m_IRC == NULL && m_ReconnectTime <= g_CurrentTime &&
-			(IsAdmin() || g_CurrentTime - m_LastReconnect > 120) &&
-			g_CurrentTime - g_LastReconnect > Interval && IsQuitted() == 0) {
+			(IsAdmin() || g_CurrentTime - m_LastReconnect > 120) && IsQuitted() == 0) {
 		return true;
 	} else {
 		return false;
@@ -689,7 +820,7 @@ bool CUser::ShouldReconnect(void) const {
  * @param Delay the delay
  */
 void CUser::ScheduleReconnect(int Delay) {
-	int MaxDelay, Interval;
+	int MaxDelay, Backoff;
 
 	if (m_IRC != NULL) {
 		return;
@@ -698,14 +829,10 @@ void CUser::ScheduleReconnect(int Delay) {
 	UnmarkQuitted();
 
 	MaxDelay = Delay;
-	Interval = g_Bouncer->GetInterval();
+	Backoff = (int)(m_LastReconnect + GetReconnectBackoff() - g_CurrentTime);
 
-	if (Interval == 0) {
-		Interval = 15;
-	}
-
-	if (g_CurrentTime - g_LastReconnect < Interval && MaxDelay < Interval) {
-		MaxDelay = Interval;
+	if (MaxDelay < Backoff) {
+		MaxDelay = Backoff;
 	}
 
 	if (g_CurrentTime - m_LastReconnect < 120 && MaxDelay < 120 && !IsAdmin()) {
@@ -714,10 +841,12 @@ void CUser::ScheduleReconnect(int Delay) {
 
 	if (m_ReconnectTime < g_CurrentTime + MaxDelay) {
 		m_ReconnectTime = g_CurrentTime + MaxDelay;
-
-		RescheduleReconnectTimer();
+		m_ReconnectReserved = false;
 	}
 
+	g_Bouncer->GetReconnectPlanner()->Queue(this);
+	RescheduleReconnectTimer();
+
 	if (GetServer() != NULL && GetClientConnectionMultiplexer() != NULL) {
 		char *Out;
 		int rc = asprintf(&Out, "Scheduled reconnect in %d seconds.", (int)(m_ReconnectTime - g_CurrentTime));
@@ -730,6 +859,24 @@ void CUser::ScheduleReconnect(int Delay) {
 	}
 }
 
+/**
+ * GetReconnectBackoff
+ *
+ * Returns the minimum number of seconds between the user's last connect
+ * attempt and the next one. The delay doubles with every failed connect.
+ */
+int CUser::GetReconnectBackoff(void) const {
+	if (m_ReconnectFailures == 0) {
+		return 0;
+	}
+
+	if (m_ReconnectFailures > 10) {
+		return RECONNECT_BACKOFF_MAX;
+	}
+
+	return min(RECONNECT_BACKOFF_MIN << (m_ReconnectFailures - 1), RECONNECT_BACKOFF_MAX);
+}
+
 /**
  * GetIRCUptime
  *
@@ -818,14 +965,6 @@ void CUser::SetIRCConnection(CIRCConnection *IRC) {
 	} else {
 		WasNull = false;
 
-		if (m_IRC->GetState() == State_Connecting) {
-			if (m_NextProtocolFamily == AF_INET) {
-				m_NextProtocolFamily = AF_UNSPEC;
-			} else {
-				m_NextProtocolFamily = AF_INET;
-			}
-		}
-
 		m_IRC->SetOwner(NULL);
 	}
 
@@ -870,6 +1009,30 @@ void CUser::SetIRCConnection(CIRCConnection *IRC) {
 
 		IRC->SetTrafficStats(m_IRCStats);
 	}
+
+	if (IRC != NULL) {
+		g_Bouncer->GetReconnectPlanner()->Unqueue(this);
+	} else if (!WasNull) {
+		// connections which fail before they have been registered (or
+		// shortly afterwards) increase the backoff for the next attempt
+		if (OldIRC->GetState() == State_Connected && g_CurrentTime - m_LastReconnect >= RECONNECT_STABLE) {
+			m_ReconnectFailures = 0;
+		} else {
+			m_ReconnectFailures++;
+		}
+
+		if (IsQuitted() == 0) {
+			time_t ReconnectTime = max(g_CurrentTime, m_LastReconnect + GetReconnectBackoff()) + rand() % (RECONNECT_JITTER + 1);
+
+			if (m_ReconnectTime < ReconnectTime) {
+				m_ReconnectTime = ReconnectTime;
+				m_ReconnectReserved = false;
+			}
+
+			g_Bouncer->GetReconnectPlanner()->Queue(this);
+			RescheduleReconnectTimer();
+		}
+	}
 }
 
 /**
@@ -1112,13 +1275,8 @@ CVector<client_t> *CUser::GetClientConnections(void) {
  * @param Admin a boolean flag
  */
 void CUser::SetAdmin(bool Admin) {
+	// UserSettingChanged updates the list of admins
 	CacheSetInteger(m_ConfigCache, admin, Admin ? 1 : 0);
-
-	if (Admin) {
-		g_Bouncer->GetAdminUsers()->Insert(this);
-	} else {
-		g_Bouncer->GetAdminUsers()->Remove(this);
-	}
 }
 
 /**
@@ -1142,11 +1300,23 @@ bool CUser::IsAdmin(void) const {
  * @param Password the new password
  */
 void CUser::SetPassword(const char *Password) {
+	char *Hash = NULL;
+
 	if (g_Bouncer->GetMD5()) {
-		Password = UtilMd5(Password, GenerateSalt());
+		Hash = UtilHashPassword(Password, GenerateSalt());
+
+		if (AllocFailed(Hash)) {
+			return;
+		}
+
+		Password = Hash;
 	}
 
 	CacheSetString(m_ConfigCache, password, Password);
+
+	m_Config->Flush();
+
+	free(Hash);
 }
 
 /**
@@ -1270,31 +1440,13 @@ int CUser::IsQuitted(void) const {
 /**
  * LogBadLogin
  *
- * Logs a bad login attempt.
+ * Logs a bad login attempt. Failed logins are counted per address
+ * for all users.
  *
  * @param Peer the IP address of the client
  */
 void CUser::LogBadLogin(sockaddr *Peer) {
-	badlogin_t BadLogin;
-
-	for (int i = 0; i < m_BadLogins.GetLength(); i++) {
-		if (CompareAddress(m_BadLogins[i].Address, Peer) == 0 && m_BadLogins[i].Count < 3) {
-			m_BadLogins[i].Count++;
-
-			return;
-		}
-	}
-
-	BadLogin.Count = 1;
-	BadLogin.Address = (sockaddr *)malloc(SOCKADDR_LEN(Peer->sa_family));
-
-	if (AllocFailed(BadLogin.Address)) {
-		return;
-	}
-
-	memcpy(BadLogin.Address, Peer, SOCKADDR_LEN(Peer->sa_family));
-
-	m_BadLogins.Insert(BadLogin);
+	g_Bouncer->GetReputationTable()->LogBadLogin(Peer);
 }
 
 /**
@@ -1305,35 +1457,7 @@ void CUser::LogBadLogin(sockaddr *Peer) {
  * @param Peer the IP address
  */
 bool CUser::IsIpBlocked(sockaddr *Peer) const {
-	for (int i = 0; i < m_BadLogins.GetLength(); i++) {
-		if (CompareAddress(m_BadLogins[i].Address, Peer) == 0) {
-			if (m_BadLogins[i].Count > 2) {
-				return true;
-			} else {
-				return false;
-			}
-		}
-	}
-
-	return false;
-}
-
-/**
- * BadLoginPulse
- *
- * Periodically expires old "bad logins".
- */
-void CUser::BadLoginPulse(void) {
-	for (int i = m_BadLogins.GetLength() - 1; i >= 0; i--) {
-		if (m_BadLogins[i].Count > 0) {
-			m_BadLogins[i].Count--;
-
-			if (m_BadLogins[i].Count <= 0) {
-				free(m_BadLogins[i].Address);
-				m_BadLogins.Remove(i);
-			}
-		}
-	}
+	return g_Bouncer->GetReputationTable()->IsBlocked(Peer);
 }
 
 /**
@@ -1363,20 +1487,6 @@ CKeyring *CUser::GetKeyring(void) {
 	return m_Keys;
 }
 
-/**
- * BadLoginTimer
- *
- * Thunks calls to the BadLoginPulse() functions.
- *
- * @param Now the current time
- * @param User a CUser object
- */
-bool BadLoginTimer(time_t Now, void *User) {
-	((CUser *)User)->BadLoginPulse();
-
-	return true;
-}
-
 /**
  * UserReconnectTimer
  *
@@ -1386,25 +1496,12 @@ bool BadLoginTimer(time_t Now, void *User) {
  * @param User a CUser object
  */
 bool UserReconnectTimer(time_t Now, void *User) {
-	int Interval;
-
 	if (((CUser *)User)->GetIRCConnection() != NULL) {
 		return false;
 	}
 
-	Interval = g_Bouncer->GetInterval();
-
-	if (Interval == 0) {
-		Interval = 15;
-	}
-
-	if (g_CurrentTime - g_LastReconnect > Interval) {
-		((CUser *)User)->Reconnect();
-	} else {
-		((CUser*)User)->ScheduleReconnect(Interval);
-	}
-
-	((CUser *)User)->m_ReconnectTime = g_CurrentTime;
+	// the reconnect planner decides when the user is actually reconnected
+	((CUser *)User)->ScheduleReconnect(0);
 
 	return false;
 }
@@ -1468,6 +1565,27 @@ const char *CUser::GetVHost(void) const {
 	return CacheGetString(m_ConfigCache, ip);
 }
 
+/**
+ * GetBindIp
+ *
+ * Returns the address which is used for binding the user's IRC
+ * connection, or NULL if the user doesn't have a vhost and there is
+ * no default vhost.
+ */
+const char *CUser::GetBindIp(void) const {
+	const char *BindIp = GetVHost();
+
+	if (BindIp == NULL || BindIp[0] == '\0') {
+		BindIp = g_Bouncer->GetDefaultVHost();
+	}
+
+	if (BindIp != NULL && BindIp[0] == '\0') {
+		BindIp = NULL;
+	}
+
+	return BindIp;
+}
+
 /**
  * SetVHost
  *
@@ -1634,6 +1752,8 @@ bool CUser::AddClientCertificate(const X509 *Certificate) {
 
 	m_ClientCertificates.Insert(DuplicateCertificate);
 
+	g_Bouncer->AddCertificateUser(DuplicateCertificate, this);
+
 	return PersistCertificates();
 #else
 	return false;
@@ -1651,6 +1771,8 @@ bool CUser::RemoveClientCertificate(const X509 *Certificate) {
 #ifdef HAVE_LIBSSL
 	for (int i = 0; i < m_ClientCertificates.GetLength(); i++) {
 		if (X509_cmp(m_ClientCertificates[i], Certificate) == 0) {
+			g_Bouncer->RemoveCertificateUser(m_ClientCertificates[i], this);
+
 			X509_free(m_ClientCertificates[i]);
 
 			m_ClientCertificates.Remove(i);
@@ -1792,24 +1914,11 @@ void CUser::SetIdent(const char *Ident) {
  * @param Tag the name of the tag
  */
 const char *CUser::GetTagString(const char *Tag) const {
-	char *Setting;
-	const char *Value;
-
 	if (Tag == NULL) {
 		return NULL;
 	}
 
-	int rc = asprintf(&Setting, "tag.%s", Tag);
-
-	if (RcFailed(rc)) {
-		return NULL;
-	}
-
-	Value = m_Config->ReadString(Setting);
-
-	free(Setting);
-
-	return Value;
+	return m_Config->ReadPrefixedString("tag.", Tag);
 }
 
 /**
@@ -1993,45 +2102,13 @@ const char *CUser::SimulateWithResult(const char *Command) {
 	return FakeClient->GetData();
 }
 
-bool GlobalUserReconnectTimer(time_t Now, void *Null) {
-	int i = rand() % g_Bouncer->GetUsers()->GetLength();
-
-	while (hash_t<CUser *> *UserHash = g_Bouncer->GetUsers()->Iterate(i++)) {
-		if (UserHash->Value->ShouldReconnect() && g_Bouncer->GetStatus() == Status_Running) {
-			UserHash->Value->Reconnect();
-
-			break;
-		}
-	}
-
-	CUser::RescheduleReconnectTimer();
-
-	return true;
-}
-
+/**
+ * RescheduleReconnectTimer
+ *
+ * Reschedules the reconnect planner's timer.
+ */
 void CUser::RescheduleReconnectTimer(void) {
-	int i = 0;
-	time_t ReconnectTime;
-
-	if (g_ReconnectTimer == NULL) {
-		g_ReconnectTimer = new CTimer(20, true, GlobalUserReconnectTimer, NULL);
-	}
-
-	ReconnectTime = g_ReconnectTimer->GetNextCall();
-
-	if (g_Bouncer->GetStatus() == Status_Running) {
-		while (hash_t<CUser *> *UserHash = g_Bouncer->GetUsers()->Iterate(i++)) {
-			if (UserHash->Value->m_ReconnectTime >= g_CurrentTime &&
-					UserHash->Value->m_ReconnectTime < ReconnectTime &&
-					UserHash->Value->GetIRCConnection() == NULL) {
-				ReconnectTime = UserHash->Value->m_ReconnectTime;
-			} else if (UserHash->Value->ShouldReconnect()) {
-				UserHash->Value->Reconnect();
-			}
-		}
-	}
-
-	g_ReconnectTimer->Reschedule(ReconnectTime);
+	g_Bouncer->GetReconnectPlanner()->Reschedule();
 }
 
 void CUser::SetUseQuitReason(bool Value) {
@@ -31,35 +31,41 @@ class CTimer;
 /**
  * Cache: User
  */
-DEFINE_CACHE(User)
-	DEFINE_OPTION_INT(quitted);
-	DEFINE_OPTION_INT(admin);
-	DEFINE_OPTION_INT(port);
-	DEFINE_OPTION_INT(lock);
-	DEFINE_OPTION_INT(seen);
-	DEFINE_OPTION_INT(delayjoin);
-	DEFINE_OPTION_INT(ssl);
-	DEFINE_OPTION_INT(ignsysnotices);
-	DEFINE_OPTION_INT(lean);
-	DEFINE_OPTION_INT(quitaway);
-
-	DEFINE_OPTION_STRING(automodes);
-	DEFINE_OPTION_STRING(dropmodes);
-	DEFINE_OPTION_STRING(password);
-	DEFINE_OPTION_STRING(away);
-	DEFINE_OPTION_STRING(awaynick);
-	DEFINE_OPTION_STRING(nick);
-	DEFINE_OPTION_STRING(realname);
-	DEFINE_OPTION_STRING(server);
-	DEFINE_OPTION_STRING(ip);
-	DEFINE_OPTION_STRING(channels);
-	DEFINE_OPTION_STRING(suspend);
-	DEFINE_OPTION_STRING(spass);
-	DEFINE_OPTION_STRING(ident);
-	DEFINE_OPTION_STRING(awaymessage);
-	DEFINE_OPTION_STRING(channelsort);
-	DEFINE_OPTION_STRING(autobacklog);
-END_DEFINE_CACHE
+#define USER_OPTIONS(INT, STRING) \
+	INT(quitted) \
+	INT(admin) \
+	INT(port) \
+	INT(lock) \
+	INT(seen) \
+	INT(delayjoin) \
+	INT(ssl) \
+	INT(ignsysnotices) \
+	INT(lean) \
+	INT(quitaway) \
+	INT(maxchannels) \
+	INT(maxnicks) \
+	INT(maxbans) \
+	INT(maxkeys) \
+	INT(maxclients) \
+	\
+	STRING(automodes) \
+	STRING(dropmodes) \
+	STRING(password) \
+	STRING(away) \
+	STRING(awaynick) \
+	STRING(nick) \
+	STRING(realname) \
+	STRING(server) \
+	STRING(ip) \
+	STRING(channels) \
+	STRING(suspend) \
+	STRING(spass) \
+	STRING(ident) \
+	STRING(awaymessage) \
+	STRING(channelsort) \
+	STRING(autobacklog)
+
+DEFINE_CACHE(User, "user.", USER_OPTIONS)
 
 /**
  * client_t
@@ -72,18 +78,37 @@ typedef struct client_s {
 } client_t;
 
 /**
- * badlogin_t
+ * usersnapshot_t
+ *
+ * The settings and client certificates of a user which have been
+ * loaded in advance (e.g. by a worker thread during startup).
+ */
+typedef struct usersnapshot_s {
+	const char *Name; /**< the name of the user */
+	char *ConfigPath; /**< the path of the user's config file, or NULL if
+						   the settings are kept in the config store */
+	char *CertificatePath; /**< the path of the user's certificate file */
+	CHashtable<char *, false> *Settings; /**< the user's settings, or NULL */
+	CVector<X509 *> Certificates; /**< the user's client certificates */
+	bool Failed; /**< whether the settings could not be loaded */
+} usersnapshot_t;
+
+/**
+ * passwordcheck_t
  *
- * Describes a failed login attempt.
+ * A password check which is performed by a worker thread.
  */
-typedef struct badlogin_s {
-	sockaddr *Address; /**< the address of the user */
-	unsigned int Count; /**< the number of times the user has used an
-							 incorrect password */
-} badlogin_t;
+typedef struct passwordcheck_s {
+	char *User; /**< the name of the user */
+	char *Password; /**< the password which was supplied by the client */
+	char *Hash; /**< the user's password hash */
+	char *Salt; /**< the salt which is used if the hash has to be updated */
+	bool Valid; /**< whether the password is correct */
+	char *NewHash; /**< a new hash for the password, or NULL */
+	CClientConnection *Client; /**< the client, or NULL if it was destroyed */
+} passwordcheck_t;
 
 #ifndef SWIG
-bool BadLoginTimer(time_t Now, void *User);
 bool UserReconnectTimer(time_t Now, void *User);
 #endif /* SWIG */
 
@@ -119,8 +144,8 @@ bool UserReconnectTimer(time_t Now, void *User);
  */
 class SBNCAPI CUser {
 	friend class CCore;
+	friend class CReconnectPlanner;
 #ifndef SWIG
-	friend bool BadLoginTimer(time_t Now, void *User);
 	friend bool UserReconnectTimer(time_t Now, void *User);
 #endif /* SWIG */
 
@@ -136,30 +161,28 @@ class SBNCAPI CUser {
 
 	time_t m_ReconnectTime; /**< when the next connect() attempt is going to be made */
 	time_t m_LastReconnect; /**< when the last connect() attempt was made for this user */
-
-	CVector<badlogin_t> m_BadLogins; /**< a list of failed login attempts for this user */
+	int m_ReconnectIndex; /**< the user's index in the reconnect queue, or -1 */
+	bool m_ReconnectReserved; /**< whether m_ReconnectTime is a slot which has been reserved by the reconnect planner */
+	unsigned int m_ReconnectFailures; /**< the number of failed connects since the last stable connection */
 
 	CTrafficStats *m_ClientStats; /**< traffic stats for the user's client connection(s) */
 	CTrafficStats *m_IRCStats; /**< traffic stats for the user's irc connection(s) */
 
 	CKeyring *m_Keys; /**< a list of channel keys */
 
-	CTimer *m_BadLoginPulse; /**< a timer which will remove "bad logins" */
-
 	CVector<X509 *> m_ClientCertificates; /**< the client certificates for the user */
 
-	int m_NextProtocolFamily; /**< which protocol family to try next */
-
 	bool PersistCertificates(void);
 
-	void BadLoginPulse(void);
+	static void PasswordCheckCompleted(void *Cookie);
 public:
 #ifndef SWIG
-	CUser(const char *Name);
+	CUser(const char *Name, usersnapshot_t *Snapshot = NULL);
 	virtual ~CUser(void);
 #endif /* SWIG */
 
 	static void RescheduleReconnectTimer(void);
+	static void LoadCertificates(const char *Filename, CVector<X509 *> *Certificates);
 
 	CClientConnection *GetPrimaryClientConnection(void);
 	CClientConnection *GetClientConnectionMultiplexer(void);
@@ -168,6 +191,9 @@ public:
 	CIRCConnection *GetIRCConnection(void);
 
 	bool CheckPassword(const char *Password);
+#ifndef SWIG
+	bool CheckPasswordAsync(const char *Password, CClientConnection *Client);
+#endif /* SWIG */
 	void Attach(CClientConnection *Client);
 
 	const char *GetNick(void) const;
@@ -186,6 +212,7 @@ public:
 
 	bool ShouldReconnect(void) const;
 	void ScheduleReconnect(int Delay = 10);
+	int GetReconnectBackoff(void) const;
 
 	unsigned int GetIRCUptime(void) const;
 
@@ -237,6 +264,7 @@ public:
 	void SetAwayText(const char *Reason);
 
 	const char *GetVHost(void) const;
+	const char *GetBindIp(void) const;
 	void SetVHost(const char *VHost);
 
 	int GetDelayJoin(void) const;
@@ -289,8 +317,6 @@ public:
 	void SetChannelSortMode(const char *Mode);
 	const char *GetChannelSortMode(void) const;
 
-	void SwitchProtocolFamily(void);
-
 	void SetAutoBacklog(const char *Value);
 	const char *GetAutoBacklog(void);
 };
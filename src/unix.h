@@ -31,6 +31,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <sys/file.h>
 #include <netinet/in.h>
@@ -43,6 +44,10 @@
 #include <termios.h>
 #include <strings.h>
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#	include <pthread.h>
+#endif
+
 typedef int SOCKET;
 
 #define SD_BOTH SHUT_RDWR
@@ -520,14 +520,17 @@ char *NickFromHostmask(const char *Hostmask) {
  * @param Port the port this socket should listen on
  * @param BindIp the IP address this socket should be bound to
  * @param Family address family (i.e. IPv4 or IPv6)
+ * @param Backlog the size of the listen backlog
+ * @param ReusePort whether other sockets may be bound to the same port (using SO_REUSEPORT)
  */
-SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family) {
+SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family, int Backlog, bool ReusePort) {
 	sockaddr *saddr;
 	sockaddr_in sin;
 #ifdef HAVE_IPV6
 	sockaddr_in6 sin6;
 #endif /* HAVE_IPV6 */
 	const int optTrue = 1;
+	unsigned long lTrue = 1;
 	bool Bound = false;
 	SOCKET Listener;
 	hostent *hent;
@@ -542,6 +545,15 @@ SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family) {
 	setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, (char *)&optTrue, sizeof(optTrue));
 #endif
 
+#ifdef SO_REUSEPORT
+	if (ReusePort) {
+		setsockopt(Listener, SOL_SOCKET, SO_REUSEPORT, (char *)&optTrue, sizeof(optTrue));
+	}
+#endif /* SO_REUSEPORT */
+
+	// listeners accept connections until accept() fails
+	ioctlsocket(Listener, FIONBIO, &lTrue);
+
 #ifdef HAVE_IPV6
 	if (Family == AF_INET) {
 #endif /* HAVE_IPV6 */
@@ -605,7 +617,7 @@ SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family) {
 		return INVALID_SOCKET;
 	}
 
-	if (listen(Listener, SOMAXCONN) != 0) {
+	if (listen(Listener, Backlog) != 0) {
 		closesocket(Listener);
 
 		return INVALID_SOCKET;
@@ -615,16 +627,18 @@ SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family) {
 }
 
 /**
- * UtilSaltedMd5
+ * Md5Hex
  *
- * Computes the MD5 hash of a given string and returns
- * a string representation of the hash.
+ * Computes the MD5 hash of a salted string. This function does not use
+ * any of the bouncer's objects and can be used by worker threads.
  *
  * @param String the string which should be hashed
- * @param Salt the salt value
+ * @param Salt the salt value, or NULL
  * @param BrokenAlgo whether to use the broken algorithm
+ * @param Result a buffer for the hex representation of the hash (at
+ *               least 33 characters)
  */
-const char *UtilMd5(const char *String, const char *Salt, bool BrokenAlgo) {
+static bool Md5Hex(const char *String, const char *Salt, bool BrokenAlgo, char *Result) {
 #ifdef HAVE_LIBSSL
 	MD5_CTX context;
 #else /* HAVE_LIBSSL */
@@ -632,20 +646,17 @@ const char *UtilMd5(const char *String, const char *Salt, bool BrokenAlgo) {
 #endif /* HAVE_LIBSSL */
 	broken_sMD5_CTX broken_context;
 	unsigned char digest[16];
-	char *StringAndSalt, *StringPtr;
-	static char *SaltAndResult = NULL;
+	char *StringAndSalt;
 	int rc;
 
-	free(SaltAndResult);
-
 	if (Salt != NULL) {
 		rc = asprintf(&StringAndSalt, "%s%s", String, Salt);
 	} else {
 		rc = asprintf(&StringAndSalt, "%s", String);
 	}
 
-	if (RcFailed(rc)) {
-		g_Bouncer->Fatal();
+	if (rc < 0) {
+		return false;
 	}
 
 	if (!BrokenAlgo) {
@@ -666,6 +677,30 @@ const char *UtilMd5(const char *String, const char *Salt, bool BrokenAlgo) {
 
 	free(StringAndSalt);
 
+	for (int i = 0; i < 16; i++) {
+		/* TODO: don't use sprintf */
+		sprintf(Result + i * 2, "%02x", digest[i]);
+	}
+
+	return true;
+}
+
+/**
+ * UtilSaltedMd5
+ *
+ * Computes the MD5 hash of a given string and returns
+ * a string representation of the hash.
+ *
+ * @param String the string which should be hashed
+ * @param Salt the salt value
+ * @param BrokenAlgo whether to use the broken algorithm
+ */
+const char *UtilMd5(const char *String, const char *Salt, bool BrokenAlgo) {
+	char *StringPtr;
+	static char *SaltAndResult = NULL;
+
+	free(SaltAndResult);
+
 	if (Salt != NULL) {
 		SaltAndResult = (char *)malloc(strlen(Salt) + 50);
 
@@ -684,14 +719,190 @@ const char *UtilMd5(const char *String, const char *Salt, bool BrokenAlgo) {
 		}
 	}
 
-	for (int i = 0; i < 16; i++) {
-		/* TODO: don't use sprintf */
-		sprintf(StringPtr + i * 2, "%02x", digest[i]);
+	if (!Md5Hex(String, Salt, BrokenAlgo, StringPtr)) {
+		g_Bouncer->Fatal();
 	}
 
 	return SaltAndResult;
 }
 
+#ifdef HAVE_EVP_PBE_SCRYPT
+/**
+ * ScryptHex
+ *
+ * Derives a key from a password using scrypt. This function can be used
+ * by worker threads.
+ *
+ * @param Password the password
+ * @param Salt the salt value
+ * @param LogN log2 of the cost parameter
+ * @param R the block size
+ * @param P the parallelization parameter
+ * @param Result a buffer for the hex representation of the key (at
+ *               least 2 * PASSWORD_KEYLENGTH + 1 characters)
+ */
+static bool ScryptHex(const char *Password, const char *Salt, int LogN, int R, int P, char *Result) {
+	unsigned char Key[PASSWORD_KEYLENGTH];
+	uint64_t N = (uint64_t)1 << LogN;
+
+	if (EVP_PBE_scrypt(Password, strlen(Password), (const unsigned char *)Salt, strlen(Salt),
+			N, R, P, 128 * (uint64_t)R * (N + P + 2), Key, sizeof(Key)) != 1) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < sizeof(Key); i++) {
+		sprintf(Result + i * 2, "%02x", Key[i]);
+	}
+
+	return true;
+}
+#endif /* HAVE_EVP_PBE_SCRYPT */
+
+/**
+ * UtilHashPassword
+ *
+ * Hashes a password using scrypt (or salted MD5 if scrypt is not available).
+ * The caller is responsible for freeing the returned string. This function
+ * can be used by worker threads.
+ *
+ * @param Password the password
+ * @param Salt the salt value (see GenerateSalt())
+ */
+char *UtilHashPassword(const char *Password, const char *Salt) {
+	char *Hash;
+	int rc;
+
+#ifdef HAVE_EVP_PBE_SCRYPT
+	char Key[2 * PASSWORD_KEYLENGTH + 1];
+
+	if (!ScryptHex(Password, Salt, PASSWORD_SCRYPT_LOGN, PASSWORD_SCRYPT_R, PASSWORD_SCRYPT_P, Key)) {
+		return NULL;
+	}
+
+	rc = asprintf(&Hash, "$scrypt$%d$%d$%d$%s$%s", PASSWORD_SCRYPT_LOGN, PASSWORD_SCRYPT_R,
+		PASSWORD_SCRYPT_P, Salt, Key);
+#else /* HAVE_EVP_PBE_SCRYPT */
+	char Digest[33];
+
+	if (!Md5Hex(Password, Salt, false, Digest)) {
+		return NULL;
+	}
+
+	rc = asprintf(&Hash, "%s$%s", Salt, Digest);
+#endif /* HAVE_EVP_PBE_SCRYPT */
+
+	if (rc < 0) {
+		return NULL;
+	}
+
+	return Hash;
+}
+
+/**
+ * UtilCheckPassword
+ *
+ * Checks whether a password matches a hash which was created by
+ * UtilHashPassword() or UtilMd5(). This function can be used by
+ * worker threads.
+ *
+ * @param Password the password
+ * @param Hash the hash
+ * @param Outdated is set to true if the password is correct and the hash
+ *                 should be replaced by a new one from UtilHashPassword()
+ */
+bool UtilCheckPassword(const char *Password, const char *Hash, bool *Outdated) {
+	const char *Expected, *HashSign;
+	char *Salt = NULL;
+	char Result[2 * PASSWORD_KEYLENGTH + 1];
+	unsigned char Difference = 0;
+	size_t Length;
+	bool Valid;
+
+	*Outdated = false;
+
+	if (strncmp(Hash, "$scrypt$", 8) == 0) {
+#ifdef HAVE_EVP_PBE_SCRYPT
+		int LogN, R, P, Offset = 0;
+
+		if (sscanf(Hash + 8, "%d$%d$%d$%n", &LogN, &R, &P, &Offset) != 3 || Offset == 0 ||
+				LogN < 1 || LogN > 24 || R < 1 || R > 64 || P < 1 || P > 16) {
+			return false;
+		}
+
+		HashSign = strchr(Hash + 8 + Offset, '$');
+
+		if (HashSign == NULL) {
+			return false;
+		}
+
+		Salt = strdup(Hash + 8 + Offset);
+
+		if (Salt == NULL) {
+			return false;
+		}
+
+		Salt[HashSign - (Hash + 8 + Offset)] = '\0';
+
+		Valid = ScryptHex(Password, Salt, LogN, R, P, Result);
+
+		*Outdated = (LogN != PASSWORD_SCRYPT_LOGN || R != PASSWORD_SCRYPT_R || P != PASSWORD_SCRYPT_P);
+#else /* HAVE_EVP_PBE_SCRYPT */
+		return false;
+#endif /* HAVE_EVP_PBE_SCRYPT */
+	} else {
+		// old hashes are "salt$md5" or just "md5"
+		HashSign = strchr(Hash, '$');
+
+		if (HashSign != NULL) {
+			Salt = strdup(Hash);
+
+			if (Salt == NULL) {
+				return false;
+			}
+
+			Salt[HashSign - Hash] = '\0';
+		}
+
+		Valid = Md5Hex(Password, Salt, false, Result);
+
+#ifdef HAVE_EVP_PBE_SCRYPT
+		*Outdated = true;
+#endif /* HAVE_EVP_PBE_SCRYPT */
+	}
+
+	Expected = (HashSign != NULL) ? HashSign + 1 : Hash;
+	Length = strlen(Result);
+
+	if (!Valid || strlen(Expected) != Length) {
+		free(Salt);
+
+		*Outdated = false;
+
+		return false;
+	}
+
+	// compare the whole hash so the time doesn't depend on where the first difference is
+	for (size_t i = 0; i < Length; i++) {
+		Difference |= Result[i] ^ Expected[i];
+	}
+
+	// some old hashes were created by a broken MD5 implementation
+	if (Difference != 0 && Hash[0] != '$' && Md5Hex(Password, Salt, true, Result) && strcmp(Result, Expected) == 0) {
+		Difference = 0;
+		*Outdated = true;
+	}
+
+	free(Salt);
+
+	if (Difference != 0) {
+		*Outdated = false;
+
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * GenerateSalt
  *
@@ -773,7 +984,8 @@ static void DestroyCommandT(command_t *Command) {
 /**
  * AddCommand
  *
- * Adds a command to a list of commands.
+ * Adds a command to a list of commands. The command is only shown by the
+ * "help" command.
  *
  * @param Commands the list of commands
  * @param Name the name of the command
@@ -782,6 +994,26 @@ static void DestroyCommandT(command_t *Command) {
  * @param HelpText the associated help text (can contain embedded \\n characters
  */
 void AddCommand(commandlist_t *Commands, const char *Name, const char *Category, const char *Description, const char *HelpText) {
+	RegisterCommand(Commands, Name, Category, Description, HelpText, NULL, 0);
+}
+
+/**
+ * RegisterCommand
+ *
+ * Adds a command and its handler to a list of commands. This is only used
+ * for the bouncer's built-in commands (see CCore::GetCommands); modules
+ * can only add help entries using AddCommand().
+ *
+ * @param Commands the list of commands
+ * @param Name the name of the command
+ * @param Category the category of the command (e.g. "Admin" or "User")
+ * @param Description a short description of the command
+ * @param HelpText the associated help text (can contain embedded \\n characters
+ * @param Handler the function which handles the command, or NULL
+ * @param Flags COMMAND_* flags for the command
+ */
+void RegisterCommand(commandlist_t *Commands, const char *Name, const char *Category, const char *Description,
+		const char *HelpText, command_handler_t Handler, int Flags) {
 	command_t *Command;
 
 	if (Commands == NULL) {
@@ -807,6 +1039,8 @@ void AddCommand(commandlist_t *Commands, const char *Name, const char *Category,
 	Command->Category = strdup(Category);
 	Command->Description = strdup(Description);
 	Command->HelpText = HelpText ? strdup(HelpText) : NULL;
+	Command->Handler = Handler;
+	Command->Flags = Flags;
 
 	(*Commands)->Add(Name, Command);
 }
@@ -975,6 +1209,24 @@ int SetPermissions(const char *Filename, int Modes) {
 #endif
 }
 
+/**
+ * UtilMsecTime
+ *
+ * Returns a monotonic timestamp in milliseconds. The value is only
+ * meaningful when compared to other values returned by this function.
+ */
+uint64_t UtilMsecTime(void) {
+#ifndef _WIN32
+	timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	return (uint64_t)Now.tv_sec * 1000 + Now.tv_nsec / 1000000;
+#else /* _WIN32 */
+	return GetTickCount64();
+#endif /* _WIN32 */
+}
+
 /**
  * FreeString
  *
@@ -20,6 +20,23 @@
 #ifndef UTILITY_H
 #define UTILITY_H
 
+class CClientConnection;
+
+/** A handler for a bouncer command. */
+typedef bool (*command_handler_t)(CClientConnection *Client, int argc, const char **argv, bool NoticeUser);
+
+/** the command can only be used by admins */
+#define COMMAND_ADMIN 1
+/** the command is not listed by the "help" command */
+#define COMMAND_HIDDEN 2
+
+/** scrypt parameters for new password hashes (N = 2^LOGN) */
+#define PASSWORD_SCRYPT_LOGN 14
+#define PASSWORD_SCRYPT_R 8
+#define PASSWORD_SCRYPT_P 1
+/** the length of the derived key in bytes */
+#define PASSWORD_KEYLENGTH 32
+
 /**
  * command_t
  *
@@ -29,6 +46,8 @@ typedef struct command_s {
 	char *Category; /**< the command's category */
 	char *Description; /**< a short description of the command */
 	char *HelpText; /**< the command's help text */
+	command_handler_t Handler; /**< the command's handler, or NULL if the entry is only used for the help */
+	int Flags; /**< COMMAND_* flags */
 } command_t;
 
 /** A list of commands. */
@@ -68,11 +87,13 @@ unsigned int ArgCount2(const tokendata_t& Tokens);
 SOCKET SocketAndConnect(const char *Host, unsigned int Port, const char *BindIp = NULL);
 SOCKET SocketAndConnectResolved(const sockaddr *Host, const sockaddr *BindIp, int *error);
 
-SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET);
+SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET, int Backlog = SOMAXCONN, bool ReusePort = false);
 
 char *NickFromHostmask(const char *Hostmask);
 
 const char *UtilMd5(const char *String, const char *Salt, bool BrokenAlgo = false);
+char *UtilHashPassword(const char *Password, const char *Salt);
+bool UtilCheckPassword(const char *Password, const char *Hash, bool *Outdated);
 const char *GenerateSalt(void);
 const char *SaltFromHash(const char *Hash);
 
@@ -83,6 +104,11 @@ SBNCAPI void AddCommand(commandlist_t *Commands, const char *Name, const char *C
 SBNCAPI void DeleteCommand(commandlist_t *Commands, const char *Name);
 SBNCAPI int CmpCommandT(const void *pA, const void *pB);
 
+#ifdef SBNC
+void RegisterCommand(commandlist_t *Commands, const char *Name, const char *Category, const char *Description,
+	const char *HelpText, command_handler_t Handler, int Flags);
+#endif /* SBNC */
+
 #define BNCVERSION SBNC_VERSION
 #define INTERFACEVERSION 25
 
@@ -109,6 +135,8 @@ SBNCAPI const sockaddr *HostEntToSockAddr(hostent *HostEnt);
 
 int SetPermissions(const char *Filename, int Modes);
 
+SBNCAPI uint64_t UtilMsecTime(void);
+
 void FreeString(char *String);
 
 void SSL_CTX_set_passwd_cb(SSL_CTX *Context);